@@ -180,6 +180,8 @@ typedef int mfs_result;
 #define MFS_CANCELLED                        -51
 #define MFS_MEMORY_ALREADY_MAPPED            -52
 #define MFS_AT_END                           -53
+#define MFS_CROSS_DEVICE                     -54
+#define MFS_CHECKSUM_MISMATCH                -55
 
 
 typedef struct
@@ -193,6 +195,186 @@ typedef struct
 } mfs_file_info;
 
 
+/*
+Throttling
+==========
+A throttle is used to limit the rate at which bulk operations perform I/O so they don't starve latency-sensitive work on the same
+device. It's a token bucket which limits both the number of bytes and the number of operations per second. A single throttle can be
+shared between any number of operations and threads, in which case the limit applies to all of them combined.
+
+Operations which support throttling have a pThrottle member in their config.
+*/
+typedef mfs_uint32 mfs_spinlock;
+
+/* I/O priorities for mfs_set_thread_io_priority() and mfs_throttle_config. */
+#define MFS_IO_PRIORITY_DEFAULT     0   /* The normal I/O priority of the thread. */
+#define MFS_IO_PRIORITY_LOW         1   /* Lowest priority of normal I/O. */
+#define MFS_IO_PRIORITY_IDLE        2   /* Only perform I/O when the device is otherwise idle. */
+
+typedef struct
+{
+    mfs_uint64 bytesPerSecond;  /* Set to 0 for no limit. */
+    mfs_uint64 opsPerSecond;    /* Set to 0 for no limit. */
+    mfs_uint64 burstBytes;      /* The maximum number of bytes that can be accumulated while idle. Set to 0 to use one second's worth. */
+    mfs_uint64 burstOps;        /* The maximum number of operations that can be accumulated while idle. Set to 0 to use one second's worth. */
+    int ioPriority;             /* One of MFS_IO_PRIORITY_*. Applied to worker threads of operations using this throttle. */
+} mfs_throttle_config;
+
+typedef struct
+{
+    mfs_throttle_config config;
+    mfs_spinlock lock;
+    double byteTokens;          /* Can go negative, in which case the next caller will need to wait for the debt to be repaid. */
+    double opTokens;
+    mfs_uint64 lastRefillTime;  /* In nanoseconds. */
+} mfs_throttle;
+
+/*
+Initializes a config object for mfs_throttle_init().
+*/
+mfs_throttle_config mfs_throttle_config_init(mfs_uint64 bytesPerSecond, mfs_uint64 opsPerSecond);
+
+/*
+Initializes a throttle. The bucket starts full.
+*/
+mfs_result mfs_throttle_init(const mfs_throttle_config* pConfig, mfs_throttle* pThrottle);
+
+/*
+Uninitializes a throttle. It must not be in use by any operation.
+*/
+void mfs_throttle_uninit(mfs_throttle* pThrottle);
+
+/*
+Consumes the given number of bytes and operations from the throttle, blocking the calling thread if necessary.
+
+Use this to throttle your own I/O with the same throttle object that is being used by minifs. This is thread-safe. A NULL throttle
+is allowed, in which case this is a no-op.
+
+A request larger than the burst size is allowed. Rather than waiting for the tokens to become available first, the throttle goes
+into debt and it's the next request that waits for it to be repaid.
+*/
+mfs_result mfs_throttle_acquire(mfs_throttle* pThrottle, mfs_uint64 bytes, mfs_uint32 ops);
+
+/*
+Sets the I/O priority of the calling thread.
+
+On Linux this uses ioprio_set(). On Windows this uses background processing mode. Returns MFS_NOT_IMPLEMENTED on other platforms.
+*/
+mfs_result mfs_set_thread_io_priority(int priority);
+
+
+/*
+Hashing
+=======
+Streaming hashes for verifying file content.
+
+  * CRC32C uses the SSE 4.2 or ARMv8 CRC32 instructions when available, falling back to a table-driven implementation.
+  * XXH64 is the 64-bit xxHash algorithm.
+  * SHA-256 is the only one suitable for security purposes, but is also by far the slowest.
+
+Digests are stored in big-endian byte order, which is the canonical representation for each algorithm. Use mfs_hash_digest_to_uint64()
+to get the numeric value.
+*/
+#define MFS_HASH_ALGORITHM_NONE     0
+#define MFS_HASH_ALGORITHM_CRC32C   1
+#define MFS_HASH_ALGORITHM_XXH64    2
+#define MFS_HASH_ALGORITHM_SHA256   3
+
+#define MFS_MAX_HASH_DIGEST_SIZE    32
+
+typedef struct
+{
+    mfs_uint8 data[MFS_MAX_HASH_DIGEST_SIZE];
+    mfs_uint32 size;    /* The number of valid bytes in data. */
+} mfs_hash_digest;
+
+typedef struct
+{
+    mfs_uint32 algorithm;
+    union
+    {
+        mfs_uint32 crc32c;
+        struct
+        {
+            mfs_uint64 acc[4];
+            mfs_uint64 totalLen;
+            mfs_uint8 buffer[32];
+            mfs_uint32 bufferLen;
+        } xxh64;
+        struct
+        {
+            mfs_uint32 h[8];
+            mfs_uint64 totalLen;
+            mfs_uint8 buffer[64];
+            mfs_uint32 bufferLen;
+        } sha256;
+    } state;
+} mfs_hasher;
+
+/*
+Initializes a hasher for the given algorithm.
+*/
+mfs_result mfs_hasher_init(mfs_uint32 algorithm, mfs_hasher* pHasher);
+
+/*
+Feeds data into the hasher.
+*/
+void mfs_hasher_update(mfs_hasher* pHasher, const void* pData, size_t dataSize);
+
+/*
+Retrieves the final digest. The hasher must be re-initialized before it can be used again.
+*/
+void mfs_hasher_finalize(mfs_hasher* pHasher, mfs_hash_digest* pDigest);
+
+/*
+Checks whether or not two digests are equal.
+*/
+mfs_bool32 mfs_hash_digest_equal(const mfs_hash_digest* pDigest1, const mfs_hash_digest* pDigest2);
+
+/*
+Retrieves the first 8 bytes of the digest as an integer. For CRC32C and XXH64 this is the full numeric value of the hash.
+*/
+mfs_uint64 mfs_hash_digest_to_uint64(const mfs_hash_digest* pDigest);
+
+
+/* Flags for mfs_hash_file_ex(). */
+#define MFS_HASH_FLAG_TREE  0x00000001  /* Hash the file in chunks on multiple threads. See mfs_hash_file_ex(). */
+
+typedef struct
+{
+    mfs_uint32 algorithm;       /* One of MFS_HASH_ALGORITHM_*. */
+    mfs_uint32 flags;           /* A combination of MFS_HASH_FLAG_* flags. */
+    mfs_uint64 chunkSize;       /* The size of each chunk in tree mode. Rounded up to a multiple of 64KB. Defaults to 4MB. */
+    mfs_uint32 threadCount;     /* The number of threads to use in tree mode. Set to 0 to use the number of CPUs. */
+    mfs_throttle* pThrottle;    /* Optional. */
+} mfs_hash_file_config;
+
+/*
+Initializes a config object for mfs_hash_file_ex() with default settings.
+*/
+mfs_hash_file_config mfs_hash_file_config_init(mfs_uint32 algorithm);
+
+/*
+Hashes the content of a file.
+
+Memory usage is constant regardless of the size of the file. Where possible the file is memory mapped a window at a time, otherwise
+it is streamed through a fixed size buffer.
+
+When MFS_HASH_FLAG_TREE is set, the file is split into chunks of chunkSize bytes which are hashed in parallel. The final digest is the
+hash of the concatenated chunk digests, using the same algorithm. This will not match the digest of the file when hashed normally,
+and it depends on the chunk size, so the chunk size must be kept the same for digests to be comparable. Files that fit in a single
+chunk are hashed normally.
+
+pConfig can be NULL, in which case MFS_HASH_ALGORITHM_XXH64 is used with default settings.
+*/
+mfs_result mfs_hash_file_ex(const char* pFilePath, const mfs_hash_file_config* pConfig, mfs_hash_digest* pDigest);
+
+/*
+Hashes the content of a file using the default settings.
+*/
+mfs_result mfs_hash_file(const char* pFilePath, mfs_uint32 algorithm, mfs_hash_digest* pDigest);
+
+
 /*
 File Reading
 */
@@ -277,9 +459,41 @@ mfs_result mfs_get_current_directory(char* pDirectoryPath, size_t directoryPathS
 
 /*
 Creates a directory.
+
+When recursive is true, any missing parent directories are created as well. It's not an error for the directory to already exist.
 */
 mfs_result mfs_mkdir(const char* pDirectory, mfs_bool32 recursive);
 
+typedef struct
+{
+    mfs_uint32 threadCount;     /* The number of threads to create directories with. Defaults to 1. Set to 0 to use the number of CPUs. */
+    mfs_throttle* pThrottle;    /* Optional. Each directory counts as one operation. */
+    void (* onError)(void* pUserData, const char* pPath, mfs_result result);  /* Optional. Called for every directory that could not be created. */
+    void* pUserData;
+} mfs_mkdir_many_config;
+
+/*
+Initializes a config object for mfs_mkdir_many_ex() with default settings.
+*/
+mfs_mkdir_many_config mfs_mkdir_many_config_init(void);
+
+/*
+Recursively creates a list of directories.
+
+Paths that share a prefix are only created once. Each directory is created after its parent, and when threadCount is greater than 1
+separate subtrees are created in parallel. Existing directories are not an error.
+
+Creation continues past errors, but nothing below a directory that could not be created is attempted. The first error is returned.
+
+pConfig can be NULL, in which case the default config will be used.
+*/
+mfs_result mfs_mkdir_many_ex(const char** ppDirectories, size_t count, const mfs_mkdir_many_config* pConfig);
+
+/*
+Same as mfs_mkdir_many_ex() with the default config.
+*/
+mfs_result mfs_mkdir_many(const char** ppDirectories, size_t count);
+
 /*
 Deletes a directory.
 */
@@ -287,9 +501,113 @@ mfs_result mfs_rmdir(const char* pDirectory, mfs_bool32 recursive);
 
 /*
 Recursively deletes the contents of a directory.
+
+This is the same as mfs_rmdir_content_ex() with the default config.
 */
 mfs_result mfs_rmdir_content(const char* pDirectory);
 
+typedef struct
+{
+    mfs_uint32 threadCount;     /* The number of threads to delete with. Set to 0 to use the number of CPUs. */
+    mfs_throttle* pThrottle;    /* Optional. Each deleted file or directory counts as one operation. */
+    void (* onError)(void* pUserData, const char* pPath, mfs_result result);  /* Optional. Called for every entry that could not be deleted. May be called from multiple threads, but never at the same time. */
+    void* pUserData;
+} mfs_rmdir_content_config;
+
+typedef struct
+{
+    mfs_uint64 fileCount;       /* The number of files deleted, including symbolic links. */
+    mfs_uint64 directoryCount;  /* The number of directories deleted. */
+    mfs_uint64 errorCount;      /* The number of entries that could not be deleted. */
+} mfs_rmdir_content_stats;
+
+/*
+Initializes a config object for mfs_rmdir_content_ex() with default settings.
+*/
+mfs_rmdir_content_config mfs_rmdir_content_config_init(void);
+
+/*
+Recursively deletes the contents of a directory with extra options.
+
+Deletion continues past errors. The first error is returned, and every error is reported to onError if it's set. A directory that
+could not be emptied is not removed, and its parents are not removed either.
+
+Symbolic links are deleted rather than followed. On POSIX platforms with openat() and unlinkat(), entries are deleted relative to
+their directory's file descriptor and subdirectories are deleted in parallel. Elsewhere this runs on the calling thread.
+
+pConfig can be NULL, in which case the default config will be used. pStats can be NULL.
+*/
+mfs_result mfs_rmdir_content_ex(const char* pDirectory, const mfs_rmdir_content_config* pConfig, mfs_rmdir_content_stats* pStats);
+
+
+/*
+Background Deletion
+===================
+mfs_rmdir_async() deletes a directory without blocking the caller. The directory is renamed into a trash directory on the same
+volume, which is atomic, and is then deleted by a background thread owned by an mfs_reaper object.
+
+The trash directory is named ".mfs-trash" and is placed at the root of the volume. If that location is not writable, it's placed in
+the parent of the directory being deleted instead. Anything left in a trash directory, such as after a crash or when the reaper is
+uninitialized before it finishes, is deleted when a reaper is next initialized. The trash directories at the root of each local
+volume are found automatically, but those in fallback locations are only found if their parent is listed in ppRecoveryDirectories.
+
+When threading is not available, mfs_rmdir_async() deletes the directory before returning.
+*/
+#define MFS_REAPER_FLAG_NO_RECOVERY     0x00000001  /* Don't delete leftover trash in mfs_reaper_init(). */
+
+typedef struct
+{
+    mfs_uint32 flags;                       /* A combination of MFS_REAPER_FLAG_* flags. */
+    int ioPriority;                         /* One of MFS_IO_PRIORITY_*. Applied to the background thread. Defaults to MFS_IO_PRIORITY_IDLE. */
+    mfs_throttle* pThrottle;                /* Optional. Each deleted file or directory counts as one operation. */
+    const char** ppRecoveryDirectories;     /* Optional. Extra directories whose ".mfs-trash" subdirectory should be recovered at init time. */
+    size_t recoveryDirectoryCount;
+    void (* onError)(void* pUserData, const char* pPath, mfs_result result);  /* Optional. Called from the background thread. */
+    void* pUserData;
+} mfs_reaper_config;
+
+typedef struct
+{
+    mfs_reaper_config config;
+    void* pInternal;
+} mfs_reaper;
+
+/*
+Initializes a config object for mfs_reaper_init() with default settings.
+*/
+mfs_reaper_config mfs_reaper_config_init(void);
+
+/*
+Initializes a reaper and starts its background thread.
+
+Unless MFS_REAPER_FLAG_NO_RECOVERY is set, leftover trash is queued for deletion before this returns. The deletion itself happens in
+the background.
+
+pConfig can be NULL, in which case the default config will be used. ppRecoveryDirectories is only used by this function.
+*/
+mfs_result mfs_reaper_init(const mfs_reaper_config* pConfig, mfs_reaper* pReaper);
+
+/*
+Stops the background thread.
+
+This waits for the directory that is currently being deleted, but not for any that are queued after it. These stay in the trash
+and will be deleted at the next init. Use mfs_reaper_wait() first to delete everything.
+*/
+void mfs_reaper_uninit(mfs_reaper* pReaper);
+
+/*
+Waits until everything queued on the reaper has been deleted.
+*/
+void mfs_reaper_wait(mfs_reaper* pReaper);
+
+/*
+Moves a directory into the trash and queues it for deletion by the reaper.
+
+As soon as this returns the directory no longer exists at its original path. Symbolic links are not followed. Returns
+MFS_NOT_DIRECTORY if the path does not refer to a directory.
+*/
+mfs_result mfs_rmdir_async(mfs_reaper* pReaper, const char* pDirectory);
+
 
 /*
 Checks if the given path refers to an existing directory.
@@ -307,8 +625,89 @@ Copies a file.
 */
 mfs_result mfs_copy_file(const char* pSrcFilePath, const char* pDstFilePath, mfs_bool32 failIfExists);
 
+
+/* Flags for mfs_copy_file_ex() and mfs_copy_directory(). */
+#define MFS_COPY_FLAG_FAIL_IF_EXISTS    0x00000001  /* Fail with MFS_ALREADY_EXISTS if the destination already exists. */
+#define MFS_COPY_FLAG_PRESERVE_MODE     0x00000002  /* Apply the exact permission bits of the source, ignoring the umask. */
+#define MFS_COPY_FLAG_PRESERVE_TIMES    0x00000004  /* Apply the access and modification times of the source. */
+#define MFS_COPY_FLAG_NO_ZERO_COPY      0x00000008  /* Always copy through a user-space buffer. */
+#define MFS_COPY_FLAG_SYNC              0x00000010  /* Flush the destination file to storage before returning. */
+
+typedef struct
+{
+    mfs_uint32 flags;           /* A combination of MFS_COPY_FLAG_* flags. */
+    mfs_throttle* pThrottle;    /* Optional. Each file counts as one operation, plus the number of bytes copied. */
+    mfs_uint32 hashAlgorithm;               /* Optional. One of MFS_HASH_ALGORITHM_*. The hash is computed over the data as it's copied. */
+    mfs_hash_digest* pHash;                 /* Optional. Receives the hash of the data when hashAlgorithm is set. */
+    const mfs_hash_digest* pExpectedHash;   /* Optional. When set, the copy fails with MFS_CHECKSUM_MISMATCH if the hash does not match. */
+} mfs_copy_file_config;
+
+/*
+Initializes a config object for mfs_copy_file_ex() with default settings.
+*/
+mfs_copy_file_config mfs_copy_file_config_init(void);
+
+/*
+Copies a file with extra options.
+
+When the platform supports it, the data is copied without going through user space. On Linux this will first try cloning the file
+(reflink) and then fall back to copy_file_range() and sendfile(), before finally falling back to a read/write loop.
+
+When hashAlgorithm is set, the hash is computed in the same pass as the copy. If the data would otherwise be copied without going
+through user space, the source is memory mapped and written out from the mapping so that it is only read once. If pExpectedHash is
+set and does not match, the destination is deleted and MFS_CHECKSUM_MISMATCH is returned. The hash is always of the data that was
+read from the source, so a mismatch means the source does not have the expected content.
+
+pConfig can be NULL, in which case the default config will be used.
+*/
+mfs_result mfs_copy_file_ex(const char* pSrcFilePath, const char* pDstFilePath, const mfs_copy_file_config* pConfig);
+
+
+/* Policies for how mfs_copy_directory() treats files that already exist in the destination. */
+#define MFS_COPY_EXISTING_OVERWRITE     0   /* Always replace the destination file. */
+#define MFS_COPY_EXISTING_SKIP          1   /* Leave the destination file as is. */
+#define MFS_COPY_EXISTING_UPDATE        2   /* Only replace the destination file if the source was modified more recently. */
+#define MFS_COPY_EXISTING_FAIL          3   /* Report MFS_ALREADY_EXISTS for the file. */
+
+typedef struct
+{
+    mfs_uint32 flags;           /* A combination of MFS_COPY_FLAG_* flags. MFS_COPY_FLAG_FAIL_IF_EXISTS is ignored. Use existingFiles instead. */
+    mfs_uint32 existingFiles;   /* One of MFS_COPY_EXISTING_*. */
+    mfs_uint32 threadCount;     /* The number of threads to copy files with, including the calling thread. Set to 0 to use one per CPU. */
+    mfs_throttle* pThrottle;    /* Optional. Applies to every file, and its I/O priority applies to every thread doing the copy. */
+    void (* onError)(void* pUserData, const char* pSrcPath, const char* pDstPath, mfs_result result);  /* Optional. Called for each file or directory that failed. Calls are serialized. */
+    void* pUserData;
+} mfs_copy_directory_config;
+
 /*
-Moves a file.
+Initializes a config object for mfs_copy_directory() with default settings.
+*/
+mfs_copy_directory_config mfs_copy_directory_config_init(void);
+
+/*
+Recursively copies a directory.
+
+The directory structure is created on the calling thread while the source is being traversed, and files are copied on a pool of
+worker threads as soon as their parent directory exists. The destination directory will be created if it does not already exist.
+
+A failure to copy a single file does not abort the operation. Instead, each failure is reported via the onError callback and the
+first error is returned once everything else has been copied.
+
+pConfig can be NULL, in which case the default config will be used.
+*/
+mfs_result mfs_copy_directory(const char* pSrcDirectory, const char* pDstDirectory, const mfs_copy_directory_config* pConfig);
+
+/*
+Moves a file or directory.
+
+When failIfExists is true, the move will fail with MFS_ALREADY_EXISTS if the destination exists. Where supported (renameat2() on
+Linux and renamex_np() on Apple platforms) this check is atomic. Otherwise files fall back to link() followed by unlink(), and only
+directories are subject to a race between the check and the rename.
+
+Moving across devices is supported. In this case the source is copied, using zero-copy methods where possible, the destination is
+flushed to storage, and then the source is deleted. Directories are copied in parallel with mfs_copy_directory() in which case any
+existing files in the destination directory are overwritten when failIfExists is false. If the copy fails, the source is left
+untouched but a partial copy may be left in the destination.
 */
 mfs_result mfs_move_file(const char* pSrcFilePath, const char* pDstFilePath, mfs_bool32 failIfExists);
 
@@ -326,10 +725,97 @@ Returns MFS_SUCCESS on success. Otherwise returns an error code.
 mfs_result mfs_get_file_info(const char* pFilePath, mfs_file_info* pFileInfo);
 
 
+/*
+Fields for mfs_get_file_info_ex() and mfs_iterator_init_ex(). The file name is always retrieved by the iterator. The first four
+apply to both mfs_file_info and mfs_file_info_ex, the rest only to mfs_file_info_ex.
+*/
+#define MFS_FILE_INFO_FIELD_TYPE        0x00000001  /* isDirectory or type. */
+#define MFS_FILE_INFO_FIELD_SIZE        0x00000002  /* sizeInBytes. */
+#define MFS_FILE_INFO_FIELD_TIMES       0x00000004  /* lastModifiedTime and lastAccessTime. */
+#define MFS_FILE_INFO_FIELD_READ_ONLY   0x00000008  /* isReadOnly. */
+#define MFS_FILE_INFO_FIELD_CHANGE_TIME 0x00000010  /* changeTime. */
+#define MFS_FILE_INFO_FIELD_BIRTH_TIME  0x00000020  /* birthTime. */
+#define MFS_FILE_INFO_FIELD_INODE       0x00000040  /* inode and device. */
+#define MFS_FILE_INFO_FIELD_LINK_COUNT  0x00000080  /* linkCount. */
+#define MFS_FILE_INFO_FIELD_MODE        0x00000100  /* mode. */
+#define MFS_FILE_INFO_FIELD_OWNER       0x00000200  /* uid and gid. */
+#define MFS_FILE_INFO_FIELD_BLOCKS      0x00000400  /* blockCount. */
+#define MFS_FILE_INFO_FIELD_ALL         0x000007FF
+
+/* Flags that can be combined with the fields passed to mfs_get_file_info_ex(). */
+#define MFS_FILE_INFO_FLAG_NO_FOLLOW    0x80000000  /* Retrieve information about a symbolic link itself rather than what it points to. */
+
+/* File types for mfs_file_info_ex and mfs_directory_entry. */
+#define MFS_FILE_TYPE_UNKNOWN           0
+#define MFS_FILE_TYPE_FILE              1
+#define MFS_FILE_TYPE_DIRECTORY         2
+#define MFS_FILE_TYPE_SYMLINK           3
+#define MFS_FILE_TYPE_OTHER             4   /* Devices, pipes, sockets, etc. */
+
+typedef struct
+{
+    mfs_uint32 fields;              /* The MFS_FILE_INFO_FIELD_* flags that were actually retrieved. Can be a subset of what was requested. */
+    mfs_uint32 type;                /* One of MFS_FILE_TYPE_*. */
+    mfs_uint32 mode;                /* The POSIX mode, including the file type bits. */
+    mfs_uint32 uid;
+    mfs_uint32 gid;
+    mfs_uint64 linkCount;
+    mfs_uint64 inode;               /* The file index on Windows. */
+    mfs_uint64 device;              /* Encoded the same way as st_dev. The volume serial number on Windows. */
+    mfs_uint64 sizeInBytes;
+    mfs_uint64 blockCount;          /* The number of 512-byte blocks allocated to the file. */
+    mfs_int64 lastModifiedTime;     /* Times are in nanoseconds since the Unix epoch. */
+    mfs_int64 lastAccessTime;
+    mfs_int64 changeTime;           /* When the file's metadata was last changed. */
+    mfs_int64 birthTime;            /* When the file was created. Not supported by every file system. */
+    mfs_bool32 isReadOnly;
+} mfs_file_info_ex;
+
+/*
+Retrieves detailed information about a file.
+
+fields is a combination of MFS_FILE_INFO_FIELD_* flags, optionally combined with MFS_FILE_INFO_FLAG_NO_FOLLOW. Only the requested
+fields are retrieved, and pFileInfo->fields is set to those that were actually available, which might not include everything
+that was requested. Anything not in pFileInfo->fields should be ignored.
+
+On Linux this uses statx() which lets the kernel skip work for fields that aren't needed, and falls back to stat() on older kernels.
+Unlike mfs_get_file_info(), isReadOnly is derived from the mode and is set when nobody has write permission. This is a property of
+the file rather than of the calling process, and does not cost an extra system call. On Windows the inode, device and link count
+require the file to be opened, so only request them when needed.
+*/
+mfs_result mfs_get_file_info_ex(const char* pFilePath, mfs_uint32 fields, mfs_file_info_ex* pFileInfo);
+
+/*
+Retrieves information about many files at once.
+
+The lookups are spread over a pool of threads, so on network and FUSE file systems the whole batch takes closer to the time of one
+round trip than the sum of all of them. Paths are grouped by their parent directory, and on POSIX platforms each directory with
+more than a few paths in it is opened once and its files are stat'ed relative to it, so its path only needs to be resolved once.
+
+fields is the same as for mfs_get_file_info_ex(). pInfos must have room for count elements. pResults is optional, and receives the
+result of each lookup. Returns MFS_SUCCESS if every lookup succeeded, otherwise the error of the first path that failed.
+*/
+mfs_result mfs_get_file_info_many(const char** ppPaths, size_t count, mfs_uint32 fields, mfs_file_info_ex* pInfos, mfs_result* pResults);
+
+
 
 /* Iteration */
+
+typedef struct
+{
+    const char* pName;  /* Points to memory owned by the iterator. Only valid until the next call to mfs_iterator_next_batch() or mfs_iterator_next(). */
+    size_t nameLength;  /* Not including the null terminator. */
+    mfs_uint64 inode;   /* 0 if unavailable. */
+    mfs_uint32 type;    /* One of MFS_FILE_TYPE_*. Symbolic links are not followed. */
+} mfs_directory_entry;
+
 typedef struct
 {
+    mfs_uint32 fields;  /* The MFS_FILE_INFO_FIELD_* flags passed to mfs_iterator_init_ex(). */
+    char* pBuffer;      /* Entries are read into this buffer in bulk where supported. Names returned by mfs_iterator_next_batch() point into it. */
+    size_t bufferSize;
+    size_t bufferCursor;
+    size_t bufferEnd;
 #if defined(_WIN32)
     struct
     {
@@ -340,8 +826,9 @@ typedef struct
 #else
     struct
     {
-        /*DIR**/ void* dir;
+        /*DIR**/ void* dir;    /* Null when entries are read with getdents64() on Linux, in which case fd is used instead. */
         char* pPath;
+        int fd;
     } posix;
 #endif
 } mfs_iterator;
@@ -353,6 +840,18 @@ Iterators are used to iterate over each of the files in a directory.
 */
 mfs_result mfs_iterator_init(const char* pDirectoryPath, mfs_iterator* pIterator);
 
+/*
+Initializes an iterator that only retrieves the given fields.
+
+fields is a combination of MFS_FILE_INFO_FIELD_* flags. Fields that are not requested may or may not be set by mfs_iterator_next(),
+depending on whether or not the platform gets them for free. On POSIX platforms, a mask of 0 or MFS_FILE_INFO_FIELD_TYPE means
+entries are read straight from the directory without any extra system calls, except on file systems that don't report the type of
+an entry. Other fields are retrieved relative to the directory's file descriptor.
+
+mfs_iterator_init() is the same as passing MFS_FILE_INFO_FIELD_ALL.
+*/
+mfs_result mfs_iterator_init_ex(const char* pDirectoryPath, mfs_uint32 fields, mfs_iterator* pIterator);
+
 /*
 Uninitializes an iterator.
 */
@@ -365,577 +864,1346 @@ Returns MFS_SUCCESS on success. Returns MFS_AT_END if it's reached the end of it
 */
 mfs_result mfs_iterator_next(mfs_iterator* pIterator, mfs_file_info* pFileInfo);
 
+/*
+Retrieves extra fields for an entry returned by mfs_iterator_next().
+
+This is for when only some entries need more than what was requested in mfs_iterator_init_ex(), such as when filtering by name. The
+entry is identified by pFileInfo->pFileName, and only the fields given are updated. The entry does not need to be the most recent
+one, but the iterator must still be initialized.
+*/
+mfs_result mfs_iterator_get_file_info(mfs_iterator* pIterator, mfs_uint32 fields, mfs_file_info* pFileInfo);
 
 /*
-Paths
-=====
-The path API is basically just a string library where the input strings are just paths. These APIs follow the following convensions:
-  * All APIs generally follow the safe string API:
-    * Return values are error codes.
-    * First parameter is always the destination, second parameter is always the destination capacity and the third parameter is
-      always the source string.
-    * Passing in NULL for the source is an error as this would normally indicate an underlying error.
-    * Unlike the standard safe string APIs, the destination can be NULL in which case the API can be used to measure the output string.
-  * All APIs copy the string, unless they're named as "_in_place".
-  * All APIs that make a copy of the source string will have an optional parameter for receiving the length of the destination string.
+Sets the size of the buffer entries are read into. Defaults to 32KB.
+
+On Linux, entries are read from the directory in bulk with getdents64() which means a larger buffer, such as 1MB, will substantially
+reduce the number of system calls on very large directories or on network file systems. On other platforms this only limits the
+amount of name data returned by each call to mfs_iterator_next_batch().
+
+Returns MFS_INVALID_OPERATION if entries that have been read from the directory are still waiting in the buffer. Changing the size
+invalidates the names returned by the previous call to mfs_iterator_next_batch(). The minimum size is 4KB.
 */
-typedef struct
-{
-    size_t offset;
-    size_t length;
-} mfs_path_segment;
+mfs_result mfs_iterator_set_buffer_size(mfs_iterator* pIterator, size_t bufferSize);
 
 /*
-Checks whether or not two path segments are equal.
+Retrieves up to capacity entries in one go.
+
+This is the fastest way to iterate over a directory. Names are not copied nor truncated. Instead, pName points to memory owned by
+the iterator which remains valid until the next call to mfs_iterator_next_batch(), mfs_iterator_next() or
+mfs_iterator_set_buffer_size(). Only the name and type
+are retrieved. If the type is not reported by the file system it will be retrieved with an extra call to stat, but only if
+MFS_FILE_INFO_FIELD_TYPE was requested in mfs_iterator_init_ex(). Otherwise it will be set to MFS_FILE_TYPE_UNKNOWN.
+
+Unlike mfs_iterator_next(), symbolic links are reported as MFS_FILE_TYPE_SYMLINK rather than what they point to. The "." and ".."
+entries are returned just like with mfs_iterator_next().
+
+Fewer entries than capacity may be returned even when there are more to come. Returns MFS_AT_END, with pCount set to 0, when there
+are no more entries.
 */
-mfs_bool32 mfs_path_segments_equal(const char* s0Path, const mfs_path_segment s0, const char* s1Path, const mfs_path_segment s1);
+mfs_result mfs_iterator_next_batch(mfs_iterator* pIterator, mfs_directory_entry* pEntries, size_t capacity, size_t* pCount);
 
 
+/*
+Globbing
+========
+A glob is a list of patterns compiled once so that it can be matched against many paths. Paths are relative, and either separator
+can be used. Patterns always use forward slashes. The syntax is:
+
+  *             Any number of characters, other than a separator.
+  ?             Any single character, other than a separator.
+  [abc], [a-z]  Any one of the characters in the set. [!...] or [^...] matches any character that isn't in the set.
+  **            When it's an entire segment, any number of segments, including none. "a" followed by a "**" segment matches
+                everything under "a".
+  \             Escapes the next character.
+  !             At the start of a pattern, negates it. Paths that match a negated pattern are excluded again.
+  trailing /    The pattern only matches directories.
+
+When a path matches more than one pattern, the last one wins, which only matters when some patterns are negated.
+
+By default patterns are anchored to the start of the path, so "*.c" only matches files at the top level. Put a "**" segment in front
+of it to match at any depth. With MFS_GLOB_FLAG_GITIGNORE, patterns follow .gitignore rules instead. A pattern without a slash, other than a
+trailing one, matches a name at any depth, a leading slash anchors a pattern, and empty patterns and those starting with "#" are
+ignored. mfs_glob_match() will also match anything under a directory that matches.
+
+Patterns that are a plain path, or a "**" segment followed by either a plain name or "*.ext", are matched with hash lookups, so
+large lists of these are cheap. A pattern can have at most 63 segments.
+*/
+#define MFS_GLOB_FLAG_CASE_INSENSITIVE  0x00000001  /* ASCII only. */
+#define MFS_GLOB_FLAG_GITIGNORE         0x00000002
+
 typedef struct
 {
-    const char* path;
-    mfs_path_segment segment;
-} mfs_path_iterator;
+    mfs_uint32 flags;
+    void* pInternal;
+} mfs_glob_matcher;
 
 /*
-Initializes a path iterator, starting from the first segment.
-*/
-mfs_result mfs_path_first_segment(const char* path, mfs_path_iterator* pIterator);
+Compiles a list of patterns.
 
-/*
-Initializes a path iterator, starting from the end segment.
+The patterns are copied and don't need to remain valid afterwards. Returns MFS_INVALID_ARGS if a pattern has too many segments.
+Uninitialize with mfs_glob_uninit().
 */
-mfs_result mfs_path_last_segment(const char* path, mfs_path_iterator* pIterator);
+mfs_result mfs_glob_compile(const char** ppPatterns, size_t patternCount, mfs_uint32 flags, mfs_glob_matcher* pGlob);
 
 /*
-Moves a path iterator to the next segment.
+Frees the memory used by a compiled glob.
 */
-mfs_result mfs_path_next_segment(mfs_path_iterator* pIterator);
+void mfs_glob_uninit(mfs_glob_matcher* pGlob);
 
 /*
-Moves a path iterator to the previous segment.
+Checks whether or not a relative path matches. isDirectory is needed for patterns with a trailing slash.
 */
-mfs_result mfs_path_prev_segment(mfs_path_iterator* pIterator);
+mfs_bool32 mfs_glob_match(const mfs_glob_matcher* pGlob, const char* pPath, mfs_bool32 isDirectory);
 
 /*
-Determines if a path iterator is at the start.
+Checks whether or not anything under a directory could match, ignoring negated patterns. Use this to avoid reading directories
+that can't contain anything of interest. An empty path is the root.
+
+This can return true even though nothing under the directory will end up matching, but never the other way around.
 */
-mfs_bool32 mfs_path_at_start(mfs_path_iterator iterator);
+mfs_bool32 mfs_glob_may_match_under(const mfs_glob_matcher* pGlob, const char* pDirectoryPath);
+
 
 /*
-Determines whether or not the iterator is at the end.
+Walking
+=======
+mfs_walk() recursively visits every file and directory under a root directory. On POSIX platforms directories are opened relative
+to their parent's file descriptor, and a single path buffer is reused for the whole walk, which means there are no allocations per
+entry and the kernel never needs to resolve a full path.
+
+Only one file descriptor is held for each level of the tree that is currently being read, up to maxOpenDirectories. Beyond that,
+the shallowest directories are closed and reopened by path, at their previous position, when the walk returns to them.
 */
-mfs_bool32 mfs_path_at_end(mfs_path_iterator iterator);
+
+/* Return values for mfs_walk_proc. */
+#define MFS_WALK_CONTINUE           0
+#define MFS_WALK_SKIP               1   /* Don't descend into this directory. Ignored for anything other than a directory in pre-order. */
+#define MFS_WALK_STOP               2   /* Stop the walk. mfs_walk() will return MFS_CANCELLED. */
+
+/* Flags for mfs_walk_config. */
+#define MFS_WALK_FLAG_PRE_ORDER     0x00000001  /* Report directories before their contents. This is the default. */
+#define MFS_WALK_FLAG_POST_ORDER    0x00000002  /* Report directories after their contents. Can be combined with MFS_WALK_FLAG_PRE_ORDER. */
+#define MFS_WALK_FLAG_ORDERED       0x00000004  /* mfs_walk_parallel() only. Report every entry on the calling thread in depth-first order. */
+
+/* Symbolic link policies for mfs_walk_config. */
+#define MFS_WALK_SYMLINKS_NONE      0   /* Never follow links. They are reported as MFS_FILE_TYPE_SYMLINK. */
+#define MFS_WALK_SYMLINKS_ROOT      1   /* Only follow the root if it's a link. */
+#define MFS_WALK_SYMLINKS_ALL       2   /* Follow every link. Directories that loop back to an ancestor are reported as MFS_TOO_MANY_LINKS. Loops are not detected on Windows. */
+
+typedef struct
+{
+    const char* pPath;      /* The full path, starting with the root exactly as it was given. Only valid during the callback. */
+    size_t pathLength;
+    const char* pName;      /* Points into pPath. */
+    size_t nameLength;
+    mfs_uint32 depth;       /* The root is at depth 0. */
+    mfs_uint32 type;        /* One of MFS_FILE_TYPE_*. Links that were followed are reported as the type of their target. */
+    mfs_uint64 inode;       /* 0 if unavailable. */
+    mfs_bool32 isSymlink;   /* Set when the entry is a link that was followed. */
+    mfs_bool32 isPostOrder; /* Set when a directory is being reported after its contents. */
+    mfs_uint32 threadIndex; /* The index of the thread the callback is running on. Always 0 for mfs_walk(). See mfs_walk_parallel(). */
+    void* pInternal;        /* For mfs_walk_get_file_info(). */
+} mfs_walk_entry;
 
 /*
-Checks if two iterators are equal.
+Called for each entry. Return one of MFS_WALK_CONTINUE, MFS_WALK_SKIP or MFS_WALK_STOP.
 */
-mfs_bool32 mfs_path_iterators_equal(const mfs_path_iterator i0, const mfs_path_iterator i1);
+typedef mfs_uint32 (* mfs_walk_proc)(void* pUserData, const mfs_walk_entry* pEntry);
 
+typedef struct
+{
+    mfs_uint32 flags;                   /* A combination of MFS_WALK_FLAG_* flags. */
+    mfs_uint32 symlinks;                /* One of MFS_WALK_SYMLINKS_*. Defaults to MFS_WALK_SYMLINKS_NONE. */
+    mfs_uint32 maxDepth;                /* Entries deeper than this are not reported. Set to 1 for only the contents of the root. 0 means no limit. */
+    mfs_uint32 maxOpenDirectories;      /* The maximum number of directory handles to keep open at once. Defaults to 32. Ignored by mfs_walk_parallel(). */
+    mfs_uint32 threadCount;             /* mfs_walk_parallel() only. Set to 0 to use the number of CPUs. */
+    const mfs_glob_matcher* pInclude;   /* Optional. Only entries that match are reported, and directories are only read if something under them could match. */
+    const mfs_glob_matcher* pExclude;   /* Optional. Entries that match are neither reported nor read. */
+    void (* onError)(void* pUserData, const char* pPath, mfs_result result);   /* Optional. Called for directories that could not be read. */
+} mfs_walk_config;
 
 /*
-Determines whether or not the given path refers to the root segment of a path.
+Initializes a config object for mfs_walk() with default settings.
 */
-mfs_bool32 mfs_path_is_root(const char* path);
-mfs_bool32 mfs_path_is_root_segment(const char* path, const mfs_path_segment segment);
+mfs_walk_config mfs_walk_config_init(void);
 
 /*
-Determines whether or not the given path refers to a Unix style root directory ("/")
+Walks the tree under pRootPath, calling onEntry for each file and directory, including the root itself.
+
+Entries are reported in the order they come from the file system. pConfig can be null, in which case defaults are used. Directories
+that can't be read are reported with onError and skipped. The walk keeps going regardless, and the first such error is returned
+once it's done. Returns MFS_CANCELLED if onEntry returned MFS_WALK_STOP.
+
+pInclude and pExclude are matched against paths relative to the root, and are not applied to the root itself. pInclude is matched
+against each entry on its own, so a pattern that matches a directory does not include its contents, even with
+MFS_GLOB_FLAG_GITIGNORE.
 */
-mfs_bool32 mfs_path_is_unix_style_root(const char* path);
-mfs_bool32 mfs_path_is_unix_style_root_segment(const char* path, const mfs_path_segment segment);
+mfs_result mfs_walk(const char* pRootPath, const mfs_walk_config* pConfig, mfs_walk_proc onEntry, void* pUserData);
 
 /*
-Determines whether or not the given path refers to a Windows style root directory.
-*/
-mfs_bool32 mfs_path_is_win32_style_root(const char* path);
-mfs_bool32 mfs_path_is_win32_style_root_segment(const char* path, const mfs_path_segment segment);
+Retrieves information about an entry from within a mfs_walk_proc callback.
 
+This is done relative to the parent directory's handle where possible, so is cheaper than calling mfs_get_file_info_ex() on the
+full path. Links are only followed if the walk followed them.
+*/
+mfs_result mfs_walk_get_file_info(const mfs_walk_entry* pEntry, mfs_uint32 fields, mfs_file_info_ex* pFileInfo);
 
 /*
-Copies a path.
+The same as mfs_walk(), except directories are read on multiple threads.
 
-This is basically the same as strcpy_s(), except the length of the string is returned in [pDstLenOut].
-*/
-mfs_result mfs_path_copy(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
+Each thread has its own queue of directories. It takes from the back of its own queue, which keeps it working depth first, and when
+that runs out it steals from the front of another thread's queue, which is where the biggest unexplored subtrees tend to be. The
+calling thread is one of the threads.
 
+By default onEntry is called concurrently from every thread as directories are read, so entries come in no particular order, other
+than a directory being reported before its contents in pre-order and after them in post-order. pEntry->threadIndex is between 0
+and the thread count, and can be used to index per-thread data so that callbacks don't need to synchronize. onError is never called
+concurrently. When MFS_WALK_STOP is returned, threads finish the directory they are currently reading before stopping.
 
-/*
-Copies a path and normalizes the slashes to forward slashes.
-*/
-mfs_result mfs_path_to_forward_slashes(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
+With MFS_WALK_FLAG_ORDERED, directories are still read in parallel, but onEntry is only called on the calling thread, in the same
+order as mfs_walk(). This needs to buffer directory listings until they are reported.
 
-/*
-Copies a path and normalizes the slashes to back slashes.
+Each thread only holds one directory handle at a time, so maxOpenDirectories is ignored.
 */
-mfs_result mfs_path_to_back_slashes(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
+mfs_result mfs_walk_parallel(const char* pRootPath, const mfs_walk_config* pConfig, mfs_walk_proc onEntry, void* pUserData);
 
 /*
-Determines whether or not the given path is a decendant of another.
-
-descendantAbsolutePath [in] The absolute path of the descendant.
-parentAbsolutePath     [in] The absolute path of the parent.
+Walks the tree under pRootPath, calling onMatch for each entry whose path relative to the root matches pPattern. The root itself is
+not reported. Directories that can't contain a match are never read, so "src/main.*" only reads "src".
 
-As an example, "C:/My/Folder" is a descendant of "C:/".
-
-If either path contains "." or "..", clean it with mfs_path_clean() before calling this.
+flags is a combination of MFS_GLOB_FLAG_* flags.
 */
-mfs_bool32 mfs_path_is_descendant(const char* descendantAbsolutePath, const char* parentAbsolutePath);
+mfs_result mfs_glob(const char* pRootPath, const char* pPattern, mfs_uint32 flags, mfs_walk_proc onMatch, void* pUserData);
+
 
 /*
-Determines whether or not the given path is a direct child of another.
+Listing
+=======
+mfs_list_directory() reads an entire directory into a single allocation. Names are stored back to back after the entries rather than
+in fixed-size buffers, so a listing takes a fraction of the memory of an array of mfs_file_info objects, and is freed in one go. The
+"." and ".." entries are never included.
+*/
 
-childAbsolutePath [in] The absolute of the child.
-parentAbsolutePath [in] The absolute path of the parent.
+/* Sort orders for mfs_list_directory(). Only one can be used. Ties are broken by name, except for MFS_LIST_SORT_NONE. */
+#define MFS_LIST_SORT_NONE              0x00000000  /* The order they come from the file system. */
+#define MFS_LIST_SORT_NAME              0x00000001  /* Byte-wise. */
+#define MFS_LIST_SORT_NATURAL           0x00000002  /* Case-insensitive (ASCII), with runs of digits compared by value so "file2" comes before "file10". */
+#define MFS_LIST_SORT_SIZE              0x00000003
+#define MFS_LIST_SORT_MODIFIED_TIME     0x00000004
+#define MFS_LIST_SORT_INODE             0x00000005  /* Usually the fastest order for reading the metadata or contents of every file. */
+#define MFS_LIST_SORT_MASK              0x0000000F
 
-As an example, "C:/My/Folder" is NOT a child of "C:/" - it is a descendant. Alternatively, "C:/My" IS a child of "C:/".
+/* Flags for mfs_list_directory(). These can be combined with one of the sort orders. */
+#define MFS_LIST_FLAG_DESCENDING        0x00000010  /* Ignored for MFS_LIST_SORT_NONE. */
+#define MFS_LIST_FLAG_DIRECTORIES_FIRST 0x00000020
+#define MFS_LIST_FLAG_FILE_INFO         0x00000040  /* Retrieve sizeInBytes and lastModifiedTime. Implied when sorting by either. */
 
-If either path contains "." or "..", clean it with mfs_path_clean() before calling this.
-*/
-mfs_bool32 mfs_path_is_child(const char* childAbsolutePath, const char* parentAbsolutePath);
+typedef struct
+{
+    const char* pName;              /* Null terminated. Points into the listing. */
+    size_t nameLength;
+    mfs_uint64 inode;               /* 0 if unavailable. */
+    mfs_uint64 sizeInBytes;         /* Only set with MFS_LIST_FLAG_FILE_INFO. Links report the size of their target. */
+    mfs_int64 lastModifiedTime;     /* Nanoseconds since the Unix epoch. Only set with MFS_LIST_FLAG_FILE_INFO. */
+    mfs_uint32 type;                /* One of MFS_FILE_TYPE_*. Links are reported as MFS_FILE_TYPE_SYMLINK where supported. */
+} mfs_directory_listing_entry;
 
+typedef struct
+{
+    mfs_directory_listing_entry* pEntries;  /* The start of the allocation. The names come after the last entry. */
+    size_t count;
+} mfs_directory_listing;
 
 /*
-Finds the file name portion of the path.
-
-path [in] The path to search.
+Reads every entry in a directory.
 
-Returns a pointer to the beginning of the string containing the file name. If this is non-null, it will always be an offset of "path".
+flags is one of MFS_LIST_SORT_* combined with any MFS_LIST_FLAG_* flags. Entries are read in bulk where supported, and extra system
+calls are only made when MFS_LIST_FLAG_FILE_INFO is needed, or the file system doesn't report the type of each entry. Free the
+listing with mfs_directory_listing_uninit().
+*/
+mfs_result mfs_list_directory(const char* pDirectoryPath, mfs_uint32 flags, mfs_directory_listing* pListing);
 
-A path with a trailing slash will return an empty string.
+/*
+Frees a listing returned by mfs_list_directory().
 */
-const char* mfs_path_file_name(const char* path);
+void mfs_directory_listing_uninit(mfs_directory_listing* pListing);
+
 
 /*
-Finds the file extension of the given file path.
+Tree Snapshots
+==============
+A snapshot records the path, type, size, modification time and inode of everything under a directory. Two snapshots can be compared
+with mfs_tree_diff() to find out what changed between them.
+
+When a previous snapshot is given, directories whose modification time hasn't changed since then are not read again. This works
+because adding, removing or renaming an entry always updates the time of its directory. Instead, their entries are taken from the
+previous snapshot and only stat'ed to pick up changes to their contents. Directories modified within a couple of seconds before the
+previous snapshot was taken are always read again. On file systems with coarse timestamps, they could have changed during that scan
+without their time changing.
+
+Entries are ordered depth first. The entries of each directory are sorted by name, and every directory is followed immediately by
+its contents. Links are recorded as themselves, and are never followed. The root itself is not included.
+*/
+typedef struct
+{
+    const char* pPath;          /* Relative to the root, with forward slashes. Null terminated. Points into the snapshot. */
+    size_t pathLength;
+    mfs_uint64 inode;
+    mfs_uint64 sizeInBytes;     /* 0 for directories. */
+    mfs_int64 lastModifiedTime; /* Nanoseconds since the Unix epoch. */
+    size_t descendantCount;     /* The number of entries under a directory. They come immediately after it. */
+    mfs_uint32 type;            /* One of MFS_FILE_TYPE_*. */
+} mfs_tree_snapshot_entry;
 
-path [in] The path to search.
+typedef struct
+{
+    mfs_tree_snapshot_entry* pEntries;  /* The start of the allocation. The paths come after the last entry. */
+    size_t count;
+    mfs_int64 rootModifiedTime;
+    mfs_int64 scanTime;                 /* The wall clock time the scan started, in nanoseconds since the Unix epoch. */
+    size_t reusedDirectoryCount;        /* The number of directories that were taken from the previous snapshot rather than read. */
+} mfs_tree_snapshot;
 
-Returns a pointer to the beginning of the string containing the path's extension. If the path does not have an extension, an empty
-string will be returned. The return value is always an offset of "path".
+/* Flags for mfs_tree_snapshot_config. */
+#define MFS_TREE_SNAPSHOT_FLAG_REUSE_FILE_INFO  0x00000001  /* Keep the size and time of everything but directories in unchanged directories rather than stat'ing them again. In-place edits to files will go unnoticed. */
 
-A path with a trailing slash will return an empty string.
+typedef struct
+{
+    mfs_uint32 flags;                   /* A combination of MFS_TREE_SNAPSHOT_FLAG_* flags. */
+    const mfs_tree_snapshot* pPrevious; /* Optional. A snapshot of the same root to reuse unchanged directories from. */
+    const mfs_glob_matcher* pExclude;   /* Optional. Entries that match are left out, along with everything under them. */
+    void (* onError)(void* pUserData, const char* pPath, mfs_result result);   /* Optional. Directories that can't be read are recorded without any contents. */
+    void* pUserData;
+} mfs_tree_snapshot_config;
+
+/* Change types for mfs_tree_change. */
+#define MFS_TREE_CHANGE_ADDED       1
+#define MFS_TREE_CHANGE_REMOVED     2
+#define MFS_TREE_CHANGE_MODIFIED    3   /* The size, modification time or inode of something other than a directory changed. */
+#define MFS_TREE_CHANGE_RENAMED     4   /* Something was removed and something with the same inode and type was added. It may also have been modified. */
 
-On a path such as "filename.ext1.ext2" the returned string will be "ext2".
-*/
-const char* mfs_path_extension(const char* path);
+typedef struct
+{
+    mfs_uint32 type;                        /* One of MFS_TREE_CHANGE_*. */
+    const mfs_tree_snapshot_entry* pOld;    /* Null for MFS_TREE_CHANGE_ADDED. */
+    const mfs_tree_snapshot_entry* pNew;    /* Null for MFS_TREE_CHANGE_REMOVED. */
+} mfs_tree_change;
+
+typedef struct
+{
+    mfs_tree_change* pChanges;
+    size_t count;
+} mfs_tree_changes;
 
 /*
-Determines whether or not the given path has an extension.
+Initializes a config object for mfs_tree_snapshot_init() with default settings.
 */
-mfs_bool32 mfs_path_has_extension(const char* path);
-
+mfs_tree_snapshot_config mfs_tree_snapshot_config_init(void);
 
 /*
-Checks whether or not the two paths are equal.
-
-path1 [in] The first path.
-path2 [in] The second path.
+Takes a snapshot of everything under pRootPath.
 
-Returns whether or not the operation is successful.
+pConfig can be NULL, in which case defaults are used. The previous snapshot is only read from, and can be uninitialized as soon as
+this returns. Returns MFS_NOT_DIRECTORY if the root is not a directory.
+*/
+mfs_result mfs_tree_snapshot_init(const char* pRootPath, const mfs_tree_snapshot_config* pConfig, mfs_tree_snapshot* pSnapshot);
 
-This is case-sensitive.
+/*
+Frees a snapshot.
+*/
+void mfs_tree_snapshot_uninit(mfs_tree_snapshot* pSnapshot);
 
-This is more than just a string comparison. Rather, this splits the path and compares each segment. The path "C:/My/Folder" is considered
-equal to to "C:\\My\\Folder".
+/*
+Looks up an entry by its path relative to the root, which must use forward slashes. Returns NULL if it's not in the snapshot.
 */
-mfs_bool32 mfs_path_equal(const char* path1, const char* path2);
+const mfs_tree_snapshot_entry* mfs_tree_snapshot_find(const mfs_tree_snapshot* pSnapshot, const char* pPath);
 
 /*
-Checks if the extension of the given path is equal to the given extension.
+Retrieves the first entry inside a directory, or NULL if it's empty. pDirectory can be NULL for the root. Use it with
+mfs_tree_snapshot_next_sibling() to list a directory:
 
-This is not case sensitive. If you want this to be case sensitive, just do "strcmp(mfs_path_extension(path), extension)".
+    for (pEntry = mfs_tree_snapshot_first_child(pSnapshot, pDirectory); pEntry != NULL; pEntry = mfs_tree_snapshot_next_sibling(pSnapshot, pEntry)) {
+        ...
+    }
 */
-mfs_bool32 mfs_path_extension_equal(const char* path, const char* extension);
+const mfs_tree_snapshot_entry* mfs_tree_snapshot_first_child(const mfs_tree_snapshot* pSnapshot, const mfs_tree_snapshot_entry* pDirectory);
 
+/*
+Retrieves the entry after pEntry in the same directory, or NULL if it's the last one.
+*/
+const mfs_tree_snapshot_entry* mfs_tree_snapshot_next_sibling(const mfs_tree_snapshot* pSnapshot, const mfs_tree_snapshot_entry* pEntry);
 
 /*
-Determines whether or not the given path is relative.
+Works out what changed between two snapshots of the same root.
 
-path [in] The path to check.
+Changes are in the same order as the entries of the snapshots, except renames, which are reported in place of the addition. The
+entries referenced by the changes point into the snapshots, so both must outlive the changes. Renaming a directory is reported as a
+rename of the directory and everything under it. Free the changes with mfs_tree_changes_uninit().
 */
-mfs_bool32 mfs_path_is_relative(const char* path);
+mfs_result mfs_tree_diff(const mfs_tree_snapshot* pOld, const mfs_tree_snapshot* pNew, mfs_tree_changes* pChanges);
 
 /*
-Determines whether or not the given path is absolute.
-
-path [in] The path to check.
+Frees the changes returned by mfs_tree_diff().
 */
-mfs_bool32 mfs_path_is_absolute(const char* path);
+void mfs_tree_changes_uninit(mfs_tree_changes* pChanges);
 
 
 /*
-Retrieves the base path from the given path, not including the trailing slash.
+Tree Indexes
+============
+An index keeps a snapshot in a file between runs so a tree doesn't have to be walked from scratch every time a process starts. On
+open, the saved snapshot is revalidated the same way as passing it as the previous snapshot to mfs_tree_snapshot_init(), so only
+directories that have changed are read. The file is rewritten if anything changed. Lookups are then served from memory using a hash
+table.
+
+Paths in the file are prefix compressed against the previous entry, which usually makes them a small fraction of their full size
+since neighbouring entries share their parent directories. The file is memory mapped where supported and checksummed, and a file
+that is missing, corrupt, from a different version or for a different root is silently replaced with a fresh scan. The file is in
+native byte order, so is not portable between machines of different endianness.
+
+For the cheapest startup, set MFS_TREE_SNAPSHOT_FLAG_REUSE_FILE_INFO in the config, in which case only directories are stat'ed.
+*/
+typedef struct
+{
+    mfs_tree_snapshot snapshot;
+    void* pInternal;
+} mfs_tree_index;
 
-dst            [out] The destination buffer.
-dstSizeInBytes [in]  The size of the buffer pointed to by "pathOut", in bytes.
-src            [in]  The input path.
+/*
+Saves a snapshot to a file, replacing the file atomically where supported. pRootPath is recorded so the file can't be used with the
+wrong directory. It should be the same path the snapshot was taken with.
+*/
+mfs_result mfs_tree_snapshot_save(const mfs_tree_snapshot* pSnapshot, const char* pRootPath, const char* pFilePath);
 
-Returns whether or not the operation is successful.
+/*
+Loads a snapshot saved with mfs_tree_snapshot_save(). Returns MFS_INVALID_FILE if the file is not a valid snapshot for pRootPath, or
+MFS_CHECKSUM_MISMATCH if it has been corrupted.
+*/
+mfs_result mfs_tree_snapshot_load(const char* pFilePath, const char* pRootPath, mfs_tree_snapshot* pSnapshot);
 
-As an example, when "src" is "C:/MyFolder/MyFile", the output will be "C:/MyFolder". Note that there is no trailing slash.
+/*
+Opens an index of pRootPath stored in pIndexFilePath, creating or updating the file as necessary.
 
-If "src" is something like "/MyFolder", the return value will be an empty string.
+pConfig can be NULL, in which case defaults are used. Its pPrevious member is ignored. A failure to write the file is not fatal, and
+is reported through the config's onError callback.
 */
-mfs_result mfs_path_base_path(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
+mfs_result mfs_tree_index_open(const char* pIndexFilePath, const char* pRootPath, const mfs_tree_snapshot_config* pConfig, mfs_tree_index* pIndex);
 
 /*
-Retrieves the file name portion of the given path, without the extension.
+Closes an index.
+*/
+void mfs_tree_index_close(mfs_tree_index* pIndex);
 
-dst            [out] The destination buffer.
-dstSizeInBytes [in]  The size of the buffer pointed to by "pathOut", in bytes.
-src            [in]  The input path.
+/*
+Looks up an entry by its path relative to the root, which must use forward slashes. Returns NULL if it doesn't exist. This is the
+same as mfs_tree_snapshot_find(), but in constant time.
 */
-mfs_result mfs_path_file_name_without_extension(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
+const mfs_tree_snapshot_entry* mfs_tree_index_find(const mfs_tree_index* pIndex, const char* pPath);
 
 
 /*
-Appends two paths together, and copies them to a separate buffer.
+Disk Usage
+==========
+mfs_disk_usage() adds up the size of everything under a directory, the same as du. The tree is walked on multiple threads with
+mfs_walk_parallel(), and each thread keeps its own totals, so the only shared state is the set of files with more than one hard
+link. Each of those files is only counted once, no matter how many times it appears in the tree.
+*/
 
-dst            [out] The destination buffer.
-dstSizeInBytes [in]  The size of the buffer pointed to by "pathOut", in bytes.
-base           [in]  The base directory.
-other          [in]  The relative path to append to "base".
+/* Flags for mfs_disk_usage_config. */
+#define MFS_DISK_USAGE_FLAG_ONE_FILE_SYSTEM 0x00000001  /* Skip directories on a different device to the root, such as mount points. */
 
-Returns whether or not the operation is successful.
+typedef struct
+{
+    mfs_uint64 apparentBytes;   /* The sum of the sizes of everything but directories. */
+    mfs_uint64 allocatedBytes;  /* The space taken up on disk, including directories. Less than apparentBytes for sparse or compressed files. Equal to apparentBytes where unavailable. */
+    mfs_uint64 fileCount;       /* Everything that isn't a directory, including links, which are never followed. */
+    mfs_uint64 directoryCount;  /* Including the root. */
+} mfs_disk_usage_totals;
 
-This assumes both paths are well formed and "other" is a relative path.
+typedef struct
+{
+    mfs_uint32 flags;                   /* A combination of MFS_DISK_USAGE_FLAG_* flags. */
+    mfs_uint32 threadCount;             /* Set to 0 to use the number of CPUs. */
+    const mfs_glob_matcher* pExclude;   /* Optional. Entries that match are not counted, and directories that match are not read. */
+    void (* onError)(void* pUserData, const char* pPath, mfs_result result);   /* Optional. Called for directories that could not be read. */
+    void* pUserData;
+} mfs_disk_usage_config;
 
-"pathOut" and "base" are allowed to be the same pointer, in which case the other path is appended in-place.
+/*
+Initializes a config object for mfs_disk_usage() with default settings.
 */
-mfs_result mfs_path_append(char* dst, size_t dstSizeInBytes, const char* base, const char* other, size_t* pDstLenOut);
+mfs_disk_usage_config mfs_disk_usage_config_init(void);
 
 /*
-Appends a base path and an iterator together, and copyies them to a separate buffer.
+Calculates the disk usage of everything under pRootPath, including the root itself.
 
-dst            [out] The destination buffer.
-dstSizeInBytes [in]  The size of the buffer pointed to by "dst", in bytes.
-base           [in]  The base directory.
-iterator       [in]  The iterator to append.
+pConfig can be NULL, in which case defaults are used. pDepths is optional, and can be used to get a breakdown of the totals by depth.
+pDepths[0] is the root, pDepths[1] is everything directly inside it, and so on. Anything deeper than depthCount-1 is added to the
+last element.
 
-Returns whether or not the operation is successful.
+Directories that can't be read are reported through onError and skipped. Everything else is still counted, and the first error is
+returned at the end, in which case the totals will be less than the true usage.
+*/
+mfs_result mfs_disk_usage(const char* pRootPath, const mfs_disk_usage_config* pConfig, mfs_disk_usage_totals* pTotals, mfs_disk_usage_totals* pDepths, size_t depthCount);
 
-This assumes both paths are well formed and "i" is a valid iterator.
 
-"pathOut" and "base" are allowed to be the same pointer, in which case the other path is appended in-place.
+/*
+Searching
+=========
+mfs_search() looks for a pattern in the contents of every file under a directory, like grep -r. Files are searched on multiple
+threads as mfs_walk_parallel() finds them. Each file is read in large chunks, or memory mapped when it's big enough for that to be
+cheaper.
+
+Before matching, the longest run of plain characters that every match must contain is pulled out of the pattern. The file is
+scanned for that run with memchr(), which is vectorized by every mainstream C library. Only lines that contain it are matched
+against the full pattern, so most of the time goes into reading the files.
+
+Patterns are regular expressions, unless MFS_SEARCH_FLAG_LITERAL is used, and are matched against one line at a time. The
+supported syntax is:
+
+    .               Any character.
+    [abc] [^a-z]    Any character in a set, or not in a set. Escapes like \d can be used inside a set.
+    ^ $             The start and end of a line.
+    * + ?           Zero or more, one or more, or zero or one of the previous item.
+    {n} {n,} {n,m}  Between n and m of the previous item. Neither can be more than 100.
+    a|b             Either a or b.
+    (...)           A group.
+    \d \w \s        A digit, a word character, or white space. \D, \W and \S match anything else.
+    \t \n \r        A tab, new line or carriage return. Any other character after a backslash is matched as is.
+
+Matching is leftmost-longest. It never backtracks, so it takes time proportional to the length of the line multiplied by the size
+of the pattern, whatever the pattern.
 */
-mfs_result mfs_path_append_iterator(char* dst, size_t dstSizeInBytes, const char* base, mfs_path_iterator iterator, size_t* pDstLenOut);
+
+/* Flags for mfs_search_config. */
+#define MFS_SEARCH_FLAG_LITERAL             0x00000001  /* Treat the pattern as plain text rather than a regular expression. */
+#define MFS_SEARCH_FLAG_CASE_INSENSITIVE    0x00000002  /* ASCII only. */
+#define MFS_SEARCH_FLAG_BINARY              0x00000004  /* Search binary files too. By default, files with a null byte in their first 8KB are skipped. */
+
+typedef struct
+{
+    const char* pPath;      /* The full path of the file, starting with the root exactly as it was given. */
+    const char* pLine;      /* Not null terminated, and doesn't include the new line. Only valid during the callback. */
+    size_t lineLength;      /* Limited to maxLineLength. */
+    mfs_uint64 lineNumber;  /* Starts at 1. */
+    size_t column;          /* The byte offset of the match within the line, starting at 1. */
+    size_t matchLength;
+    mfs_uint32 threadIndex; /* The same as mfs_walk_entry.threadIndex. */
+} mfs_search_match;
 
 /*
-Appends an extension to the given base path and copies them to a separate buffer.
+Called for each line with a match. Only the first match on each line is reported. Return MFS_WALK_CONTINUE to keep going,
+MFS_WALK_SKIP to move on to the next file, or MFS_WALK_STOP to stop the search.
+*/
+typedef mfs_uint32 (* mfs_search_proc)(void* pUserData, const mfs_search_match* pMatch);
 
-dst            [out] The destination buffer.
-dstSizeInBytes [in]  The size of the buffer pointed to by "dst", in bytes.
-base           [in]  The base directory.
-extension      [in]  The relative path to append to "base".
+typedef struct
+{
+    mfs_uint32 flags;                   /* A combination of MFS_SEARCH_FLAG_* flags. */
+    mfs_uint32 threadCount;             /* Set to 0 to use the number of CPUs. */
+    size_t maxMatches;                  /* The search stops after this many matches in total. 0 means no limit. */
+    size_t maxMatchesPerFile;           /* The rest of a file is skipped after this many matches in it. 0 means no limit. */
+    size_t maxLineLength;               /* Lines longer than this are cut short when they're reported. 0 means no limit. */
+    const mfs_glob_matcher* pInclude;   /* Optional. The same as mfs_walk_config. */
+    const mfs_glob_matcher* pExclude;   /* Optional. The same as mfs_walk_config. */
+    void (* onError)(void* pUserData, const char* pPath, mfs_result result);   /* Optional. Called for directories and files that could not be read. */
+} mfs_search_config;
 
-Returns whether or not the operation is successful.
+/*
+Initializes a config object for mfs_search() with default settings.
+*/
+mfs_search_config mfs_search_config_init(void);
 
-"pathOut" and "base" are allowed to be the same pointer, in which case the other path is appended in-place.
+/*
+Searches the contents of every file under pRootPath for pPattern. Links are not followed.
+
+pConfig can be NULL, in which case defaults are used. onMatch is called concurrently from every thread, in the same way as
+mfs_walk_parallel(). The matches in each file are reported in order by a single thread, but matches from different files can be
+interleaved. Files and directories that can't be read are reported with onError and skipped, and the first such error is returned
+once the search is done.
+
+Returns MFS_INVALID_ARGS if the pattern is not valid, and MFS_CANCELLED if onMatch returned MFS_WALK_STOP. Reaching maxMatches is
+not an error.
 */
-mfs_result mfs_path_append_extension(char* dst, size_t dstSizeInBytes, const char* base, const char* extension, size_t* pDstLenOut);
+mfs_result mfs_search(const char* pRootPath, const char* pPattern, const mfs_search_config* pConfig, mfs_search_proc onMatch, void* pUserData);
 
 
 /*
-Cleans the path and resolves the ".." and "." segments.
+Trigram Indexes
+===============
+A trigram index answers "which paths contain this text" and "which files contain this text" without walking the tree. For every
+three byte sequence, it records the entries whose path contains it and, optionally, the files whose contents contain it. A query
+looks up each trigram of the text, intersects the lists, and then checks each remaining candidate to rule out false positives.
+Trigrams are case insensitive for ASCII, so the same index serves both kinds of query.
+
+The index lives in a file along with a snapshot of the tree, in the same way as mfs_tree_index_open(). On open, the snapshot is
+revalidated, the previous snapshot is diffed against the new one, and only paths that were added or renamed and files that were
+added or modified get their trigrams extracted again. Everything else is carried over from the old lists. When nothing has changed,
+the file is memory mapped and used as is.
+
+Only regular files no bigger than maxFileSize have their contents indexed, and files with a null byte in their first 8KB are
+treated as binary and left out, the same as mfs_search(). Files are read on multiple threads.
+
+The file is in native byte order and is replaced with a fresh build if it's missing, corrupt or was built with different settings.
+*/
 
-dst            [out] A pointer to the buffer that will receive the path.
-dstSizeInBytes [in]  The size of the buffer pointed to by pathOut, in bytes.
-src            [in]  The path to clean.
+/* Flags for mfs_trigram_index_config. */
+#define MFS_TRIGRAM_INDEX_FLAG_CONTENTS     0x00000001  /* Index the contents of files, not just paths. */
 
-Returns whether or not the operation is successful.
+typedef struct
+{
+    mfs_uint32 flags;                   /* A combination of MFS_TRIGRAM_INDEX_FLAG_* flags. */
+    mfs_uint32 snapshotFlags;           /* A combination of MFS_TREE_SNAPSHOT_FLAG_* flags. */
+    mfs_uint32 threadCount;             /* The number of threads to read files with. Set to 0 to use the number of CPUs. */
+    mfs_uint64 maxFileSize;             /* Files bigger than this don't have their contents indexed. Defaults to 1MB. */
+    const mfs_glob_matcher* pExclude;   /* Optional. Entries that match are left out of the index, along with everything under them. */
+    void (* onError)(void* pUserData, const char* pPath, mfs_result result);   /* Optional. Called for directories and files that could not be read, and if the file could not be written. Calls are serialized. */
+    void* pUserData;
+} mfs_trigram_index_config;
 
-The output path will never be longer than the input path.
+typedef struct
+{
+    mfs_tree_snapshot snapshot;         /* Everything that was indexed. */
+    void* pInternal;
+} mfs_trigram_index;
 
-The output buffer should never overlap with the input path.
+/*
+Called for each entry that matches a query. Return MFS_WALK_CONTINUE to keep going or MFS_WALK_STOP to stop.
+*/
+typedef mfs_uint32 (* mfs_trigram_index_proc)(void* pUserData, const mfs_tree_snapshot_entry* pEntry);
 
-As an example, the path "my/messy/../path" will result in "my/path"
+/*
+Initializes a config object for mfs_trigram_index_open() with default settings.
+*/
+mfs_trigram_index_config mfs_trigram_index_config_init(void);
 
-The path "my/messy/../../../path" (note how there are too many ".." segments) will return "path" (the extra ".." segments will be dropped.)
+/*
+Opens a trigram index of pRootPath stored in pIndexFilePath, creating or updating the file as necessary.
 
-If an error occurs, such as an invalid input path, 0 will be returned.
+pConfig can be NULL, in which case defaults are used, and only paths are indexed. A failure to write the file is not fatal, and is
+reported through the config's onError callback.
 */
-mfs_result mfs_path_clean(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
+mfs_result mfs_trigram_index_open(const char* pIndexFilePath, const char* pRootPath, const mfs_trigram_index_config* pConfig, mfs_trigram_index* pIndex);
 
 /*
-Appends one path to the other and then cleans it.
+Closes a trigram index.
 */
-mfs_result mfs_path_append_and_clean(char* dst, size_t dstSizeInBytes, const char* base, const char* other, size_t* pDstLenOut);
-
+void mfs_trigram_index_close(mfs_trigram_index* pIndex);
 
 /*
-Removes the extension from a path.
+Finds every entry whose path relative to the root contains pText. Paths use forward slashes.
 
-If the path does not have an extension, the source string is copied straight into the destination without any changes and [pDstLenOut]
-receives the length of the string.
+flags can be 0 or MFS_SEARCH_FLAG_CASE_INSENSITIVE. Entries are reported in the same order as the snapshot. Text shorter than three
+bytes can't use the index, so every entry is checked. Returns MFS_CANCELLED if onMatch returned MFS_WALK_STOP.
 */
-mfs_result mfs_path_remove_extension(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
-mfs_result mfs_path_remove_extension_in_place(char* path, size_t* pDstLenOut);
+mfs_result mfs_trigram_index_find_paths(const mfs_trigram_index* pIndex, const char* pText, mfs_uint32 flags, mfs_trigram_index_proc onMatch, void* pUserData);
 
 /*
-Creates a copy of the given string and removes the extension.
+Finds every file whose contents contain pText. The index must have been opened with MFS_TRIGRAM_INDEX_FLAG_CONTENTS, otherwise
+MFS_INVALID_OPERATION is returned.
+
+This works the same as mfs_trigram_index_find_paths(), except candidates are checked by reading them. This means a file that has
+changed since the index was opened is matched against what it contains now, but files that have been created since then won't be
+found. Files that can't be read are skipped.
 */
-mfs_result mfs_path_remove_file_name(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
-mfs_result mfs_path_remove_file_name_in_place(char* path, size_t* pDstLenOut);
+mfs_result mfs_trigram_index_find_contents(const mfs_trigram_index* pIndex, const char* pText, mfs_uint32 flags, mfs_trigram_index_proc onMatch, void* pUserData);
 
 
 /*
-Converts an absolute path to a relative path.
-
-Returns whether or not the operation is successful.
+Paths
+=====
+The path API is basically just a string library where the input strings are just paths. These APIs follow the following convensions:
+  * All APIs generally follow the safe string API:
+    * Return values are error codes.
+    * First parameter is always the destination, second parameter is always the destination capacity and the third parameter is
+      always the source string.
+    * Passing in NULL for the source is an error as this would normally indicate an underlying error.
+    * Unlike the standard safe string APIs, the destination can be NULL in which case the API can be used to measure the output string.
+  * All APIs copy the string, unless they're named as "_in_place".
+  * All APIs that make a copy of the source string will have an optional parameter for receiving the length of the destination string.
 
-This will normalize every slash to forward slashes.
+Scanning for separators, dots and null terminators is done 16 bytes at a time with SSE2 or NEON where available. Define MFS_NO_SIMD to
+always use the scalar code.
 */
-mfs_result mfs_path_to_relative(char* dst, size_t dstSizeInBytes, const char* absolutePathToMakeRelative, const char* absolutePathToMakeRelativeTo, size_t* pDstLenOut);
+typedef struct
+{
+    size_t offset;
+    size_t length;
+} mfs_path_segment;
 
 /*
-Converts a relative path to an absolute path based on a base path.
+Checks whether or not two path segments are equal.
+*/
+mfs_bool32 mfs_path_segments_equal(const char* s0Path, const mfs_path_segment s0, const char* s1Path, const mfs_path_segment s1);
 
-Returns true if the conversion was successful; false if there was an error.
 
-This is equivalent to an append followed by a clean. Slashes will be normalized to forward slashes.
+typedef struct
+{
+    const char* path;
+    mfs_path_segment segment;
+} mfs_path_iterator;
+
+/*
+Initializes a path iterator, starting from the first segment.
 */
-mfs_result mfs_path_to_absolute(char* dst, size_t dstSizeInBytes, const char* relativePathToMakeAbsolute, const char* basePath, size_t* pDstLenOut);
+mfs_result mfs_path_first_segment(const char* path, mfs_path_iterator* pIterator);
 
+/*
+Initializes a path iterator, starting from the end segment.
+*/
+mfs_result mfs_path_last_segment(const char* path, mfs_path_iterator* pIterator);
 
 /*
-Miscellaneous APIs.
+Moves a path iterator to the next segment.
 */
+mfs_result mfs_path_next_segment(mfs_path_iterator* pIterator);
 
 /*
-Frees memory that was previously allocated by a public API, such as mfs_open_and_read_file().
+Moves a path iterator to the previous segment.
 */
-void mfs_free(void* p);
+mfs_result mfs_path_prev_segment(mfs_path_iterator* pIterator);
 
+/*
+Determines if a path iterator is at the start.
+*/
+mfs_bool32 mfs_path_at_start(mfs_path_iterator iterator);
 
-#ifdef __cplusplus
-}
-#endif
-#endif  /* minifs_h */
+/*
+Determines whether or not the iterator is at the end.
+*/
+mfs_bool32 mfs_path_at_end(mfs_path_iterator iterator);
 
+/*
+Checks if two iterators are equal.
+*/
+mfs_bool32 mfs_path_iterators_equal(const mfs_path_iterator i0, const mfs_path_iterator i1);
 
-/************************************************************************************************************************************************************
-*************************************************************************************************************************************************************
 
-IMPLEMENTATION
+/*
+Determines whether or not the given path refers to the root segment of a path.
+*/
+mfs_bool32 mfs_path_is_root(const char* path);
+mfs_bool32 mfs_path_is_root_segment(const char* path, const mfs_path_segment segment);
 
-*************************************************************************************************************************************************************
-************************************************************************************************************************************************************/
-#if defined(MINIFS_IMPLEMENTATION) || defined(MFS_IMPLEMENTATION)
-#ifndef minifs_c
-#define minifs_c
+/*
+Determines whether or not the given path refers to a Unix style root directory ("/")
+*/
+mfs_bool32 mfs_path_is_unix_style_root(const char* path);
+mfs_bool32 mfs_path_is_unix_style_root_segment(const char* path, const mfs_path_segment segment);
 
-#include <stdlib.h>
-#include <string.h>
-#include <assert.h>
-#include <errno.h>
-#include <wchar.h>
+/*
+Determines whether or not the given path refers to a Windows style root directory.
+*/
+mfs_bool32 mfs_path_is_win32_style_root(const char* path);
+mfs_bool32 mfs_path_is_win32_style_root_segment(const char* path, const mfs_path_segment segment);
 
-#ifndef MFS_MALLOC
-#ifdef MFS_WIN32
-#define MFS_MALLOC(sz) HeapAlloc(GetProcessHeap(), 0, (sz))
-#else
-#define MFS_MALLOC(sz) malloc((sz))
-#endif
-#endif
 
-#ifndef MFS_REALLOC
-#ifdef MFS_WIN32
-#define MFS_REALLOC(p, sz) (((sz) > 0) ? ((p) ? HeapReAlloc(GetProcessHeap(), 0, (p), (sz)) : HeapAlloc(GetProcessHeap(), 0, (sz))) : ((VOID*)(size_t)(HeapFree(GetProcessHeap(), 0, (p)) & 0)))
-#else
-#define MFS_REALLOC(p, sz) realloc((p), (sz))
-#endif
-#endif
+/*
+Copies a path.
 
-#ifndef MFS_FREE
-#ifdef MFS_WIN32
-#define MFS_FREE(p) HeapFree(GetProcessHeap(), 0, (p))
-#else
-#define MFS_FREE(p) free((p))
-#endif
-#endif
+This is basically the same as strcpy_s(), except the length of the string is returned in [pDstLenOut].
+*/
+mfs_result mfs_path_copy(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
 
-#ifndef MFS_ZERO_MEMORY
-#ifdef MFS_WIN32
-#define MFS_ZERO_MEMORY(p, sz) ZeroMemory((p), (sz))
-#else
-#define MFS_ZERO_MEMORY(p, sz) memset((p), 0, (sz))
-#endif
-#endif
 
-#ifndef MFS_COPY_MEMORY
-#ifdef MFS_WIN32
-#define MFS_COPY_MEMORY(dst, src, sz) CopyMemory((dst), (src), (sz))
-#else
-#define MFS_COPY_MEMORY(dst, src, sz) memcpy((dst), (src), (sz))
-#endif
-#endif
+/*
+Copies a path and normalizes the slashes to forward slashes.
+*/
+mfs_result mfs_path_to_forward_slashes(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
 
-#ifndef MFS_ASSERT
-#ifdef MFS_WIN32
-#define MFS_ASSERT(condition) assert(condition)
-#else
-#define MFS_ASSERT(condition) assert(condition)
-#endif
-#endif
+/*
+Copies a path and normalizes the slashes to back slashes.
+*/
+mfs_result mfs_path_to_back_slashes(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
 
-#define MFS_ZERO_OBJECT(p) MFS_ZERO_MEMORY((p), sizeof(*(p)))
+/*
+Determines whether or not the given path is a decendant of another.
 
-#if defined(MFS_WIN32)
-#include <windows.h>
+descendantAbsolutePath [in] The absolute path of the descendant.
+parentAbsolutePath     [in] The absolute path of the parent.
 
-mfs_result mfs_result_from_GetLastError(DWORD error)
-{
-    switch (error)
-    {
-        case ERROR_SUCCESS:             return MFS_SUCCESS;
-        case ERROR_PATH_NOT_FOUND:      return MFS_DOES_NOT_EXIST;
-        case ERROR_TOO_MANY_OPEN_FILES: return MFS_TOO_MANY_OPEN_FILES;
-        case ERROR_NOT_ENOUGH_MEMORY:   return MFS_OUT_OF_MEMORY;
-        case ERROR_DISK_FULL:           return MFS_NO_SPACE;
-        case ERROR_HANDLE_EOF:          return MFS_END_OF_FILE;
-        case ERROR_NEGATIVE_SEEK:       return MFS_BAD_SEEK;
-        case ERROR_INVALID_PARAMETER:   return MFS_INVALID_ARGS;
-        case ERROR_ACCESS_DENIED:       return MFS_ACCESS_DENIED;
-        case ERROR_SEM_TIMEOUT:         return MFS_TIMEOUT;
-        case ERROR_FILE_NOT_FOUND:      return MFS_DOES_NOT_EXIST;
-        default: break;
-    }
+As an example, "C:/My/Folder" is a descendant of "C:/".
 
-    return MFS_ERROR;
-}
-#endif
-#if defined(MFS_POSIX)
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <dirent.h>
-#include <unistd.h>
-#include <fcntl.h> /* For open() flags. */
-#include <strings.h>    /* For strcasecmp(). */
-#endif
+If either path contains "." or "..", clean it with mfs_path_clean() before calling this.
+*/
+mfs_bool32 mfs_path_is_descendant(const char* descendantAbsolutePath, const char* parentAbsolutePath);
 
-const char* mfs_result_description(mfs_result result)
-{
-    switch (result)
-    {
-        case MFS_SUCCESS:                       return "No error";
-        case MFS_ERROR:                         return "Unknown error";
-        case MFS_INVALID_ARGS:                  return "Invalid argument";
-        case MFS_INVALID_OPERATION:             return "Invalid operation";
-        case MFS_OUT_OF_MEMORY:                 return "Out of memory";
-        case MFS_OUT_OF_RANGE:                  return "Out of range";
-        case MFS_ACCESS_DENIED:                 return "Permission denied";
-        case MFS_DOES_NOT_EXIST:                return "Resource does not exist";
-        case MFS_ALREADY_EXISTS:                return "Resource already exists";
-        case MFS_TOO_MANY_OPEN_FILES:           return "Too many open files";
-        case MFS_INVALID_FILE:                  return "Invalid file";
-        case MFS_TOO_BIG:                       return "Too large";
-        case MFS_PATH_TOO_LONG:                 return "Path too long";
-        case MFS_NAME_TOO_LONG:                 return "Name too long";
-        case MFS_NOT_DIRECTORY:                 return "Not a directory";
-        case MFS_IS_DIRECTORY:                  return "Is a directory";
-        case MFS_DIRECTORY_NOT_EMPTY:           return "Directory not empty";
-        case MFS_END_OF_FILE:                   return "End of file";
-        case MFS_NO_SPACE:                      return "No space available";
-        case MFS_BUSY:                          return "Device or resource busy";
-        case MFS_IO_ERROR:                      return "Input/output error";
-        case MFS_INTERRUPT:                     return "Interrupted";
-        case MFS_UNAVAILABLE:                   return "Resource unavailable";
-        case MFS_ALREADY_IN_USE:                return "Resource already in use";
-        case MFS_BAD_ADDRESS:                   return "Bad address";
-        case MFS_BAD_SEEK:                      return "Illegal seek";
-        case MFS_BAD_PIPE:                      return "Broken pipe";
-        case MFS_DEADLOCK:                      return "Deadlock";
-        case MFS_TOO_MANY_LINKS:                return "Too many links";
-        case MFS_NOT_IMPLEMENTED:               return "Not implemented";
-        case MFS_NO_MESSAGE:                    return "No message of desired type";
-        case MFS_BAD_MESSAGE:                   return "Invalid message";
-        case MFS_NO_DATA_AVAILABLE:             return "No data available";
-        case MFS_INVALID_DATA:                  return "Invalid data";
-        case MFS_TIMEOUT:                       return "Timeout";
-        case MFS_NO_NETWORK:                    return "Network unavailable";
-        case MFS_NOT_UNIQUE:                    return "Not unique";
-        case MFS_NOT_SOCKET:                    return "Socket operation on non-socket";
-        case MFS_NO_ADDRESS:                    return "Destination address required";
-        case MFS_BAD_PROTOCOL:                  return "Protocol wrong type for socket";
-        case MFS_PROTOCOL_UNAVAILABLE:          return "Protocol not available";
-        case MFS_PROTOCOL_NOT_SUPPORTED:        return "Protocol not supported";
-        case MFS_PROTOCOL_FAMILY_NOT_SUPPORTED: return "Protocol family not supported";
-        case MFS_ADDRESS_FAMILY_NOT_SUPPORTED:  return "Address family not supported";
-        case MFS_SOCKET_NOT_SUPPORTED:          return "Socket type not supported";
-        case MFS_CONNECTION_RESET:              return "Connection reset";
-        case MFS_ALREADY_CONNECTED:             return "Already connected";
-        case MFS_NOT_CONNECTED:                 return "Not connected";
-        case MFS_CONNECTION_REFUSED:            return "Connection refused";
-        case MFS_NO_HOST:                       return "No host";
-        case MFS_IN_PROGRESS:                   return "Operation in progress";
-        case MFS_CANCELLED:                     return "Operation cancelled";
-        case MFS_MEMORY_ALREADY_MAPPED:         return "Memory already mapped";
-        case MFS_AT_END:                        return "Reached end of collection";
-        default:                                return "Unknown error";
-    }
-}
+/*
+Determines whether or not the given path is a direct child of another.
 
-mfs_result mfs_result_from_errno(int e)
-{
-    switch (e)
-    {
-        case 0: return MFS_SUCCESS;
-    #ifdef EPERM
-        case EPERM: return MFS_INVALID_OPERATION;
-    #endif
-    #ifdef ENOENT
-        case ENOENT: return MFS_DOES_NOT_EXIST;
-    #endif
-    #ifdef ESRCH
-        case ESRCH: return MFS_DOES_NOT_EXIST;
-    #endif
-    #ifdef EINTR
-        case EINTR: return MFS_INTERRUPT;
-    #endif
-    #ifdef EIO
-        case EIO: return MFS_IO_ERROR;
-    #endif
-    #ifdef ENXIO
-        case ENXIO: return MFS_DOES_NOT_EXIST;
-    #endif
-    #ifdef E2BIG
-        case E2BIG: return MFS_INVALID_ARGS;
-    #endif
-    #ifdef ENOEXEC
-        case ENOEXEC: return MFS_INVALID_FILE;
-    #endif
-    #ifdef EBADF
-        case EBADF: return MFS_INVALID_FILE;
-    #endif
-    #ifdef ECHILD
-        case ECHILD: return MFS_ERROR;
-    #endif
-    #ifdef EAGAIN
-        case EAGAIN: return MFS_UNAVAILABLE;
-    #endif
-    #ifdef ENOMEM
-        case ENOMEM: return MFS_OUT_OF_MEMORY;
-    #endif
-    #ifdef EACCES
-        case EACCES: return MFS_ACCESS_DENIED;
-    #endif
-    #ifdef EFAULT
-        case EFAULT: return MFS_BAD_ADDRESS;
-    #endif
-    #ifdef ENOTBLK
-        case ENOTBLK: return MFS_ERROR;
-    #endif
-    #ifdef EBUSY
-        case EBUSY: return MFS_BUSY;
-    #endif
-    #ifdef EEXIST
-        case EEXIST: return MFS_ALREADY_EXISTS;
-    #endif
-    #ifdef EXDEV
-        case EXDEV: return MFS_ERROR;
-    #endif
-    #ifdef ENODEV
+childAbsolutePath [in] The absolute of the child.
+parentAbsolutePath [in] The absolute path of the parent.
+
+As an example, "C:/My/Folder" is NOT a child of "C:/" - it is a descendant. Alternatively, "C:/My" IS a child of "C:/".
+
+If either path contains "." or "..", clean it with mfs_path_clean() before calling this.
+*/
+mfs_bool32 mfs_path_is_child(const char* childAbsolutePath, const char* parentAbsolutePath);
+
+
+/*
+Finds the file name portion of the path.
+
+path [in] The path to search.
+
+Returns a pointer to the beginning of the string containing the file name. If this is non-null, it will always be an offset of "path".
+
+A path with a trailing slash will return an empty string.
+*/
+const char* mfs_path_file_name(const char* path);
+
+/*
+Finds the file extension of the given file path.
+
+path [in] The path to search.
+
+Returns a pointer to the beginning of the string containing the path's extension. If the path does not have an extension, an empty
+string will be returned. The return value is always an offset of "path".
+
+A path with a trailing slash will return an empty string.
+
+On a path such as "filename.ext1.ext2" the returned string will be "ext2".
+*/
+const char* mfs_path_extension(const char* path);
+
+/*
+Determines whether or not the given path has an extension.
+*/
+mfs_bool32 mfs_path_has_extension(const char* path);
+
+
+/*
+Checks whether or not the two paths are equal.
+
+path1 [in] The first path.
+path2 [in] The second path.
+
+Returns whether or not the operation is successful.
+
+This is case-sensitive.
+
+This is more than just a string comparison. Rather, this splits the path and compares each segment. The path "C:/My/Folder" is considered
+equal to to "C:\\My\\Folder".
+*/
+mfs_bool32 mfs_path_equal(const char* path1, const char* path2);
+
+/*
+Flags for mfs_path_equal_ex() and mfs_path_hash().
+
+MFS_PATH_FLAG_CASE_INSENSITIVE folds ASCII letters so that "A" and "a" are the same. Other characters are compared as they are.
+
+MFS_PATH_FLAG_CLEAN compares the paths as if they had been passed through mfs_path_clean() first, so "a/./b/../c" is the same as
+"a/c". Like mfs_path_clean(), only a leading forward slash counts as the root when this is set.
+*/
+#define MFS_PATH_FLAG_CASE_INSENSITIVE  0x00000001
+#define MFS_PATH_FLAG_CLEAN             0x00000002
+
+/*
+The same as mfs_path_equal(), but with options. With no flags this is exactly mfs_path_equal().
+*/
+mfs_bool32 mfs_path_equal_ex(const char* path1, const char* path2, mfs_uint32 flags);
+
+/*
+Hashes a path such that any two paths that mfs_path_equal_ex() says are equal with the same flags will have the same hash. The path
+doesn't need to be normalized or cleaned first, and no memory is allocated.
+
+mfs_path_hash_and_length() also outputs the length of the path string, which is useful for storing a copy of the path as the key
+of a hash table entry. Without MFS_PATH_FLAG_CLEAN both are done in the same pass.
+
+This is for in-memory hash tables. The value is the same on every platform, but it's not a cryptographic hash and is not guaranteed
+to stay the same between versions, so don't store it anywhere.
+*/
+mfs_uint64 mfs_path_hash(const char* path, mfs_uint32 flags);
+mfs_uint64 mfs_path_hash_and_length(const char* path, mfs_uint32 flags, size_t* pLength);
+
+/*
+Checks if the extension of the given path is equal to the given extension.
+
+This is not case sensitive. If you want this to be case sensitive, just do "strcmp(mfs_path_extension(path), extension)".
+*/
+mfs_bool32 mfs_path_extension_equal(const char* path, const char* extension);
+
+
+/*
+Determines whether or not the given path is relative.
+
+path [in] The path to check.
+*/
+mfs_bool32 mfs_path_is_relative(const char* path);
+
+/*
+Determines whether or not the given path is absolute.
+
+path [in] The path to check.
+*/
+mfs_bool32 mfs_path_is_absolute(const char* path);
+
+
+/*
+Retrieves the base path from the given path, not including the trailing slash.
+
+dst            [out] The destination buffer.
+dstSizeInBytes [in]  The size of the buffer pointed to by "pathOut", in bytes.
+src            [in]  The input path.
+
+Returns whether or not the operation is successful.
+
+As an example, when "src" is "C:/MyFolder/MyFile", the output will be "C:/MyFolder". Note that there is no trailing slash.
+
+If "src" is something like "/MyFolder", the return value will be an empty string.
+*/
+mfs_result mfs_path_base_path(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
+
+/*
+Retrieves the file name portion of the given path, without the extension.
+
+dst            [out] The destination buffer.
+dstSizeInBytes [in]  The size of the buffer pointed to by "pathOut", in bytes.
+src            [in]  The input path.
+*/
+mfs_result mfs_path_file_name_without_extension(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
+
+
+/*
+Appends two paths together, and copies them to a separate buffer.
+
+dst            [out] The destination buffer.
+dstSizeInBytes [in]  The size of the buffer pointed to by "pathOut", in bytes.
+base           [in]  The base directory.
+other          [in]  The relative path to append to "base".
+
+Returns whether or not the operation is successful.
+
+This assumes both paths are well formed and "other" is a relative path.
+
+"pathOut" and "base" are allowed to be the same pointer, in which case the other path is appended in-place.
+*/
+mfs_result mfs_path_append(char* dst, size_t dstSizeInBytes, const char* base, const char* other, size_t* pDstLenOut);
+
+/*
+Appends a base path and an iterator together, and copyies them to a separate buffer.
+
+dst            [out] The destination buffer.
+dstSizeInBytes [in]  The size of the buffer pointed to by "dst", in bytes.
+base           [in]  The base directory.
+iterator       [in]  The iterator to append.
+
+Returns whether or not the operation is successful.
+
+This assumes both paths are well formed and "i" is a valid iterator.
+
+"pathOut" and "base" are allowed to be the same pointer, in which case the other path is appended in-place.
+*/
+mfs_result mfs_path_append_iterator(char* dst, size_t dstSizeInBytes, const char* base, mfs_path_iterator iterator, size_t* pDstLenOut);
+
+/*
+Appends an extension to the given base path and copies them to a separate buffer.
+
+dst            [out] The destination buffer.
+dstSizeInBytes [in]  The size of the buffer pointed to by "dst", in bytes.
+base           [in]  The base directory.
+extension      [in]  The relative path to append to "base".
+
+Returns whether or not the operation is successful.
+
+"pathOut" and "base" are allowed to be the same pointer, in which case the other path is appended in-place.
+*/
+mfs_result mfs_path_append_extension(char* dst, size_t dstSizeInBytes, const char* base, const char* extension, size_t* pDstLenOut);
+
+
+/*
+Cleans the path and resolves the ".." and "." segments.
+
+dst            [out] A pointer to the buffer that will receive the path.
+dstSizeInBytes [in]  The size of the buffer pointed to by pathOut, in bytes.
+src            [in]  The path to clean.
+
+Returns whether or not the operation is successful.
+
+The output path will never be longer than the input path.
+
+dst can be the same as src, in which case the path is cleaned in place. Otherwise the two should never overlap.
+
+The path is cleaned in a single pass, and the time it takes grows linearly with its length regardless of how many segments it has.
+
+As an example, the path "my/messy/../path" will result in "my/path"
+
+The path "my/messy/../../../path" (note how there are too many ".." segments) will return "path" (the extra ".." segments will be dropped.)
+
+If an error occurs, such as an invalid input path, 0 will be returned.
+*/
+mfs_result mfs_path_clean(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
+
+/*
+Appends one path to the other and then cleans it.
+
+This is the same as cleaning the two paths joined with a separator, but without needing to build the joined path first. The output
+buffer should never overlap with either of the input paths.
+*/
+mfs_result mfs_path_append_and_clean(char* dst, size_t dstSizeInBytes, const char* base, const char* other, size_t* pDstLenOut);
+
+
+/*
+Removes the extension from a path.
+
+If the path does not have an extension, the source string is copied straight into the destination without any changes and [pDstLenOut]
+receives the length of the string.
+*/
+mfs_result mfs_path_remove_extension(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
+mfs_result mfs_path_remove_extension_in_place(char* path, size_t* pDstLenOut);
+
+/*
+Creates a copy of the given string and removes the extension.
+*/
+mfs_result mfs_path_remove_file_name(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut);
+mfs_result mfs_path_remove_file_name_in_place(char* path, size_t* pDstLenOut);
+
+
+/*
+Converts an absolute path to a relative path.
+
+Returns whether or not the operation is successful.
+
+This will normalize every slash to forward slashes.
+*/
+mfs_result mfs_path_to_relative(char* dst, size_t dstSizeInBytes, const char* absolutePathToMakeRelative, const char* absolutePathToMakeRelativeTo, size_t* pDstLenOut);
+
+/*
+Converts a relative path to an absolute path based on a base path.
+
+Returns true if the conversion was successful; false if there was an error.
+
+This is equivalent to an append followed by a clean. Slashes will be normalized to forward slashes.
+*/
+mfs_result mfs_path_to_absolute(char* dst, size_t dstSizeInBytes, const char* relativePathToMakeAbsolute, const char* basePath, size_t* pDstLenOut);
+
+
+/*
+Path Builder
+
+mfs_path_buf is for building up a path in place, one segment at a time, such as when walking a directory tree. Paths that fit in
+MFS_PATH_BUF_INLINE_SIZE bytes, including the null terminator, are stored inside the structure itself so building them doesn't
+allocate any memory. Longer paths are moved to the heap, with the capacity doubling each time it runs out, so pushing a segment is
+amortised O(1). Popping a segment only needs to look at that segment.
+
+pPath is always null terminated and can be passed straight to other APIs, but it should only be modified with the functions below.
+Since it can point into the structure itself, a mfs_path_buf must not be copied or moved while it's in use.
+*/
+#ifndef MFS_PATH_BUF_INLINE_SIZE
+#define MFS_PATH_BUF_INLINE_SIZE    256
+#endif
+
+typedef struct
+{
+    char* pPath;
+    size_t length;
+    size_t capacity;    /* The size of the memory pointed to by pPath, in bytes, including the null terminator. */
+    char pInlineData[MFS_PATH_BUF_INLINE_SIZE];
+} mfs_path_buf;
+
+/*
+Initializes the buffer with a copy of the given path. pPath can be NULL, in which case the path starts out empty.
+
+The buffer is always left in a state where it's safe to uninitialize, even if this fails.
+*/
+mfs_result mfs_path_buf_init(mfs_path_buf* pBuf, const char* pPath);
+void mfs_path_buf_uninit(mfs_path_buf* pBuf);
+
+/*
+Appends a segment to the end of the path, with a separator in between unless the path is empty or already ends with one. This is
+the same as mfs_path_append(), except the segment must not be an absolute path.
+
+Nothing is changed if this fails.
+*/
+mfs_result mfs_path_buf_push_segment(mfs_path_buf* pBuf, const char* pSegment);
+
+/*
+Removes the last segment from the path, along with any separators before and after it. A leading separator is kept so that "/a"
+becomes "/" rather than an empty string.
+
+Returns MFS_AT_END if there are no segments left to remove.
+*/
+mfs_result mfs_path_buf_pop_segment(mfs_path_buf* pBuf);
+
+/*
+Replaces the extension of the file name, or adds one if it doesn't have one. If pExtension is NULL or an empty string the extension
+is removed. The extension should not include the period.
+*/
+mfs_result mfs_path_buf_set_extension(mfs_path_buf* pBuf, const char* pExtension);
+
+/*
+Shortens the path to the given length, such as a length that was recorded before pushing some segments. This never frees memory.
+*/
+mfs_result mfs_path_buf_truncate(mfs_path_buf* pBuf, size_t length);
+
+
+/*
+Miscellaneous APIs.
+*/
+
+/*
+Frees memory that was previously allocated by a public API, such as mfs_open_and_read_file().
+*/
+void mfs_free(void* p);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* minifs_h */
+
+
+/************************************************************************************************************************************************************
+*************************************************************************************************************************************************************
+
+IMPLEMENTATION
+
+*************************************************************************************************************************************************************
+************************************************************************************************************************************************************/
+#if defined(MINIFS_IMPLEMENTATION) || defined(MFS_IMPLEMENTATION)
+#ifndef minifs_c
+#define minifs_c
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <wchar.h>
+
+#ifndef MFS_MALLOC
+#ifdef MFS_WIN32
+#define MFS_MALLOC(sz) HeapAlloc(GetProcessHeap(), 0, (sz))
+#else
+#define MFS_MALLOC(sz) malloc((sz))
+#endif
+#endif
+
+#ifndef MFS_REALLOC
+#ifdef MFS_WIN32
+#define MFS_REALLOC(p, sz) (((sz) > 0) ? ((p) ? HeapReAlloc(GetProcessHeap(), 0, (p), (sz)) : HeapAlloc(GetProcessHeap(), 0, (sz))) : ((VOID*)(size_t)(HeapFree(GetProcessHeap(), 0, (p)) & 0)))
+#else
+#define MFS_REALLOC(p, sz) realloc((p), (sz))
+#endif
+#endif
+
+#ifndef MFS_FREE
+#ifdef MFS_WIN32
+#define MFS_FREE(p) HeapFree(GetProcessHeap(), 0, (p))
+#else
+#define MFS_FREE(p) free((p))
+#endif
+#endif
+
+#ifndef MFS_ZERO_MEMORY
+#ifdef MFS_WIN32
+#define MFS_ZERO_MEMORY(p, sz) ZeroMemory((p), (sz))
+#else
+#define MFS_ZERO_MEMORY(p, sz) memset((p), 0, (sz))
+#endif
+#endif
+
+#ifndef MFS_COPY_MEMORY
+#ifdef MFS_WIN32
+#define MFS_COPY_MEMORY(dst, src, sz) CopyMemory((dst), (src), (sz))
+#else
+#define MFS_COPY_MEMORY(dst, src, sz) memcpy((dst), (src), (sz))
+#endif
+#endif
+
+#ifndef MFS_ASSERT
+#ifdef MFS_WIN32
+#define MFS_ASSERT(condition) assert(condition)
+#else
+#define MFS_ASSERT(condition) assert(condition)
+#endif
+#endif
+
+#define MFS_ZERO_OBJECT(p) MFS_ZERO_MEMORY((p), sizeof(*(p)))
+
+#if defined(MFS_WIN32)
+#include <windows.h>
+
+mfs_result mfs_result_from_GetLastError(DWORD error)
+{
+    switch (error)
+    {
+        case ERROR_SUCCESS:             return MFS_SUCCESS;
+        case ERROR_PATH_NOT_FOUND:      return MFS_DOES_NOT_EXIST;
+        case ERROR_TOO_MANY_OPEN_FILES: return MFS_TOO_MANY_OPEN_FILES;
+        case ERROR_NOT_ENOUGH_MEMORY:   return MFS_OUT_OF_MEMORY;
+        case ERROR_DISK_FULL:           return MFS_NO_SPACE;
+        case ERROR_HANDLE_EOF:          return MFS_END_OF_FILE;
+        case ERROR_NEGATIVE_SEEK:       return MFS_BAD_SEEK;
+        case ERROR_INVALID_PARAMETER:   return MFS_INVALID_ARGS;
+        case ERROR_ACCESS_DENIED:       return MFS_ACCESS_DENIED;
+        case ERROR_SEM_TIMEOUT:         return MFS_TIMEOUT;
+        case ERROR_FILE_NOT_FOUND:      return MFS_DOES_NOT_EXIST;
+        case ERROR_NOT_SAME_DEVICE:     return MFS_CROSS_DEVICE;
+        case ERROR_FILE_EXISTS:         return MFS_ALREADY_EXISTS;
+        case ERROR_ALREADY_EXISTS:      return MFS_ALREADY_EXISTS;
+        default: break;
+    }
+
+    return MFS_ERROR;
+}
+#endif
+#if defined(MFS_POSIX)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h> /* For open() flags. */
+#include <strings.h>    /* For strcasecmp(). */
+#include <sched.h>      /* For sched_yield(). */
+#include <time.h>       /* For clock_gettime() and nanosleep(). */
+#include <sys/mman.h>   /* For mmap(). */
+#endif
+#if defined(MFS_LINUX)
+#include <sys/ioctl.h>      /* For ioctl(FICLONE). */
+#include <sys/sendfile.h>   /* For sendfile(). */
+#include <sys/syscall.h>    /* For SYS_copy_file_range. */
+#include <mntent.h>         /* For getmntent(). */
+#endif
+#if defined(MFS_APPLE)
+#include <copyfile.h>       /* For fcopyfile(). */
+#endif
+#if defined(MFS_APPLE) || defined(MFS_BSD)
+#include <sys/param.h>
+#include <sys/mount.h>      /* For getmntinfo(). */
+#endif
+
+/*
+Linux-specific system calls are invoked with syscall() so we don't need to depend on a particular version of glibc. This is only
+declared by unistd.h when the default feature set is enabled, which will not be the case when compiling with something like -std=c89.
+*/
+#if defined(MFS_LINUX) && (defined(_DEFAULT_SOURCE) || defined(_GNU_SOURCE) || defined(_BSD_SOURCE))
+    #define MFS_HAS_SYSCALL
+#endif
+
+const char* mfs_result_description(mfs_result result)
+{
+    switch (result)
+    {
+        case MFS_SUCCESS:                       return "No error";
+        case MFS_ERROR:                         return "Unknown error";
+        case MFS_INVALID_ARGS:                  return "Invalid argument";
+        case MFS_INVALID_OPERATION:             return "Invalid operation";
+        case MFS_OUT_OF_MEMORY:                 return "Out of memory";
+        case MFS_OUT_OF_RANGE:                  return "Out of range";
+        case MFS_ACCESS_DENIED:                 return "Permission denied";
+        case MFS_DOES_NOT_EXIST:                return "Resource does not exist";
+        case MFS_ALREADY_EXISTS:                return "Resource already exists";
+        case MFS_TOO_MANY_OPEN_FILES:           return "Too many open files";
+        case MFS_INVALID_FILE:                  return "Invalid file";
+        case MFS_TOO_BIG:                       return "Too large";
+        case MFS_PATH_TOO_LONG:                 return "Path too long";
+        case MFS_NAME_TOO_LONG:                 return "Name too long";
+        case MFS_NOT_DIRECTORY:                 return "Not a directory";
+        case MFS_IS_DIRECTORY:                  return "Is a directory";
+        case MFS_DIRECTORY_NOT_EMPTY:           return "Directory not empty";
+        case MFS_END_OF_FILE:                   return "End of file";
+        case MFS_NO_SPACE:                      return "No space available";
+        case MFS_BUSY:                          return "Device or resource busy";
+        case MFS_IO_ERROR:                      return "Input/output error";
+        case MFS_INTERRUPT:                     return "Interrupted";
+        case MFS_UNAVAILABLE:                   return "Resource unavailable";
+        case MFS_ALREADY_IN_USE:                return "Resource already in use";
+        case MFS_BAD_ADDRESS:                   return "Bad address";
+        case MFS_BAD_SEEK:                      return "Illegal seek";
+        case MFS_BAD_PIPE:                      return "Broken pipe";
+        case MFS_DEADLOCK:                      return "Deadlock";
+        case MFS_TOO_MANY_LINKS:                return "Too many links";
+        case MFS_NOT_IMPLEMENTED:               return "Not implemented";
+        case MFS_NO_MESSAGE:                    return "No message of desired type";
+        case MFS_BAD_MESSAGE:                   return "Invalid message";
+        case MFS_NO_DATA_AVAILABLE:             return "No data available";
+        case MFS_INVALID_DATA:                  return "Invalid data";
+        case MFS_TIMEOUT:                       return "Timeout";
+        case MFS_NO_NETWORK:                    return "Network unavailable";
+        case MFS_NOT_UNIQUE:                    return "Not unique";
+        case MFS_NOT_SOCKET:                    return "Socket operation on non-socket";
+        case MFS_NO_ADDRESS:                    return "Destination address required";
+        case MFS_BAD_PROTOCOL:                  return "Protocol wrong type for socket";
+        case MFS_PROTOCOL_UNAVAILABLE:          return "Protocol not available";
+        case MFS_PROTOCOL_NOT_SUPPORTED:        return "Protocol not supported";
+        case MFS_PROTOCOL_FAMILY_NOT_SUPPORTED: return "Protocol family not supported";
+        case MFS_ADDRESS_FAMILY_NOT_SUPPORTED:  return "Address family not supported";
+        case MFS_SOCKET_NOT_SUPPORTED:          return "Socket type not supported";
+        case MFS_CONNECTION_RESET:              return "Connection reset";
+        case MFS_ALREADY_CONNECTED:             return "Already connected";
+        case MFS_NOT_CONNECTED:                 return "Not connected";
+        case MFS_CONNECTION_REFUSED:            return "Connection refused";
+        case MFS_NO_HOST:                       return "No host";
+        case MFS_IN_PROGRESS:                   return "Operation in progress";
+        case MFS_CANCELLED:                     return "Operation cancelled";
+        case MFS_MEMORY_ALREADY_MAPPED:         return "Memory already mapped";
+        case MFS_AT_END:                        return "Reached end of collection";
+        case MFS_CROSS_DEVICE:                  return "Cross-device link";
+        case MFS_CHECKSUM_MISMATCH:             return "Checksum mismatch";
+        default:                                return "Unknown error";
+    }
+}
+
+mfs_result mfs_result_from_errno(int e)
+{
+    switch (e)
+    {
+        case 0: return MFS_SUCCESS;
+    #ifdef EPERM
+        case EPERM: return MFS_INVALID_OPERATION;
+    #endif
+    #ifdef ENOENT
+        case ENOENT: return MFS_DOES_NOT_EXIST;
+    #endif
+    #ifdef ESRCH
+        case ESRCH: return MFS_DOES_NOT_EXIST;
+    #endif
+    #ifdef EINTR
+        case EINTR: return MFS_INTERRUPT;
+    #endif
+    #ifdef EIO
+        case EIO: return MFS_IO_ERROR;
+    #endif
+    #ifdef ENXIO
+        case ENXIO: return MFS_DOES_NOT_EXIST;
+    #endif
+    #ifdef E2BIG
+        case E2BIG: return MFS_INVALID_ARGS;
+    #endif
+    #ifdef ENOEXEC
+        case ENOEXEC: return MFS_INVALID_FILE;
+    #endif
+    #ifdef EBADF
+        case EBADF: return MFS_INVALID_FILE;
+    #endif
+    #ifdef ECHILD
+        case ECHILD: return MFS_ERROR;
+    #endif
+    #ifdef EAGAIN
+        case EAGAIN: return MFS_UNAVAILABLE;
+    #endif
+    #ifdef ENOMEM
+        case ENOMEM: return MFS_OUT_OF_MEMORY;
+    #endif
+    #ifdef EACCES
+        case EACCES: return MFS_ACCESS_DENIED;
+    #endif
+    #ifdef EFAULT
+        case EFAULT: return MFS_BAD_ADDRESS;
+    #endif
+    #ifdef ENOTBLK
+        case ENOTBLK: return MFS_ERROR;
+    #endif
+    #ifdef EBUSY
+        case EBUSY: return MFS_BUSY;
+    #endif
+    #ifdef EEXIST
+        case EEXIST: return MFS_ALREADY_EXISTS;
+    #endif
+    #ifdef EXDEV
+        case EXDEV: return MFS_CROSS_DEVICE;
+    #endif
+    #ifdef ENODEV
         case ENODEV: return MFS_DOES_NOT_EXIST;
     #endif
     #ifdef ENOTDIR
@@ -1190,1543 +2458,13770 @@ mfs_result mfs_result_from_errno(int e)
     #ifdef ENOBUFS
         case ENOBUFS: return MFS_NO_SPACE;
     #endif
-    #ifdef EISCONN
-        case EISCONN: return MFS_ALREADY_CONNECTED;
+    #ifdef EISCONN
+        case EISCONN: return MFS_ALREADY_CONNECTED;
+    #endif
+    #ifdef ENOTCONN
+        case ENOTCONN: return MFS_NOT_CONNECTED;
+    #endif
+    #ifdef ESHUTDOWN
+        case ESHUTDOWN: return MFS_ERROR;
+    #endif
+    #ifdef ETOOMANYREFS
+        case ETOOMANYREFS: return MFS_ERROR;
+    #endif
+    #ifdef ETIMEDOUT
+        case ETIMEDOUT: return MFS_TIMEOUT;
+    #endif
+    #ifdef ECONNREFUSED
+        case ECONNREFUSED: return MFS_CONNECTION_REFUSED;
+    #endif
+    #ifdef EHOSTDOWN
+        case EHOSTDOWN: return MFS_NO_HOST;
+    #endif
+    #ifdef EHOSTUNREACH
+        case EHOSTUNREACH: return MFS_NO_HOST;
+    #endif
+    #ifdef EALREADY
+        case EALREADY: return MFS_IN_PROGRESS;
+    #endif
+    #ifdef EINPROGRESS
+        case EINPROGRESS: return MFS_IN_PROGRESS;
+    #endif
+    #ifdef ESTALE
+        case ESTALE: return MFS_INVALID_FILE;
+    #endif
+    #ifdef EUCLEAN
+        case EUCLEAN: return MFS_ERROR;
+    #endif
+    #ifdef ENOTNAM
+        case ENOTNAM: return MFS_ERROR;
+    #endif
+    #ifdef ENAVAIL
+        case ENAVAIL: return MFS_ERROR;
+    #endif
+    #ifdef EISNAM
+        case EISNAM: return MFS_ERROR;
+    #endif
+    #ifdef EREMOTEIO
+        case EREMOTEIO: return MFS_IO_ERROR;
+    #endif
+    #ifdef EDQUOT
+        case EDQUOT: return MFS_NO_SPACE;
+    #endif
+    #ifdef ENOMEDIUM
+        case ENOMEDIUM: return MFS_DOES_NOT_EXIST;
+    #endif
+    #ifdef EMEDIUMTYPE
+        case EMEDIUMTYPE: return MFS_ERROR;
+    #endif
+    #ifdef ECANCELED
+        case ECANCELED: return MFS_CANCELLED;
+    #endif
+    #ifdef ENOKEY
+        case ENOKEY: return MFS_ERROR;
+    #endif
+    #ifdef EKEYEXPIRED
+        case EKEYEXPIRED: return MFS_ERROR;
+    #endif
+    #ifdef EKEYREVOKED
+        case EKEYREVOKED: return MFS_ERROR;
+    #endif
+    #ifdef EKEYREJECTED
+        case EKEYREJECTED: return MFS_ERROR;
+    #endif
+    #ifdef EOWNERDEAD
+        case EOWNERDEAD: return MFS_ERROR;
+    #endif
+    #ifdef ENOTRECOVERABLE
+        case ENOTRECOVERABLE: return MFS_ERROR;
+    #endif
+    #ifdef ERFKILL
+        case ERFKILL: return MFS_ERROR;
+    #endif
+    #ifdef EHWPOISON
+        case EHWPOISON: return MFS_ERROR;
+    #endif
+        default: return MFS_ERROR;
+    }
+}
+
+
+/*
+Return Values:
+  0:  Success
+  22: EINVAL
+  34: ERANGE
+
+Not using symbolic constants for errors because I want to avoid #including errno.h
+*/
+int mfs_strcpy_s(char* dst, size_t dstSizeInBytes, const char* src)
+{
+    size_t i;
+
+    if (dst == 0) {
+        return 22;
+    }
+    if (dstSizeInBytes == 0) {
+        return 34;
+    }
+    if (src == 0) {
+        dst[0] = '\0';
+        return 22;
+    }
+
+    for (i = 0; i < dstSizeInBytes && src[i] != '\0'; ++i) {
+        dst[i] = src[i];
+    }
+
+    if (i < dstSizeInBytes) {
+        dst[i] = '\0';
+        return 0;
+    }
+
+    dst[0] = '\0';
+    return 34;
+}
+
+int mfs_strncpy_s(char* dst, size_t dstSizeInBytes, const char* src, size_t count)
+{
+    size_t maxcount;
+    size_t i;
+
+    if (dst == 0) {
+        return 22;
+    }
+    if (dstSizeInBytes == 0) {
+        return 34;
+    }
+    if (src == 0) {
+        dst[0] = '\0';
+        return 22;
+    }
+
+    maxcount = count;
+    if (count == ((size_t)-1) || count >= dstSizeInBytes) {        /* -1 = _TRUNCATE */
+        maxcount = dstSizeInBytes - 1;
+    }
+
+    for (i = 0; i < maxcount && src[i] != '\0'; ++i) {
+        dst[i] = src[i];
+    }
+
+    if (src[i] == '\0' || i == count || count == ((size_t)-1)) {
+        dst[i] = '\0';
+        return 0;
+    }
+
+    dst[0] = '\0';
+    return 34;
+}
+
+int mfs_strcat_s(char* dst, size_t dstSizeInBytes, const char* src)
+{
+    char* dstorig;
+
+    if (dst == 0) {
+        return 22;
+    }
+    if (dstSizeInBytes == 0) {
+        return 34;
+    }
+    if (src == 0) {
+        dst[0] = '\0';
+        return 22;
+    }
+
+    dstorig = dst;
+
+    while (dstSizeInBytes > 0 && dst[0] != '\0') {
+        dst += 1;
+        dstSizeInBytes -= 1;
+    }
+
+    if (dstSizeInBytes == 0) {
+        return 22;  /* Unterminated. */
+    }
+
+
+    while (dstSizeInBytes > 0 && src[0] != '\0') {
+        *dst++ = *src++;
+        dstSizeInBytes -= 1;
+    }
+
+    if (dstSizeInBytes > 0) {
+        dst[0] = '\0';
+    } else {
+        dstorig[0] = '\0';
+        return 34;
+    }
+
+    return 0;
+}
+
+mfs_bool32 mfs_string_is_null_or_empty(const char* str)
+{
+    return str == NULL || str[0] == '\0';
+}
+
+
+
+/*
+Threading
+
+This is only used internally for operations that benefit from doing work on multiple threads, such as copying a directory. Define
+MFS_NO_THREADING to disable threading entirely, in which case all work will be done on the calling thread. On POSIX platforms you
+will need to link with -lpthread unless threading is disabled.
+*/
+#if !defined(MFS_NO_THREADING)
+    #if defined(MFS_WIN32)
+        typedef HANDLE             mfs_thread;
+        typedef CRITICAL_SECTION   mfs_mutex;
+        typedef CONDITION_VARIABLE mfs_cond;
+        typedef DWORD              mfs_thread_result;
+        #define MFS_THREADCALL     WINAPI
+    #elif defined(MFS_POSIX)
+        #include <pthread.h>
+        typedef pthread_t          mfs_thread;
+        typedef pthread_mutex_t    mfs_mutex;
+        typedef pthread_cond_t     mfs_cond;
+        typedef void*              mfs_thread_result;
+        #define MFS_THREADCALL
+    #else
+        #define MFS_NO_THREADING
     #endif
-    #ifdef ENOTCONN
-        case ENOTCONN: return MFS_NOT_CONNECTED;
+#endif
+
+#if defined(MFS_NO_THREADING)
+    typedef int                    mfs_thread;
+    typedef int                    mfs_mutex;
+    typedef int                    mfs_cond;
+    typedef void*                  mfs_thread_result;
+    #define MFS_THREADCALL
+#endif
+
+typedef mfs_thread_result (MFS_THREADCALL * mfs_thread_proc)(void* pData);
+
+static mfs_result mfs_thread_create(mfs_thread* pThread, mfs_thread_proc proc, void* pData)
+{
+#if defined(MFS_NO_THREADING)
+    (void)pThread;
+    (void)proc;
+    (void)pData;
+    return MFS_NOT_IMPLEMENTED;
+#elif defined(MFS_WIN32)
+    *pThread = CreateThread(NULL, 0, proc, pData, 0, NULL);
+    if (*pThread == NULL) {
+        return mfs_result_from_GetLastError(GetLastError());
+    }
+
+    return MFS_SUCCESS;
+#else
+    int result = pthread_create(pThread, NULL, proc, pData);
+    if (result != 0) {
+        return mfs_result_from_errno(result);
+    }
+
+    return MFS_SUCCESS;
+#endif
+}
+
+static void mfs_thread_join(mfs_thread thread)
+{
+#if defined(MFS_NO_THREADING)
+    (void)thread;
+#elif defined(MFS_WIN32)
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+static void mfs_mutex_init(mfs_mutex* pMutex)
+{
+#if defined(MFS_NO_THREADING)
+    *pMutex = 0;
+#elif defined(MFS_WIN32)
+    InitializeCriticalSection(pMutex);
+#else
+    pthread_mutex_init(pMutex, NULL);
+#endif
+}
+
+static void mfs_mutex_uninit(mfs_mutex* pMutex)
+{
+#if defined(MFS_NO_THREADING)
+    (void)pMutex;
+#elif defined(MFS_WIN32)
+    DeleteCriticalSection(pMutex);
+#else
+    pthread_mutex_destroy(pMutex);
+#endif
+}
+
+static void mfs_mutex_lock(mfs_mutex* pMutex)
+{
+#if defined(MFS_NO_THREADING)
+    (void)pMutex;
+#elif defined(MFS_WIN32)
+    EnterCriticalSection(pMutex);
+#else
+    pthread_mutex_lock(pMutex);
+#endif
+}
+
+static void mfs_mutex_unlock(mfs_mutex* pMutex)
+{
+#if defined(MFS_NO_THREADING)
+    (void)pMutex;
+#elif defined(MFS_WIN32)
+    LeaveCriticalSection(pMutex);
+#else
+    pthread_mutex_unlock(pMutex);
+#endif
+}
+
+static void mfs_cond_init(mfs_cond* pCond)
+{
+#if defined(MFS_NO_THREADING)
+    *pCond = 0;
+#elif defined(MFS_WIN32)
+    InitializeConditionVariable(pCond);
+#else
+    pthread_cond_init(pCond, NULL);
+#endif
+}
+
+static void mfs_cond_uninit(mfs_cond* pCond)
+{
+#if defined(MFS_NO_THREADING)
+    (void)pCond;
+#elif defined(MFS_WIN32)
+    (void)pCond;    /* Win32 condition variables do not need to be destroyed. */
+#else
+    pthread_cond_destroy(pCond);
+#endif
+}
+
+static void mfs_cond_wait(mfs_cond* pCond, mfs_mutex* pMutex)
+{
+#if defined(MFS_NO_THREADING)
+    (void)pCond;
+    (void)pMutex;
+    MFS_ASSERT(!"mfs_cond_wait() called without threading support.");
+#elif defined(MFS_WIN32)
+    SleepConditionVariableCS(pCond, pMutex, INFINITE);
+#else
+    pthread_cond_wait(pCond, pMutex);
+#endif
+}
+
+static void mfs_cond_signal(mfs_cond* pCond)
+{
+#if defined(MFS_NO_THREADING)
+    (void)pCond;
+#elif defined(MFS_WIN32)
+    WakeConditionVariable(pCond);
+#else
+    pthread_cond_signal(pCond);
+#endif
+}
+
+static void mfs_cond_broadcast(mfs_cond* pCond)
+{
+#if defined(MFS_NO_THREADING)
+    (void)pCond;
+#elif defined(MFS_WIN32)
+    WakeAllConditionVariable(pCond);
+#else
+    pthread_cond_broadcast(pCond);
+#endif
+}
+
+static mfs_uint32 mfs_get_cpu_count(void)
+{
+#if defined(MFS_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0) ? (mfs_uint32)info.dwNumberOfProcessors : 1;
+#elif defined(MFS_POSIX) && defined(_SC_NPROCESSORS_ONLN)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (mfs_uint32)count : 1;
+#else
+    return 1;
+#endif
+}
+
+
+static void mfs_spinlock_lock(volatile mfs_spinlock* pSpinlock)
+{
+    for (;;) {
+    #if defined(_MSC_VER)
+        if (InterlockedExchange((volatile LONG*)pSpinlock, 1) == 0) {
+            break;
+        }
+    #else
+        if (__sync_lock_test_and_set(pSpinlock, 1) == 0) {
+            break;
+        }
+    #endif
+
+        while (*pSpinlock == 1) {
+        #if defined(MFS_WIN32)
+            SwitchToThread();
+        #elif defined(MFS_POSIX)
+            sched_yield();
+        #endif
+        }
+    }
+}
+
+static void mfs_spinlock_unlock(volatile mfs_spinlock* pSpinlock)
+{
+#if defined(_MSC_VER)
+    InterlockedExchange((volatile LONG*)pSpinlock, 0);
+#else
+    __sync_lock_release(pSpinlock);
+#endif
+}
+
+static mfs_uint64 mfs_get_time_ns(void)
+{
+#if defined(MFS_WIN32)
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+
+    return (mfs_uint64)((double)counter.QuadPart * 1000000000.0 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((mfs_uint64)ts.tv_sec * 1000000000) + (mfs_uint64)ts.tv_nsec;
+#endif
+}
+
+static void mfs_sleep_ns(mfs_uint64 nanoseconds)
+{
+#if defined(MFS_WIN32)
+    Sleep((DWORD)((nanoseconds + 999999) / 1000000));
+#else
+    struct timespec ts;
+    ts.tv_sec  = (time_t)(nanoseconds / 1000000000);
+    ts.tv_nsec = (long)(nanoseconds % 1000000000);
+
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+        /* Interrupted. Keep sleeping for the remaining time. */
+    }
+#endif
+}
+
+
+#if defined(MFS_HAS_SYSCALL) && defined(SYS_ioprio_set)
+    #define MFS_IOPRIO_WHO_PROCESS      1   /* With a "who" of 0 this refers to the calling thread. */
+    #define MFS_IOPRIO_CLASS_SHIFT      13
+    #define MFS_IOPRIO_CLASS_NONE       0
+    #define MFS_IOPRIO_CLASS_BE         2
+    #define MFS_IOPRIO_CLASS_IDLE       3
+#endif
+
+mfs_result mfs_set_thread_io_priority(int priority)
+{
+#if defined(MFS_HAS_SYSCALL) && defined(SYS_ioprio_set)
+    int ioprio;
+
+    switch (priority)
+    {
+        case MFS_IO_PRIORITY_DEFAULT: ioprio = (MFS_IOPRIO_CLASS_NONE << MFS_IOPRIO_CLASS_SHIFT);     break;
+        case MFS_IO_PRIORITY_LOW:     ioprio = (MFS_IOPRIO_CLASS_BE   << MFS_IOPRIO_CLASS_SHIFT) | 7; break;
+        case MFS_IO_PRIORITY_IDLE:    ioprio = (MFS_IOPRIO_CLASS_IDLE << MFS_IOPRIO_CLASS_SHIFT);     break;
+        default: return MFS_INVALID_ARGS;
+    }
+
+    if (syscall(SYS_ioprio_set, MFS_IOPRIO_WHO_PROCESS, 0, ioprio) != 0) {
+        return mfs_result_from_errno(errno);
+    }
+
+    return MFS_SUCCESS;
+#elif defined(MFS_WIN32_DESKTOP)
+    /* Background mode lowers both the CPU and I/O priority. Windows does not distinguish between low and idle I/O in this mode. */
+    if (priority < MFS_IO_PRIORITY_DEFAULT || priority > MFS_IO_PRIORITY_IDLE) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (!SetThreadPriority(GetCurrentThread(), (priority == MFS_IO_PRIORITY_DEFAULT) ? THREAD_MODE_BACKGROUND_END : THREAD_MODE_BACKGROUND_BEGIN)) {
+        return mfs_result_from_GetLastError(GetLastError());
+    }
+
+    return MFS_SUCCESS;
+#else
+    (void)priority;
+    return MFS_NOT_IMPLEMENTED;
+#endif
+}
+
+
+mfs_throttle_config mfs_throttle_config_init(mfs_uint64 bytesPerSecond, mfs_uint64 opsPerSecond)
+{
+    mfs_throttle_config config;
+
+    MFS_ZERO_OBJECT(&config);
+    config.bytesPerSecond = bytesPerSecond;
+    config.opsPerSecond   = opsPerSecond;
+    config.ioPriority     = MFS_IO_PRIORITY_DEFAULT;
+
+    return config;
+}
+
+mfs_result mfs_throttle_init(const mfs_throttle_config* pConfig, mfs_throttle* pThrottle)
+{
+    if (pThrottle == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(pThrottle);
+
+    if (pConfig == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    pThrottle->config = *pConfig;
+
+    if (pThrottle->config.burstBytes == 0) {
+        pThrottle->config.burstBytes = pThrottle->config.bytesPerSecond;
+    }
+    if (pThrottle->config.burstOps == 0) {
+        pThrottle->config.burstOps = pThrottle->config.opsPerSecond;
+    }
+
+    pThrottle->byteTokens     = (double)pThrottle->config.burstBytes;
+    pThrottle->opTokens       = (double)pThrottle->config.burstOps;
+    pThrottle->lastRefillTime = mfs_get_time_ns();
+
+    return MFS_SUCCESS;
+}
+
+void mfs_throttle_uninit(mfs_throttle* pThrottle)
+{
+    if (pThrottle == NULL) {
+        return;
+    }
+
+    /* Nothing to do. This is just here for consistency and future proofing. */
+}
+
+mfs_result mfs_throttle_acquire(mfs_throttle* pThrottle, mfs_uint64 bytes, mfs_uint32 ops)
+{
+    mfs_uint64 now;
+    double elapsed;
+    double waitTime = 0;
+
+    if (pThrottle == NULL) {
+        return MFS_SUCCESS;
+    }
+
+    mfs_spinlock_lock(&pThrottle->lock);
+    {
+        now     = mfs_get_time_ns();
+        elapsed = (now > pThrottle->lastRefillTime) ? (double)(now - pThrottle->lastRefillTime) / 1000000000.0 : 0;
+        pThrottle->lastRefillTime = now;
+
+        if (pThrottle->config.bytesPerSecond > 0) {
+            pThrottle->byteTokens += elapsed * (double)pThrottle->config.bytesPerSecond;
+            if (pThrottle->byteTokens > (double)pThrottle->config.burstBytes) {
+                pThrottle->byteTokens = (double)pThrottle->config.burstBytes;
+            }
+
+            /* If we're already in debt we need to wait for it to be repaid before this request can go through. */
+            if (pThrottle->byteTokens < 0) {
+                waitTime = -pThrottle->byteTokens / (double)pThrottle->config.bytesPerSecond;
+            }
+
+            pThrottle->byteTokens -= (double)bytes;
+        }
+
+        if (pThrottle->config.opsPerSecond > 0) {
+            pThrottle->opTokens += elapsed * (double)pThrottle->config.opsPerSecond;
+            if (pThrottle->opTokens > (double)pThrottle->config.burstOps) {
+                pThrottle->opTokens = (double)pThrottle->config.burstOps;
+            }
+
+            if (pThrottle->opTokens < 0) {
+                double opWaitTime = -pThrottle->opTokens / (double)pThrottle->config.opsPerSecond;
+                if (waitTime < opWaitTime) {
+                    waitTime = opWaitTime;
+                }
+            }
+
+            pThrottle->opTokens -= (double)ops;
+        }
+    }
+    mfs_spinlock_unlock(&pThrottle->lock);
+
+    if (waitTime > 0) {
+        mfs_sleep_ns((mfs_uint64)(waitTime * 1000000000.0));
+    }
+
+    return MFS_SUCCESS;
+}
+
+
+/*
+Hashing
+*/
+#define MFS_UINT64_CONST(hi, lo)    (((mfs_uint64)(hi) << 32) | (mfs_uint64)(lo))
+
+#define MFS_HASH_TO_END             (~(mfs_uint64)0)    /* For hashing a file from an offset until the end of the file. */
+#define MFS_HASH_BUFFER_SIZE        262144              /* The size of the buffer when streaming a file through a hasher. */
+#define MFS_HASH_WINDOW_SIZE        16777216            /* The size of each memory mapped window when hashing a file. Must be a multiple of 64KB. */
+
+#if !defined(MFS_NO_SIMD)
+    #if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        #define MFS_SUPPORT_SSE42_CRC32C
+    #elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        #define MFS_SUPPORT_SSE42_CRC32C
+        #include <intrin.h>
+        #include <nmmintrin.h>
+    #elif defined(__ARM_FEATURE_CRC32)
+        #define MFS_SUPPORT_ARM_CRC32C
+        #include <arm_acle.h>
     #endif
-    #ifdef ESHUTDOWN
-        case ESHUTDOWN: return MFS_ERROR;
+#endif
+
+static mfs_uint32 mfs_crc32c_table[8][256];
+static mfs_bool32 mfs_crc32c_table_initialized = MFS_FALSE;
+
+static void mfs_crc32c_init_table(void)
+{
+    mfs_uint32 i;
+    mfs_uint32 j;
+
+    /*
+    Multiple threads may initialize the table at the same time. This is benign because they will all write the same values, and the
+    flag is only set once the table is complete.
+    */
+    if (mfs_crc32c_table_initialized) {
+        return;
+    }
+
+    for (i = 0; i < 256; i += 1) {
+        mfs_uint32 crc = i;
+        for (j = 0; j < 8; j += 1) {
+            crc = (crc & 1) ? ((crc >> 1) ^ 0x82F63B78) : (crc >> 1);
+        }
+        mfs_crc32c_table[0][i] = crc;
+    }
+
+    for (i = 0; i < 256; i += 1) {
+        for (j = 1; j < 8; j += 1) {
+            mfs_crc32c_table[j][i] = (mfs_crc32c_table[j-1][i] >> 8) ^ mfs_crc32c_table[0][mfs_crc32c_table[j-1][i] & 0xFF];
+        }
+    }
+
+    mfs_crc32c_table_initialized = MFS_TRUE;
+}
+
+static mfs_uint32 mfs_crc32c_update__scalar(mfs_uint32 crc, const mfs_uint8* pData, size_t dataSize)
+{
+    /* Slicing-by-8. */
+    while (dataSize >= 8) {
+        mfs_uint32 lo = crc ^ ((mfs_uint32)pData[0] | ((mfs_uint32)pData[1] << 8) | ((mfs_uint32)pData[2] << 16) | ((mfs_uint32)pData[3] << 24));
+        mfs_uint32 hi =        ((mfs_uint32)pData[4] | ((mfs_uint32)pData[5] << 8) | ((mfs_uint32)pData[6] << 16) | ((mfs_uint32)pData[7] << 24));
+
+        crc = mfs_crc32c_table[7][(lo      ) & 0xFF] ^
+              mfs_crc32c_table[6][(lo >>  8) & 0xFF] ^
+              mfs_crc32c_table[5][(lo >> 16) & 0xFF] ^
+              mfs_crc32c_table[4][(lo >> 24)       ] ^
+              mfs_crc32c_table[3][(hi      ) & 0xFF] ^
+              mfs_crc32c_table[2][(hi >>  8) & 0xFF] ^
+              mfs_crc32c_table[1][(hi >> 16) & 0xFF] ^
+              mfs_crc32c_table[0][(hi >> 24)       ];
+
+        pData    += 8;
+        dataSize -= 8;
+    }
+
+    while (dataSize > 0) {
+        crc = (crc >> 8) ^ mfs_crc32c_table[0][(crc ^ *pData) & 0xFF];
+        pData    += 1;
+        dataSize -= 1;
+    }
+
+    return crc;
+}
+
+#if defined(MFS_SUPPORT_SSE42_CRC32C)
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((target("sse4.2")))
+#endif
+static mfs_uint32 mfs_crc32c_update__sse42(mfs_uint32 crc, const mfs_uint8* pData, size_t dataSize)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    mfs_uint64 crc64 = crc;
+    while (dataSize >= 8) {
+        mfs_uint64 value;
+        MFS_COPY_MEMORY(&value, pData, 8);
+    #if defined(_MSC_VER)
+        crc64 = _mm_crc32_u64(crc64, value);
+    #else
+        crc64 = __builtin_ia32_crc32di(crc64, value);
     #endif
-    #ifdef ETOOMANYREFS
-        case ETOOMANYREFS: return MFS_ERROR;
+        pData    += 8;
+        dataSize -= 8;
+    }
+    crc = (mfs_uint32)crc64;
+#endif
+
+    while (dataSize >= 4) {
+        mfs_uint32 value;
+        MFS_COPY_MEMORY(&value, pData, 4);
+    #if defined(_MSC_VER)
+        crc = _mm_crc32_u32(crc, value);
+    #else
+        crc = __builtin_ia32_crc32si(crc, value);
     #endif
-    #ifdef ETIMEDOUT
-        case ETIMEDOUT: return MFS_TIMEOUT;
+        pData    += 4;
+        dataSize -= 4;
+    }
+
+    while (dataSize > 0) {
+    #if defined(_MSC_VER)
+        crc = _mm_crc32_u8(crc, *pData);
+    #else
+        crc = __builtin_ia32_crc32qi(crc, *pData);
     #endif
-    #ifdef ECONNREFUSED
-        case ECONNREFUSED: return MFS_CONNECTION_REFUSED;
+        pData    += 1;
+        dataSize -= 1;
+    }
+
+    return crc;
+}
+
+static mfs_bool32 mfs_has_sse42(void)
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2") != 0;
+#endif
+}
+#endif
+
+#if defined(MFS_SUPPORT_ARM_CRC32C)
+static mfs_uint32 mfs_crc32c_update__arm(mfs_uint32 crc, const mfs_uint8* pData, size_t dataSize)
+{
+    while (dataSize >= 8) {
+        mfs_uint64 value;
+        MFS_COPY_MEMORY(&value, pData, 8);
+        crc = __crc32cd(crc, value);
+        pData    += 8;
+        dataSize -= 8;
+    }
+
+    while (dataSize > 0) {
+        crc = __crc32cb(crc, *pData);
+        pData    += 1;
+        dataSize -= 1;
+    }
+
+    return crc;
+}
+#endif
+
+static mfs_uint32 mfs_crc32c_update(mfs_uint32 crc, const mfs_uint8* pData, size_t dataSize)
+{
+#if defined(MFS_SUPPORT_SSE42_CRC32C)
+    static int hasSSE42 = -1;   /* Benign race. Every thread will compute the same value. */
+    if (hasSSE42 == -1) {
+        hasSSE42 = mfs_has_sse42() ? 1 : 0;
+    }
+
+    if (hasSSE42 == 1) {
+        return mfs_crc32c_update__sse42(crc, pData, dataSize);
+    }
+#elif defined(MFS_SUPPORT_ARM_CRC32C)
+    return mfs_crc32c_update__arm(crc, pData, dataSize);
+#endif
+
+    mfs_crc32c_init_table();
+    return mfs_crc32c_update__scalar(crc, pData, dataSize);
+}
+
+
+#define MFS_XXH64_PRIME1    MFS_UINT64_CONST(0x9E3779B1, 0x85EBCA87)
+#define MFS_XXH64_PRIME2    MFS_UINT64_CONST(0xC2B2AE3D, 0x27D4EB4F)
+#define MFS_XXH64_PRIME3    MFS_UINT64_CONST(0x165667B1, 0x9E3779F9)
+#define MFS_XXH64_PRIME4    MFS_UINT64_CONST(0x85EBCA77, 0xC2B2AE63)
+#define MFS_XXH64_PRIME5    MFS_UINT64_CONST(0x27D4EB2F, 0x165667C5)
+
+static mfs_uint64 mfs_rotl64(mfs_uint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static mfs_uint64 mfs_read_le64(const mfs_uint8* p)
+{
+    return ((mfs_uint64)p[0]      ) | ((mfs_uint64)p[1] <<  8) | ((mfs_uint64)p[2] << 16) | ((mfs_uint64)p[3] << 24) |
+           ((mfs_uint64)p[4] << 32) | ((mfs_uint64)p[5] << 40) | ((mfs_uint64)p[6] << 48) | ((mfs_uint64)p[7] << 56);
+}
+
+static mfs_uint32 mfs_read_le32(const mfs_uint8* p)
+{
+    return ((mfs_uint32)p[0]) | ((mfs_uint32)p[1] << 8) | ((mfs_uint32)p[2] << 16) | ((mfs_uint32)p[3] << 24);
+}
+
+static void mfs_write_be64(mfs_uint8* p, mfs_uint64 x)
+{
+    int i;
+    for (i = 0; i < 8; i += 1) {
+        p[i] = (mfs_uint8)(x >> (56 - i*8));
+    }
+}
+
+static mfs_uint64 mfs_xxh64_round(mfs_uint64 acc, mfs_uint64 input)
+{
+    acc += input * MFS_XXH64_PRIME2;
+    acc  = mfs_rotl64(acc, 31);
+    acc *= MFS_XXH64_PRIME1;
+    return acc;
+}
+
+static mfs_uint64 mfs_xxh64_merge_round(mfs_uint64 acc, mfs_uint64 value)
+{
+    acc ^= mfs_xxh64_round(0, value);
+    acc  = acc * MFS_XXH64_PRIME1 + MFS_XXH64_PRIME4;
+    return acc;
+}
+
+static void mfs_xxh64_update(mfs_hasher* pHasher, const mfs_uint8* pData, size_t dataSize)
+{
+    mfs_uint64* acc = pHasher->state.xxh64.acc;
+
+    pHasher->state.xxh64.totalLen += dataSize;
+
+    /* Fill the buffer first. */
+    if (pHasher->state.xxh64.bufferLen > 0) {
+        size_t bytesToCopy = 32 - pHasher->state.xxh64.bufferLen;
+        if (bytesToCopy > dataSize) {
+            bytesToCopy = dataSize;
+        }
+
+        MFS_COPY_MEMORY(pHasher->state.xxh64.buffer + pHasher->state.xxh64.bufferLen, pData, bytesToCopy);
+        pHasher->state.xxh64.bufferLen += (mfs_uint32)bytesToCopy;
+        pData    += bytesToCopy;
+        dataSize -= bytesToCopy;
+
+        if (pHasher->state.xxh64.bufferLen < 32) {
+            return;
+        }
+
+        acc[0] = mfs_xxh64_round(acc[0], mfs_read_le64(pHasher->state.xxh64.buffer +  0));
+        acc[1] = mfs_xxh64_round(acc[1], mfs_read_le64(pHasher->state.xxh64.buffer +  8));
+        acc[2] = mfs_xxh64_round(acc[2], mfs_read_le64(pHasher->state.xxh64.buffer + 16));
+        acc[3] = mfs_xxh64_round(acc[3], mfs_read_le64(pHasher->state.xxh64.buffer + 24));
+        pHasher->state.xxh64.bufferLen = 0;
+    }
+
+    /* Process whole stripes directly from the input. The four lanes are independent which allows the CPU to pipeline them. */
+    while (dataSize >= 32) {
+        acc[0] = mfs_xxh64_round(acc[0], mfs_read_le64(pData +  0));
+        acc[1] = mfs_xxh64_round(acc[1], mfs_read_le64(pData +  8));
+        acc[2] = mfs_xxh64_round(acc[2], mfs_read_le64(pData + 16));
+        acc[3] = mfs_xxh64_round(acc[3], mfs_read_le64(pData + 24));
+        pData    += 32;
+        dataSize -= 32;
+    }
+
+    if (dataSize > 0) {
+        MFS_COPY_MEMORY(pHasher->state.xxh64.buffer, pData, dataSize);
+        pHasher->state.xxh64.bufferLen = (mfs_uint32)dataSize;
+    }
+}
+
+static mfs_uint64 mfs_xxh64_finalize(mfs_hasher* pHasher)
+{
+    const mfs_uint64* acc = pHasher->state.xxh64.acc;
+    const mfs_uint8* p = pHasher->state.xxh64.buffer;
+    size_t remaining = pHasher->state.xxh64.bufferLen;
+    mfs_uint64 h64;
+
+    if (pHasher->state.xxh64.totalLen >= 32) {
+        h64 = mfs_rotl64(acc[0], 1) + mfs_rotl64(acc[1], 7) + mfs_rotl64(acc[2], 12) + mfs_rotl64(acc[3], 18);
+        h64 = mfs_xxh64_merge_round(h64, acc[0]);
+        h64 = mfs_xxh64_merge_round(h64, acc[1]);
+        h64 = mfs_xxh64_merge_round(h64, acc[2]);
+        h64 = mfs_xxh64_merge_round(h64, acc[3]);
+    } else {
+        h64 = acc[2] /* seed */ + MFS_XXH64_PRIME5;
+    }
+
+    h64 += pHasher->state.xxh64.totalLen;
+
+    while (remaining >= 8) {
+        h64 ^= mfs_xxh64_round(0, mfs_read_le64(p));
+        h64  = mfs_rotl64(h64, 27) * MFS_XXH64_PRIME1 + MFS_XXH64_PRIME4;
+        p += 8;
+        remaining -= 8;
+    }
+
+    if (remaining >= 4) {
+        h64 ^= (mfs_uint64)mfs_read_le32(p) * MFS_XXH64_PRIME1;
+        h64  = mfs_rotl64(h64, 23) * MFS_XXH64_PRIME2 + MFS_XXH64_PRIME3;
+        p += 4;
+        remaining -= 4;
+    }
+
+    while (remaining > 0) {
+        h64 ^= (*p) * MFS_XXH64_PRIME5;
+        h64  = mfs_rotl64(h64, 11) * MFS_XXH64_PRIME1;
+        p += 1;
+        remaining -= 1;
+    }
+
+    h64 ^= h64 >> 33;
+    h64 *= MFS_XXH64_PRIME2;
+    h64 ^= h64 >> 29;
+    h64 *= MFS_XXH64_PRIME3;
+    h64 ^= h64 >> 32;
+
+    return h64;
+}
+
+
+static const mfs_uint32 mfs_sha256_k[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define MFS_SHA256_ROTR(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void mfs_sha256_transform(mfs_uint32* h, const mfs_uint8* pBlock)
+{
+    mfs_uint32 w[64];
+    mfs_uint32 a, b, c, d, e, f, g, hh;
+    mfs_uint32 i;
+
+    for (i = 0; i < 16; i += 1) {
+        w[i] = ((mfs_uint32)pBlock[i*4+0] << 24) | ((mfs_uint32)pBlock[i*4+1] << 16) | ((mfs_uint32)pBlock[i*4+2] << 8) | ((mfs_uint32)pBlock[i*4+3]);
+    }
+
+    for (i = 16; i < 64; i += 1) {
+        mfs_uint32 s0 = MFS_SHA256_ROTR(w[i-15],  7) ^ MFS_SHA256_ROTR(w[i-15], 18) ^ (w[i-15] >>  3);
+        mfs_uint32 s1 = MFS_SHA256_ROTR(w[i- 2], 17) ^ MFS_SHA256_ROTR(w[i- 2], 19) ^ (w[i- 2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    a = h[0]; b = h[1]; c = h[2]; d = h[3]; e = h[4]; f = h[5]; g = h[6]; hh = h[7];
+
+    for (i = 0; i < 64; i += 1) {
+        mfs_uint32 S1 = MFS_SHA256_ROTR(e, 6) ^ MFS_SHA256_ROTR(e, 11) ^ MFS_SHA256_ROTR(e, 25);
+        mfs_uint32 ch = (e & f) ^ (~e & g);
+        mfs_uint32 t1 = hh + S1 + ch + mfs_sha256_k[i] + w[i];
+        mfs_uint32 S0 = MFS_SHA256_ROTR(a, 2) ^ MFS_SHA256_ROTR(a, 13) ^ MFS_SHA256_ROTR(a, 22);
+        mfs_uint32 maj = (a & b) ^ (a & c) ^ (b & c);
+        mfs_uint32 t2 = S0 + maj;
+
+        hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}
+
+static void mfs_sha256_update(mfs_hasher* pHasher, const mfs_uint8* pData, size_t dataSize)
+{
+    pHasher->state.sha256.totalLen += dataSize;
+
+    if (pHasher->state.sha256.bufferLen > 0) {
+        size_t bytesToCopy = 64 - pHasher->state.sha256.bufferLen;
+        if (bytesToCopy > dataSize) {
+            bytesToCopy = dataSize;
+        }
+
+        MFS_COPY_MEMORY(pHasher->state.sha256.buffer + pHasher->state.sha256.bufferLen, pData, bytesToCopy);
+        pHasher->state.sha256.bufferLen += (mfs_uint32)bytesToCopy;
+        pData    += bytesToCopy;
+        dataSize -= bytesToCopy;
+
+        if (pHasher->state.sha256.bufferLen < 64) {
+            return;
+        }
+
+        mfs_sha256_transform(pHasher->state.sha256.h, pHasher->state.sha256.buffer);
+        pHasher->state.sha256.bufferLen = 0;
+    }
+
+    while (dataSize >= 64) {
+        mfs_sha256_transform(pHasher->state.sha256.h, pData);
+        pData    += 64;
+        dataSize -= 64;
+    }
+
+    if (dataSize > 0) {
+        MFS_COPY_MEMORY(pHasher->state.sha256.buffer, pData, dataSize);
+        pHasher->state.sha256.bufferLen = (mfs_uint32)dataSize;
+    }
+}
+
+static void mfs_sha256_finalize(mfs_hasher* pHasher, mfs_uint8* pDigest)
+{
+    mfs_uint8 padding[72];
+    mfs_uint64 bitLen = pHasher->state.sha256.totalLen * 8;
+    size_t paddingSize;
+    mfs_uint32 i;
+
+    /* Pad with 0x80 followed by zeros until 8 bytes short of a block boundary, then the length in bits. */
+    paddingSize = (pHasher->state.sha256.bufferLen < 56) ? (56 - pHasher->state.sha256.bufferLen) : (120 - pHasher->state.sha256.bufferLen);
+    MFS_ZERO_MEMORY(padding, sizeof(padding));
+    padding[0] = 0x80;
+    mfs_write_be64(padding + paddingSize, bitLen);
+
+    mfs_sha256_update(pHasher, padding, paddingSize + 8);
+
+    for (i = 0; i < 8; i += 1) {
+        pDigest[i*4+0] = (mfs_uint8)(pHasher->state.sha256.h[i] >> 24);
+        pDigest[i*4+1] = (mfs_uint8)(pHasher->state.sha256.h[i] >> 16);
+        pDigest[i*4+2] = (mfs_uint8)(pHasher->state.sha256.h[i] >>  8);
+        pDigest[i*4+3] = (mfs_uint8)(pHasher->state.sha256.h[i] >>  0);
+    }
+}
+
+
+mfs_result mfs_hasher_init(mfs_uint32 algorithm, mfs_hasher* pHasher)
+{
+    if (pHasher == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(pHasher);
+    pHasher->algorithm = algorithm;
+
+    switch (algorithm)
+    {
+        case MFS_HASH_ALGORITHM_CRC32C:
+        {
+            pHasher->state.crc32c = 0xFFFFFFFF;
+        } break;
+
+        case MFS_HASH_ALGORITHM_XXH64:
+        {
+            /* A seed of 0. */
+            pHasher->state.xxh64.acc[0] = MFS_XXH64_PRIME1 + MFS_XXH64_PRIME2;
+            pHasher->state.xxh64.acc[1] = MFS_XXH64_PRIME2;
+            pHasher->state.xxh64.acc[2] = 0;
+            pHasher->state.xxh64.acc[3] = 0 - MFS_XXH64_PRIME1;
+        } break;
+
+        case MFS_HASH_ALGORITHM_SHA256:
+        {
+            pHasher->state.sha256.h[0] = 0x6a09e667;
+            pHasher->state.sha256.h[1] = 0xbb67ae85;
+            pHasher->state.sha256.h[2] = 0x3c6ef372;
+            pHasher->state.sha256.h[3] = 0xa54ff53a;
+            pHasher->state.sha256.h[4] = 0x510e527f;
+            pHasher->state.sha256.h[5] = 0x9b05688c;
+            pHasher->state.sha256.h[6] = 0x1f83d9ab;
+            pHasher->state.sha256.h[7] = 0x5be0cd19;
+        } break;
+
+        default: return MFS_INVALID_ARGS;
+    }
+
+    return MFS_SUCCESS;
+}
+
+void mfs_hasher_update(mfs_hasher* pHasher, const void* pData, size_t dataSize)
+{
+    if (pHasher == NULL || pData == NULL) {
+        return;
+    }
+
+    switch (pHasher->algorithm)
+    {
+        case MFS_HASH_ALGORITHM_CRC32C:
+        {
+            pHasher->state.crc32c = mfs_crc32c_update(pHasher->state.crc32c, (const mfs_uint8*)pData, dataSize);
+        } break;
+
+        case MFS_HASH_ALGORITHM_XXH64:
+        {
+            mfs_xxh64_update(pHasher, (const mfs_uint8*)pData, dataSize);
+        } break;
+
+        case MFS_HASH_ALGORITHM_SHA256:
+        {
+            mfs_sha256_update(pHasher, (const mfs_uint8*)pData, dataSize);
+        } break;
+
+        default: break;
+    }
+}
+
+void mfs_hasher_finalize(mfs_hasher* pHasher, mfs_hash_digest* pDigest)
+{
+    if (pHasher == NULL || pDigest == NULL) {
+        return;
+    }
+
+    MFS_ZERO_OBJECT(pDigest);
+
+    switch (pHasher->algorithm)
+    {
+        case MFS_HASH_ALGORITHM_CRC32C:
+        {
+            mfs_uint32 crc = pHasher->state.crc32c ^ 0xFFFFFFFF;
+            pDigest->data[0] = (mfs_uint8)(crc >> 24);
+            pDigest->data[1] = (mfs_uint8)(crc >> 16);
+            pDigest->data[2] = (mfs_uint8)(crc >>  8);
+            pDigest->data[3] = (mfs_uint8)(crc >>  0);
+            pDigest->size = 4;
+        } break;
+
+        case MFS_HASH_ALGORITHM_XXH64:
+        {
+            mfs_write_be64(pDigest->data, mfs_xxh64_finalize(pHasher));
+            pDigest->size = 8;
+        } break;
+
+        case MFS_HASH_ALGORITHM_SHA256:
+        {
+            mfs_sha256_finalize(pHasher, pDigest->data);
+            pDigest->size = 32;
+        } break;
+
+        default: break;
+    }
+}
+
+mfs_bool32 mfs_hash_digest_equal(const mfs_hash_digest* pDigest1, const mfs_hash_digest* pDigest2)
+{
+    if (pDigest1 == NULL || pDigest2 == NULL) {
+        return MFS_FALSE;
+    }
+
+    return pDigest1->size == pDigest2->size && memcmp(pDigest1->data, pDigest2->data, pDigest1->size) == 0;
+}
+
+mfs_uint64 mfs_hash_digest_to_uint64(const mfs_hash_digest* pDigest)
+{
+    mfs_uint64 value = 0;
+    mfs_uint32 i;
+
+    if (pDigest == NULL) {
+        return 0;
+    }
+
+    for (i = 0; i < pDigest->size && i < 8; i += 1) {
+        value = (value << 8) | pDigest->data[i];
+    }
+
+    return value;
+}
+
+
+/*
+Worker Pool
+
+Jobs are intrusive. The job structure is placed at the start of a larger structure that contains the job's data, and the job is
+responsible for freeing itself, if necessary, in its onProcess callback. Jobs are allowed to post more jobs.
+
+The thread calling mfs_worker_pool_wait() will process jobs alongside the worker threads. This means a pool with a thread count of
+1 will not create any threads at all and everything will be processed in mfs_worker_pool_wait(), which is also what happens when
+threading is unavailable.
+*/
+typedef struct mfs_job mfs_job;
+struct mfs_job
+{
+    void (* onProcess)(mfs_job* pJob);
+    mfs_job* pNext;
+};
+
+typedef struct
+{
+    mfs_mutex lock;
+    mfs_cond cond;              /* Signaled when a job is posted, when the pool becomes idle, and when the pool is being shut down. */
+    mfs_job* pHead;
+    mfs_job* pTail;
+    size_t pendingCount;        /* The number of jobs that are either queued or being processed. */
+    mfs_bool32 isShuttingDown;
+    mfs_uint32 threadCount;     /* The number of worker threads, not including the thread calling mfs_worker_pool_wait(). */
+    mfs_thread* pThreads;
+    int ioPriority;             /* One of MFS_IO_PRIORITY_*. Applied to each worker thread, and to the thread calling mfs_worker_pool_wait() for the duration of the call. */
+} mfs_worker_pool;
+
+static mfs_job* mfs_worker_pool_dequeue(mfs_worker_pool* pPool)
+{
+    mfs_job* pJob;
+
+    /* Must be called while the lock is held. */
+    pJob = pPool->pHead;
+    if (pJob != NULL) {
+        pPool->pHead = pJob->pNext;
+        if (pPool->pHead == NULL) {
+            pPool->pTail = NULL;
+        }
+    }
+
+    return pJob;
+}
+
+static void mfs_worker_pool_process(mfs_worker_pool* pPool, mfs_job* pJob)
+{
+    /* Must be called while the lock is held. It will be released while the job is being processed. */
+    mfs_mutex_unlock(&pPool->lock);
+    {
+        pJob->onProcess(pJob);  /* <-- The job may be freed at this point. */
+    }
+    mfs_mutex_lock(&pPool->lock);
+
+    MFS_ASSERT(pPool->pendingCount > 0);
+    pPool->pendingCount -= 1;
+    if (pPool->pendingCount == 0) {
+        mfs_cond_broadcast(&pPool->cond);
+    }
+}
+
+static mfs_thread_result MFS_THREADCALL mfs_worker_pool_thread(void* pData)
+{
+    mfs_worker_pool* pPool = (mfs_worker_pool*)pData;
+
+    if (pPool->ioPriority != MFS_IO_PRIORITY_DEFAULT) {
+        mfs_set_thread_io_priority(pPool->ioPriority);
+    }
+
+    mfs_mutex_lock(&pPool->lock);
+    for (;;) {
+        mfs_job* pJob = mfs_worker_pool_dequeue(pPool);
+        if (pJob != NULL) {
+            mfs_worker_pool_process(pPool, pJob);
+        } else {
+            if (pPool->isShuttingDown) {
+                break;
+            }
+
+            mfs_cond_wait(&pPool->cond, &pPool->lock);
+        }
+    }
+    mfs_mutex_unlock(&pPool->lock);
+
+    return (mfs_thread_result)0;
+}
+
+static mfs_result mfs_worker_pool_init(mfs_uint32 threadCount, int ioPriority, mfs_worker_pool* pPool)
+{
+    mfs_uint32 iThread;
+
+    MFS_ASSERT(pPool != NULL);
+
+    MFS_ZERO_OBJECT(pPool);
+    pPool->ioPriority = ioPriority;
+
+    if (threadCount == 0) {
+        threadCount = mfs_get_cpu_count();
+    }
+
+    mfs_mutex_init(&pPool->lock);
+    mfs_cond_init(&pPool->cond);
+
+    /* The calling thread counts as one of the threads. */
+    if (threadCount > 1) {
+        pPool->pThreads = (mfs_thread*)MFS_MALLOC(sizeof(*pPool->pThreads) * (threadCount - 1));
+        if (pPool->pThreads != NULL) {
+            for (iThread = 0; iThread < threadCount - 1; iThread += 1) {
+                if (mfs_thread_create(&pPool->pThreads[iThread], mfs_worker_pool_thread, pPool) != MFS_SUCCESS) {
+                    break;  /* Not a critical error. We'll just run with fewer threads. */
+                }
+
+                pPool->threadCount += 1;
+            }
+        }
+    }
+
+    return MFS_SUCCESS;
+}
+
+static void mfs_worker_pool_uninit(mfs_worker_pool* pPool)
+{
+    mfs_uint32 iThread;
+
+    MFS_ASSERT(pPool != NULL);
+
+    mfs_mutex_lock(&pPool->lock);
+    {
+        pPool->isShuttingDown = MFS_TRUE;
+        mfs_cond_broadcast(&pPool->cond);
+    }
+    mfs_mutex_unlock(&pPool->lock);
+
+    for (iThread = 0; iThread < pPool->threadCount; iThread += 1) {
+        mfs_thread_join(pPool->pThreads[iThread]);
+    }
+
+    MFS_FREE(pPool->pThreads);
+    mfs_cond_uninit(&pPool->cond);
+    mfs_mutex_uninit(&pPool->lock);
+}
+
+static void mfs_worker_pool_post(mfs_worker_pool* pPool, mfs_job* pJob)
+{
+    MFS_ASSERT(pPool != NULL);
+    MFS_ASSERT(pJob  != NULL);
+
+    pJob->pNext = NULL;
+
+    mfs_mutex_lock(&pPool->lock);
+    {
+        if (pPool->pTail == NULL) {
+            pPool->pHead = pJob;
+        } else {
+            pPool->pTail->pNext = pJob;
+        }
+        pPool->pTail = pJob;
+
+        pPool->pendingCount += 1;
+        mfs_cond_signal(&pPool->cond);
+    }
+    mfs_mutex_unlock(&pPool->lock);
+}
+
+static void mfs_worker_pool_wait(mfs_worker_pool* pPool)
+{
+    MFS_ASSERT(pPool != NULL);
+
+    if (pPool->ioPriority != MFS_IO_PRIORITY_DEFAULT) {
+        mfs_set_thread_io_priority(pPool->ioPriority);
+    }
+
+    mfs_mutex_lock(&pPool->lock);
+    for (;;) {
+        mfs_job* pJob = mfs_worker_pool_dequeue(pPool);
+        if (pJob != NULL) {
+            mfs_worker_pool_process(pPool, pJob);
+        } else {
+            if (pPool->pendingCount == 0) {
+                break;
+            }
+
+            /* Getting here means there are no queued jobs, but some are still being processed by worker threads and may post more. */
+            mfs_cond_wait(&pPool->cond, &pPool->lock);
+        }
+    }
+    mfs_mutex_unlock(&pPool->lock);
+
+    if (pPool->ioPriority != MFS_IO_PRIORITY_DEFAULT) {
+        mfs_set_thread_io_priority(MFS_IO_PRIORITY_DEFAULT);
+    }
+}
+
+
+
+mfs_result mfs_fopen(FILE** ppFile, const char* pFilePath, const char* pOpenMode)
+{
+#if defined(_MSC_VER) && _MSC_VER >= 1400
+    errno_t err;
+#endif
+
+    if (ppFile != NULL) {
+        *ppFile = NULL;  /* Safety. */
+    }
+
+    if (pFilePath == NULL || pOpenMode == NULL || ppFile == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+#if defined(_MSC_VER) && _MSC_VER >= 1400
+    err = fopen_s(ppFile, pFilePath, pOpenMode);
+    if (err != 0) {
+        return mfs_result_from_errno(err);
+    }
+#else
+#if defined(_WIN32) || defined(__APPLE__)
+    *ppFile = fopen(pFilePath, pOpenMode);
+#else
+    #if defined(_FILE_OFFSET_BITS) && _FILE_OFFSET_BITS == 64 && defined(_LARGEFILE64_SOURCE)
+        *ppFile = fopen64(pFilePath, pOpenMode);
+    #else
+        *ppFile = fopen(pFilePath, pOpenMode);
     #endif
-    #ifdef EHOSTDOWN
-        case EHOSTDOWN: return MFS_NO_HOST;
+#endif
+    if (*ppFile == NULL) {
+        mfs_result result = mfs_result_from_errno(errno);
+        if (result == MFS_SUCCESS) {
+            result = MFS_ERROR; /* Just a safety check to make sure we never ever return success when pFile == NULL. */
+        }
+
+        return result;
+    }
+#endif
+
+    return MFS_SUCCESS;
+}
+
+/*
+_wfopen() isn't always available in all compilation environments.
+
+    * Windows only.
+    * MSVC seems to support it universally as far back as VC6 from what I can tell (haven't checked further back).
+    * MinGW-64 (both 32- and 64-bit) seems to support it.
+    * MinGW wraps it in !defined(__STRICT_ANSI__).
+
+This can be reviewed as compatibility issues arise. The preference is to use _wfopen_s() and _wfopen() as opposed to the wcsrtombs()
+fallback, so if you notice your compiler not detecting this properly I'm happy to look at adding support.
+*/
+#if defined(_WIN32)
+    #if defined(_MSC_VER) || defined(__MINGW64__) || !defined(__STRICT_ANSI__)
+        #define MFS_HAS_WFOPEN
     #endif
-    #ifdef EHOSTUNREACH
-        case EHOSTUNREACH: return MFS_NO_HOST;
+#endif
+
+mfs_result mfs_wfopen(FILE** ppFile, const wchar_t* pFilePath, const wchar_t* pOpenMode)
+{
+#if defined(_MSC_VER) && _MSC_VER >= 1400
+    errno_t err;
+#endif
+
+    if (ppFile != NULL) {
+        *ppFile = NULL;  /* Safety. */
+    }
+
+    if (pFilePath == NULL || pOpenMode == NULL || ppFile == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+#if defined(MFS_HAS_WFOPEN)
+    /* Use _wfopen() on Windows. */
+    #if defined(_MSC_VER) && _MSC_VER >= 1400
+        err = _wfopen_s(ppFile, pFilePath, pOpenMode);
+        if (err != 0) {
+            return mfs_result_from_errno(err);
+        }
+    #else
+        *ppFile = _wfopen(pFilePath, pOpenMode);
+        if (*ppFile == NULL) {
+            return mfs_result_from_errno(errno);
+        }
     #endif
-    #ifdef EALREADY
-        case EALREADY: return MFS_IN_PROGRESS;
+#else
+    /*
+    Use fopen() on anything other than Windows. Requires a conversion. This is annoying because fopen() is locale specific. The only real way I can
+    think of to do this is with wcsrtombs(). Note that wcstombs() is apparently not thread-safe because it uses a static global mbstate_t object for
+    maintaining state. I've checked this with -std=c89 and it works, but if somebody get's a compiler error I'll look into improving compatibility.
+    */
+    {
+        mbstate_t mbs;
+        size_t lenMB;
+        const wchar_t* pFilePathTemp = pFilePath;
+        char* pFilePathMB = NULL;
+        char pOpenModeMB[32] = {0};
+
+        /* Get the length first. */
+        MFS_ZERO_OBJECT(&mbs);
+        lenMB = wcsrtombs(NULL, &pFilePathTemp, 0, &mbs);
+        if (lenMB == (size_t)-1) {
+            return mfs_result_from_errno(errno);
+        }
+
+        pFilePathMB = (char*)MFS_MALLOC(lenMB + 1);
+        if (pFilePathMB == NULL) {
+            return MFS_OUT_OF_MEMORY;
+        }
+
+        pFilePathTemp = pFilePath;
+        MFS_ZERO_OBJECT(&mbs);
+        wcsrtombs(pFilePathMB, &pFilePathTemp, lenMB + 1, &mbs);
+
+        /* The open mode should always consist of ASCII characters so we should be able to do a trivial conversion. */
+        {
+            size_t i = 0;
+            for (;;) {
+                if (pOpenMode[i] == 0) {
+                    pOpenModeMB[i] = '\0';
+                    break;
+                }
+
+                pOpenModeMB[i] = (char)pOpenMode[i];
+                i += 1;
+            }
+        }
+
+        *ppFile = fopen(pFilePathMB, pOpenModeMB);
+
+        MFS_FREE(pFilePathMB);
+    }
+
+    if (*ppFile == NULL) {
+        return MFS_ERROR;
+    }
+#endif
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_fclose(FILE* pFile)
+{
+    int result = fclose(pFile);
+    if (result != 0) {
+        return MFS_ERROR;
+    }
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_fread(FILE* pFile, void* pData, size_t sizeInBytes, size_t* pBytesRead)
+{
+    size_t result;
+
+    result = fread(pData, 1, sizeInBytes, pFile);
+    
+    if (pBytesRead != NULL) {
+        *pBytesRead = result;
+    }
+    
+    if (result != sizeInBytes) {
+        if (feof(pFile)) {
+            return MFS_END_OF_FILE;
+        } else {
+            return mfs_result_from_errno(ferror(pFile));
+        }
+    }
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_fwrite(FILE* pFile, const void* pData, size_t sizeInBytes, size_t* pBytesWritten)
+{
+    size_t result;
+
+    result = fwrite(pData, 1, sizeInBytes, pFile);
+
+    if (pBytesWritten != NULL) {
+        *pBytesWritten = result;
+    }
+
+    if (result != sizeInBytes) {
+        return mfs_result_from_errno(ferror(pFile));
+    }
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_fseek(FILE* pFile, mfs_int64 offset, int origin)
+{
+    int result;
+#if defined(_WIN32)
+    result = _fseeki64(pFile, offset, origin);
+#else
+    result = fseek(pFile, (long int)offset, origin);
+#endif
+    if (result != 0) {
+        return MFS_ERROR;
+    }
+
+    return MFS_SUCCESS;
+}
+
+mfs_int64 mfs_ftell(FILE* pFile)
+{
+    mfs_int64 result;
+#if defined(_WIN32)
+    result = _ftelli64(pFile);
+#else
+    result = ftell(pFile);
+#endif
+
+    return result;
+}
+
+#if !defined(_MSC_VER) && !((defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 1) || defined(_XOPEN_SOURCE) || defined(_POSIX_SOURCE)) && !(defined(__DragonFly__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__))
+int fileno(FILE *stream);
+#endif
+
+mfs_result mfs_fstat(FILE* pFile, mfs_stat_info* info)
+{
+    int fd;
+
+#if defined(_MSC_VER)
+    fd = _fileno(pFile);
+#else
+    fd =  fileno(pFile);
+#endif
+
+#if defined(_MSC_VER)
+    if (_fstat64(fd, info) != 0) {
+#elif defined(_FILE_OFFSET_BITS) && _FILE_OFFSET_BITS == 64 && defined(_LARGEFILE64_SOURCE)
+    if (fstat64(fd, info) != 0) {
+#else
+    if (fstat(fd, info) != 0) {
+#endif
+        return mfs_result_from_errno(errno);
+    }
+
+    return MFS_SUCCESS;
+}
+
+
+static mfs_result mfs_open_and_read_file_with_extra_data(const char* pFilePath, size_t* pFileSizeOut, void** ppFileData, size_t extraBytes)
+{
+    mfs_result result;
+    mfs_uint64 fileSize;
+    FILE* pFile;
+    void* pFileData;
+    size_t bytesRead;
+
+    if (pFilePath == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    result = mfs_fopen(&pFile, pFilePath, "rb");
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    fseek(pFile, 0, SEEK_END);
+    fileSize = ftell(pFile);
+    fseek(pFile, 0, SEEK_SET);
+
+    if (fileSize+extraBytes > SIZE_MAX) {
+        mfs_fclose(pFile);
+        return MFS_TOO_BIG;
+    }
+
+    pFileData = MFS_MALLOC((size_t)fileSize + extraBytes);    /* <-- Safe cast due to the check above. */
+    if (pFileData == NULL) {
+        mfs_fclose(pFile);
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    result = mfs_fread(pFile, pFileData, (size_t)fileSize, &bytesRead);
+    if (result != MFS_SUCCESS) {
+        MFS_FREE(pFileData);
+        fclose(pFile);
+        return result;
+    }
+
+    fclose(pFile);
+
+    if (pFileSizeOut) {
+        *pFileSizeOut = (size_t)fileSize;
+    }
+
+    if (ppFileData) {
+        *ppFileData = pFileData;
+    } else {
+        MFS_FREE(pFileData);
+    }
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_open_and_read_file(const char* pFilePath, size_t* pFileSizeOut, void** ppFileData)
+{
+    return mfs_open_and_read_file_with_extra_data(pFilePath, pFileSizeOut, ppFileData, 0);
+}
+
+mfs_result mfs_open_and_read_text_file(const char* pFilePath, size_t* pFileSizeOut, char** ppFileData)
+{
+    size_t fileSize;
+    mfs_result result = mfs_open_and_read_file_with_extra_data(pFilePath, &fileSize, (void**)ppFileData, 1);    /* 1 extra byte for the null terminator. */
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    /* Output data needs to be null terminated. */
+    (*ppFileData)[fileSize] = '\0';
+
+    if (pFileSizeOut != NULL) {
+        *pFileSizeOut = fileSize;
+    }
+
+    return result;
+}
+
+
+mfs_result mfs_open_and_write_file(const char* pFilePath, size_t fileSize, const void* pFileData)
+{
+    mfs_result result;
+    FILE* pFile;
+
+    if (pFilePath == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    result = mfs_fopen(&pFile, pFilePath, "wb");
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    result = mfs_fwrite(pFile, pFileData, fileSize, NULL);
+    mfs_fclose(pFile);
+
+    return result;
+}
+
+
+/* Current Directory */
+
+#if defined(MFS_WIN32)
+mfs_result mfs_set_current_directory__win32(const char* pDirectoryPath)
+{
+    if (SetCurrentDirectoryA(pDirectoryPath)) {
+        return MFS_SUCCESS;
+    }
+
+    return mfs_result_from_GetLastError(GetLastError());
+}
+
+mfs_result mfs_get_current_directory__win32(char* pDirectoryPath, size_t directoryPathSizeInBytes)
+{
+    DWORD result;
+
+    result = GetCurrentDirectoryA((DWORD)directoryPathSizeInBytes, pDirectoryPath);
+    if (result == 0) {
+        return mfs_result_from_GetLastError(GetLastError());
+    }
+
+    /*
+    It's not entirely clear by the documentation for GetCurrentDirectory() what the contents of the output buffer is set to in the scenario where
+    it's not large enough to hold the result. For consistency with the POSIX implementation I'm going to explicitly set this to a blank string and
+    return an error if the return value is larger than the size of the buffer.
+    */
+    if (result > (DWORD)directoryPathSizeInBytes) {
+        pDirectoryPath[0] = '\0';
+        return MFS_OUT_OF_RANGE;
+    }
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_mkdir__win32(const char* pDirectoryPath)
+{
+    BOOL result = CreateDirectoryA(pDirectoryPath, NULL);
+    if (result) {
+        return MFS_SUCCESS;
+    }
+
+    return mfs_result_from_GetLastError(GetLastError());
+}
+#endif
+
+#if defined(MFS_POSIX)
+mfs_result mfs_set_current_directory__posix(const char* pDirectoryPath)
+{
+    int result = chdir(pDirectoryPath);
+    if (result != 0) {
+        return mfs_result_from_errno(errno);
+    }
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_get_current_directory__posix(char* pDirectoryPath, size_t directoryPathSizeInBytes)
+{
+    int result;
+    char* cwd;
+    
+    cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        return mfs_result_from_errno(errno);
+    }
+
+    result = mfs_strcpy_s(pDirectoryPath, directoryPathSizeInBytes, cwd);
+    free(cwd);
+
+    if (result != 0) {
+        return mfs_result_from_errno(errno);
+    }
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_mkdir__posix(const char* pDirectoryPath)
+{
+    if (mkdir(pDirectoryPath, 0777) == 0) {
+        return MFS_SUCCESS;
+    }
+
+    return mfs_result_from_errno(errno);
+}
+#endif
+
+mfs_result mfs_set_current_directory(const char* pDirectoryPath)
+{
+#if defined(MFS_WIN32)
+    return mfs_set_current_directory__win32(pDirectoryPath);
+#elif defined(MFS_POSIX)
+    return mfs_set_current_directory__posix(pDirectoryPath);
+#else
+    return MFS_INVALID_OPERATION;   /* Unsupported platform. */
+#endif
+}
+
+mfs_result mfs_get_current_directory(char* pDirectoryPath, size_t directoryPathSizeInBytes)
+{
+    if (pDirectoryPath == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+    if (directoryPathSizeInBytes == 0) {
+        return MFS_OUT_OF_RANGE;
+    }
+
+    pDirectoryPath[0] = '\0';
+
+#if defined(MFS_WIN32)
+    return mfs_get_current_directory__win32(pDirectoryPath, directoryPathSizeInBytes);
+#elif defined(MFS_POSIX)
+    return mfs_get_current_directory__posix(pDirectoryPath, directoryPathSizeInBytes);
+#else
+    return MFS_INVALID_OPERATION;   /* Unsupported platform. */
+#endif
+}
+
+static mfs_result mfs_mkdir_single(const char* pDirectory)
+{
+#if defined(MFS_WIN32)
+    return mfs_mkdir__win32(pDirectory);
+#elif defined(MFS_POSIX)
+    return mfs_mkdir__posix(pDirectory);
+#else
+    (void)pDirectory;
+    return MFS_INVALID_OPERATION;   /* Unsupported platform. */
+#endif
+}
+
+static mfs_result mfs_mkdir_single_or_existing(const char* pDirectory)
+{
+    /* Treats an existing directory as success. Something other than a directory in the way is an error. */
+    mfs_result result = mfs_mkdir_single(pDirectory);
+    if (result == MFS_ALREADY_EXISTS) {
+        if (mfs_is_directory(pDirectory)) {
+            result = MFS_SUCCESS;
+        } else {
+            result = MFS_INVALID_OPERATION; /* The path refers to a file. */
+        }
+    }
+
+    return result;
+}
+
+static mfs_bool32 mfs_is_path_separator(char c)
+{
+    return c == '/' || c == '\\';
+}
+
+static mfs_result mfs_mkdir_recursive(const char* pDirectory)
+{
+    /*
+    The common case is that most of the path already exists, so the leaf is created first. Only when that fails because the parent
+    does not exist do we walk back up, one segment at a time, until a directory can be created. Then we walk forward again creating
+    each directory that was skipped. Creating a directory whose parent exists is a single system call.
+
+    The walk is done on a copy of the path. Stepping back terminates the string at a separator and stepping forward restores it. The
+    copy only needs the heap if the path is too long to fit inside the mfs_path_buf.
+    */
+    mfs_result result;
+    mfs_path_buf path;
+    char* pPath;
+    size_t pathLen;
+    size_t len;
+
+    result = mfs_mkdir_single_or_existing(pDirectory);
+    if (result != MFS_DOES_NOT_EXIST) {
+        return result;
+    }
+
+    result = mfs_path_buf_init(&path, pDirectory);
+    if (result != MFS_SUCCESS) {
+        mfs_path_buf_uninit(&path);
+        return result;
+    }
+
+    pPath   = path.pPath;
+    pathLen = path.length;
+
+    /* Trailing separators are ignored. */
+    while (pathLen > 1 && mfs_is_path_separator(pPath[pathLen - 1])) {
+        pathLen -= 1;
+        pPath[pathLen] = '\0';
+    }
+
+    /* Walk back. */
+    len = pathLen;
+    for (;;) {
+        size_t parentLen = len;
+
+        while (parentLen > 0 && mfs_is_path_separator(pPath[parentLen - 1]) == MFS_FALSE) {
+            parentLen -= 1;
+        }
+        while (parentLen > 0 && mfs_is_path_separator(pPath[parentLen - 1])) {
+            parentLen -= 1;
+        }
+
+        if (parentLen == 0) {
+            mfs_path_buf_uninit(&path);
+            return result;  /* Got to the start of the path. Either the root does not exist or it's a relative path whose first segment could not be created. */
+        }
+
+        pPath[parentLen] = '\0';
+        len = parentLen;
+
+        result = mfs_mkdir_single_or_existing(pPath);
+        if (result == MFS_SUCCESS) {
+            break;
+        }
+
+        if (result != MFS_DOES_NOT_EXIST) {
+            mfs_path_buf_uninit(&path);
+            return result;
+        }
+    }
+
+    /* Walk forward. */
+    while (len < pathLen) {
+        pPath[len] = pDirectory[len];
+        len += strlen(pPath + len);
+
+        result = mfs_mkdir_single_or_existing(pPath);
+        if (result != MFS_SUCCESS) {
+            break;
+        }
+    }
+
+    mfs_path_buf_uninit(&path);
+    return result;
+}
+
+mfs_result mfs_mkdir(const char* pDirectory, mfs_bool32 recursive)
+{
+    if (pDirectory == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (pDirectory[0] == '\0') {
+        return MFS_SUCCESS; /* It's an empty directory which we'll treat as the current directory. The current directory must exist so we just pretend to be successful. */
+    }
+
+    if (recursive == MFS_FALSE) {
+        return mfs_mkdir_single(pDirectory);
+    } else {
+        return mfs_mkdir_recursive(pDirectory);
+    }
+}
+
+
+mfs_mkdir_many_config mfs_mkdir_many_config_init(void)
+{
+    mfs_mkdir_many_config config;
+
+    MFS_ZERO_OBJECT(&config);
+    config.threadCount = 1;
+
+    return config;
+}
+
+/*
+The paths are deduplicated by inserting each segment into a trie, with the children of each node found through a single hash table
+keyed on the parent node and the segment's name. Each node refers to a prefix of one of the input paths rather than storing a copy.
+*/
+typedef struct mfs_mkdir_many_state mfs_mkdir_many_state;
+typedef struct mfs_mkdir_many_node  mfs_mkdir_many_node;
+
+struct mfs_mkdir_many_node
+{
+    mfs_job job;                        /* Must be the first member. */
+    mfs_mkdir_many_state* pState;
+    mfs_mkdir_many_node* pParent;
+    mfs_mkdir_many_node* pFirstChild;
+    mfs_mkdir_many_node* pNextSibling;
+    const char* pPath;                  /* Points into one of the input paths. Not null terminated. */
+    size_t pathLen;                     /* The length of the prefix of pPath that makes up this node's path. */
+    size_t segmentOffset;               /* The node's name is the part of the path from here up to pathLen. */
+    mfs_bool32 exists;                  /* Set for the root of the trie and for root directories. These are never created. */
+};
+
+struct mfs_mkdir_many_state
+{
+    mfs_mkdir_many_config config;
+    mfs_worker_pool pool;
+    mfs_mutex lock;                     /* For result and onError(). */
+    mfs_result result;                  /* The first error that occurred. */
+    mfs_mkdir_many_node root;
+    mfs_mkdir_many_node* pNodes;        /* Allocated up front. There can't be more nodes than there are segments. */
+    size_t nodeCount;
+    mfs_mkdir_many_node** ppBuckets;
+    size_t bucketCount;                 /* Always a power of two. */
+};
+
+static mfs_uint32 mfs_mkdir_many_hash(const mfs_mkdir_many_node* pParent, const char* pName, size_t nameLen)
+{
+    /* FNV-1a over the name, seeded with the parent's address. */
+    mfs_uint32 hash = 2166136261u ^ (mfs_uint32)((size_t)pParent >> 4);
+    size_t i;
+
+    for (i = 0; i < nameLen; i += 1) {
+        hash ^= (mfs_uint8)pName[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static mfs_mkdir_many_node* mfs_mkdir_many_insert(mfs_mkdir_many_state* pState, mfs_mkdir_many_node* pParent, const char* pPath, size_t segmentOffset, size_t pathLen)
+{
+    const char* pName = pPath + segmentOffset;
+    size_t nameLen = pathLen - segmentOffset;
+    size_t iBucket;
+    mfs_mkdir_many_node* pNode;
+
+    iBucket = mfs_mkdir_many_hash(pParent, pName, nameLen) & (pState->bucketCount - 1);
+    for (;;) {
+        pNode = pState->ppBuckets[iBucket];
+        if (pNode == NULL) {
+            break;
+        }
+
+        if (pNode->pParent == pParent && pNode->pathLen - pNode->segmentOffset == nameLen && memcmp(pNode->pPath + pNode->segmentOffset, pName, nameLen) == 0) {
+            return pNode;   /* Already in the trie. */
+        }
+
+        iBucket = (iBucket + 1) & (pState->bucketCount - 1);
+    }
+
+    MFS_ASSERT(pState->nodeCount < pState->bucketCount);
+
+    pNode = &pState->pNodes[pState->nodeCount];
+    pState->nodeCount += 1;
+
+    MFS_ZERO_OBJECT(pNode);
+    pNode->pState        = pState;
+    pNode->pParent       = pParent;
+    pNode->pPath         = pPath;
+    pNode->pathLen       = pathLen;
+    pNode->segmentOffset = segmentOffset;
+    pNode->pNextSibling  = pParent->pFirstChild;
+    pParent->pFirstChild = pNode;
+
+    pState->ppBuckets[iBucket] = pNode;
+
+    return pNode;
+}
+
+static void mfs_mkdir_many_report_error(mfs_mkdir_many_state* pState, const char* pPath, mfs_result result)
+{
+    mfs_mutex_lock(&pState->lock);
+    {
+        if (pState->result == MFS_SUCCESS) {
+            pState->result = result;
+        }
+
+        if (pState->config.onError != NULL) {
+            pState->config.onError(pState->config.pUserData, pPath, result);
+        }
+    }
+    mfs_mutex_unlock(&pState->lock);
+}
+
+static mfs_bool32 mfs_mkdir_many_create(mfs_mkdir_many_node* pNode)
+{
+    mfs_result result;
+    char pathStack[256];
+    char* pPath;
+
+    if (pNode->exists) {
+        return MFS_TRUE;
+    }
+
+    mfs_throttle_acquire(pNode->pState->config.pThrottle, 0, 1);
+
+    if (pNode->pathLen < sizeof(pathStack)) {
+        pPath = pathStack;
+    } else {
+        pPath = (char*)MFS_MALLOC(pNode->pathLen + 1);
+        if (pPath == NULL) {
+            mfs_mkdir_many_report_error(pNode->pState, "", MFS_OUT_OF_MEMORY);
+            return MFS_FALSE;
+        }
+    }
+
+    MFS_COPY_MEMORY(pPath, pNode->pPath, pNode->pathLen);
+    pPath[pNode->pathLen] = '\0';
+
+    /*
+    Parents are always created before their children so there's no need to walk back up like mfs_mkdir(). An existing directory is
+    only checked when this is a leaf. If anything else is in the way of a node with children, creating the children will fail.
+    */
+    result = mfs_mkdir_single(pPath);
+    if (result == MFS_ALREADY_EXISTS) {
+        if (pNode->pFirstChild != NULL || mfs_is_directory(pPath)) {
+            result = MFS_SUCCESS;
+        } else {
+            result = MFS_INVALID_OPERATION; /* The path refers to a file. */
+        }
+    }
+
+    if (result != MFS_SUCCESS) {
+        mfs_mkdir_many_report_error(pNode->pState, pPath, result);
+    }
+
+    if (pPath != pathStack) {
+        MFS_FREE(pPath);
+    }
+
+    return result == MFS_SUCCESS;
+}
+
+static void mfs_mkdir_many_process(mfs_job* pJob)
+{
+    mfs_mkdir_many_node* pNode = (mfs_mkdir_many_node*)pJob;
+    mfs_mkdir_many_node* pChild;
+
+    if (mfs_mkdir_many_create(pNode) == MFS_FALSE) {
+        return; /* No point trying to create the children. */
+    }
+
+    /* Each subtree is independent once its root exists so they are posted to the pool. Leaves are created right away. */
+    for (pChild = pNode->pFirstChild; pChild != NULL; pChild = pChild->pNextSibling) {
+        if (pChild->pFirstChild != NULL) {
+            pChild->job.onProcess = mfs_mkdir_many_process;
+            mfs_worker_pool_post(&pNode->pState->pool, &pChild->job);
+        } else {
+            mfs_mkdir_many_create(pChild);
+        }
+    }
+}
+
+mfs_result mfs_mkdir_many_ex(const char** ppDirectories, size_t count, const mfs_mkdir_many_config* pConfig)
+{
+    mfs_result result;
+    mfs_mkdir_many_state state;
+    mfs_path_iterator iterator;
+    size_t segmentCount;
+    size_t iDirectory;
+
+    if (ppDirectories == NULL && count > 0) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(&state);
+    if (pConfig != NULL) {
+        state.config = *pConfig;
+    } else {
+        state.config = mfs_mkdir_many_config_init();
+    }
+
+    /* First pass is to count the segments so everything can be allocated in one go. */
+    segmentCount = 0;
+    for (iDirectory = 0; iDirectory < count; iDirectory += 1) {
+        if (ppDirectories[iDirectory] == NULL) {
+            return MFS_INVALID_ARGS;
+        }
+
+        if (mfs_path_first_segment(ppDirectories[iDirectory], &iterator) == MFS_SUCCESS) {
+            do {
+                segmentCount += 1;
+            } while (mfs_path_next_segment(&iterator) == MFS_SUCCESS);
+        }
+    }
+
+    if (segmentCount == 0) {
+        return MFS_SUCCESS;
+    }
+
+    state.bucketCount = 16;
+    while (state.bucketCount < segmentCount * 2) {
+        state.bucketCount *= 2;
+    }
+
+    state.pNodes = (mfs_mkdir_many_node*)MFS_MALLOC(sizeof(*state.pNodes) * segmentCount + sizeof(*state.ppBuckets) * state.bucketCount);
+    if (state.pNodes == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    state.ppBuckets = (mfs_mkdir_many_node**)(state.pNodes + segmentCount);
+    MFS_ZERO_MEMORY(state.ppBuckets, sizeof(*state.ppBuckets) * state.bucketCount);
+
+    state.root.pState = &state;
+    state.root.exists = MFS_TRUE;
+
+    /* Second pass builds the trie. */
+    for (iDirectory = 0; iDirectory < count; iDirectory += 1) {
+        const char* pDirectory = ppDirectories[iDirectory];
+        mfs_mkdir_many_node* pNode = &state.root;
+        mfs_bool32 isFirst = MFS_TRUE;
+
+        if (mfs_path_first_segment(pDirectory, &iterator) != MFS_SUCCESS) {
+            continue;   /* Empty path. Treated as the current directory which must already exist. */
+        }
+
+        do {
+            pNode = mfs_mkdir_many_insert(&state, pNode, pDirectory, iterator.segment.offset, iterator.segment.offset + iterator.segment.length);
+
+            /* The first segment of an absolute path is the root, or a drive on Windows, which can't be created. */
+            if (isFirst && mfs_path_is_absolute(pDirectory)) {
+                pNode->exists = MFS_TRUE;
+            }
+
+            isFirst = MFS_FALSE;
+        } while (mfs_path_next_segment(&iterator) == MFS_SUCCESS);
+    }
+
+    result = mfs_worker_pool_init(state.config.threadCount, (state.config.pThrottle != NULL) ? state.config.pThrottle->config.ioPriority : MFS_IO_PRIORITY_DEFAULT, &state.pool);
+    if (result != MFS_SUCCESS) {
+        MFS_FREE(state.pNodes);
+        return result;
+    }
+
+    mfs_mutex_init(&state.lock);
+
+    state.root.job.onProcess = mfs_mkdir_many_process;
+    mfs_worker_pool_post(&state.pool, &state.root.job);
+    mfs_worker_pool_wait(&state.pool);
+    mfs_worker_pool_uninit(&state.pool);
+
+    mfs_mutex_uninit(&state.lock);
+    MFS_FREE(state.pNodes);
+
+    return state.result;
+}
+
+mfs_result mfs_mkdir_many(const char** ppDirectories, size_t count)
+{
+    return mfs_mkdir_many_ex(ppDirectories, count, NULL);
+}
+
+mfs_result mfs_rmdir(const char* pDirectory, mfs_bool32 recursive)
+{
+    if (pDirectory == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (mfs_is_directory(pDirectory) == MFS_FALSE) {
+        return MFS_NOT_DIRECTORY;
+    }
+
+    if (recursive) {
+        mfs_result result = mfs_rmdir_content(pDirectory);
+        if (result != MFS_SUCCESS) {
+            return result;  /* Failed to delete the content of the directory. */
+        }
+    }
+
+    return mfs_delete_file(pDirectory);
+}
+
+mfs_rmdir_content_config mfs_rmdir_content_config_init(void)
+{
+    mfs_rmdir_content_config config;
+
+    MFS_ZERO_OBJECT(&config);
+
+    return config;
+}
+
+#if defined(MFS_POSIX) && defined(AT_REMOVEDIR) && defined(O_DIRECTORY) && defined(O_NOFOLLOW)
+    #define MFS_RMDIR_CONTENT_AT
+#endif
+
+typedef struct
+{
+    mfs_rmdir_content_config config;
+    const char* pDirectory;
+    mfs_mutex lock;                 /* For everything below, onError(), and the reference counts and error flags of each node. */
+    mfs_result result;              /* The first error that occurred. */
+    mfs_rmdir_content_stats stats;
+    mfs_worker_pool pool;
+    mfs_uint32 postedCount;         /* The number of directories posted to the pool that have not yet been removed. */
+} mfs_rmdir_content_state;
+
+static void mfs_rmdir_content_report_error_by_path(mfs_rmdir_content_state* pState, const char* pPath, mfs_result result)
+{
+    /* Must be called while the lock is held. */
+    if (pState->result == MFS_SUCCESS) {
+        pState->result = result;
+    }
+
+    pState->stats.errorCount += 1;
+
+    if (pState->config.onError != NULL) {
+        pState->config.onError(pState->config.pUserData, pPath, result);
+    }
+}
+
+static void mfs_rmdir_content_add_stats(mfs_rmdir_content_state* pState, const mfs_rmdir_content_stats* pStats)
+{
+    mfs_mutex_lock(&pState->lock);
+    {
+        pState->stats.fileCount      += pStats->fileCount;
+        pState->stats.directoryCount += pStats->directoryCount;
+    }
+    mfs_mutex_unlock(&pState->lock);
+}
+
+#if defined(MFS_RMDIR_CONTENT_AT)
+#if !defined(O_CLOEXEC)
+#define O_CLOEXEC 0
+#endif
+
+/*
+Each directory is opened relative to its parent and its entries are deleted relative to it, so no full paths are ever built and the
+kernel never needs to resolve more than one path component. A directory stays open until all of its child directories have been
+removed, at which point it is closed and removed from its own parent.
+
+Child directories are posted to the worker pool so that subtrees are deleted in parallel. Each posted directory holds a file
+descriptor until it's removed, so the number of posted directories is capped. Beyond that, child directories are deleted recursively
+on the current thread which only holds one descriptor per level.
+*/
+#define MFS_RMDIR_CONTENT_MAX_POSTED_DIRECTORIES    256
+
+typedef struct mfs_rmdir_content_node mfs_rmdir_content_node;
+struct mfs_rmdir_content_node
+{
+    mfs_job job;                        /* Must be the first member. Only used if the node is posted to the worker pool. */
+    mfs_rmdir_content_state* pState;
+    mfs_rmdir_content_node* pParent;    /* NULL for the root directory. */
+    DIR* pDir;                          /* NULL if the directory could not be opened. */
+    mfs_uint32 refCount;                /* One for the enumeration of this directory, plus one for each child directory that has not yet been removed. */
+    mfs_bool32 isPosted;
+    mfs_bool32 hasErrors;               /* Set when something in this directory could not be deleted, in which case the directory itself will not be removed. */
+    char* pName;                        /* Points to the memory immediately after this structure. */
+};
+
+static void mfs_rmdir_content_at_report_error(mfs_rmdir_content_state* pState, mfs_rmdir_content_node* pNode, const char* pName, mfs_result result)
+{
+    /* The path is only built when there's someone to report it to. */
+    char* pPath = NULL;
+
+    if (pState->config.onError != NULL) {
+        size_t pathLen = strlen(pState->pDirectory);
+        mfs_rmdir_content_node* pAncestor;
+        char* pCursor;
+
+        for (pAncestor = pNode; pAncestor->pParent != NULL; pAncestor = pAncestor->pParent) {
+            pathLen += 1 + strlen(pAncestor->pName);
+        }
+
+        if (pName != NULL) {
+            pathLen += 1 + strlen(pName);
+        }
+
+        pPath = (char*)MFS_MALLOC(pathLen + 1);
+        if (pPath != NULL) {
+            /* Fill from the end. */
+            pCursor = pPath + pathLen;
+            *pCursor = '\0';
+
+            if (pName != NULL) {
+                pCursor -= strlen(pName);
+                MFS_COPY_MEMORY(pCursor, pName, strlen(pName));
+                *(--pCursor) = '/';
+            }
+
+            for (pAncestor = pNode; pAncestor->pParent != NULL; pAncestor = pAncestor->pParent) {
+                pCursor -= strlen(pAncestor->pName);
+                MFS_COPY_MEMORY(pCursor, pAncestor->pName, strlen(pAncestor->pName));
+                *(--pCursor) = '/';
+            }
+
+            MFS_COPY_MEMORY(pPath, pState->pDirectory, strlen(pState->pDirectory));
+        }
+    }
+
+    mfs_mutex_lock(&pState->lock);
+    {
+        pNode->hasErrors = MFS_TRUE;
+        mfs_rmdir_content_report_error_by_path(pState, (pPath != NULL) ? pPath : pState->pDirectory, result);
+    }
+    mfs_mutex_unlock(&pState->lock);
+
+    MFS_FREE(pPath);
+}
+
+static void mfs_rmdir_content_at_release(mfs_rmdir_content_node* pNode, mfs_rmdir_content_stats* pStats)
+{
+    mfs_rmdir_content_state* pState = pNode->pState;
+
+    while (pNode != NULL) {
+        mfs_rmdir_content_node* pParent = pNode->pParent;
+        mfs_uint32 refCount;
+        mfs_bool32 hasErrors;
+
+        mfs_mutex_lock(&pState->lock);
+        {
+            MFS_ASSERT(pNode->refCount > 0);
+            pNode->refCount -= 1;
+            refCount  = pNode->refCount;
+            hasErrors = pNode->hasErrors;
+
+            if (refCount == 0 && pNode->isPosted) {
+                pState->postedCount -= 1;
+            }
+        }
+        mfs_mutex_unlock(&pState->lock);
+
+        if (refCount > 0) {
+            return; /* Something is still deleting the content of this directory. */
+        }
+
+        if (pNode->pDir != NULL) {
+            closedir(pNode->pDir);
+        }
+
+        if (pParent != NULL) {
+            if (hasErrors) {
+                /* The directory is not empty so there's no point trying to remove it. Propagate the failure so the parent doesn't try either. */
+                mfs_mutex_lock(&pState->lock);
+                {
+                    pParent->hasErrors = MFS_TRUE;
+                }
+                mfs_mutex_unlock(&pState->lock);
+            } else {
+                mfs_throttle_acquire(pState->config.pThrottle, 0, 1);
+
+                if (unlinkat(dirfd(pParent->pDir), pNode->pName, AT_REMOVEDIR) == 0) {
+                    pStats->directoryCount += 1;
+                } else if (errno != ENOENT) {
+                    mfs_rmdir_content_at_report_error(pState, pParent, pNode->pName, mfs_result_from_errno(errno));
+                }
+            }
+        }
+
+        MFS_FREE(pNode);
+        pNode = pParent;
+    }
+}
+
+static void mfs_rmdir_content_at_process(mfs_rmdir_content_node* pNode, mfs_rmdir_content_stats* pStats);
+
+static void mfs_rmdir_content_at_process_job(mfs_job* pJob)
+{
+    mfs_rmdir_content_node* pNode = (mfs_rmdir_content_node*)pJob;
+    mfs_rmdir_content_state* pState = pNode->pState;
+    mfs_rmdir_content_stats stats;
+
+    MFS_ZERO_OBJECT(&stats);
+
+    mfs_rmdir_content_at_process(pNode, &stats);
+    mfs_rmdir_content_at_release(pNode, &stats);
+
+    /* Stats are accumulated locally and added in one go to avoid locking for every file. */
+    mfs_rmdir_content_add_stats(pState, &stats);
+}
+
+static void mfs_rmdir_content_at_process(mfs_rmdir_content_node* pNode, mfs_rmdir_content_stats* pStats)
+{
+    mfs_rmdir_content_state* pState = pNode->pState;
+    struct dirent* pEntry;
+    int fd;
+
+    /* The root directory is opened by the caller. */
+    if (pNode->pDir == NULL) {
+        fd = openat(dirfd(pNode->pParent->pDir), pNode->pName, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd >= 0) {
+            pNode->pDir = fdopendir(fd);
+            if (pNode->pDir == NULL) {
+                close(fd);
+            }
+        }
+
+        if (pNode->pDir == NULL) {
+            mfs_rmdir_content_at_report_error(pState, pNode->pParent, pNode->pName, mfs_result_from_errno(errno));
+            pNode->hasErrors = MFS_TRUE;    /* Nothing else references this node yet so no need to lock. */
+            return;
+        }
+    }
+
+    fd = dirfd(pNode->pDir);
+
+    for (;;) {
+        mfs_bool32 isDirectory;
+        mfs_rmdir_content_node* pChild;
+        size_t nameLen;
+
+        errno = 0;
+        pEntry = readdir(pNode->pDir);
+        if (pEntry == NULL) {
+            if (errno != 0) {
+                mfs_rmdir_content_at_report_error(pState, pNode, NULL, mfs_result_from_errno(errno));
+            }
+
+            break;
+        }
+
+        if (pEntry->d_name[0] == '.' && (pEntry->d_name[1] == '\0' || (pEntry->d_name[1] == '.' && pEntry->d_name[2] == '\0'))) {
+            continue;   /* "." or "..". */
+        }
+
+        /* Symbolic links are never followed. They are deleted like any other file. */
+    #if defined(DT_UNKNOWN)
+        if (pEntry->d_type != DT_UNKNOWN) {
+            isDirectory = pEntry->d_type == DT_DIR;
+        } else
     #endif
-    #ifdef EINPROGRESS
-        case EINPROGRESS: return MFS_IN_PROGRESS;
+        {
+            struct stat info;
+            if (fstatat(fd, pEntry->d_name, &info, AT_SYMLINK_NOFOLLOW) != 0) {
+                if (errno != ENOENT) {
+                    mfs_rmdir_content_at_report_error(pState, pNode, pEntry->d_name, mfs_result_from_errno(errno));
+                }
+
+                continue;
+            }
+
+            isDirectory = S_ISDIR(info.st_mode);
+        }
+
+        if (isDirectory == MFS_FALSE) {
+            mfs_throttle_acquire(pState->config.pThrottle, 0, 1);
+
+            if (unlinkat(fd, pEntry->d_name, 0) == 0) {
+                pStats->fileCount += 1;
+            } else if (errno != ENOENT) {
+                mfs_rmdir_content_at_report_error(pState, pNode, pEntry->d_name, mfs_result_from_errno(errno));
+            }
+
+            continue;
+        }
+
+        nameLen = strlen(pEntry->d_name);
+
+        pChild = (mfs_rmdir_content_node*)MFS_MALLOC(sizeof(*pChild) + nameLen + 1);
+        if (pChild == NULL) {
+            mfs_rmdir_content_at_report_error(pState, pNode, pEntry->d_name, MFS_OUT_OF_MEMORY);
+            continue;
+        }
+
+        MFS_ZERO_OBJECT(pChild);
+        pChild->pState   = pState;
+        pChild->pParent  = pNode;
+        pChild->refCount = 1;
+        pChild->pName    = (char*)(pChild + 1);
+        MFS_COPY_MEMORY(pChild->pName, pEntry->d_name, nameLen + 1);
+
+        mfs_mutex_lock(&pState->lock);
+        {
+            pNode->refCount += 1;
+
+            if (pState->postedCount < MFS_RMDIR_CONTENT_MAX_POSTED_DIRECTORIES) {
+                pState->postedCount += 1;
+                pChild->isPosted = MFS_TRUE;
+            }
+        }
+        mfs_mutex_unlock(&pState->lock);
+
+        if (pChild->isPosted) {
+            pChild->job.onProcess = mfs_rmdir_content_at_process_job;
+            mfs_worker_pool_post(&pState->pool, &pChild->job);
+        } else {
+            mfs_rmdir_content_at_process(pChild, pStats);
+            mfs_rmdir_content_at_release(pChild, pStats);
+        }
+    }
+}
+
+static mfs_result mfs_rmdir_content_at(mfs_rmdir_content_state* pState)
+{
+    mfs_result result;
+    mfs_rmdir_content_node* pRoot;
+    mfs_rmdir_content_stats stats;
+    DIR* pDir;
+    int fd;
+
+    fd = open(pState->pDirectory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return mfs_result_from_errno(errno);
+    }
+
+    pDir = fdopendir(fd);
+    if (pDir == NULL) {
+        result = mfs_result_from_errno(errno);
+        close(fd);
+        return result;
+    }
+
+    pRoot = (mfs_rmdir_content_node*)MFS_MALLOC(sizeof(*pRoot) + 1);
+    if (pRoot == NULL) {
+        closedir(pDir);
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    result = mfs_worker_pool_init(pState->config.threadCount, (pState->config.pThrottle != NULL) ? pState->config.pThrottle->config.ioPriority : MFS_IO_PRIORITY_DEFAULT, &pState->pool);
+    if (result != MFS_SUCCESS) {
+        MFS_FREE(pRoot);
+        closedir(pDir);
+        return result;
+    }
+
+    MFS_ZERO_OBJECT(pRoot);
+    pRoot->pState   = pState;
+    pRoot->pDir     = pDir;
+    pRoot->refCount = 1;
+    pRoot->pName    = (char*)(pRoot + 1);
+    pRoot->pName[0] = '\0';
+
+    MFS_ZERO_OBJECT(&stats);
+
+    /* The root is enumerated on this thread. The worker threads will pick up subdirectories as they are found. */
+    mfs_rmdir_content_at_process(pRoot, &stats);
+    mfs_rmdir_content_at_release(pRoot, &stats);   /* <-- The root will be freed by whichever thread removes its last child directory. */
+    mfs_rmdir_content_add_stats(pState, &stats);
+
+    mfs_worker_pool_wait(&pState->pool);
+    mfs_worker_pool_uninit(&pState->pool);
+
+    return MFS_SUCCESS;
+}
+#endif
+
+#if !defined(MFS_RMDIR_CONTENT_AT)
+static void mfs_rmdir_content_by_path(mfs_rmdir_content_state* pState, mfs_path_buf* pPath)
+{
+    /*
+    This is the fallback for platforms without the *at() family of functions. It is single threaded.
+
+    pPath is the directory. Each entry is pushed onto the end of it and recursing into a subdirectory pushes more, so the whole tree
+    is walked with the one buffer. It's restored to the directory before returning.
+    */
+    mfs_result result;
+    mfs_iterator iterator;
+    mfs_file_info fi;
+    mfs_rmdir_content_stats stats;
+    size_t directoryLength = pPath->length;
+
+    MFS_ZERO_OBJECT(&stats);
+
+    result = mfs_iterator_init(pPath->pPath, &iterator);
+    if (result != MFS_SUCCESS) {
+        mfs_mutex_lock(&pState->lock);
+        {
+            mfs_rmdir_content_report_error_by_path(pState, pPath->pPath, result);
+        }
+        mfs_mutex_unlock(&pState->lock);
+        return;
+    }
+
+    while (mfs_iterator_next(&iterator, &fi) == MFS_SUCCESS) {
+        if (fi.pFileName[0] == '.' && (fi.pFileName[1] == '\0' || (fi.pFileName[1] == '.' && fi.pFileName[2] == '\0'))) {
+            continue;   /* "." or "..". */
+        }
+
+        result = mfs_path_buf_push_segment(pPath, fi.pFileName);
+        if (result != MFS_SUCCESS) {
+            mfs_mutex_lock(&pState->lock);
+            {
+                mfs_rmdir_content_report_error_by_path(pState, pPath->pPath, result);
+            }
+            mfs_mutex_unlock(&pState->lock);
+            continue;
+        }
+
+        if (fi.isDirectory) {
+            mfs_rmdir_content_by_path(pState, pPath);
+        }
+
+        mfs_throttle_acquire(pState->config.pThrottle, 0, 1);
+
+        result = mfs_delete_file(pPath->pPath);
+        if (result == MFS_SUCCESS) {
+            if (fi.isDirectory) {
+                stats.directoryCount += 1;
+            } else {
+                stats.fileCount += 1;
+            }
+        } else {
+            mfs_mutex_lock(&pState->lock);
+            {
+                mfs_rmdir_content_report_error_by_path(pState, pPath->pPath, result);
+            }
+            mfs_mutex_unlock(&pState->lock);
+        }
+
+        mfs_path_buf_truncate(pPath, directoryLength);
+    }
+
+    mfs_iterator_uninit(&iterator);
+
+    mfs_rmdir_content_add_stats(pState, &stats);
+}
+#endif
+
+mfs_result mfs_rmdir_content_ex(const char* pDirectory, const mfs_rmdir_content_config* pConfig, mfs_rmdir_content_stats* pStats)
+{
+    mfs_rmdir_content_state state;
+
+    if (pStats != NULL) {
+        MFS_ZERO_OBJECT(pStats);
+    }
+
+    if (pDirectory == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(&state);
+    if (pConfig != NULL) {
+        state.config = *pConfig;
+    } else {
+        state.config = mfs_rmdir_content_config_init();
+    }
+
+    state.pDirectory = pDirectory;
+    mfs_mutex_init(&state.lock);
+
+#if defined(MFS_RMDIR_CONTENT_AT)
+    {
+        mfs_result result = mfs_rmdir_content_at(&state);
+        if (result != MFS_SUCCESS) {
+            mfs_mutex_uninit(&state.lock);
+            return result;  /* Failed to open the directory. */
+        }
+    }
+#else
+    if (mfs_is_directory(pDirectory) == MFS_FALSE) {
+        mfs_mutex_uninit(&state.lock);
+        return MFS_NOT_DIRECTORY;
+    }
+
+    {
+        mfs_path_buf path;
+        mfs_result result;
+
+        result = mfs_path_buf_init(&path, pDirectory);
+        if (result != MFS_SUCCESS) {
+            mfs_path_buf_uninit(&path);
+            mfs_mutex_uninit(&state.lock);
+            return result;
+        }
+
+        mfs_rmdir_content_by_path(&state, &path);
+        mfs_path_buf_uninit(&path);
+    }
+#endif
+
+    mfs_mutex_uninit(&state.lock);
+
+    if (pStats != NULL) {
+        *pStats = state.stats;
+    }
+
+    return state.result;
+}
+
+mfs_result mfs_rmdir_content(const char* pDirectory)
+{
+    return mfs_rmdir_content_ex(pDirectory, NULL, NULL);
+}
+
+
+#if defined(MFS_WIN32)
+mfs_bool32 mfs_is_directory__win32(const char* pPath)
+{
+    DWORD attributes;
+
+    MFS_ASSERT(pPath != NULL);
+
+    attributes = GetFileAttributesA(pPath);
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+}
+
+mfs_bool32 mfs_file_exists__win32(const char* pFilePath)
+{
+    DWORD attributes;
+
+    MFS_ASSERT(pFilePath != NULL);
+
+    attributes = GetFileAttributesA(pFilePath);
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0;
+}
+
+typedef struct
+{
+    mfs_throttle* pThrottle;
+    mfs_uint64 bytesCopied;
+} mfs_copy_file_progress__win32;
+
+static DWORD CALLBACK mfs_copy_file_progress_routine__win32(LARGE_INTEGER totalFileSize, LARGE_INTEGER totalBytesTransferred, LARGE_INTEGER streamSize, LARGE_INTEGER streamBytesTransferred, DWORD streamNumber, DWORD callbackReason, HANDLE hSourceFile, HANDLE hDestinationFile, LPVOID lpData)
+{
+    mfs_copy_file_progress__win32* pProgress = (mfs_copy_file_progress__win32*)lpData;
+
+    (void)totalFileSize;
+    (void)streamSize;
+    (void)streamBytesTransferred;
+    (void)streamNumber;
+    (void)callbackReason;
+    (void)hSourceFile;
+    (void)hDestinationFile;
+
+    /* Blocking inside the progress routine is what throttles the copy. */
+    if ((mfs_uint64)totalBytesTransferred.QuadPart > pProgress->bytesCopied) {
+        mfs_throttle_acquire(pProgress->pThrottle, (mfs_uint64)totalBytesTransferred.QuadPart - pProgress->bytesCopied, 0);
+        pProgress->bytesCopied = (mfs_uint64)totalBytesTransferred.QuadPart;
+    }
+
+    return PROGRESS_CONTINUE;
+}
+
+static mfs_result mfs_hash_file_range__win32(const char* pFilePath, mfs_uint64 offset, mfs_uint64 size, mfs_throttle* pThrottle, mfs_hasher* pHasher)
+{
+    mfs_result result = MFS_SUCCESS;
+    HANDLE hFile;
+    LARGE_INTEGER position;
+    void* pBuffer;
+    DWORD bytesToRead;
+    DWORD bytesRead;
+
+    pBuffer = MFS_MALLOC(MFS_HASH_BUFFER_SIZE);
+    if (pBuffer == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    hFile = CreateFileA(pFilePath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        MFS_FREE(pBuffer);
+        return mfs_result_from_GetLastError(GetLastError());
+    }
+
+    position.QuadPart = (LONGLONG)offset;
+    if (offset > 0 && !SetFilePointerEx(hFile, position, NULL, FILE_BEGIN)) {
+        result = mfs_result_from_GetLastError(GetLastError());
+    }
+
+    while (result == MFS_SUCCESS && size > 0) {
+        bytesToRead = (size < MFS_HASH_BUFFER_SIZE) ? (DWORD)size : MFS_HASH_BUFFER_SIZE;
+
+        if (!ReadFile(hFile, pBuffer, bytesToRead, &bytesRead, NULL)) {
+            result = mfs_result_from_GetLastError(GetLastError());
+            break;
+        }
+
+        if (bytesRead == 0) {
+            break;  /* End of file. */
+        }
+
+        mfs_hasher_update(pHasher, pBuffer, bytesRead);
+        mfs_throttle_acquire(pThrottle, bytesRead, 0);
+
+        if (size != MFS_HASH_TO_END) {
+            size -= bytesRead;
+        }
+    }
+
+    CloseHandle(hFile);
+    MFS_FREE(pBuffer);
+
+    return result;
+}
+
+mfs_result mfs_copy_file_ex__win32(const char* pSrcFilePath, const char* pDstFilePath, const mfs_copy_file_config* pConfig, mfs_hasher* pHasher)
+{
+    /*
+    CopyFile() always preserves attributes and times, and will use the most efficient copying method available. There is no way to
+    see the data as it goes past so when hashing, the source is read again after the copy.
+    */
+    BOOL result;
+
+    if (pConfig->pThrottle != NULL) {
+        mfs_copy_file_progress__win32 progress;
+        progress.pThrottle   = pConfig->pThrottle;
+        progress.bytesCopied = 0;
+
+        mfs_throttle_acquire(pConfig->pThrottle, 0, 1);
+        result = CopyFileExA(pSrcFilePath, pDstFilePath, mfs_copy_file_progress_routine__win32, &progress, NULL, ((pConfig->flags & MFS_COPY_FLAG_FAIL_IF_EXISTS) != 0) ? COPY_FILE_FAIL_IF_EXISTS : 0);
+    } else {
+        result = CopyFileA(pSrcFilePath, pDstFilePath, (pConfig->flags & MFS_COPY_FLAG_FAIL_IF_EXISTS) != 0);
+    }
+
+    if (result && (pConfig->flags & MFS_COPY_FLAG_SYNC) != 0) {
+        HANDLE hFile = CreateFileA(pDstFilePath, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            return mfs_result_from_GetLastError(GetLastError());
+        }
+
+        result = FlushFileBuffers(hFile);
+        CloseHandle(hFile);
+    }
+
+    if (!result) {
+        return mfs_result_from_GetLastError(GetLastError());
+    }
+
+    if (pHasher != NULL) {
+        return mfs_hash_file_range__win32(pSrcFilePath, 0, MFS_HASH_TO_END, pConfig->pThrottle, pHasher);
+    }
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_move_file__win32(const char* pSrcFilePath, const char* pDstFilePath, mfs_bool32 failIfExists)
+{
+    DWORD dwFlags;
+    BOOL result;
+
+    dwFlags = MOVEFILE_COPY_ALLOWED | MOVEFILE_WRITE_THROUGH;  /* Write-through ensures the copy is flushed before the source is deleted when moving across volumes. */
+    if (failIfExists == MFS_FALSE) {
+        dwFlags |= MOVEFILE_REPLACE_EXISTING;
+    }
+
+    result = MoveFileExA(pSrcFilePath, pDstFilePath, dwFlags);
+    if (result) {
+        return MFS_SUCCESS;
+    }
+
+    return mfs_result_from_GetLastError(GetLastError());
+}
+
+mfs_result mfs_delete_file__win32(const char* pFilePath)
+{
+    BOOL wasSuccessful;
+    DWORD attributes;
+
+    attributes = GetFileAttributesA(pFilePath);
+    if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+        wasSuccessful = DeleteFileA(pFilePath);
+    } else {
+        wasSuccessful = RemoveDirectoryA(pFilePath);
+    }
+
+    if (wasSuccessful) {
+        return MFS_SUCCESS;
+    }
+
+    return mfs_result_from_GetLastError(GetLastError());
+}
+#endif
+
+#if defined(MFS_POSIX)
+mfs_bool32 mfs_is_directory__posix(const char* pPath)
+{
+    struct stat info;
+
+    MFS_ASSERT(pPath != NULL);
+
+    if (stat(pPath, &info) != 0) {
+        return MFS_FALSE;   /* Likely the folder doesn't exist. */
+    }
+
+    return (info.st_mode & S_IFDIR) != 0;
+}
+
+mfs_bool32 mfs_file_exists__posix(const char* pFilePath)
+{
+    struct stat info;
+
+    MFS_ASSERT(pFilePath != NULL);
+    
+    if (stat(pFilePath, &info) != 0) {
+        return MFS_FALSE;   /* Likely the file doesn't exist. */
+    }
+
+    return (info.st_mode & S_IFDIR) == 0;
+}
+
+#if defined(MFS_LINUX) && !defined(FICLONE)
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+#if defined(MFS_APPLE)
+    #define MFS_STAT_ATIM(info) (info).st_atimespec
+    #define MFS_STAT_MTIM(info) (info).st_mtimespec
+#else
+    #define MFS_STAT_ATIM(info) (info).st_atim
+    #define MFS_STAT_MTIM(info) (info).st_mtim
+#endif
+
+#if defined(MFS_HAS_SYSCALL)
+static mfs_bool32 mfs_is_zero_copy_unsupported__posix(int e)
+{
+    /* These are the errors that indicate the kernel or file system does not support the zero-copy method, in which case we fall back to the next one. */
+    return e == ENOSYS || e == EXDEV || e == EINVAL || e == EOPNOTSUPP || e == ENOTTY || e == EBADF;
+}
+#endif
+
+static mfs_result mfs_write_all__posix(int fd, const void* pData, size_t dataSize)
+{
+    size_t totalBytesWritten = 0;
+
+    while (totalBytesWritten < dataSize) {
+        ssize_t bytesWritten = write(fd, (const char*)pData + totalBytesWritten, dataSize - totalBytesWritten);
+        if (bytesWritten < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return mfs_result_from_errno(errno);
+        }
+
+        totalBytesWritten += (size_t)bytesWritten;
+    }
+
+    return MFS_SUCCESS;
+}
+
+static mfs_result mfs_copy_mapped_fd_data__posix(int inFd, int outFd, mfs_uint64 sizeInBytes, const mfs_copy_file_config* pConfig, mfs_hasher* pHasher, mfs_bool32* pIsMapped)
+{
+    /*
+    Hashes the source through a memory mapping, writing it out to outFd from the same mapping if outFd is not -1. This avoids the
+    extra copy into an intermediary buffer. If the file cannot be mapped, *pIsMapped will be set to false and nothing will have been
+    written so the caller can fall back to the read/write loop.
+    */
+    mfs_result res = MFS_SUCCESS;
+    const mfs_uint8* pMappedData;
+    size_t chunkSize = 1048576;
+    mfs_uint64 offset;
+
+    *pIsMapped = MFS_FALSE;
+
+    if (sizeInBytes > (mfs_uint64)((size_t)-1)) {
+        return MFS_SUCCESS; /* Too big to map on a 32-bit build. */
+    }
+
+    pMappedData = (const mfs_uint8*)mmap(NULL, (size_t)sizeInBytes, PROT_READ, MAP_SHARED, inFd, 0);
+    if (pMappedData == (const mfs_uint8*)MAP_FAILED) {
+        return MFS_SUCCESS;
+    }
+
+    *pIsMapped = MFS_TRUE;
+
+#if defined(MADV_SEQUENTIAL)
+    madvise((void*)pMappedData, (size_t)sizeInBytes, MADV_SEQUENTIAL);
+#endif
+
+    for (offset = 0; offset < sizeInBytes; offset += chunkSize) {
+        size_t bytesToProcess = chunkSize;
+        if (bytesToProcess > sizeInBytes - offset) {
+            bytesToProcess = (size_t)(sizeInBytes - offset);
+        }
+
+        mfs_hasher_update(pHasher, pMappedData + offset, bytesToProcess);
+
+        if (outFd >= 0) {
+            res = mfs_write_all__posix(outFd, pMappedData + offset, bytesToProcess);
+            if (res != MFS_SUCCESS) {
+                break;
+            }
+        }
+
+        mfs_throttle_acquire(pConfig->pThrottle, bytesToProcess, 0);
+    }
+
+    munmap((void*)pMappedData, (size_t)sizeInBytes);
+
+    return res;
+}
+
+static mfs_result mfs_hash_fd_range__posix(int fd, mfs_uint64 offset, mfs_uint64 size, mfs_throttle* pThrottle, mfs_hasher* pHasher)
+{
+    /*
+    The range is memory mapped one window at a time so that address space usage is constant. offset must be a multiple of 64KB. If
+    the size is not known, or the file cannot be mapped, it is streamed with pread() instead. Using pread() rather than read() allows
+    the file descriptor to be shared between threads.
+    */
+    mfs_result result = MFS_SUCCESS;
+    mfs_uint8* pBuffer;
+    ssize_t bytesRead;
+
+    if (size != MFS_HASH_TO_END) {
+        while (size > 0) {
+            const mfs_uint8* pMappedData;
+            size_t windowSize = MFS_HASH_WINDOW_SIZE;
+            size_t windowOffset;
+
+            if (windowSize > size) {
+                windowSize = (size_t)size;
+            }
+
+            pMappedData = (const mfs_uint8*)mmap(NULL, windowSize, PROT_READ, MAP_SHARED, fd, (off_t)offset);
+            if (pMappedData == (const mfs_uint8*)MAP_FAILED) {
+                break;  /* Fall back to pread(). */
+            }
+
+        #if defined(MADV_SEQUENTIAL)
+            madvise((void*)pMappedData, windowSize, MADV_SEQUENTIAL);
+        #endif
+
+            /* Process in smaller steps so the throttle can keep the rate smooth. */
+            for (windowOffset = 0; windowOffset < windowSize; windowOffset += 1048576) {
+                size_t bytesToProcess = windowSize - windowOffset;
+                if (bytesToProcess > 1048576) {
+                    bytesToProcess = 1048576;
+                }
+
+                mfs_hasher_update(pHasher, pMappedData + windowOffset, bytesToProcess);
+                mfs_throttle_acquire(pThrottle, bytesToProcess, 0);
+            }
+
+            munmap((void*)pMappedData, windowSize);
+
+            offset += windowSize;
+            size   -= windowSize;
+        }
+
+        if (size == 0) {
+            return MFS_SUCCESS;
+        }
+    }
+
+    pBuffer = (mfs_uint8*)MFS_MALLOC(MFS_HASH_BUFFER_SIZE);
+    if (pBuffer == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fd, (off_t)offset, (size == MFS_HASH_TO_END) ? 0 : (off_t)size, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    while (size > 0) {
+        size_t bytesToRead = (size < MFS_HASH_BUFFER_SIZE) ? (size_t)size : MFS_HASH_BUFFER_SIZE;
+
+        bytesRead = pread(fd, pBuffer, bytesToRead, (off_t)offset);
+        if (bytesRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            result = mfs_result_from_errno(errno);
+            break;
+        }
+
+        if (bytesRead == 0) {
+            break;  /* End of file. */
+        }
+
+        mfs_hasher_update(pHasher, pBuffer, (size_t)bytesRead);
+        mfs_throttle_acquire(pThrottle, (mfs_uint64)bytesRead, 0);
+
+        offset += (mfs_uint64)bytesRead;
+        if (size != MFS_HASH_TO_END) {
+            size -= (mfs_uint64)bytesRead;
+        }
+    }
+
+    MFS_FREE(pBuffer);
+
+    return result;
+}
+
+static mfs_result mfs_hash_file_range__posix(const char* pFilePath, mfs_uint64 offset, mfs_uint64 size, mfs_throttle* pThrottle, mfs_hasher* pHasher)
+{
+    mfs_result result;
+    int fd;
+    struct stat info;
+
+    fd = open(pFilePath, O_RDONLY);
+    if (fd < 0) {
+        return mfs_result_from_errno(errno);
+    }
+
+    /* Files in pseudo file systems like /proc report a size of 0 even though they have content, so they can't be mapped. */
+    if (size == MFS_HASH_TO_END && offset == 0 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        size = (mfs_uint64)info.st_size;
+    }
+
+    result = mfs_hash_fd_range__posix(fd, offset, size, pThrottle, pHasher);
+
+    close(fd);
+    return result;
+}
+
+static mfs_result mfs_copy_fd_data__posix(int inFd, int outFd, mfs_uint64 sizeInBytes, const mfs_copy_file_config* pConfig, mfs_hasher* pHasher)
+{
+    mfs_result res;
+    ssize_t readBytes;
+    char buff[32768];
+    mfs_uint32 flags = pConfig->flags;
+
+    /*
+    When hashing, the data needs to pass through user space. Instead of falling back to the read/write loop the source is mapped
+    which avoids copying it into a buffer. Cloning is still attempted first because it doesn't need to write any data, in which case
+    the source only needs to be hashed.
+    */
+    if ((flags & MFS_COPY_FLAG_NO_ZERO_COPY) == 0 && sizeInBytes > 0 && pHasher != NULL) {
+        mfs_bool32 isCloned = MFS_FALSE;
+        mfs_bool32 isMapped;
+
+    #if defined(MFS_LINUX)
+        isCloned = ioctl(outFd, FICLONE, inFd) == 0;
     #endif
-    #ifdef ESTALE
-        case ESTALE: return MFS_INVALID_FILE;
+
+        res = mfs_copy_mapped_fd_data__posix(inFd, (isCloned) ? -1 : outFd, sizeInBytes, pConfig, pHasher, &isMapped);
+        if (isMapped) {
+            return res;
+        }
+
+        if (isCloned) {
+            outFd = -1; /* The data is already in the destination. The read/write loop below only needs to hash it. */
+        }
+    }
+
+    /*
+    The zero-copy methods are skipped for empty files. Files in pseudo file systems like /proc report a size of 0 but still have
+    content. These need to go through the read/write loop.
+    */
+    if ((flags & MFS_COPY_FLAG_NO_ZERO_COPY) == 0 && sizeInBytes > 0 && pHasher == NULL) {
+    #if defined(MFS_HAS_SYSCALL)
+        {
+            mfs_uint64 totalBytesCopied = 0;
+            long bytesCopied;
+            size_t chunkSize = (pConfig->pThrottle != NULL) ? 1048576 : 0x40000000; /* Use smaller chunks when throttling so the rate is smooth. */
+
+            /* Cloning is the best case since the data is shared until it is modified. Only supported on file systems like Btrfs and XFS. */
+            if (ioctl(outFd, FICLONE, inFd) == 0) {
+                return MFS_SUCCESS;
+            }
+
+            #if defined(SYS_copy_file_range)
+            {
+                for (;;) {
+                    bytesCopied = syscall(SYS_copy_file_range, inFd, NULL, outFd, NULL, chunkSize, 0);
+                    if (bytesCopied < 0) {
+                        if (totalBytesCopied == 0 && mfs_is_zero_copy_unsupported__posix(errno)) {
+                            break;  /* Fall back to sendfile(). */
+                        }
+
+                        return mfs_result_from_errno(errno);
+                    }
+
+                    if (bytesCopied == 0) {
+                        return MFS_SUCCESS;
+                    }
+
+                    totalBytesCopied += (mfs_uint64)bytesCopied;
+                    mfs_throttle_acquire(pConfig->pThrottle, (mfs_uint64)bytesCopied, 0);
+                }
+            }
+            #endif
+
+            for (;;) {
+                bytesCopied = (long)sendfile(outFd, inFd, NULL, chunkSize);
+                if (bytesCopied < 0) {
+                    if (totalBytesCopied == 0 && mfs_is_zero_copy_unsupported__posix(errno)) {
+                        break;  /* Fall back to read/write. */
+                    }
+
+                    return mfs_result_from_errno(errno);
+                }
+
+                if (bytesCopied == 0) {
+                    return MFS_SUCCESS;
+                }
+
+                totalBytesCopied += (mfs_uint64)bytesCopied;
+                mfs_throttle_acquire(pConfig->pThrottle, (mfs_uint64)bytesCopied, 0);
+            }
+        }
+    #elif defined(MFS_APPLE)
+        if (pConfig->pThrottle == NULL) {   /* fcopyfile() copies everything in one go so can't be throttled. */
+            if (fcopyfile(inFd, outFd, NULL, COPYFILE_DATA) == 0) {
+                return MFS_SUCCESS;
+            }
+
+            /* Fall back to read/write. */
+        }
     #endif
-    #ifdef EUCLEAN
-        case EUCLEAN: return MFS_ERROR;
+    }
+
+    /* Perform file copy in chunks until end of file. */
+    do {
+        readBytes = read(inFd, buff, sizeof(buff));
+
+        if (readBytes < 0) { /* Read error. */
+            res = mfs_result_from_errno(errno);
+            return res;
+        } else if (readBytes > 0) { /* Read some bytes. */
+            mfs_hasher_update(pHasher, buff, (size_t)readBytes);
+
+            if (outFd >= 0) {
+                res = mfs_write_all__posix(outFd, buff, (size_t)readBytes);
+                if (res != MFS_SUCCESS) {
+                    return res;
+                }
+            }
+
+            mfs_throttle_acquire(pConfig->pThrottle, (mfs_uint64)readBytes, 0);
+        }
+    } while (readBytes > 0);
+
+    return MFS_SUCCESS;
+}
+
+static mfs_result mfs_apply_file_attributes__posix(int fd, const char* pPath, const struct stat* pInfo, mfs_uint32 flags)
+{
+    /* When fd is -1 the attributes are applied by path. This is used for directories. */
+    if ((flags & MFS_COPY_FLAG_PRESERVE_MODE) != 0) {
+        int result = (fd >= 0) ? fchmod(fd, pInfo->st_mode & 07777) : chmod(pPath, pInfo->st_mode & 07777);
+        if (result != 0) {
+            return mfs_result_from_errno(errno);
+        }
+    }
+
+    if ((flags & MFS_COPY_FLAG_PRESERVE_TIMES) != 0) {
+    #if defined(UTIME_OMIT)
+        struct timespec times[2];
+        int result;
+
+        times[0] = MFS_STAT_ATIM(*pInfo);
+        times[1] = MFS_STAT_MTIM(*pInfo);
+
+        result = (fd >= 0) ? futimens(fd, times) : utimensat(AT_FDCWD, pPath, times, 0);
+        if (result != 0) {
+            return mfs_result_from_errno(errno);
+        }
+    #else
+        (void)fd;
+        (void)pPath;
+        (void)pInfo;
     #endif
-    #ifdef ENOTNAM
-        case ENOTNAM: return MFS_ERROR;
+    }
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_copy_file_ex__posix(const char* pSrcFilePath, const char* pDstFilePath, const mfs_copy_file_config* pConfig, mfs_hasher* pHasher)
+{
+    mfs_result res;
+    int inFd, outFd;
+    int openFlags;
+    struct stat info;
+
+    /* Acquire a file descriptor for the input file. */
+    inFd = open(pSrcFilePath, O_RDONLY);
+    if (inFd < 0) {
+        res = mfs_result_from_errno(errno);
+        return res;
+    }
+
+    /* Retrieve mode information of the input file. */
+    if (fstat(inFd, &info) != 0) {
+        res = mfs_result_from_errno(errno);
+        close(inFd);
+        return res;
+    }
+
+    /* Create an output file and acquire its FD. Using O_EXCL makes the existence check atomic. */
+    openFlags = O_CREAT | O_WRONLY | O_TRUNC;
+    if ((pConfig->flags & MFS_COPY_FLAG_FAIL_IF_EXISTS) != 0) {
+        openFlags |= O_EXCL;
+    }
+
+    outFd = open(pDstFilePath, openFlags, info.st_mode);
+    if (outFd < 0) {
+        res = mfs_result_from_errno(errno);
+        close(inFd);
+        return res;
+    }
+
+    mfs_throttle_acquire(pConfig->pThrottle, 0, 1);
+
+    res = mfs_copy_fd_data__posix(inFd, outFd, (mfs_uint64)info.st_size, pConfig, pHasher);
+    if (res == MFS_SUCCESS) {
+        res = mfs_apply_file_attributes__posix(outFd, pDstFilePath, &info, pConfig->flags);
+    }
+
+    if (res == MFS_SUCCESS && (pConfig->flags & MFS_COPY_FLAG_SYNC) != 0) {
+        if (fsync(outFd) != 0) {
+            res = mfs_result_from_errno(errno);
+        }
+    }
+
+    /* Close both FDs. */
+    close(outFd);
+    close(inFd);
+
+    return res;
+}
+
+#if defined(MFS_HAS_SYSCALL) && defined(SYS_renameat2) && defined(AT_FDCWD)
+    #define MFS_RENAME_NOREPLACE    1
+#endif
+
+static mfs_result mfs_rename_noreplace__posix(const char* pSrcFilePath, const char* pDstFilePath)
+{
+    struct stat info;
+
+#if defined(MFS_RENAME_NOREPLACE)
+    if (syscall(SYS_renameat2, AT_FDCWD, pSrcFilePath, AT_FDCWD, pDstFilePath, MFS_RENAME_NOREPLACE) == 0) {
+        return MFS_SUCCESS;
+    }
+
+    if (errno != ENOSYS && errno != EINVAL) {
+        return mfs_result_from_errno(errno);
+    }
+
+    /* Getting here means the kernel or file system does not support RENAME_NOREPLACE. */
+#elif defined(MFS_APPLE) && defined(RENAME_EXCL)
+    if (renamex_np(pSrcFilePath, pDstFilePath, RENAME_EXCL) == 0) {
+        return MFS_SUCCESS;
+    }
+
+    if (errno != ENOTSUP) {
+        return mfs_result_from_errno(errno);
+    }
+#endif
+
+    /* Creating a hard link fails if the destination exists, which makes it an atomic no-replace rename for files. */
+    if (link(pSrcFilePath, pDstFilePath) == 0) {
+        if (unlink(pSrcFilePath) != 0) {
+            int error = errno;
+            unlink(pDstFilePath);
+            return mfs_result_from_errno(error);
+        }
+
+        return MFS_SUCCESS;
+    }
+
+    if (errno == EEXIST || errno == EXDEV || errno == ENOENT) {
+        return mfs_result_from_errno(errno);
+    }
+
+    /* Directories and file systems without hard links. The best we can do is check before renaming. */
+    if (lstat(pDstFilePath, &info) == 0) {
+        return MFS_ALREADY_EXISTS;
+    }
+
+    if (rename(pSrcFilePath, pDstFilePath) == 0) {
+        return MFS_SUCCESS;
+    }
+
+    return mfs_result_from_errno(errno);
+}
+
+static mfs_result mfs_sync_parent_directory__posix(const char* pPath)
+{
+    /* Flushes the directory entry of the given path to storage. */
+    mfs_result result;
+    char* pParentPath;
+    size_t parentPathLen;
+    int fd;
+
+    result = mfs_path_base_path(NULL, 0, pPath, &parentPathLen);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    pParentPath = (char*)MFS_MALLOC(parentPathLen + 1);
+    if (pParentPath == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    mfs_path_base_path(pParentPath, parentPathLen + 1, pPath, NULL);
+
+    fd = open((pParentPath[0] != '\0') ? pParentPath : ".", O_RDONLY);
+    MFS_FREE(pParentPath);
+
+    if (fd < 0) {
+        return mfs_result_from_errno(errno);
+    }
+
+    result = MFS_SUCCESS;
+    if (fsync(fd) != 0) {
+        result = mfs_result_from_errno(errno);
+    }
+
+    close(fd);
+    return result;
+}
+
+mfs_result mfs_move_file__posix(const char* pSrcFilePath, const char* pDstFilePath, mfs_bool32 failIfExists)
+{
+    if (failIfExists) {
+        return mfs_rename_noreplace__posix(pSrcFilePath, pDstFilePath);
+    }
+
+    if (rename(pSrcFilePath, pDstFilePath) == 0) {
+        return MFS_SUCCESS;
+    }
+
+    return mfs_result_from_errno(errno);
+}
+
+mfs_result mfs_delete_file__posix(const char* pFilePath)
+{
+    if (remove(pFilePath) == 0) {
+        return MFS_SUCCESS;
+    }
+
+    return mfs_result_from_errno(errno);
+}
+#endif
+
+mfs_bool32 mfs_is_directory(const char* pPath)
+{
+    if (pPath == NULL) {
+        return MFS_FALSE;
+    }
+
+#if defined(MFS_WIN32)
+    return mfs_is_directory__win32(pPath);
+#elif defined(MFS_POSIX)
+    return mfs_is_directory__posix(pPath);
+#else
+    return MFS_FALSE;
+#endif
+}
+
+mfs_bool32 mfs_file_exists(const char* pFilePath)
+{
+    if (pFilePath == NULL) {
+        return MFS_FALSE;
+    }
+    
+#if defined(MFS_WIN32)
+    return mfs_file_exists__win32(pFilePath);
+#elif defined(MFS_POSIX)
+    return mfs_file_exists__posix(pFilePath);
+#else
+    return MFS_FALSE;
+#endif
+}
+
+
+mfs_result mfs_copy_file(const char* pSrcFilePath, const char* pDstFilePath, mfs_bool32 failIfExists)
+{
+    mfs_copy_file_config config;
+
+    config = mfs_copy_file_config_init();
+    if (failIfExists) {
+        config.flags |= MFS_COPY_FLAG_FAIL_IF_EXISTS;
+    }
+
+    return mfs_copy_file_ex(pSrcFilePath, pDstFilePath, &config);
+}
+
+
+mfs_copy_file_config mfs_copy_file_config_init(void)
+{
+    mfs_copy_file_config config;
+
+    MFS_ZERO_OBJECT(&config);
+
+    return config;
+}
+
+mfs_result mfs_copy_file_ex(const char* pSrcFilePath, const char* pDstFilePath, const mfs_copy_file_config* pConfig)
+{
+    mfs_result result;
+    mfs_copy_file_config defaultConfig;
+    mfs_hasher hasher;
+    mfs_hasher* pHasher = NULL;
+    mfs_hash_digest digest;
+
+    if (pSrcFilePath == NULL || pDstFilePath == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (pConfig == NULL) {
+        defaultConfig = mfs_copy_file_config_init();
+        pConfig = &defaultConfig;
+    }
+
+    if (pConfig->hashAlgorithm != MFS_HASH_ALGORITHM_NONE) {
+        result = mfs_hasher_init(pConfig->hashAlgorithm, &hasher);
+        if (result != MFS_SUCCESS) {
+            return result;
+        }
+
+        pHasher = &hasher;
+    } else if (pConfig->pExpectedHash != NULL) {
+        return MFS_INVALID_ARGS;    /* Can't verify without knowing the algorithm. */
+    }
+
+#if defined(MFS_WIN32)
+    result = mfs_copy_file_ex__win32(pSrcFilePath, pDstFilePath, pConfig, pHasher);
+#elif defined(MFS_POSIX)
+    result = mfs_copy_file_ex__posix(pSrcFilePath, pDstFilePath, pConfig, pHasher);
+#else
+    result = MFS_NOT_IMPLEMENTED;
+#endif
+
+    if (result != MFS_SUCCESS || pHasher == NULL) {
+        return result;
+    }
+
+    mfs_hasher_finalize(pHasher, &digest);
+
+    if (pConfig->pHash != NULL) {
+        *pConfig->pHash = digest;
+    }
+
+    if (pConfig->pExpectedHash != NULL && mfs_hash_digest_equal(&digest, pConfig->pExpectedHash) == MFS_FALSE) {
+        mfs_delete_file(pDstFilePath);
+        return MFS_CHECKSUM_MISMATCH;
+    }
+
+    return MFS_SUCCESS;
+}
+
+
+mfs_copy_directory_config mfs_copy_directory_config_init(void)
+{
+    mfs_copy_directory_config config;
+
+    MFS_ZERO_OBJECT(&config);
+    config.flags         = MFS_COPY_FLAG_PRESERVE_MODE | MFS_COPY_FLAG_PRESERVE_TIMES;
+    config.existingFiles = MFS_COPY_EXISTING_OVERWRITE;
+
+    return config;
+}
+
+typedef struct mfs_copy_directory_node mfs_copy_directory_node;
+struct mfs_copy_directory_node
+{
+    mfs_copy_directory_node* pNext;
+    char* pDstPath;     /* Points to the memory immediately after pSrcPath. */
+    char* pSrcPath;     /* Points to the memory immediately after this structure. */
+};
+
+typedef struct
+{
+    mfs_copy_directory_config config;
+    mfs_worker_pool pool;
+    mfs_mutex lock;                             /* For result and onError(). */
+    mfs_result result;                          /* The first error that occurred. */
+    mfs_copy_directory_node* pDirectoriesHead;  /* Directories whose attributes need to be applied once all files have been copied. Only accessed by the calling thread. */
+    mfs_copy_directory_node* pDirectoriesTail;
+} mfs_copy_directory_state;
+
+typedef struct
+{
+    mfs_job job;
+    mfs_copy_directory_state* pState;
+    char* pDstPath;
+    char* pSrcPath;
+} mfs_copy_directory_job;
+
+static void mfs_copy_directory_report_error(mfs_copy_directory_state* pState, const char* pSrcPath, const char* pDstPath, mfs_result result)
+{
+    mfs_mutex_lock(&pState->lock);
+    {
+        if (pState->result == MFS_SUCCESS) {
+            pState->result = result;
+        }
+
+        if (pState->config.onError != NULL) {
+            pState->config.onError(pState->config.pUserData, pSrcPath, pDstPath, result);
+        }
+    }
+    mfs_mutex_unlock(&pState->lock);
+}
+
+static void* mfs_copy_directory_alloc_paths(size_t headerSize, const char* pSrcDir, const char* pDstDir, const char* pName, char** ppSrcPath, char** ppDstPath)
+{
+    /* Allocates a structure of the given size with the source and destination paths stored immediately after it. */
+    char* pAllocation;
+    size_t srcPathLen;
+    size_t dstPathLen;
+
+    if (mfs_path_append(NULL, 0, pSrcDir, pName, &srcPathLen) != MFS_SUCCESS || mfs_path_append(NULL, 0, pDstDir, pName, &dstPathLen) != MFS_SUCCESS) {
+        return NULL;
+    }
+
+    pAllocation = (char*)MFS_MALLOC(headerSize + srcPathLen+1 + dstPathLen+1);
+    if (pAllocation == NULL) {
+        return NULL;
+    }
+
+    *ppSrcPath = pAllocation + headerSize;
+    *ppDstPath = pAllocation + headerSize + srcPathLen+1;
+
+    mfs_path_append(*ppSrcPath, srcPathLen+1, pSrcDir, pName, NULL);
+    mfs_path_append(*ppDstPath, dstPathLen+1, pDstDir, pName, NULL);
+
+    return pAllocation;
+}
+
+static void mfs_copy_directory_process_file(mfs_job* pJob)
+{
+    mfs_copy_directory_job* pFileJob = (mfs_copy_directory_job*)pJob;
+    mfs_copy_directory_state* pState = pFileJob->pState;
+    mfs_copy_file_config config;
+    mfs_result result;
+
+    config = mfs_copy_file_config_init();
+    config.flags     = pState->config.flags & ~MFS_COPY_FLAG_FAIL_IF_EXISTS;
+    config.pThrottle = pState->config.pThrottle;
+
+    if (pState->config.existingFiles == MFS_COPY_EXISTING_SKIP || pState->config.existingFiles == MFS_COPY_EXISTING_FAIL) {
+        config.flags |= MFS_COPY_FLAG_FAIL_IF_EXISTS;
+    }
+
+    if (pState->config.existingFiles == MFS_COPY_EXISTING_UPDATE) {
+        mfs_file_info srcInfo;
+        mfs_file_info dstInfo;
+
+        if (mfs_get_file_info(pFileJob->pDstPath, &dstInfo) == MFS_SUCCESS) {
+            result = mfs_get_file_info(pFileJob->pSrcPath, &srcInfo);
+            if (result != MFS_SUCCESS) {
+                mfs_copy_directory_report_error(pState, pFileJob->pSrcPath, pFileJob->pDstPath, result);
+                MFS_FREE(pFileJob);
+                return;
+            }
+
+            if (srcInfo.lastModifiedTime <= dstInfo.lastModifiedTime) {
+                MFS_FREE(pFileJob);
+                return; /* The destination is up to date. */
+            }
+        }
+    }
+
+    result = mfs_copy_file_ex(pFileJob->pSrcPath, pFileJob->pDstPath, &config);
+    if (result == MFS_ALREADY_EXISTS && pState->config.existingFiles == MFS_COPY_EXISTING_SKIP) {
+        result = MFS_SUCCESS;
+    }
+
+    if (result != MFS_SUCCESS) {
+        mfs_copy_directory_report_error(pState, pFileJob->pSrcPath, pFileJob->pDstPath, result);
+    }
+
+    MFS_FREE(pFileJob);
+}
+
+static mfs_result mfs_copy_directory_create(const char* pDstDirectory, mfs_bool32 recursive)
+{
+    mfs_result result;
+
+    result = mfs_mkdir(pDstDirectory, recursive);
+    if (result == MFS_ALREADY_EXISTS || (result != MFS_SUCCESS && recursive)) {
+        /* It's fine if the directory already exists, but not if it's a file. */
+        if (mfs_is_directory(pDstDirectory)) {
+            result = MFS_SUCCESS;
+        }
+    }
+
+    return result;
+}
+
+static mfs_result mfs_copy_directory_apply_attributes(const char* pSrcDirectory, const char* pDstDirectory, mfs_uint32 flags)
+{
+#if defined(MFS_POSIX)
+    struct stat info;
+
+    if (stat(pSrcDirectory, &info) != 0) {
+        return mfs_result_from_errno(errno);
+    }
+
+    return mfs_apply_file_attributes__posix(-1, pDstDirectory, &info, flags);
+#else
+    /* Not supported on this platform. Attributes are only applied to files. */
+    (void)pSrcDirectory;
+    (void)pDstDirectory;
+    (void)flags;
+    return MFS_SUCCESS;
+#endif
+}
+
+static void mfs_copy_directory_traverse(mfs_copy_directory_state* pState, const char* pSrcDirectory, const char* pDstDirectory)
+{
+    mfs_result result;
+    mfs_iterator iterator;
+    mfs_file_info fi;
+    char* pSrcPath;
+    char* pDstPath;
+
+    result = mfs_iterator_init(pSrcDirectory, &iterator);
+    if (result != MFS_SUCCESS) {
+        mfs_copy_directory_report_error(pState, pSrcDirectory, pDstDirectory, result);
+        return;
+    }
+
+    while (mfs_iterator_next(&iterator, &fi) == MFS_SUCCESS) {
+        if (fi.pFileName[0] == '.' && (fi.pFileName[1] == '\0' || (fi.pFileName[1] == '.' && fi.pFileName[2] == '\0'))) {
+            continue;   /* "." or "..". */
+        }
+
+        if (fi.isDirectory) {
+            mfs_copy_directory_node* pNode;
+
+            pNode = (mfs_copy_directory_node*)mfs_copy_directory_alloc_paths(sizeof(*pNode), pSrcDirectory, pDstDirectory, fi.pFileName, &pSrcPath, &pDstPath);
+            if (pNode == NULL) {
+                mfs_copy_directory_report_error(pState, pSrcDirectory, pDstDirectory, MFS_OUT_OF_MEMORY);
+                continue;
+            }
+
+            pNode->pSrcPath = pSrcPath;
+            pNode->pDstPath = pDstPath;
+
+            /* The directory must be created before any of its files are posted to the worker threads. */
+            result = mfs_copy_directory_create(pNode->pDstPath, MFS_FALSE);
+            if (result != MFS_SUCCESS) {
+                mfs_copy_directory_report_error(pState, pNode->pSrcPath, pNode->pDstPath, result);
+                MFS_FREE(pNode);
+                continue;
+            }
+
+            mfs_copy_directory_traverse(pState, pNode->pSrcPath, pNode->pDstPath);
+
+            /* Attributes are applied at the end since copying files into the directory will change its modification time. */
+            if ((pState->config.flags & (MFS_COPY_FLAG_PRESERVE_MODE | MFS_COPY_FLAG_PRESERVE_TIMES)) != 0) {
+                pNode->pNext = NULL;
+                if (pState->pDirectoriesTail == NULL) {
+                    pState->pDirectoriesHead = pNode;
+                } else {
+                    pState->pDirectoriesTail->pNext = pNode;
+                }
+                pState->pDirectoriesTail = pNode;
+            } else {
+                MFS_FREE(pNode);
+            }
+        } else {
+            mfs_copy_directory_job* pFileJob;
+
+            pFileJob = (mfs_copy_directory_job*)mfs_copy_directory_alloc_paths(sizeof(*pFileJob), pSrcDirectory, pDstDirectory, fi.pFileName, &pSrcPath, &pDstPath);
+            if (pFileJob == NULL) {
+                mfs_copy_directory_report_error(pState, pSrcDirectory, pDstDirectory, MFS_OUT_OF_MEMORY);
+                continue;
+            }
+
+            pFileJob->pSrcPath = pSrcPath;
+            pFileJob->pDstPath = pDstPath;
+            pFileJob->job.onProcess = mfs_copy_directory_process_file;
+            pFileJob->pState = pState;
+            mfs_worker_pool_post(&pState->pool, &pFileJob->job);
+        }
+    }
+
+    mfs_iterator_uninit(&iterator);
+}
+
+mfs_result mfs_copy_directory(const char* pSrcDirectory, const char* pDstDirectory, const mfs_copy_directory_config* pConfig)
+{
+    mfs_result result;
+    mfs_copy_directory_state state;
+    mfs_copy_directory_node* pNode;
+
+    if (pSrcDirectory == NULL || pDstDirectory == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (mfs_is_directory(pSrcDirectory) == MFS_FALSE) {
+        return MFS_NOT_DIRECTORY;
+    }
+
+    MFS_ZERO_OBJECT(&state);
+    if (pConfig != NULL) {
+        state.config = *pConfig;
+    } else {
+        state.config = mfs_copy_directory_config_init();
+    }
+
+    result = mfs_copy_directory_create(pDstDirectory, MFS_TRUE);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    result = mfs_worker_pool_init(state.config.threadCount, (state.config.pThrottle != NULL) ? state.config.pThrottle->config.ioPriority : MFS_IO_PRIORITY_DEFAULT, &state.pool);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    mfs_mutex_init(&state.lock);
+
+    /* Worker threads will start copying files while the rest of the tree is still being traversed. */
+    mfs_copy_directory_traverse(&state, pSrcDirectory, pDstDirectory);
+    mfs_worker_pool_wait(&state.pool);
+    mfs_worker_pool_uninit(&state.pool);
+
+    /* Now that all files have been copied the directory attributes can be applied. The list is ordered such that children come before their parents. */
+    pNode = state.pDirectoriesHead;
+    while (pNode != NULL) {
+        mfs_copy_directory_node* pNext = pNode->pNext;
+
+        result = mfs_copy_directory_apply_attributes(pNode->pSrcPath, pNode->pDstPath, state.config.flags);
+        if (result != MFS_SUCCESS) {
+            mfs_copy_directory_report_error(&state, pNode->pSrcPath, pNode->pDstPath, result);
+        }
+
+        MFS_FREE(pNode);
+        pNode = pNext;
+    }
+
+    if ((state.config.flags & (MFS_COPY_FLAG_PRESERVE_MODE | MFS_COPY_FLAG_PRESERVE_TIMES)) != 0) {
+        result = mfs_copy_directory_apply_attributes(pSrcDirectory, pDstDirectory, state.config.flags);
+        if (result != MFS_SUCCESS) {
+            mfs_copy_directory_report_error(&state, pSrcDirectory, pDstDirectory, result);
+        }
+    }
+
+    mfs_mutex_uninit(&state.lock);
+
+    return state.result;
+}
+
+
+static mfs_result mfs_hash_file_range(const char* pFilePath, mfs_uint64 offset, mfs_uint64 size, mfs_throttle* pThrottle, mfs_hasher* pHasher)
+{
+#if defined(MFS_WIN32)
+    return mfs_hash_file_range__win32(pFilePath, offset, size, pThrottle, pHasher);
+#elif defined(MFS_POSIX)
+    return mfs_hash_file_range__posix(pFilePath, offset, size, pThrottle, pHasher);
+#else
+    (void)pFilePath;
+    (void)offset;
+    (void)size;
+    (void)pThrottle;
+    (void)pHasher;
+    return MFS_NOT_IMPLEMENTED;
+#endif
+}
+
+mfs_hash_file_config mfs_hash_file_config_init(mfs_uint32 algorithm)
+{
+    mfs_hash_file_config config;
+
+    MFS_ZERO_OBJECT(&config);
+    config.algorithm = algorithm;
+    config.chunkSize = 4194304;
+
+    return config;
+}
+
+typedef struct
+{
+    const char* pFilePath;
+    mfs_uint32 algorithm;
+    mfs_throttle* pThrottle;
+    mfs_uint64 fileSize;
+    mfs_uint64 chunkSize;
+    mfs_uint64 chunkCount;
+    mfs_uint32 digestSize;
+    mfs_uint8* pChunkDigests;   /* chunkCount * digestSize bytes. */
+    mfs_mutex lock;             /* For nextChunk and result. */
+    mfs_uint64 nextChunk;
+    mfs_result result;
+} mfs_hash_file_tree_state;
+
+typedef struct
+{
+    mfs_job job;
+    mfs_hash_file_tree_state* pState;
+} mfs_hash_file_tree_job;
+
+static void mfs_hash_file_tree_process(mfs_job* pJob)
+{
+    /* There is one job per thread. Each one keeps taking the next chunk until there are none left. */
+    mfs_hash_file_tree_state* pState = ((mfs_hash_file_tree_job*)pJob)->pState;
+    mfs_result result;
+    mfs_uint64 iChunk;
+    mfs_uint64 offset;
+    mfs_hasher hasher;
+    mfs_hash_digest digest;
+
+    for (;;) {
+        mfs_mutex_lock(&pState->lock);
+        {
+            if (pState->result != MFS_SUCCESS || pState->nextChunk == pState->chunkCount) {
+                mfs_mutex_unlock(&pState->lock);
+                break;
+            }
+
+            iChunk = pState->nextChunk;
+            pState->nextChunk += 1;
+        }
+        mfs_mutex_unlock(&pState->lock);
+
+        offset = iChunk * pState->chunkSize;
+
+        mfs_hasher_init(pState->algorithm, &hasher);
+        result = mfs_hash_file_range(pState->pFilePath, offset, (pState->fileSize - offset < pState->chunkSize) ? (pState->fileSize - offset) : pState->chunkSize, pState->pThrottle, &hasher);
+        if (result != MFS_SUCCESS) {
+            mfs_mutex_lock(&pState->lock);
+            {
+                if (pState->result == MFS_SUCCESS) {
+                    pState->result = result;
+                }
+            }
+            mfs_mutex_unlock(&pState->lock);
+            break;
+        }
+
+        mfs_hasher_finalize(&hasher, &digest);
+        MFS_COPY_MEMORY(pState->pChunkDigests + (size_t)iChunk * pState->digestSize, digest.data, pState->digestSize);
+    }
+}
+
+static mfs_result mfs_hash_file_tree(const char* pFilePath, const mfs_hash_file_config* pConfig, mfs_uint64 fileSize, mfs_hasher* pHasher)
+{
+    mfs_result result;
+    mfs_hash_file_tree_state state;
+    mfs_hash_file_tree_job* pJobs;
+    mfs_worker_pool pool;
+    mfs_hash_digest digest;
+    mfs_uint32 threadCount;
+    mfs_uint32 iThread;
+
+    MFS_ZERO_OBJECT(&state);
+    state.pFilePath  = pFilePath;
+    state.algorithm  = pConfig->algorithm;
+    state.pThrottle  = pConfig->pThrottle;
+    state.fileSize   = fileSize;
+    state.chunkSize  = pConfig->chunkSize;
+    state.chunkCount = (fileSize + state.chunkSize - 1) / state.chunkSize;
+
+    /* The size of the digest is found by finalizing the hasher that the chunk digests will be fed into. */
+    {
+        mfs_hasher tmp = *pHasher;
+        mfs_hasher_finalize(&tmp, &digest);
+        state.digestSize = digest.size;
+    }
+
+    if (state.chunkCount > (mfs_uint64)((size_t)-1) / state.digestSize) {
+        return MFS_TOO_BIG;
+    }
+
+    state.pChunkDigests = (mfs_uint8*)MFS_MALLOC((size_t)state.chunkCount * state.digestSize);
+    if (state.pChunkDigests == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    threadCount = (pConfig->threadCount > 0) ? pConfig->threadCount : mfs_get_cpu_count();
+    if (threadCount > state.chunkCount) {
+        threadCount = (mfs_uint32)state.chunkCount;
+    }
+
+    pJobs = (mfs_hash_file_tree_job*)MFS_MALLOC(sizeof(*pJobs) * threadCount);
+    if (pJobs == NULL) {
+        MFS_FREE(state.pChunkDigests);
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    result = mfs_worker_pool_init(threadCount, (pConfig->pThrottle != NULL) ? pConfig->pThrottle->config.ioPriority : MFS_IO_PRIORITY_DEFAULT, &pool);
+    if (result != MFS_SUCCESS) {
+        MFS_FREE(pJobs);
+        MFS_FREE(state.pChunkDigests);
+        return result;
+    }
+
+    mfs_mutex_init(&state.lock);
+
+    for (iThread = 0; iThread < threadCount; iThread += 1) {
+        pJobs[iThread].job.onProcess = mfs_hash_file_tree_process;
+        pJobs[iThread].pState = &state;
+        mfs_worker_pool_post(&pool, &pJobs[iThread].job);
+    }
+
+    mfs_worker_pool_wait(&pool);
+    mfs_worker_pool_uninit(&pool);
+    mfs_mutex_uninit(&state.lock);
+
+    if (state.result == MFS_SUCCESS) {
+        mfs_hasher_update(pHasher, state.pChunkDigests, (size_t)state.chunkCount * state.digestSize);
+    }
+
+    MFS_FREE(pJobs);
+    MFS_FREE(state.pChunkDigests);
+
+    return state.result;
+}
+
+mfs_result mfs_hash_file_ex(const char* pFilePath, const mfs_hash_file_config* pConfig, mfs_hash_digest* pDigest)
+{
+    mfs_result result;
+    mfs_hash_file_config config;
+    mfs_hasher hasher;
+
+    if (pDigest != NULL) {
+        MFS_ZERO_OBJECT(pDigest);
+    }
+
+    if (pFilePath == NULL || pDigest == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (pConfig != NULL) {
+        config = *pConfig;
+    } else {
+        config = mfs_hash_file_config_init(MFS_HASH_ALGORITHM_XXH64);
+    }
+
+    result = mfs_hasher_init(config.algorithm, &hasher);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    mfs_throttle_acquire(config.pThrottle, 0, 1);
+
+    if ((config.flags & MFS_HASH_FLAG_TREE) != 0) {
+        mfs_file_info info;
+
+        if (config.chunkSize == 0) {
+            config.chunkSize = 4194304;
+        }
+
+        /* Chunks are memory mapped so they need to start on a page boundary. */
+        config.chunkSize = (config.chunkSize + 65535) & ~(mfs_uint64)65535;
+
+        result = mfs_get_file_info(pFilePath, &info);
+        if (result != MFS_SUCCESS) {
+            return result;
+        }
+
+        if (info.sizeInBytes > config.chunkSize) {
+            result = mfs_hash_file_tree(pFilePath, &config, info.sizeInBytes, &hasher);
+        } else {
+            result = mfs_hash_file_range(pFilePath, 0, MFS_HASH_TO_END, config.pThrottle, &hasher);
+        }
+    } else {
+        result = mfs_hash_file_range(pFilePath, 0, MFS_HASH_TO_END, config.pThrottle, &hasher);
+    }
+
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    mfs_hasher_finalize(&hasher, pDigest);
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_hash_file(const char* pFilePath, mfs_uint32 algorithm, mfs_hash_digest* pDigest)
+{
+    mfs_hash_file_config config = mfs_hash_file_config_init(algorithm);
+    return mfs_hash_file_ex(pFilePath, &config, pDigest);
+}
+
+
+static mfs_result mfs_move_file__cross_device(const char* pSrcFilePath, const char* pDstFilePath, mfs_bool32 failIfExists)
+{
+    mfs_result result;
+    mfs_bool32 isDirectory;
+
+    isDirectory = mfs_is_directory(pSrcFilePath);
+    if (isDirectory) {
+        mfs_copy_directory_config config;
+
+        if (failIfExists && (mfs_is_directory(pDstFilePath) || mfs_file_exists(pDstFilePath))) {
+            return MFS_ALREADY_EXISTS;
+        }
+
+        config = mfs_copy_directory_config_init();
+        config.flags        |= MFS_COPY_FLAG_SYNC;
+        config.existingFiles = MFS_COPY_EXISTING_OVERWRITE;
+
+        result = mfs_copy_directory(pSrcFilePath, pDstFilePath, &config);
+        if (result != MFS_SUCCESS) {
+            return result;
+        }
+    } else {
+        mfs_copy_file_config config;
+
+        config = mfs_copy_file_config_init();
+        config.flags = MFS_COPY_FLAG_PRESERVE_MODE | MFS_COPY_FLAG_PRESERVE_TIMES | MFS_COPY_FLAG_SYNC;
+        if (failIfExists) {
+            config.flags |= MFS_COPY_FLAG_FAIL_IF_EXISTS;
+        }
+
+        result = mfs_copy_file_ex(pSrcFilePath, pDstFilePath, &config);
+        if (result != MFS_SUCCESS) {
+            if (result != MFS_ALREADY_EXISTS) {
+                mfs_delete_file(pDstFilePath);  /* Don't leave a partial file behind. */
+            }
+
+            return result;
+        }
+    }
+
+#if defined(MFS_POSIX)
+    /* The new directory entry must be durable before the source is removed. */
+    result = mfs_sync_parent_directory__posix(pDstFilePath);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+#endif
+
+    if (isDirectory) {
+        return mfs_rmdir(pSrcFilePath, MFS_TRUE);
+    } else {
+        return mfs_delete_file(pSrcFilePath);
+    }
+}
+
+mfs_result mfs_move_file(const char* pSrcFilePath, const char* pDstFilePath, mfs_bool32 failIfExists)
+{
+    mfs_result result;
+
+    if (pSrcFilePath == NULL || pDstFilePath == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+#if defined(MFS_WIN32)
+    result = mfs_move_file__win32(pSrcFilePath, pDstFilePath, failIfExists);
+#elif defined(MFS_POSIX)
+    result = mfs_move_file__posix(pSrcFilePath, pDstFilePath, failIfExists);
+#else
+    result = MFS_NOT_IMPLEMENTED;
+#endif
+
+    if (result == MFS_CROSS_DEVICE) {
+        result = mfs_move_file__cross_device(pSrcFilePath, pDstFilePath, failIfExists);
+    }
+
+    return result;
+}
+
+
+#define MFS_TRASH_DIRECTORY_NAME    ".mfs-trash"
+
+typedef struct mfs_reaper_item mfs_reaper_item;
+struct mfs_reaper_item
+{
+    mfs_reaper_item* pNext;
+    char* pPath;    /* Points to the memory immediately after this structure. */
+};
+
+typedef struct
+{
+    mfs_mutex lock;
+    mfs_cond cond;              /* Signaled when an item is queued, when an item has finished being deleted, and when stopping. */
+    mfs_reaper_item* pHead;
+    mfs_reaper_item* pTail;
+    mfs_bool32 isBusy;          /* Whether or not the background thread is deleting an item. */
+    mfs_bool32 isStopping;
+    mfs_bool32 hasThread;
+    mfs_thread thread;
+    mfs_uint32 counter;         /* For generating unique names in the trash. */
+} mfs_reaper_internal;
+
+mfs_reaper_config mfs_reaper_config_init(void)
+{
+    mfs_reaper_config config;
+
+    MFS_ZERO_OBJECT(&config);
+    config.ioPriority = MFS_IO_PRIORITY_IDLE;
+
+    return config;
+}
+
+static void mfs_reaper_delete(mfs_reaper* pReaper, const char* pPath)
+{
+    mfs_result result;
+    mfs_rmdir_content_config config;
+
+    /* A single thread is used. The point is to get out of the way, not to finish quickly. */
+    config = mfs_rmdir_content_config_init();
+    config.threadCount = 1;
+    config.pThrottle   = pReaper->config.pThrottle;
+    config.onError     = pReaper->config.onError;
+    config.pUserData   = pReaper->config.pUserData;
+
+    result = mfs_rmdir_content_ex(pPath, &config, NULL);
+    if (result == MFS_SUCCESS) {
+        mfs_throttle_acquire(pReaper->config.pThrottle, 0, 1);
+        result = mfs_delete_file(pPath);
+        if (result != MFS_SUCCESS && pReaper->config.onError != NULL) {
+            pReaper->config.onError(pReaper->config.pUserData, pPath, result);
+        }
+    }
+}
+
+static mfs_thread_result MFS_THREADCALL mfs_reaper_thread(void* pData)
+{
+    mfs_reaper* pReaper = (mfs_reaper*)pData;
+    mfs_reaper_internal* pInternal = (mfs_reaper_internal*)pReaper->pInternal;
+
+    mfs_mutex_lock(&pInternal->lock);
+    for (;;) {
+        mfs_reaper_item* pItem;
+
+        while (pInternal->pHead == NULL && pInternal->isStopping == MFS_FALSE) {
+            mfs_cond_wait(&pInternal->cond, &pInternal->lock);
+        }
+
+        if (pInternal->isStopping) {
+            break;
+        }
+
+        pItem = pInternal->pHead;
+        pInternal->pHead = pItem->pNext;
+        if (pInternal->pHead == NULL) {
+            pInternal->pTail = NULL;
+        }
+
+        pInternal->isBusy = MFS_TRUE;
+        mfs_mutex_unlock(&pInternal->lock);
+        {
+            /* Set every time since deleting can change it. See mfs_worker_pool_wait(). */
+            if (pReaper->config.ioPriority != MFS_IO_PRIORITY_DEFAULT) {
+                mfs_set_thread_io_priority(pReaper->config.ioPriority);
+            }
+
+            mfs_reaper_delete(pReaper, pItem->pPath);
+            MFS_FREE(pItem);
+        }
+        mfs_mutex_lock(&pInternal->lock);
+        pInternal->isBusy = MFS_FALSE;
+
+        mfs_cond_broadcast(&pInternal->cond);
+    }
+    mfs_mutex_unlock(&pInternal->lock);
+
+    return (mfs_thread_result)0;
+}
+
+static mfs_result mfs_reaper_enqueue(mfs_reaper* pReaper, const char* pPath)
+{
+    mfs_reaper_internal* pInternal = (mfs_reaper_internal*)pReaper->pInternal;
+    mfs_reaper_item* pItem;
+    size_t pathLen;
+
+    if (pInternal->hasThread == MFS_FALSE) {
+        mfs_reaper_delete(pReaper, pPath);
+        return MFS_SUCCESS;
+    }
+
+    pathLen = strlen(pPath);
+
+    pItem = (mfs_reaper_item*)MFS_MALLOC(sizeof(*pItem) + pathLen + 1);
+    if (pItem == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    pItem->pNext = NULL;
+    pItem->pPath = (char*)(pItem + 1);
+    MFS_COPY_MEMORY(pItem->pPath, pPath, pathLen + 1);
+
+    mfs_mutex_lock(&pInternal->lock);
+    {
+        if (pInternal->pTail == NULL) {
+            pInternal->pHead = pItem;
+        } else {
+            pInternal->pTail->pNext = pItem;
+        }
+        pInternal->pTail = pItem;
+
+        mfs_cond_broadcast(&pInternal->cond);
+    }
+    mfs_mutex_unlock(&pInternal->lock);
+
+    return MFS_SUCCESS;
+}
+
+static void mfs_reaper_recover_trash_directory(mfs_reaper* pReaper, const char* pTrashDirectory)
+{
+    mfs_iterator iterator;
+    mfs_file_info fi;
+
+    if (mfs_iterator_init(pTrashDirectory, &iterator) != MFS_SUCCESS) {
+        return; /* Most likely there is no trash here. */
+    }
+
+    while (mfs_iterator_next(&iterator, &fi) == MFS_SUCCESS) {
+        char* pPath;
+        size_t pathLen;
+
+        if (fi.pFileName[0] == '.' && (fi.pFileName[1] == '\0' || (fi.pFileName[1] == '.' && fi.pFileName[2] == '\0'))) {
+            continue;   /* "." or "..". */
+        }
+
+        if (mfs_path_append(NULL, 0, pTrashDirectory, fi.pFileName, &pathLen) != MFS_SUCCESS) {
+            continue;
+        }
+
+        pPath = (char*)MFS_MALLOC(pathLen + 1);
+        if (pPath == NULL) {
+            break;
+        }
+
+        mfs_path_append(pPath, pathLen + 1, pTrashDirectory, fi.pFileName, NULL);
+
+        /* Only directories are ever moved into the trash. */
+        if (fi.isDirectory) {
+            mfs_reaper_enqueue(pReaper, pPath);
+        }
+
+        MFS_FREE(pPath);
+    }
+
+    mfs_iterator_uninit(&iterator);
+}
+
+static void mfs_reaper_recover_in_directory(mfs_reaper* pReaper, const char* pDirectory)
+{
+    char* pTrashDirectory;
+    size_t trashDirectoryLen;
+
+    if (mfs_path_append(NULL, 0, pDirectory, MFS_TRASH_DIRECTORY_NAME, &trashDirectoryLen) != MFS_SUCCESS) {
+        return;
+    }
+
+    pTrashDirectory = (char*)MFS_MALLOC(trashDirectoryLen + 1);
+    if (pTrashDirectory == NULL) {
+        return;
+    }
+
+    mfs_path_append(pTrashDirectory, trashDirectoryLen + 1, pDirectory, MFS_TRASH_DIRECTORY_NAME, NULL);
+    mfs_reaper_recover_trash_directory(pReaper, pTrashDirectory);
+
+    MFS_FREE(pTrashDirectory);
+}
+
+static void mfs_reaper_recover(mfs_reaper* pReaper)
+{
+    size_t iDirectory;
+
+    /* Only local volumes are checked. Touching a network volume that has gone away can block for a long time. */
+#if defined(MFS_WIN32)
+    {
+        char drives[256];
+        DWORD length;
+        const char* pDrive;
+
+        length = GetLogicalDriveStringsA(sizeof(drives), drives);
+        if (length > 0 && length < sizeof(drives)) {
+            for (pDrive = drives; pDrive[0] != '\0'; pDrive += strlen(pDrive) + 1) {
+                if (GetDriveTypeA(pDrive) == DRIVE_FIXED) {
+                    mfs_reaper_recover_in_directory(pReaper, pDrive);
+                }
+            }
+        }
+    }
+#elif defined(MFS_LINUX)
+    {
+        FILE* pMounts;
+        struct mntent* pMount;
+
+        pMounts = setmntent("/proc/self/mounts", "r");
+        if (pMounts != NULL) {
+            while ((pMount = getmntent(pMounts)) != NULL) {
+                if (strncmp(pMount->mnt_fsname, "/dev/", 5) == 0) {
+                    mfs_reaper_recover_in_directory(pReaper, pMount->mnt_dir);
+                }
+            }
+
+            endmntent(pMounts);
+        }
+    }
+#elif defined(MFS_APPLE) || defined(MFS_BSD)
+    {
+        struct statfs* pMounts;
+        int mountCount;
+        int iMount;
+
+        mountCount = getmntinfo(&pMounts, MNT_NOWAIT);
+        for (iMount = 0; iMount < mountCount; iMount += 1) {
+            if ((pMounts[iMount].f_flags & MNT_LOCAL) != 0) {
+                mfs_reaper_recover_in_directory(pReaper, pMounts[iMount].f_mntonname);
+            }
+        }
+    }
+#endif
+
+    for (iDirectory = 0; iDirectory < pReaper->config.recoveryDirectoryCount; iDirectory += 1) {
+        if (pReaper->config.ppRecoveryDirectories[iDirectory] != NULL) {
+            mfs_reaper_recover_in_directory(pReaper, pReaper->config.ppRecoveryDirectories[iDirectory]);
+        }
+    }
+}
+
+mfs_result mfs_reaper_init(const mfs_reaper_config* pConfig, mfs_reaper* pReaper)
+{
+    mfs_reaper_internal* pInternal;
+
+    if (pReaper == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(pReaper);
+
+    if (pConfig != NULL) {
+        pReaper->config = *pConfig;
+    } else {
+        pReaper->config = mfs_reaper_config_init();
+    }
+
+    pInternal = (mfs_reaper_internal*)MFS_MALLOC(sizeof(*pInternal));
+    if (pInternal == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    MFS_ZERO_OBJECT(pInternal);
+    mfs_mutex_init(&pInternal->lock);
+    mfs_cond_init(&pInternal->cond);
+    pReaper->pInternal = pInternal;
+
+    /* If a thread can't be created everything will be deleted synchronously. */
+    if (mfs_thread_create(&pInternal->thread, mfs_reaper_thread, pReaper) == MFS_SUCCESS) {
+        pInternal->hasThread = MFS_TRUE;
+    }
+
+    if ((pReaper->config.flags & MFS_REAPER_FLAG_NO_RECOVERY) == 0) {
+        mfs_reaper_recover(pReaper);
+    }
+
+    /* Don't hold onto the caller's memory. */
+    pReaper->config.ppRecoveryDirectories  = NULL;
+    pReaper->config.recoveryDirectoryCount = 0;
+
+    return MFS_SUCCESS;
+}
+
+void mfs_reaper_uninit(mfs_reaper* pReaper)
+{
+    mfs_reaper_internal* pInternal;
+
+    if (pReaper == NULL || pReaper->pInternal == NULL) {
+        return;
+    }
+
+    pInternal = (mfs_reaper_internal*)pReaper->pInternal;
+
+    mfs_mutex_lock(&pInternal->lock);
+    {
+        pInternal->isStopping = MFS_TRUE;
+        mfs_cond_broadcast(&pInternal->cond);
+    }
+    mfs_mutex_unlock(&pInternal->lock);
+
+    if (pInternal->hasThread) {
+        mfs_thread_join(pInternal->thread);
+    }
+
+    /* Anything still queued stays in the trash. */
+    while (pInternal->pHead != NULL) {
+        mfs_reaper_item* pNext = pInternal->pHead->pNext;
+        MFS_FREE(pInternal->pHead);
+        pInternal->pHead = pNext;
+    }
+
+    mfs_cond_uninit(&pInternal->cond);
+    mfs_mutex_uninit(&pInternal->lock);
+    MFS_FREE(pInternal);
+    pReaper->pInternal = NULL;
+}
+
+void mfs_reaper_wait(mfs_reaper* pReaper)
+{
+    mfs_reaper_internal* pInternal;
+
+    if (pReaper == NULL || pReaper->pInternal == NULL) {
+        return;
+    }
+
+    pInternal = (mfs_reaper_internal*)pReaper->pInternal;
+    if (pInternal->hasThread == MFS_FALSE) {
+        return; /* Everything was deleted synchronously. */
+    }
+
+    mfs_mutex_lock(&pInternal->lock);
+    {
+        while (pInternal->pHead != NULL || pInternal->isBusy) {
+            mfs_cond_wait(&pInternal->cond, &pInternal->lock);
+        }
+    }
+    mfs_mutex_unlock(&pInternal->lock);
+}
+
+static mfs_result mfs_reaper_make_trash_directory(const char* pParentDirectory, char** ppTrashDirectory)
+{
+    mfs_result result;
+    char* pTrashDirectory;
+    size_t trashDirectoryLen;
+
+    *ppTrashDirectory = NULL;
+
+    result = mfs_path_append(NULL, 0, pParentDirectory, MFS_TRASH_DIRECTORY_NAME, &trashDirectoryLen);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    pTrashDirectory = (char*)MFS_MALLOC(trashDirectoryLen + 1);
+    if (pTrashDirectory == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    mfs_path_append(pTrashDirectory, trashDirectoryLen + 1, pParentDirectory, MFS_TRASH_DIRECTORY_NAME, NULL);
+
+    result = mfs_mkdir(pTrashDirectory, MFS_FALSE);
+    if (result == MFS_ALREADY_EXISTS && mfs_is_directory(pTrashDirectory)) {
+        result = MFS_SUCCESS;
+    }
+
+    if (result != MFS_SUCCESS) {
+        MFS_FREE(pTrashDirectory);
+        return result;
+    }
+
+#if defined(MFS_WIN32)
+    SetFileAttributesA(pTrashDirectory, FILE_ATTRIBUTE_HIDDEN);
+#endif
+
+    *ppTrashDirectory = pTrashDirectory;
+    return MFS_SUCCESS;
+}
+
+static mfs_result mfs_reaper_get_trash_directory(const char* pDirectory, char** ppTrashDirectory)
+{
+    /*
+    The trash directory must be on the same volume as the directory being deleted so that moving into it is a rename. The root of
+    the volume is found by walking up from the parent until the device changes.
+    */
+    mfs_result result;
+    char* pParentDirectory;
+    char* pVolumeRoot;
+    size_t parentDirectoryLen;
+
+    result = mfs_path_base_path(NULL, 0, pDirectory, &parentDirectoryLen);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    pParentDirectory = (char*)MFS_MALLOC(parentDirectoryLen + 2);   /* +2 for "." when empty. */
+    if (pParentDirectory == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    mfs_path_base_path(pParentDirectory, parentDirectoryLen + 1, pDirectory, NULL);
+    if (pParentDirectory[0] == '\0') {
+        if (pDirectory[0] == '/') {
+            pParentDirectory[0] = '/';
+        } else {
+            pParentDirectory[0] = '.';
+        }
+        pParentDirectory[1] = '\0';
+    }
+
+    pVolumeRoot = NULL;
+
+#if defined(MFS_WIN32)
+    {
+        char volumeRoot[MAX_PATH];
+        if (GetVolumePathNameA(pParentDirectory, volumeRoot, sizeof(volumeRoot))) {
+            pVolumeRoot = (char*)MFS_MALLOC(strlen(volumeRoot) + 1);
+            if (pVolumeRoot != NULL) {
+                MFS_COPY_MEMORY(pVolumeRoot, volumeRoot, strlen(volumeRoot) + 1);
+            }
+        }
+    }
+#elif defined(MFS_POSIX)
+    {
+        char* pRealPath;
+        struct stat info;
+        dev_t device;
+
+        pRealPath = realpath(pParentDirectory, NULL);
+        if (pRealPath != NULL && stat(pRealPath, &info) == 0) {
+            pVolumeRoot = (char*)MFS_MALLOC(strlen(pRealPath) + 1);
+            if (pVolumeRoot != NULL) {
+                MFS_COPY_MEMORY(pVolumeRoot, pRealPath, strlen(pRealPath) + 1);
+                device = info.st_dev;
+
+                /* Walk up in place by truncating at the last separator. */
+                while (strcmp(pVolumeRoot, "/") != 0) {
+                    size_t parentLen = (size_t)(strrchr(pVolumeRoot, '/') - pVolumeRoot);
+                    char truncated;
+
+                    if (parentLen == 0) {
+                        parentLen = 1;  /* Keep the "/". */
+                    }
+
+                    truncated = pVolumeRoot[parentLen];
+                    pVolumeRoot[parentLen] = '\0';
+
+                    if (stat(pVolumeRoot, &info) != 0 || info.st_dev != device) {
+                        pVolumeRoot[parentLen] = truncated; /* Went too far. */
+                        break;
+                    }
+                }
+            }
+        }
+
+        free(pRealPath);    /* Allocated by realpath(). */
+    }
+#endif
+
+    result = MFS_INVALID_OPERATION;
+    if (pVolumeRoot != NULL) {
+        result = mfs_reaper_make_trash_directory(pVolumeRoot, ppTrashDirectory);
+        MFS_FREE(pVolumeRoot);
+    }
+
+    /* The root of the volume is often not writable, in which case the trash goes next to the directory. */
+    if (result != MFS_SUCCESS) {
+        result = mfs_reaper_make_trash_directory(pParentDirectory, ppTrashDirectory);
+    }
+
+    MFS_FREE(pParentDirectory);
+    return result;
+}
+
+static void mfs_reaper_format_hex(char* pDst, mfs_uint32 value)
+{
+    /* Writes exactly 8 characters with no null terminator. */
+    int i;
+    for (i = 7; i >= 0; i -= 1) {
+        pDst[i] = "0123456789abcdef"[value & 0xF];
+        value >>= 4;
+    }
+}
+
+mfs_result mfs_rmdir_async(mfs_reaper* pReaper, const char* pDirectory)
+{
+    mfs_result result;
+    mfs_reaper_internal* pInternal;
+    char* pTrashDirectory;
+    char* pTrashPath;
+    size_t trashPathCap;
+    size_t trashDirectoryLen;
+    mfs_uint32 attempt;
+
+    if (pReaper == NULL || pReaper->pInternal == NULL || pDirectory == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    pInternal = (mfs_reaper_internal*)pReaper->pInternal;
+
+#if defined(MFS_POSIX)
+    {
+        struct stat info;
+        if (lstat(pDirectory, &info) != 0) {
+            return mfs_result_from_errno(errno);
+        }
+
+        if (!S_ISDIR(info.st_mode)) {
+            return MFS_NOT_DIRECTORY;
+        }
+    }
+#else
+    if (mfs_is_directory(pDirectory) == MFS_FALSE) {
+        return MFS_NOT_DIRECTORY;
+    }
+#endif
+
+    result = mfs_reaper_get_trash_directory(pDirectory, &pTrashDirectory);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    /* The name is a 16 character timestamp and an 8 character counter separated by a dash. */
+    trashDirectoryLen = strlen(pTrashDirectory);
+    trashPathCap = trashDirectoryLen + 1 + 16 + 1 + 8 + 1;
+    pTrashPath = (char*)MFS_MALLOC(trashPathCap);
+    if (pTrashPath == NULL) {
+        MFS_FREE(pTrashDirectory);
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    MFS_COPY_MEMORY(pTrashPath, pTrashDirectory, trashDirectoryLen);
+    pTrashPath[trashDirectoryLen] = '/';
+
+    /* The name only needs to be unique within the trash. A clash is only possible when another process is trashing at the same time. */
+    for (attempt = 0; attempt < 16; attempt += 1) {
+        mfs_uint64 time = mfs_get_time_ns();
+        mfs_uint32 counter;
+
+        mfs_mutex_lock(&pInternal->lock);
+        {
+            counter = pInternal->counter;
+            pInternal->counter += 1;
+        }
+        mfs_mutex_unlock(&pInternal->lock);
+
+        mfs_reaper_format_hex(pTrashPath + trashDirectoryLen + 1,      (mfs_uint32)(time >> 32));
+        mfs_reaper_format_hex(pTrashPath + trashDirectoryLen + 1 + 8,  (mfs_uint32)(time & 0xFFFFFFFF));
+        pTrashPath[trashDirectoryLen + 1 + 16] = '-';
+        mfs_reaper_format_hex(pTrashPath + trashDirectoryLen + 1 + 17, counter);
+        pTrashPath[trashDirectoryLen + 1 + 25] = '\0';
+
+    #if defined(MFS_WIN32)
+        if (MoveFileExA(pDirectory, pTrashPath, 0)) {
+            result = MFS_SUCCESS;
+        } else {
+            result = mfs_result_from_GetLastError(GetLastError());
+        }
+    #elif defined(MFS_POSIX)
+        result = mfs_rename_noreplace__posix(pDirectory, pTrashPath);
+    #else
+        result = MFS_NOT_IMPLEMENTED;
     #endif
-    #ifdef ENAVAIL
-        case ENAVAIL: return MFS_ERROR;
+
+        if (result != MFS_ALREADY_EXISTS) {
+            break;
+        }
+    }
+
+    if (result == MFS_SUCCESS) {
+        result = mfs_reaper_enqueue(pReaper, pTrashPath);
+        if (result != MFS_SUCCESS) {
+            result = MFS_SUCCESS;   /* The directory is in the trash so it'll be cleaned up at the next init. As far as the caller is concerned it's gone. */
+        }
+    }
+
+    MFS_FREE(pTrashPath);
+    MFS_FREE(pTrashDirectory);
+
+    return result;
+}
+
+mfs_result mfs_delete_file(const char* pFilePath)
+{
+    if (pFilePath == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+#if defined(MFS_WIN32)
+    return mfs_delete_file__win32(pFilePath);
+#elif defined(MFS_POSIX)
+    return mfs_delete_file__posix(pFilePath);
+#else
+    return MFS_NOT_IMPLEMENTED;
+#endif
+}
+
+
+#if defined(MFS_WIN32)
+mfs_result mfs_get_file_info__win32(const char* pFilePath, mfs_file_info* pFileInfo)
+{
+    MFS_ASSERT(pFilePath != NULL);
+
+    /* pFileInfo can be null, in which case it's equivalent to just checking if the file exist. */
+    if (pFileInfo == NULL) {
+        if (GetFileAttributesA(pFilePath) != INVALID_FILE_ATTRIBUTES) {
+            return MFS_SUCCESS;
+        }
+
+        return MFS_DOES_NOT_EXIST;
+    } else {
+        WIN32_FILE_ATTRIBUTE_DATA fad;
+        if (GetFileAttributesExA(pFilePath, GetFileExInfoStandard, &fad)) {
+            ULARGE_INTEGER li;
+
+            li.LowPart  = fad.nFileSizeLow;
+            li.HighPart = fad.nFileSizeHigh;
+            pFileInfo->sizeInBytes = li.QuadPart;
+
+            li.LowPart  = fad.ftLastWriteTime.dwLowDateTime;
+            li.HighPart = fad.ftLastWriteTime.dwHighDateTime;
+            pFileInfo->lastModifiedTime = li.QuadPart;
+
+            li.LowPart  = fad.ftLastAccessTime.dwLowDateTime;
+            li.HighPart = fad.ftLastAccessTime.dwHighDateTime;
+            pFileInfo->lastAccessTime = li.QuadPart;
+
+            pFileInfo->isDirectory = (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+            pFileInfo->isReadOnly  = (fad.dwFileAttributes & FILE_ATTRIBUTE_READONLY)  != 0;
+
+            return MFS_SUCCESS;
+        }
+
+        return MFS_DOES_NOT_EXIST;
+    }
+}
+#elif defined(MFS_POSIX)
+mfs_result mfs_get_file_info__posix(const char* pFilePath, mfs_file_info* pFileInfo)
+{
+    struct stat info;
+
+    MFS_ASSERT(pFilePath != NULL);
+
+    if (stat(pFilePath, &info) != 0) {
+        return mfs_result_from_errno(errno);
+    }
+
+    if (pFileInfo != NULL) {
+        pFileInfo->sizeInBytes      = info.st_size;
+        pFileInfo->lastModifiedTime = info.st_mtime;
+        pFileInfo->lastAccessTime   = info.st_atime;
+        pFileInfo->isDirectory      = S_ISDIR(info.st_mode);
+        pFileInfo->isReadOnly       = (access(pFilePath, W_OK) != 0);
+    }
+
+    return MFS_SUCCESS;
+}
+#endif
+
+mfs_result mfs_get_file_info(const char* pFilePath, mfs_file_info* pFileInfo)
+{
+    if (mfs_string_is_null_or_empty(pFilePath)) {
+        return MFS_INVALID_ARGS;
+    }
+
+    /*
+    The caller will always have access to the original file path so I think it's OK to just copy as much of the name into the pre-allocated space
+    as possible and just truncate the rest. This will cover the majority of cases. Since the caller already has access to the original path, I
+    think this might be more useful to just store the file name portion rather than the whole path.
+    */
+    if (pFileInfo != NULL) {
+        mfs_strncpy_s(pFileInfo->pFileName, sizeof(pFileInfo->pFileName), mfs_path_file_name(pFilePath), (size_t)-1);
+    }
+
+#if defined(MFS_WIN32)
+    return mfs_get_file_info__win32(pFilePath, pFileInfo);
+#elif defined(MFS_POSIX)
+    return mfs_get_file_info__posix(pFilePath, pFileInfo);
+#else
+    return MFS_NOT_IMPLEMENTED; /* Unsupported platform. */
+#endif
+}
+
+
+#if defined(MFS_WIN32)
+static mfs_int64 mfs_FILETIME_to_unix_time_ns(FILETIME ft)
+{
+    ULARGE_INTEGER li;
+
+    li.LowPart  = ft.dwLowDateTime;
+    li.HighPart = ft.dwHighDateTime;
+
+    /* FILETIME is in 100-nanosecond intervals since 1601. */
+    return ((mfs_int64)li.QuadPart - (mfs_int64)MFS_UINT64_CONST(0x019DB1DE, 0xD53E8000)) * 100;
+}
+
+mfs_result mfs_get_file_info_ex__win32(const char* pFilePath, mfs_uint32 fields, mfs_file_info_ex* pFileInfo)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    ULARGE_INTEGER li;
+
+    if (!GetFileAttributesExA(pFilePath, GetFileExInfoStandard, &fad)) {
+        return mfs_result_from_GetLastError(GetLastError());
+    }
+
+    li.LowPart  = fad.nFileSizeLow;
+    li.HighPart = fad.nFileSizeHigh;
+
+    if ((fad.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0 && (fields & MFS_FILE_INFO_FLAG_NO_FOLLOW) != 0) {
+        pFileInfo->type = MFS_FILE_TYPE_SYMLINK;
+    } else if ((fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+        pFileInfo->type = MFS_FILE_TYPE_DIRECTORY;
+    } else {
+        pFileInfo->type = MFS_FILE_TYPE_FILE;
+    }
+
+    pFileInfo->sizeInBytes      = li.QuadPart;
+    pFileInfo->lastModifiedTime = mfs_FILETIME_to_unix_time_ns(fad.ftLastWriteTime);
+    pFileInfo->lastAccessTime   = mfs_FILETIME_to_unix_time_ns(fad.ftLastAccessTime);
+    pFileInfo->birthTime        = mfs_FILETIME_to_unix_time_ns(fad.ftCreationTime);
+    pFileInfo->isReadOnly       = (fad.dwFileAttributes & FILE_ATTRIBUTE_READONLY) != 0;
+    pFileInfo->fields           = MFS_FILE_INFO_FIELD_TYPE | MFS_FILE_INFO_FIELD_SIZE | MFS_FILE_INFO_FIELD_TIMES | MFS_FILE_INFO_FIELD_BIRTH_TIME | MFS_FILE_INFO_FIELD_READ_ONLY;
+
+    /* The rest can only be retrieved from a handle. */
+    if ((fields & (MFS_FILE_INFO_FIELD_INODE | MFS_FILE_INFO_FIELD_LINK_COUNT)) != 0) {
+        HANDLE hFile;
+        BY_HANDLE_FILE_INFORMATION info;
+        DWORD flags = FILE_FLAG_BACKUP_SEMANTICS;   /* Required for opening directories. */
+
+        if ((fields & MFS_FILE_INFO_FLAG_NO_FOLLOW) != 0) {
+            flags |= FILE_FLAG_OPEN_REPARSE_POINT;
+        }
+
+        hFile = CreateFileA(pFilePath, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, flags, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            return mfs_result_from_GetLastError(GetLastError());
+        }
+
+        if (!GetFileInformationByHandle(hFile, &info)) {
+            mfs_result result = mfs_result_from_GetLastError(GetLastError());
+            CloseHandle(hFile);
+            return result;
+        }
+
+        CloseHandle(hFile);
+
+        pFileInfo->inode     = ((mfs_uint64)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+        pFileInfo->device    = info.dwVolumeSerialNumber;
+        pFileInfo->linkCount = info.nNumberOfLinks;
+        pFileInfo->fields   |= MFS_FILE_INFO_FIELD_INODE | MFS_FILE_INFO_FIELD_LINK_COUNT;
+    }
+
+    return MFS_SUCCESS;
+}
+#endif
+
+#if defined(MFS_POSIX)
+static mfs_uint32 mfs_file_type_from_mode__posix(mode_t mode)
+{
+    if (S_ISREG(mode)) {
+        return MFS_FILE_TYPE_FILE;
+    }
+    if (S_ISDIR(mode)) {
+        return MFS_FILE_TYPE_DIRECTORY;
+    }
+    if (S_ISLNK(mode)) {
+        return MFS_FILE_TYPE_SYMLINK;
+    }
+
+    return MFS_FILE_TYPE_OTHER;
+}
+
+/*
+Nanosecond timestamps are in st_mtim with POSIX.1-2008, in which case st_mtime is defined as a macro that refers to it. Apple has
+its own names. Otherwise we only have seconds.
+*/
+#if defined(MFS_APPLE)
+    #define MFS_STAT_TIME_NS(info, x)       ((mfs_int64)(info).st_##x##timespec.tv_sec * 1000000000 + (info).st_##x##timespec.tv_nsec)
+    #define MFS_STAT_BIRTH_TIME_NS(info)    ((mfs_int64)(info).st_birthtimespec.tv_sec * 1000000000 + (info).st_birthtimespec.tv_nsec)
+#elif defined(st_mtime)
+    #define MFS_STAT_TIME_NS(info, x)       ((mfs_int64)(info).st_##x##tim.tv_sec * 1000000000 + (info).st_##x##tim.tv_nsec)
+    #if defined(MFS_BSD) && defined(st_birthtime)
+    #define MFS_STAT_BIRTH_TIME_NS(info)    ((mfs_int64)(info).st_birthtim.tv_sec * 1000000000 + (info).st_birthtim.tv_nsec)
     #endif
-    #ifdef EISNAM
-        case EISNAM: return MFS_ERROR;
+#endif
+
+static void mfs_file_info_ex_from_stat__posix(const struct stat* pStatInfo, mfs_uint32 fields, mfs_file_info_ex* pFileInfo)
+{
+    pFileInfo->type             = mfs_file_type_from_mode__posix(pStatInfo->st_mode);
+    pFileInfo->mode             = (mfs_uint32)pStatInfo->st_mode;
+    pFileInfo->uid              = (mfs_uint32)pStatInfo->st_uid;
+    pFileInfo->gid              = (mfs_uint32)pStatInfo->st_gid;
+    pFileInfo->linkCount        = (mfs_uint64)pStatInfo->st_nlink;
+    pFileInfo->inode            = (mfs_uint64)pStatInfo->st_ino;
+    pFileInfo->device           = (mfs_uint64)pStatInfo->st_dev;
+    pFileInfo->sizeInBytes      = (mfs_uint64)pStatInfo->st_size;
+    pFileInfo->blockCount       = (mfs_uint64)pStatInfo->st_blocks;
+#if defined(MFS_STAT_TIME_NS)
+    pFileInfo->lastModifiedTime = MFS_STAT_TIME_NS(*pStatInfo, m);
+    pFileInfo->lastAccessTime   = MFS_STAT_TIME_NS(*pStatInfo, a);
+    pFileInfo->changeTime       = MFS_STAT_TIME_NS(*pStatInfo, c);
+#else
+    pFileInfo->lastModifiedTime = (mfs_int64)pStatInfo->st_mtime * 1000000000;
+    pFileInfo->lastAccessTime   = (mfs_int64)pStatInfo->st_atime * 1000000000;
+    pFileInfo->changeTime       = (mfs_int64)pStatInfo->st_ctime * 1000000000;
+#endif
+    pFileInfo->isReadOnly       = (pStatInfo->st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)) == 0;
+    pFileInfo->fields           = MFS_FILE_INFO_FIELD_ALL & ~MFS_FILE_INFO_FIELD_BIRTH_TIME;
+
+#if defined(MFS_STAT_BIRTH_TIME_NS)
+    pFileInfo->birthTime        = MFS_STAT_BIRTH_TIME_NS(*pStatInfo);
+    pFileInfo->fields          |= MFS_FILE_INFO_FIELD_BIRTH_TIME;
+#endif
+
+    (void)fields;
+}
+
+#if defined(MFS_HAS_SYSCALL) && defined(SYS_statx) && defined(AT_FDCWD)
+#define MFS_HAS_STATX
+
+/* Our own copy of struct statx so we don't depend on the version of the kernel headers. */
+typedef struct
+{
+    mfs_int64 tv_sec;
+    mfs_uint32 tv_nsec;
+    mfs_int32 reserved;
+} mfs_statx_timestamp;
+
+typedef struct
+{
+    mfs_uint32 stx_mask;
+    mfs_uint32 stx_blksize;
+    mfs_uint64 stx_attributes;
+    mfs_uint32 stx_nlink;
+    mfs_uint32 stx_uid;
+    mfs_uint32 stx_gid;
+    mfs_uint16 stx_mode;
+    mfs_uint16 spare0;
+    mfs_uint64 stx_ino;
+    mfs_uint64 stx_size;
+    mfs_uint64 stx_blocks;
+    mfs_uint64 stx_attributes_mask;
+    mfs_statx_timestamp stx_atime;
+    mfs_statx_timestamp stx_btime;
+    mfs_statx_timestamp stx_ctime;
+    mfs_statx_timestamp stx_mtime;
+    mfs_uint32 stx_rdev_major;
+    mfs_uint32 stx_rdev_minor;
+    mfs_uint32 stx_dev_major;
+    mfs_uint32 stx_dev_minor;
+    mfs_uint64 spare2[14];
+} mfs_statx;
+
+#define MFS_STATX_TYPE              0x00000001
+#define MFS_STATX_MODE              0x00000002
+#define MFS_STATX_NLINK             0x00000004
+#define MFS_STATX_UID               0x00000008
+#define MFS_STATX_GID               0x00000010
+#define MFS_STATX_ATIME             0x00000020
+#define MFS_STATX_MTIME             0x00000040
+#define MFS_STATX_CTIME             0x00000080
+#define MFS_STATX_INO               0x00000100
+#define MFS_STATX_SIZE              0x00000200
+#define MFS_STATX_BLOCKS            0x00000400
+#define MFS_STATX_BTIME             0x00000800
+#define MFS_AT_STATX_DONT_SYNC      0x00004000
+
+static mfs_int64 mfs_statx_timestamp_to_ns(const mfs_statx_timestamp* pTimestamp)
+{
+    return pTimestamp->tv_sec * 1000000000 + pTimestamp->tv_nsec;
+}
+
+static mfs_uint64 mfs_statx_make_device(mfs_uint32 major, mfs_uint32 minor)
+{
+    /* The same encoding as glibc's makedev() so devices can be compared with st_dev. */
+    return (((mfs_uint64)(major & 0xFFFFF000) << 32) | ((mfs_uint64)(major & 0x00000FFF) << 8) |
+            ((mfs_uint64)(minor & 0xFFFFFF00) << 12) | ((mfs_uint64)(minor & 0x000000FF)));
+}
+
+static int mfs_get_file_info_statx__posix(int dirFD, const char* pPath, mfs_uint32 fields, mfs_file_info_ex* pFileInfo)
+{
+    mfs_statx stx;
+    unsigned int mask = 0;
+    int flags = MFS_AT_STATX_DONT_SYNC;
+
+    if ((fields & MFS_FILE_INFO_FIELD_TYPE)        != 0) { mask |= MFS_STATX_TYPE; }
+    if ((fields & MFS_FILE_INFO_FIELD_SIZE)        != 0) { mask |= MFS_STATX_SIZE; }
+    if ((fields & MFS_FILE_INFO_FIELD_TIMES)       != 0) { mask |= MFS_STATX_MTIME | MFS_STATX_ATIME; }
+    if ((fields & MFS_FILE_INFO_FIELD_READ_ONLY)   != 0) { mask |= MFS_STATX_MODE; }
+    if ((fields & MFS_FILE_INFO_FIELD_CHANGE_TIME) != 0) { mask |= MFS_STATX_CTIME; }
+    if ((fields & MFS_FILE_INFO_FIELD_BIRTH_TIME)  != 0) { mask |= MFS_STATX_BTIME; }
+    if ((fields & MFS_FILE_INFO_FIELD_INODE)       != 0) { mask |= MFS_STATX_INO; }
+    if ((fields & MFS_FILE_INFO_FIELD_LINK_COUNT)  != 0) { mask |= MFS_STATX_NLINK; }
+    if ((fields & MFS_FILE_INFO_FIELD_MODE)        != 0) { mask |= MFS_STATX_TYPE | MFS_STATX_MODE; }
+    if ((fields & MFS_FILE_INFO_FIELD_OWNER)       != 0) { mask |= MFS_STATX_UID | MFS_STATX_GID; }
+    if ((fields & MFS_FILE_INFO_FIELD_BLOCKS)      != 0) { mask |= MFS_STATX_BLOCKS; }
+
+    if ((fields & MFS_FILE_INFO_FLAG_NO_FOLLOW) != 0) {
+        flags |= AT_SYMLINK_NOFOLLOW;
+    }
+
+    /* Returns an errno code rather than a result code so the caller can tell whether or not statx() is supported. */
+    if (syscall(SYS_statx, dirFD, pPath, flags, mask, &stx) != 0) {
+        return errno;
+    }
+
+    /* The kernel can return more than what was asked for. Only report what we actually need to avoid confusion. */
+    mask &= stx.stx_mask;
+
+    if ((mask & MFS_STATX_TYPE) != 0) {
+        pFileInfo->type = mfs_file_type_from_mode__posix(stx.stx_mode);
+        if ((fields & MFS_FILE_INFO_FIELD_TYPE) != 0) {
+            pFileInfo->fields |= MFS_FILE_INFO_FIELD_TYPE;
+        }
+    }
+    if ((mask & MFS_STATX_SIZE) != 0) {
+        pFileInfo->sizeInBytes = stx.stx_size;
+        pFileInfo->fields |= MFS_FILE_INFO_FIELD_SIZE;
+    }
+    if ((mask & (MFS_STATX_MTIME | MFS_STATX_ATIME)) == (MFS_STATX_MTIME | MFS_STATX_ATIME)) {
+        pFileInfo->lastModifiedTime = mfs_statx_timestamp_to_ns(&stx.stx_mtime);
+        pFileInfo->lastAccessTime   = mfs_statx_timestamp_to_ns(&stx.stx_atime);
+        pFileInfo->fields |= MFS_FILE_INFO_FIELD_TIMES;
+    }
+    if ((mask & MFS_STATX_MODE) != 0) {
+        pFileInfo->isReadOnly = (stx.stx_mode & (S_IWUSR | S_IWGRP | S_IWOTH)) == 0;
+        if ((fields & MFS_FILE_INFO_FIELD_READ_ONLY) != 0) {
+            pFileInfo->fields |= MFS_FILE_INFO_FIELD_READ_ONLY;
+        }
+    }
+    if ((mask & MFS_STATX_CTIME) != 0) {
+        pFileInfo->changeTime = mfs_statx_timestamp_to_ns(&stx.stx_ctime);
+        pFileInfo->fields |= MFS_FILE_INFO_FIELD_CHANGE_TIME;
+    }
+    if ((mask & MFS_STATX_BTIME) != 0) {
+        pFileInfo->birthTime = mfs_statx_timestamp_to_ns(&stx.stx_btime);
+        pFileInfo->fields |= MFS_FILE_INFO_FIELD_BIRTH_TIME;
+    }
+    if ((mask & MFS_STATX_INO) != 0) {
+        /* The device is always returned. */
+        pFileInfo->inode  = stx.stx_ino;
+        pFileInfo->device = mfs_statx_make_device(stx.stx_dev_major, stx.stx_dev_minor);
+        pFileInfo->fields |= MFS_FILE_INFO_FIELD_INODE;
+    }
+    if ((mask & MFS_STATX_NLINK) != 0) {
+        pFileInfo->linkCount = stx.stx_nlink;
+        pFileInfo->fields |= MFS_FILE_INFO_FIELD_LINK_COUNT;
+    }
+    if ((fields & MFS_FILE_INFO_FIELD_MODE) != 0 && (mask & (MFS_STATX_TYPE | MFS_STATX_MODE)) == (MFS_STATX_TYPE | MFS_STATX_MODE)) {
+        pFileInfo->mode = stx.stx_mode;
+        pFileInfo->fields |= MFS_FILE_INFO_FIELD_MODE;
+    }
+    if ((mask & (MFS_STATX_UID | MFS_STATX_GID)) == (MFS_STATX_UID | MFS_STATX_GID)) {
+        pFileInfo->uid = stx.stx_uid;
+        pFileInfo->gid = stx.stx_gid;
+        pFileInfo->fields |= MFS_FILE_INFO_FIELD_OWNER;
+    }
+    if ((mask & MFS_STATX_BLOCKS) != 0) {
+        pFileInfo->blockCount = stx.stx_blocks;
+        pFileInfo->fields |= MFS_FILE_INFO_FIELD_BLOCKS;
+    }
+
+    return 0;
+}
+#endif
+
+/*
+Retrieves information about a file relative to a directory file descriptor, which can be AT_FDCWD. This is used internally by
+anything that walks directories so it can avoid building full paths.
+*/
+static mfs_result mfs_get_file_info_at__posix(int dirFD, const char* pPath, mfs_uint32 fields, mfs_file_info_ex* pFileInfo)
+{
+    struct stat info;
+    int statResult;
+
+    MFS_ZERO_OBJECT(pFileInfo);
+
+#if defined(MFS_HAS_STATX)
+    {
+        static int s_isStatxUnavailable = 0;    /* Set when the kernel doesn't support statx(). Races are harmless. */
+
+        if (s_isStatxUnavailable == 0) {
+            int e = mfs_get_file_info_statx__posix(dirFD, pPath, fields, pFileInfo);
+            if (e == 0) {
+                return MFS_SUCCESS;
+            }
+
+            /* ENOSYS on older kernels, or EPERM from seccomp filters in some containers. */
+            if (e != ENOSYS && e != EPERM) {
+                return mfs_result_from_errno(e);
+            }
+
+            s_isStatxUnavailable = 1;
+            MFS_ZERO_OBJECT(pFileInfo);
+        }
+    }
+#endif
+
+#if defined(AT_FDCWD)
+    statResult = fstatat(dirFD, pPath, &info, ((fields & MFS_FILE_INFO_FLAG_NO_FOLLOW) != 0) ? AT_SYMLINK_NOFOLLOW : 0);
+#else
+    (void)dirFD;
+    if ((fields & MFS_FILE_INFO_FLAG_NO_FOLLOW) != 0) {
+        statResult = lstat(pPath, &info);
+    } else {
+        statResult = stat(pPath, &info);
+    }
+#endif
+    if (statResult != 0) {
+        return mfs_result_from_errno(errno);
+    }
+
+    mfs_file_info_ex_from_stat__posix(&info, fields, pFileInfo);
+
+    return MFS_SUCCESS;
+}
+#endif
+
+mfs_result mfs_get_file_info_ex(const char* pFilePath, mfs_uint32 fields, mfs_file_info_ex* pFileInfo)
+{
+    if (pFileInfo != NULL) {
+        MFS_ZERO_OBJECT(pFileInfo);
+    }
+
+    if (mfs_string_is_null_or_empty(pFilePath) || pFileInfo == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+#if defined(MFS_WIN32)
+    return mfs_get_file_info_ex__win32(pFilePath, fields, pFileInfo);
+#elif defined(MFS_POSIX)
+    #if defined(AT_FDCWD)
+    return mfs_get_file_info_at__posix(AT_FDCWD, pFilePath, fields, pFileInfo);
+    #else
+    return mfs_get_file_info_at__posix(-1, pFilePath, fields, pFileInfo);
     #endif
-    #ifdef EREMOTEIO
-        case EREMOTEIO: return MFS_IO_ERROR;
+#else
+    (void)fields;
+    return MFS_NOT_IMPLEMENTED; /* Unsupported platform. */
+#endif
+}
+
+#define MFS_FILE_INFO_MANY_CHUNK_SIZE       64  /* The most paths given to a thread at once. */
+#define MFS_FILE_INFO_MANY_MAX_THREADS      16  /* Lookups mostly wait on the file system rather than the CPU, so this isn't tied to the CPU count. */
+#define MFS_FILE_INFO_MANY_MIN_RELATIVE     4   /* Opening a directory costs a lookup of its own, so it's not worth it for fewer paths than this. */
+
+typedef struct
+{
+    const char* pParent;    /* Points into the first path in the group. */
+    size_t parentLength;    /* 0 for paths that need to be looked up in full. */
+    size_t head;            /* Indices of paths in the group are linked through pNext. */
+    size_t tail;
+    size_t count;
+} mfs_file_info_many_group;
+
+typedef struct
+{
+    mfs_job job;
+    const char** ppPaths;
+    const size_t* pOrder;
+    size_t first;           /* Into pOrder. */
+    size_t count;
+    size_t parentLength;    /* The same for every path in the job. */
+    mfs_uint32 fields;
+    mfs_file_info_ex* pInfos;
+    mfs_result* pResults;
+} mfs_file_info_many_job;
+
+static size_t mfs_file_info_many_parent_length(const char* pPath)
+{
+    /* Returns 0 when the path can't safely be looked up relative to its parent, in which case the full path is used. */
+    size_t length = strlen(pPath);
+    size_t separator = length;
+    const char* pName;
+
+    while (separator > 0 && mfs_is_path_separator(pPath[separator - 1]) == MFS_FALSE) {
+        separator -= 1;
+    }
+
+    if (separator == 0) {
+        return 0;
+    }
+
+    pName = pPath + separator;
+    if (pName[0] == '\0' || (pName[0] == '.' && (pName[1] == '\0' || (pName[1] == '.' && pName[2] == '\0')))) {
+        return 0;
+    }
+
+    return separator;   /* Includes the trailing separator, which makes "/" work for files in the root directory. */
+}
+
+static size_t mfs_file_info_many_hash(const char* pParent, size_t parentLength)
+{
+    /* FNV-1a. */
+    mfs_uint32 hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < parentLength; i += 1) {
+        hash ^= (mfs_uint8)pParent[i];
+        hash *= 16777619u;
+    }
+
+    return (size_t)hash;
+}
+
+static void mfs_file_info_many_process(mfs_job* pJob)
+{
+    mfs_file_info_many_job* pManyJob = (mfs_file_info_many_job*)pJob;
+    size_t iPath;
+#if defined(MFS_POSIX) && defined(AT_FDCWD) && defined(O_DIRECTORY) && defined(O_CLOEXEC)
+    int dirFD = -1;
+
+    if (pManyJob->parentLength > 0 && pManyJob->count >= MFS_FILE_INFO_MANY_MIN_RELATIVE) {
+        char pStackParent[256];
+        char* pParent = pStackParent;
+
+        if (pManyJob->parentLength + 1 > sizeof(pStackParent)) {
+            pParent = (char*)MFS_MALLOC(pManyJob->parentLength + 1);
+        }
+
+        if (pParent != NULL) {
+            MFS_COPY_MEMORY(pParent, pManyJob->ppPaths[pManyJob->pOrder[pManyJob->first]], pManyJob->parentLength);
+            pParent[pManyJob->parentLength] = '\0';
+
+            dirFD = open(pParent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+            if (pParent != pStackParent) {
+                MFS_FREE(pParent);
+            }
+        }
+    }
+#endif
+
+    for (iPath = pManyJob->first; iPath < pManyJob->first + pManyJob->count; iPath += 1) {
+        size_t index = pManyJob->pOrder[iPath];
+
+    #if defined(MFS_POSIX) && defined(AT_FDCWD) && defined(O_DIRECTORY) && defined(O_CLOEXEC)
+        if (dirFD >= 0) {
+            pManyJob->pResults[index] = mfs_get_file_info_at__posix(dirFD, pManyJob->ppPaths[index] + pManyJob->parentLength, pManyJob->fields, &pManyJob->pInfos[index]);
+            continue;
+        }
     #endif
-    #ifdef EDQUOT
-        case EDQUOT: return MFS_NO_SPACE;
+
+        pManyJob->pResults[index] = mfs_get_file_info_ex(pManyJob->ppPaths[index], pManyJob->fields, &pManyJob->pInfos[index]);
+    }
+
+#if defined(MFS_POSIX) && defined(AT_FDCWD) && defined(O_DIRECTORY) && defined(O_CLOEXEC)
+    if (dirFD >= 0) {
+        close(dirFD);
+    }
+#endif
+}
+
+mfs_result mfs_get_file_info_many(const char** ppPaths, size_t count, mfs_uint32 fields, mfs_file_info_ex* pInfos, mfs_result* pResults)
+{
+    mfs_file_info_many_group* pGroups;
+    mfs_file_info_many_job* pJobs;
+    size_t* pSlots;
+    size_t* pNext;
+    size_t* pOrder;
+    mfs_result result = MFS_SUCCESS;
+    size_t slotCount;
+    size_t groupCount = 0;
+    size_t jobCount = 0;
+    size_t iPath;
+    size_t iGroup;
+    size_t iOrder;
+    size_t iJob;
+    mfs_uint32 threadCount;
+
+    if (ppPaths == NULL || pInfos == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (count == 0) {
+        return MFS_SUCCESS;
+    }
+
+    slotCount = 16;
+    while (slotCount < count * 2) {
+        slotCount *= 2;
+    }
+
+    /* Everything is in one allocation. The jobs can't outnumber the paths. */
+    pGroups = (mfs_file_info_many_group*)MFS_MALLOC((sizeof(*pGroups) + sizeof(*pJobs) + sizeof(*pNext) + sizeof(*pOrder) + ((pResults == NULL) ? sizeof(*pResults) : 0)) * count + sizeof(*pSlots) * slotCount);
+    if (pGroups == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    pJobs  = (mfs_file_info_many_job*)(pGroups + count);
+    pNext  = (size_t*)(pJobs + count);
+    pOrder = pNext  + count;
+    pSlots = pOrder + count;
+    if (pResults == NULL) {
+        pResults = (mfs_result*)(pSlots + slotCount);
+    }
+
+    MFS_ZERO_MEMORY(pSlots, sizeof(*pSlots) * slotCount);
+
+    /* Paths are grouped by their parent. Slots hold the index of the group plus one so that 0 can mean empty. */
+    for (iPath = 0; iPath < count; iPath += 1) {
+        const char* pPath = ppPaths[iPath];
+        size_t parentLength;
+        size_t iSlot;
+        mfs_file_info_many_group* pGroup = NULL;
+
+        if (pPath == NULL || pPath[0] == '\0') {
+            MFS_ZERO_OBJECT(&pInfos[iPath]);
+            pResults[iPath] = MFS_INVALID_ARGS;
+            continue;
+        }
+
+        parentLength = mfs_file_info_many_parent_length(pPath);
+
+        iSlot = mfs_file_info_many_hash(pPath, parentLength) & (slotCount - 1);
+        while (pSlots[iSlot] != 0) {
+            mfs_file_info_many_group* pCandidate = &pGroups[pSlots[iSlot] - 1];
+
+            if (pCandidate->parentLength == parentLength && memcmp(pCandidate->pParent, pPath, parentLength) == 0) {
+                pGroup = pCandidate;
+                break;
+            }
+
+            iSlot = (iSlot + 1) & (slotCount - 1);
+        }
+
+        if (pGroup == NULL) {
+            pGroup = &pGroups[groupCount];
+            pGroup->pParent      = pPath;
+            pGroup->parentLength = parentLength;
+            pGroup->head         = iPath;
+            pGroup->count        = 0;
+            groupCount += 1;
+            pSlots[iSlot] = groupCount;
+        } else {
+            pNext[pGroup->tail] = iPath;
+        }
+
+        pGroup->tail   = iPath;
+        pGroup->count += 1;
+    }
+
+    /* Each group is laid out contiguously and then cut into jobs. */
+    iOrder = 0;
+    for (iGroup = 0; iGroup < groupCount; iGroup += 1) {
+        const mfs_file_info_many_group* pGroup = &pGroups[iGroup];
+        size_t groupStart = iOrder;
+        size_t iMember = pGroup->head;
+
+        for (iPath = 0; iPath < pGroup->count; iPath += 1) {
+            pOrder[iOrder] = iMember;
+            iOrder += 1;
+            iMember = pNext[iMember];
+        }
+
+        for (iPath = 0; iPath < pGroup->count; iPath += MFS_FILE_INFO_MANY_CHUNK_SIZE) {
+            mfs_file_info_many_job* pJob = &pJobs[jobCount];
+
+            pJob->job.onProcess = mfs_file_info_many_process;
+            pJob->ppPaths       = ppPaths;
+            pJob->pOrder        = pOrder;
+            pJob->first         = groupStart + iPath;
+            pJob->count         = (pGroup->count - iPath < MFS_FILE_INFO_MANY_CHUNK_SIZE) ? pGroup->count - iPath : MFS_FILE_INFO_MANY_CHUNK_SIZE;
+            pJob->parentLength  = pGroup->parentLength;
+            pJob->fields        = fields;
+            pJob->pInfos        = pInfos;
+            pJob->pResults      = pResults;
+            jobCount += 1;
+        }
+    }
+
+    threadCount = (jobCount < MFS_FILE_INFO_MANY_MAX_THREADS) ? (mfs_uint32)jobCount : MFS_FILE_INFO_MANY_MAX_THREADS;
+    if (threadCount > 1) {
+        mfs_worker_pool pool;
+
+        mfs_worker_pool_init(threadCount, MFS_IO_PRIORITY_DEFAULT, &pool);
+        for (iJob = 0; iJob < jobCount; iJob += 1) {
+            mfs_worker_pool_post(&pool, &pJobs[iJob].job);
+        }
+        mfs_worker_pool_wait(&pool);
+        mfs_worker_pool_uninit(&pool);
+    } else {
+        for (iJob = 0; iJob < jobCount; iJob += 1) {
+            mfs_file_info_many_process(&pJobs[iJob].job);
+        }
+    }
+
+    for (iPath = 0; iPath < count; iPath += 1) {
+        if (pResults[iPath] != MFS_SUCCESS) {
+            result = pResults[iPath];
+            break;
+        }
+    }
+
+    MFS_FREE(pGroups);  /* <-- Also frees pResults if it was allocated internally. */
+
+    return result;
+}
+
+
+#define MFS_ITERATOR_DEFAULT_BUFFER_SIZE    32768
+#define MFS_ITERATOR_MIN_BUFFER_SIZE        4096
+#define MFS_ITERATOR_MAX_NAME_SIZE          1024    /* For when names need to be copied into the buffer. Generous since some platforms allow names longer than 255 bytes. */
+
+static mfs_result mfs_iterator_alloc_buffer(mfs_iterator* pIterator)
+{
+    if (pIterator->pBuffer != NULL) {
+        return MFS_SUCCESS;
+    }
+
+    if (pIterator->bufferSize == 0) {
+        pIterator->bufferSize = MFS_ITERATOR_DEFAULT_BUFFER_SIZE;
+    }
+
+    pIterator->pBuffer = (char*)MFS_MALLOC(pIterator->bufferSize);
+    if (pIterator->pBuffer == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    return MFS_SUCCESS;
+}
+
+
+#if defined(MFS_WIN32)
+mfs_result mfs_WIN32_FIND_DATAA_to_file_info(const WIN32_FIND_DATAA* pWin32FindData, mfs_file_info* pFileInfo)
+{
+    ULARGE_INTEGER li;
+
+    MFS_ASSERT(pWin32FindData != NULL);
+    MFS_ASSERT(pFileInfo != NULL);
+
+    /* Slashes need to be normalized to forward slashes. */
+    mfs_path_to_forward_slashes(pFileInfo->pFileName, sizeof(pFileInfo->pFileName), pWin32FindData->cFileName, NULL);
+
+    li.LowPart  = pWin32FindData->nFileSizeLow;
+    li.HighPart = pWin32FindData->nFileSizeHigh;
+    pFileInfo->sizeInBytes = li.QuadPart;
+
+    li.LowPart  = pWin32FindData->ftLastWriteTime.dwLowDateTime;
+    li.HighPart = pWin32FindData->ftLastWriteTime.dwHighDateTime;
+    pFileInfo->lastModifiedTime = li.QuadPart;
+
+    li.LowPart  = pWin32FindData->ftLastAccessTime.dwLowDateTime;
+    li.HighPart = pWin32FindData->ftLastAccessTime.dwHighDateTime;
+    pFileInfo->lastAccessTime = li.QuadPart;
+    
+    pFileInfo->isDirectory = (pWin32FindData->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    pFileInfo->isReadOnly  = (pWin32FindData->dwFileAttributes & FILE_ATTRIBUTE_READONLY)  != 0;
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_iterator_init__win32(const char* pDirectoryPath, mfs_iterator* pIterator)
+{
+    mfs_result result;
+    char query[MAX_PATH];
+    size_t queryLen;
+    WIN32_FIND_DATAA fd;
+
+    MFS_ASSERT(pDirectoryPath != NULL);
+    MFS_ASSERT(pIterator != NULL);
+
+    /* We need to make sure slashes are normalized to back slashes for Win32. */
+    result = mfs_path_to_back_slashes(query, sizeof(query), pDirectoryPath, &queryLen);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    if (queryLen >= MAX_PATH-3) {
+        return MFS_PATH_TOO_LONG;
+    }
+
+    /* An empty path means the current directory. */
+    if (query[0] == '\0') {
+        query[0] = '.';
+        query[1] = '\0';
+        queryLen += 1;
+    }
+
+    /* We need to add a wildcard, making sure we don't duplicate any trailing slash. */
+    if (query[queryLen-1] == '\\' || query[queryLen-1] == '/') {
+        query[queryLen+0] = '*';
+        query[queryLen+1] = '\0';
+        queryLen += 1;
+    } else {
+        query[queryLen+0] = '\\';
+        query[queryLen+1] = '*';
+        query[queryLen+2] = '\0';
+        queryLen += 2;
+    }
+
+    pIterator->win32.handle = (mfs_handle)FindFirstFileA(query, &fd);
+    if (pIterator->win32.handle == INVALID_HANDLE_VALUE) {
+        pIterator->win32.handle = NULL;
+        return mfs_result_from_GetLastError(GetLastError());
+    };
+
+    result = mfs_WIN32_FIND_DATAA_to_file_info(&fd, &pIterator->win32.fi);
+    if (result != MFS_SUCCESS) {
+        FindClose((HANDLE)pIterator->win32.handle);
+        pIterator->win32.handle = NULL;
+        return result;
+    }
+
+    pIterator->win32.atEnd = MFS_FALSE;
+
+    return MFS_SUCCESS;
+}
+
+void mfs_iterator_uninit__win32(mfs_iterator* pIterator)
+{
+    MFS_ASSERT(pIterator != NULL);
+
+    FindClose((HANDLE)pIterator->win32.handle);
+    pIterator->win32.handle = NULL;
+}
+
+mfs_result mfs_iterator_next__win32(mfs_iterator* pIterator, mfs_file_info* pFileInfo)
+{
+    WIN32_FIND_DATAA fd;
+
+    MFS_ASSERT(pIterator != NULL);
+
+    if (pIterator->win32.atEnd) {
+        return MFS_AT_END;
+    }
+
+    MFS_ASSERT(pIterator->win32.atEnd == MFS_FALSE);
+
+    /* The file info will have already been retrieved. The first file is retrieved in mfs_iterator_init__win32(). */
+    if (pFileInfo != NULL) {
+        MFS_COPY_MEMORY(pFileInfo, &pIterator->win32.fi, sizeof(*pFileInfo));
+    }
+
+    /* Now we need to get the next file and store the info. */
+    if (FindNextFileA((HANDLE)pIterator->win32.handle, &fd)) {
+        mfs_WIN32_FIND_DATAA_to_file_info(&fd, &pIterator->win32.fi);
+    } else {
+        pIterator->win32.atEnd = MFS_TRUE;  /* Reached the end. */
+    }
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_iterator_next_batch__win32(mfs_iterator* pIterator, mfs_directory_entry* pEntries, size_t capacity, size_t* pCount)
+{
+    /* There's no bulk API for the ANSI functions so names are just packed into the buffer. */
+    size_t count = 0;
+    size_t nameLength;
+
+    while (count < capacity && pIterator->win32.atEnd == MFS_FALSE) {
+        nameLength = strlen(pIterator->win32.fi.pFileName);
+        if (pIterator->bufferEnd + nameLength+1 > pIterator->bufferSize) {
+            break;
+        }
+
+        pEntries[count].pName      = pIterator->pBuffer + pIterator->bufferEnd;
+        pEntries[count].nameLength = nameLength;
+        pEntries[count].inode      = 0;
+        pEntries[count].type       = pIterator->win32.fi.isDirectory ? MFS_FILE_TYPE_DIRECTORY : MFS_FILE_TYPE_FILE;
+        MFS_COPY_MEMORY(pIterator->pBuffer + pIterator->bufferEnd, pIterator->win32.fi.pFileName, nameLength+1);
+        pIterator->bufferEnd += nameLength+1;
+
+        mfs_iterator_next__win32(pIterator, NULL);
+        count += 1;
+    }
+
+    pIterator->bufferCursor = pIterator->bufferEnd; /* The buffer only holds names that have already been returned. */
+
+    *pCount = count;
+    return (count > 0) ? MFS_SUCCESS : MFS_AT_END;
+}
+#endif
+
+#if defined(MFS_POSIX)
+/*
+On Linux we bypass readdir() and read entries straight into our own buffer with getdents64(). This lets the caller control the size of
+the buffer, and lets mfs_iterator_next_batch() return names without copying them.
+*/
+#if defined(MFS_HAS_SYSCALL) && defined(SYS_getdents64) && defined(AT_FDCWD) && defined(O_DIRECTORY) && defined(O_CLOEXEC)
+    #define MFS_ITERATOR_GETDENTS64
+#endif
+
+#if defined(MFS_ITERATOR_GETDENTS64)
+typedef struct
+{
+    mfs_uint64 d_ino;
+    mfs_int64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];     /* Variable length and null terminated. */
+} mfs_linux_dirent64;
+#endif
+
+static int mfs_iterator_dirfd__posix(mfs_iterator* pIterator)
+{
+#if defined(MFS_ITERATOR_GETDENTS64)
+    return pIterator->posix.fd;
+#else
+    return dirfd((DIR*)pIterator->posix.dir);
+#endif
+}
+
+mfs_result mfs_iterator_init__posix(const char* pDirectoryPath, mfs_iterator* pIterator)
+{
+#if !defined(MFS_ITERATOR_GETDENTS64)
+    DIR* dir;
+#endif
+    size_t directoryPathLen;
+
+    MFS_ASSERT(pDirectoryPath != NULL);
+    MFS_ASSERT(pIterator != NULL);
+
+    /* In our implementation, an empty string is equivalent to ".". */
+    if (pDirectoryPath[0] == '\0') {
+        pDirectoryPath = ".";
+    }
+
+    /* We need to keep track of the path so we can avoid changing the working directory in mfs_iterator_next__posix() when stat-ing the file. */
+    directoryPathLen = strlen(pDirectoryPath);
+    pIterator->posix.pPath = (char*)MFS_MALLOC(directoryPathLen + 1);   /* +1 for null terminator. */
+    if (pIterator->posix.pPath == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+    mfs_strcpy_s(pIterator->posix.pPath, directoryPathLen+1, pDirectoryPath);
+
+#if defined(MFS_ITERATOR_GETDENTS64)
+    pIterator->posix.fd = open(pDirectoryPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (pIterator->posix.fd < 0) {
+        mfs_result result = mfs_result_from_errno(errno);
+        MFS_FREE(pIterator->posix.pPath);
+        pIterator->posix.pPath = NULL;
+        return result;
+    }
+#else
+    dir = opendir(pDirectoryPath);
+    if (dir == NULL) {
+        mfs_result result = mfs_result_from_errno(errno);
+        MFS_FREE(pIterator->posix.pPath);
+        pIterator->posix.pPath = NULL;
+        return result;
+    }
+
+    pIterator->posix.dir = dir;
+#endif
+
+    return MFS_SUCCESS;
+}
+
+void mfs_iterator_uninit__posix(mfs_iterator* pIterator)
+{
+    MFS_ASSERT(pIterator != NULL);
+
+#if defined(MFS_ITERATOR_GETDENTS64)
+    close(pIterator->posix.fd);
+    pIterator->posix.fd = -1;
+#else
+    closedir((DIR*)pIterator->posix.dir);
+    pIterator->posix.dir = NULL;
+#endif
+
+    MFS_FREE(pIterator->posix.pPath);
+    pIterator->posix.pPath = NULL;
+}
+
+static int mfs_iterator_stat__posix(mfs_iterator* pIterator, const char* pFileName, struct stat* pStatInfo, mfs_bool32* pHasWritePermissions)
+{
+    /* pHasWritePermissions can be null, in which case write permissions are not checked. */
+    int statResult;
+
+#if defined(AT_FDCWD)
+    {
+        int fd = mfs_iterator_dirfd__posix(pIterator);
+
+        statResult = fstatat(fd, pFileName, pStatInfo, 0);
+        if (statResult != 0 && errno == ENOENT) {
+            statResult = fstatat(fd, pFileName, pStatInfo, AT_SYMLINK_NOFOLLOW);   /* Might be a dangling symbolic link. */
+        }
+
+        if (pHasWritePermissions != NULL) {
+            *pHasWritePermissions = (faccessat(fd, pFileName, W_OK, 0) == 0);
+        }
+    }
+#else
+    {
+        /*
+        We don't want to change the working directory as this has thread-safety implications. We instead need to append the file name to the
+        directory path of the iterator.
+        */
+        mfs_path_buf filePath;
+
+        if (mfs_path_buf_init(&filePath, pIterator->posix.pPath) != MFS_SUCCESS || mfs_path_buf_push_segment(&filePath, pFileName) != MFS_SUCCESS) {
+            mfs_path_buf_uninit(&filePath);
+            errno = ENOMEM;
+            return -1;
+        }
+
+        statResult = stat(filePath.pPath, pStatInfo);
+        if (statResult != 0 && errno == ENOENT) {
+            statResult = lstat(filePath.pPath, pStatInfo);
+        }
+
+        if (pHasWritePermissions != NULL) {
+            *pHasWritePermissions = (access(filePath.pPath, W_OK) == 0);
+        }
+
+        mfs_path_buf_uninit(&filePath);
+    }
+#endif
+
+    return statResult;
+}
+
+static mfs_result mfs_iterator_get_file_info__posix(mfs_iterator* pIterator, mfs_uint32 fields, int type, mfs_file_info* pFileInfo)
+{
+    /* type is the d_type of the entry, or -1 if unknown. */
+    struct stat statInfo;
+    mfs_bool32 needsStat;
+    mfs_bool32 hasWritePermissions;
+
+    needsStat = (fields & (MFS_FILE_INFO_FIELD_SIZE | MFS_FILE_INFO_FIELD_TIMES | MFS_FILE_INFO_FIELD_READ_ONLY)) != 0;
+
+    if ((fields & MFS_FILE_INFO_FIELD_TYPE) != 0 && needsStat == MFS_FALSE) {
+        /* Symbolic links are followed so need a stat to find out what they point to. */
+    #if defined(DT_UNKNOWN)
+        if (type != -1 && type != DT_UNKNOWN && type != DT_LNK) {
+            pFileInfo->isDirectory = (type == DT_DIR);
+        } else
     #endif
-    #ifdef ENOMEDIUM
-        case ENOMEDIUM: return MFS_DOES_NOT_EXIST;
+        {
+            needsStat = MFS_TRUE;
+        }
+    }
+
+    if (needsStat == MFS_FALSE) {
+        return MFS_SUCCESS;
+    }
+
+    if (mfs_iterator_stat__posix(pIterator, pFileInfo->pFileName, &statInfo, ((fields & MFS_FILE_INFO_FIELD_READ_ONLY) != 0) ? &hasWritePermissions : NULL) != 0) {
+        return mfs_result_from_errno(errno);
+    }
+
+    /* Everything that comes with the stat is set since it's free. */
+    pFileInfo->sizeInBytes      = statInfo.st_size;
+    pFileInfo->lastModifiedTime = statInfo.st_mtime;
+    pFileInfo->lastAccessTime   = statInfo.st_atime;
+    pFileInfo->isDirectory      = S_ISDIR(statInfo.st_mode);
+
+    if ((fields & MFS_FILE_INFO_FIELD_READ_ONLY) != 0) {
+        pFileInfo->isReadOnly = !hasWritePermissions;
+    }
+
+    return MFS_SUCCESS;
+}
+
+static mfs_uint32 mfs_file_type_from_dirent_type__posix(mfs_iterator* pIterator, int type, const char* pName)
+{
+    struct stat statInfo;
+
+#if defined(DT_UNKNOWN)
+    switch (type)
+    {
+        case DT_REG:     return MFS_FILE_TYPE_FILE;
+        case DT_DIR:     return MFS_FILE_TYPE_DIRECTORY;
+        case DT_LNK:     return MFS_FILE_TYPE_SYMLINK;
+        case DT_UNKNOWN: break;
+        default:         return MFS_FILE_TYPE_OTHER;
+    }
+#else
+    (void)type;
+#endif
+
+    /* Getting here means the file system doesn't report the type. */
+    if ((pIterator->fields & MFS_FILE_INFO_FIELD_TYPE) == 0) {
+        return MFS_FILE_TYPE_UNKNOWN;
+    }
+
+#if defined(AT_FDCWD)
+    if (fstatat(mfs_iterator_dirfd__posix(pIterator), pName, &statInfo, AT_SYMLINK_NOFOLLOW) != 0) {
+        return MFS_FILE_TYPE_UNKNOWN;
+    }
+#else
+    if (mfs_iterator_stat__posix(pIterator, pName, &statInfo, NULL) != 0) {
+        return MFS_FILE_TYPE_UNKNOWN;
+    }
+#endif
+
+    return mfs_file_type_from_mode__posix(statInfo.st_mode);
+}
+
+#if defined(MFS_ITERATOR_GETDENTS64)
+static mfs_result mfs_iterator_read_entries__posix(mfs_iterator* pIterator)
+{
+    mfs_result result;
+    long bytesRead;
+
+    result = mfs_iterator_alloc_buffer(pIterator);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    pIterator->bufferCursor = 0;
+    pIterator->bufferEnd    = 0;
+
+    do {
+        bytesRead = syscall(SYS_getdents64, pIterator->posix.fd, pIterator->pBuffer, pIterator->bufferSize);
+    } while (bytesRead < 0 && errno == EINTR);
+
+    if (bytesRead < 0) {
+        return mfs_result_from_errno(errno);
+    }
+
+    if (bytesRead == 0) {
+        return MFS_AT_END;
+    }
+
+    pIterator->bufferEnd = (size_t)bytesRead;
+
+    return MFS_SUCCESS;
+}
+
+static mfs_linux_dirent64* mfs_iterator_next_entry__posix(mfs_iterator* pIterator)
+{
+    /* Returns null if the buffer needs to be refilled. */
+    mfs_linux_dirent64* pEntry;
+
+    if (pIterator->bufferCursor >= pIterator->bufferEnd) {
+        return NULL;
+    }
+
+    pEntry = (mfs_linux_dirent64*)(pIterator->pBuffer + pIterator->bufferCursor);
+    pIterator->bufferCursor += pEntry->d_reclen;
+
+    return pEntry;
+}
+#endif
+
+mfs_result mfs_iterator_next__posix(mfs_iterator* pIterator, mfs_file_info* pFileInfo)
+{
+    const char* pName;
+    int type = -1;
+#if defined(MFS_ITERATOR_GETDENTS64)
+    mfs_linux_dirent64* pEntry;
+#else
+    struct dirent* info;
+#endif
+
+    MFS_ASSERT(pIterator != NULL);
+
+#if defined(MFS_ITERATOR_GETDENTS64)
+    pEntry = mfs_iterator_next_entry__posix(pIterator);
+    if (pEntry == NULL) {
+        mfs_result result = mfs_iterator_read_entries__posix(pIterator);
+        if (result != MFS_SUCCESS) {
+            return result;
+        }
+
+        pEntry = mfs_iterator_next_entry__posix(pIterator);
+    }
+
+    pName = pEntry->d_name;
+    type  = pEntry->d_type;
+#else
+    info = readdir((DIR*)pIterator->posix.dir);
+    if (info == NULL) {
+        return MFS_AT_END;
+    }
+
+    pName = info->d_name;
+    #if defined(DT_UNKNOWN)
+    type  = info->d_type;
     #endif
-    #ifdef EMEDIUMTYPE
-        case EMEDIUMTYPE: return MFS_ERROR;
+#endif
+
+    if (pFileInfo == NULL) {
+        return MFS_SUCCESS;
+    }
+
+    mfs_strcpy_s(pFileInfo->pFileName, sizeof(pFileInfo->pFileName), pName);
+
+    return mfs_iterator_get_file_info__posix(pIterator, pIterator->fields, type, pFileInfo);
+}
+
+mfs_result mfs_iterator_next_batch__posix(mfs_iterator* pIterator, mfs_directory_entry* pEntries, size_t capacity, size_t* pCount)
+{
+    mfs_result result;
+    size_t count = 0;
+#if defined(MFS_ITERATOR_GETDENTS64)
+    mfs_linux_dirent64* pEntry;
+
+    /*
+    Entries left over from mfs_iterator_next() are returned first. The buffer is only refilled at the start of a batch since doing so
+    would invalidate the names that have already been handed out.
+    */
+    if (pIterator->bufferCursor >= pIterator->bufferEnd) {
+        result = mfs_iterator_read_entries__posix(pIterator);
+        if (result != MFS_SUCCESS) {
+            return result;
+        }
+    }
+
+    while (count < capacity) {
+        pEntry = mfs_iterator_next_entry__posix(pIterator);
+        if (pEntry == NULL) {
+            break;
+        }
+
+        pEntries[count].pName      = pEntry->d_name;
+        pEntries[count].nameLength = strlen(pEntry->d_name);
+        pEntries[count].inode      = pEntry->d_ino;
+        pEntries[count].type       = mfs_file_type_from_dirent_type__posix(pIterator, pEntry->d_type, pEntry->d_name);
+        count += 1;
+    }
+#else
+    struct dirent* info;
+    size_t nameLength;
+
+    /* readdir() only keeps one entry around at a time so names need to be copied into our own buffer. */
+    result = mfs_iterator_alloc_buffer(pIterator);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    /* An entry can't be put back once it's been read so there needs to be enough room for the longest possible name. */
+    while (count < capacity && pIterator->bufferEnd + MFS_ITERATOR_MAX_NAME_SIZE <= pIterator->bufferSize) {
+        info = readdir((DIR*)pIterator->posix.dir);
+        if (info == NULL) {
+            break;
+        }
+
+        nameLength = strlen(info->d_name);
+        if (nameLength >= MFS_ITERATOR_MAX_NAME_SIZE) {
+            return MFS_PATH_TOO_LONG;
+        }
+
+        MFS_COPY_MEMORY(pIterator->pBuffer + pIterator->bufferEnd, info->d_name, nameLength+1);
+
+        pEntries[count].pName      = pIterator->pBuffer + pIterator->bufferEnd;
+        pEntries[count].nameLength = nameLength;
+        pEntries[count].inode      = (mfs_uint64)info->d_ino;
+    #if defined(DT_UNKNOWN)
+        pEntries[count].type       = mfs_file_type_from_dirent_type__posix(pIterator, info->d_type, pEntries[count].pName);
+    #else
+        pEntries[count].type       = mfs_file_type_from_dirent_type__posix(pIterator, -1, pEntries[count].pName);
     #endif
-    #ifdef ECANCELED
-        case ECANCELED: return MFS_CANCELLED;
+        pIterator->bufferEnd += nameLength+1;
+        count += 1;
+    }
+
+    pIterator->bufferCursor = pIterator->bufferEnd; /* The buffer only holds names that have already been returned. */
+#endif
+
+    *pCount = count;
+    return (count > 0) ? MFS_SUCCESS : MFS_AT_END;
+}
+#endif
+
+mfs_result mfs_iterator_init(const char* pDirectoryPath, mfs_iterator* pIterator)
+{
+    return mfs_iterator_init_ex(pDirectoryPath, MFS_FILE_INFO_FIELD_ALL, pIterator);
+}
+
+mfs_result mfs_iterator_init_ex(const char* pDirectoryPath, mfs_uint32 fields, mfs_iterator* pIterator)
+{
+    if (pDirectoryPath == NULL || pIterator == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(pIterator);
+    pIterator->fields = fields;
+
+    pIterator->bufferSize = MFS_ITERATOR_DEFAULT_BUFFER_SIZE;
+
+#if defined(MFS_WIN32)
+    return mfs_iterator_init__win32(pDirectoryPath, pIterator);
+#elif defined(MFS_POSIX)
+    return mfs_iterator_init__posix(pDirectoryPath, pIterator);
+#else
+    return MFS_INVALID_OPERATION;   /* Unsupported platform. */
+#endif
+}
+
+void mfs_iterator_uninit(mfs_iterator* pIterator)
+{
+    if (pIterator == NULL) {
+        return;
+    }
+
+#if defined(MFS_WIN32)
+    mfs_iterator_uninit__win32(pIterator);
+#elif defined(MFS_POSIX)
+    mfs_iterator_uninit__posix(pIterator);
+#else
+    /* Unsupported platform. */
+#endif
+
+    MFS_FREE(pIterator->pBuffer);
+    MFS_ZERO_OBJECT(pIterator);
+}
+
+mfs_result mfs_iterator_next(mfs_iterator* pIterator, mfs_file_info* pFileInfo)
+{
+    if (pIterator == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (pFileInfo != NULL) {
+        MFS_ZERO_OBJECT(pFileInfo);
+    }
+
+#if defined(MFS_WIN32)
+    return mfs_iterator_next__win32(pIterator, pFileInfo);
+#elif defined(MFS_POSIX)
+    return mfs_iterator_next__posix(pIterator, pFileInfo);
+#else
+    return MFS_INVALID_OPERATION;
+#endif
+}
+
+mfs_result mfs_iterator_get_file_info(mfs_iterator* pIterator, mfs_uint32 fields, mfs_file_info* pFileInfo)
+{
+    if (pIterator == NULL || pFileInfo == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+#if defined(MFS_WIN32)
+    (void)fields;
+    return MFS_SUCCESS; /* Every field is always retrieved on Win32. */
+#elif defined(MFS_POSIX)
+    if (pIterator->posix.pPath == NULL) {
+        return MFS_INVALID_OPERATION;
+    }
+
+    return mfs_iterator_get_file_info__posix(pIterator, fields, -1, pFileInfo);
+#else
+    (void)fields;
+    return MFS_INVALID_OPERATION;
+#endif
+}
+
+mfs_result mfs_iterator_set_buffer_size(mfs_iterator* pIterator, size_t bufferSize)
+{
+    if (pIterator == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (pIterator->bufferCursor < pIterator->bufferEnd) {
+        return MFS_INVALID_OPERATION;   /* There are entries in the buffer that haven't been returned yet. */
+    }
+
+    if (bufferSize < MFS_ITERATOR_MIN_BUFFER_SIZE) {
+        bufferSize = MFS_ITERATOR_MIN_BUFFER_SIZE;
+    }
+
+    if (bufferSize != pIterator->bufferSize) {
+        MFS_FREE(pIterator->pBuffer);
+        pIterator->pBuffer    = NULL;   /* Allocated on demand. */
+        pIterator->bufferSize = bufferSize;
+    }
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_iterator_next_batch(mfs_iterator* pIterator, mfs_directory_entry* pEntries, size_t capacity, size_t* pCount)
+{
+    if (pCount != NULL) {
+        *pCount = 0;
+    }
+
+    if (pIterator == NULL || pEntries == NULL || capacity == 0 || pCount == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+#if defined(MFS_WIN32)
+    {
+        mfs_result result = mfs_iterator_alloc_buffer(pIterator);
+        if (result != MFS_SUCCESS) {
+            return result;
+        }
+
+        pIterator->bufferCursor = 0;   /* Names from the previous batch are no longer needed. */
+        pIterator->bufferEnd    = 0;
+        return mfs_iterator_next_batch__win32(pIterator, pEntries, capacity, pCount);
+    }
+#elif defined(MFS_POSIX)
+    #if !defined(MFS_ITERATOR_GETDENTS64)
+    pIterator->bufferCursor = 0;   /* Names from the previous batch are no longer needed. */
+    pIterator->bufferEnd    = 0;
     #endif
-    #ifdef ENOKEY
-        case ENOKEY: return MFS_ERROR;
+    return mfs_iterator_next_batch__posix(pIterator, pEntries, capacity, pCount);
+#else
+    return MFS_INVALID_OPERATION;
+#endif
+}
+
+
+
+/* Globbing */
+#define MFS_GLOB_RULE_GENERAL       0
+#define MFS_GLOB_RULE_PATH          1   /* Anchored and entirely literal. */
+#define MFS_GLOB_RULE_NAME          2   /* "**" followed by a literal name. */
+#define MFS_GLOB_RULE_EXTENSION     3   /* "**" followed by "*.ext". */
+#define MFS_GLOB_MAX_SEGMENTS       63  /* Matching tracks the possible positions in a pattern with the bits of a 64-bit integer. */
+
+typedef struct
+{
+    size_t offset;              /* Into the text buffer. */
+    size_t length;
+    mfs_bool32 isGlobstar;
+    mfs_bool32 isLiteral;       /* Escapes have been removed from literal segments. */
+} mfs_glob_segment;
+
+typedef struct
+{
+    size_t textOffset;          /* The segments joined with forward slashes. */
+    size_t textLength;
+    size_t firstSegment;
+    size_t segmentCount;
+    mfs_uint32 kind;            /* One of MFS_GLOB_RULE_*. */
+    mfs_bool32 isNegated;
+    mfs_bool32 isDirectoryOnly;
+} mfs_glob_rule;
+
+typedef struct
+{
+    size_t* pSlots;             /* Rule indices plus one, with 0 meaning empty. */
+    size_t cap;                 /* Always a power of two. */
+} mfs_glob_table;
+
+typedef struct
+{
+    char* pText;
+    size_t textLength;
+    mfs_glob_segment* pSegments;
+    size_t segmentCount;
+    mfs_glob_rule* pRules;
+    size_t ruleCount;
+    size_t* pGeneralRules;      /* Rules that aren't in a table, in order. */
+    size_t generalRuleCount;
+    mfs_glob_table tables[3];   /* Indexed by the rule kind minus one. */
+    mfs_bool32 isCaseInsensitive;
+    mfs_bool32 hasNegation;
+    mfs_bool32 hasLeadingGlobstar;  /* A non-negated rule starts with "**", so something could match under any directory. */
+} mfs_glob_internal;
+
+static mfs_bool32 mfs_glob_is_separator(char c)
+{
+    return c == '/' || c == '\\';
+}
+
+static char mfs_glob_fold(char c, mfs_bool32 isCaseInsensitive)
+{
+    if (isCaseInsensitive && c >= 'A' && c <= 'Z') {
+        return (char)(c - 'A' + 'a');
+    }
+
+    return c;
+}
+
+static mfs_bool32 mfs_glob_next_segment(const char* pPath, size_t pathLength, size_t* pCursor, size_t* pOffset, size_t* pLength)
+{
+    size_t cursor = *pCursor;
+
+    while (cursor < pathLength && mfs_glob_is_separator(pPath[cursor])) {
+        cursor += 1;
+    }
+
+    if (cursor == pathLength) {
+        *pCursor = cursor;
+        return MFS_FALSE;
+    }
+
+    *pOffset = cursor;
+    while (cursor < pathLength && !mfs_glob_is_separator(pPath[cursor])) {
+        cursor += 1;
+    }
+
+    *pLength = cursor - *pOffset;
+    *pCursor = cursor;
+
+    return MFS_TRUE;
+}
+
+static mfs_uint64 mfs_glob_hash(mfs_uint64 hash, const char* pData, size_t length, mfs_bool32 isCaseInsensitive)
+{
+    /* FNV-1a. */
+    size_t i;
+
+    for (i = 0; i < length; i += 1) {
+        hash ^= (mfs_uint8)mfs_glob_fold(pData[i], isCaseInsensitive);
+        hash *= MFS_UINT64_CONST(0x00000100, 0x000001B3);
+    }
+
+    return hash;
+}
+
+static mfs_uint64 mfs_glob_hash_path(const char* pPath, size_t pathLength, mfs_bool32 isCaseInsensitive)
+{
+    /* Hashes the path as if it had been normalized to single forward slashes, so it's consistent with the text of a rule. */
+    mfs_uint64 hash = MFS_UINT64_CONST(0xCBF29CE4, 0x84222325);
+    size_t cursor = 0;
+    size_t offset;
+    size_t length;
+    mfs_bool32 isFirst = MFS_TRUE;
+
+    while (mfs_glob_next_segment(pPath, pathLength, &cursor, &offset, &length)) {
+        if (isFirst == MFS_FALSE) {
+            hash = mfs_glob_hash(hash, "/", 1, MFS_FALSE);
+        }
+
+        hash = mfs_glob_hash(hash, pPath + offset, length, isCaseInsensitive);
+        isFirst = MFS_FALSE;
+    }
+
+    return hash;
+}
+
+static mfs_bool32 mfs_glob_text_equal(const char* pA, const char* pB, size_t length, mfs_bool32 isCaseInsensitive)
+{
+    size_t i;
+
+    if (isCaseInsensitive == MFS_FALSE) {
+        return memcmp(pA, pB, length) == 0;
+    }
+
+    for (i = 0; i < length; i += 1) {
+        if (mfs_glob_fold(pA[i], MFS_TRUE) != mfs_glob_fold(pB[i], MFS_TRUE)) {
+            return MFS_FALSE;
+        }
+    }
+
+    return MFS_TRUE;
+}
+
+static mfs_bool32 mfs_glob_path_equal_text(const char* pPath, size_t pathLength, const char* pText, size_t textLength, mfs_bool32 isCaseInsensitive)
+{
+    size_t cursor = 0;
+    size_t offset;
+    size_t length;
+    size_t textCursor = 0;
+
+    while (mfs_glob_next_segment(pPath, pathLength, &cursor, &offset, &length)) {
+        if (textCursor > 0) {
+            if (textCursor == textLength || pText[textCursor] != '/') {
+                return MFS_FALSE;
+            }
+
+            textCursor += 1;
+        }
+
+        if (textLength - textCursor < length || mfs_glob_text_equal(pPath + offset, pText + textCursor, length, isCaseInsensitive) == MFS_FALSE) {
+            return MFS_FALSE;
+        }
+
+        textCursor += length;
+    }
+
+    return textCursor == textLength;
+}
+
+static void mfs_glob_rule_key(const mfs_glob_internal* pGlob, const mfs_glob_rule* pRule, const char** ppKey, size_t* pKeyLength)
+{
+    const mfs_glob_segment* pLast = &pGlob->pSegments[pRule->firstSegment + pRule->segmentCount - 1];
+
+    if (pRule->kind == MFS_GLOB_RULE_PATH) {
+        *ppKey      = pGlob->pText + pRule->textOffset;
+        *pKeyLength = pRule->textLength;
+    } else if (pRule->kind == MFS_GLOB_RULE_NAME) {
+        *ppKey      = pGlob->pText + pLast->offset;
+        *pKeyLength = pLast->length;
+    } else {
+        *ppKey      = pGlob->pText + pLast->offset + 2;    /* Skip the "*.". */
+        *pKeyLength = pLast->length - 2;
+    }
+}
+
+static mfs_uint64 mfs_glob_rule_hash(const mfs_glob_internal* pGlob, const mfs_glob_rule* pRule)
+{
+    const char* pKey;
+    size_t keyLength;
+
+    mfs_glob_rule_key(pGlob, pRule, &pKey, &keyLength);
+
+    if (pRule->kind == MFS_GLOB_RULE_PATH) {
+        return mfs_glob_hash_path(pKey, keyLength, pGlob->isCaseInsensitive);
+    } else {
+        return mfs_glob_hash(MFS_UINT64_CONST(0xCBF29CE4, 0x84222325), pKey, keyLength, pGlob->isCaseInsensitive);
+    }
+}
+
+static size_t mfs_glob_table_find(const mfs_glob_internal* pGlob, mfs_uint32 kind, const char* pKey, size_t keyLength, mfs_bool32 isDirectory, size_t best)
+{
+    /* Returns the highest matching rule index plus one, or best if nothing higher matches. */
+    const mfs_glob_table* pTable = &pGlob->tables[kind - 1];
+    mfs_uint64 hash;
+    size_t iSlot;
+
+    if (pTable->cap == 0) {
+        return best;
+    }
+
+    if (kind == MFS_GLOB_RULE_PATH) {
+        hash = mfs_glob_hash_path(pKey, keyLength, pGlob->isCaseInsensitive);
+    } else {
+        hash = mfs_glob_hash(MFS_UINT64_CONST(0xCBF29CE4, 0x84222325), pKey, keyLength, pGlob->isCaseInsensitive);
+    }
+
+    for (iSlot = (size_t)hash & (pTable->cap - 1); pTable->pSlots[iSlot] != 0; iSlot = (iSlot + 1) & (pTable->cap - 1)) {
+        const mfs_glob_rule* pRule;
+        const char* pRuleKey;
+        size_t ruleKeyLength;
+        mfs_bool32 isEqual;
+
+        if (pTable->pSlots[iSlot] <= best) {
+            continue;
+        }
+
+        pRule = &pGlob->pRules[pTable->pSlots[iSlot] - 1];
+        if (pRule->isDirectoryOnly && isDirectory == MFS_FALSE) {
+            continue;
+        }
+
+        mfs_glob_rule_key(pGlob, pRule, &pRuleKey, &ruleKeyLength);
+        if (kind == MFS_GLOB_RULE_PATH) {
+            isEqual = mfs_glob_path_equal_text(pKey, keyLength, pRuleKey, ruleKeyLength, pGlob->isCaseInsensitive);
+        } else {
+            isEqual = ruleKeyLength == keyLength && mfs_glob_text_equal(pKey, pRuleKey, keyLength, pGlob->isCaseInsensitive);
+        }
+
+        if (isEqual) {
+            best = pTable->pSlots[iSlot];
+        }
+    }
+
+    return best;
+}
+
+static mfs_bool32 mfs_glob_match_char(const char* pPattern, size_t patternLength, size_t* pCursor, char c, mfs_bool32 isCaseInsensitive)
+{
+    /* Matches a single character token, which is a literal, an escaped character, "?" or a set, and moves past it. */
+    size_t cursor = *pCursor;
+
+    if (pPattern[cursor] == '?') {
+        *pCursor = cursor + 1;
+        return MFS_TRUE;
+    }
+
+    if (pPattern[cursor] == '[') {
+        size_t setCursor = cursor + 1;
+        mfs_bool32 isNegated = MFS_FALSE;
+        mfs_bool32 isMatch = MFS_FALSE;
+        mfs_bool32 isFirst = MFS_TRUE;
+
+        if (setCursor < patternLength && (pPattern[setCursor] == '!' || pPattern[setCursor] == '^')) {
+            isNegated = MFS_TRUE;
+            setCursor += 1;
+        }
+
+        c = mfs_glob_fold(c, isCaseInsensitive);
+
+        while (setCursor < patternLength && (pPattern[setCursor] != ']' || isFirst)) {
+            char lo;
+            char hi;
+
+            if (pPattern[setCursor] == '\\' && setCursor+1 < patternLength) {
+                setCursor += 1;
+            }
+
+            lo = mfs_glob_fold(pPattern[setCursor], isCaseInsensitive);
+            hi = lo;
+            setCursor += 1;
+
+            if (setCursor+1 < patternLength && pPattern[setCursor] == '-' && pPattern[setCursor+1] != ']') {
+                setCursor += 1;
+                if (pPattern[setCursor] == '\\' && setCursor+1 < patternLength) {
+                    setCursor += 1;
+                }
+
+                hi = mfs_glob_fold(pPattern[setCursor], isCaseInsensitive);
+                setCursor += 1;
+            }
+
+            if ((mfs_uint8)c >= (mfs_uint8)lo && (mfs_uint8)c <= (mfs_uint8)hi) {
+                isMatch = MFS_TRUE;
+            }
+
+            isFirst = MFS_FALSE;
+        }
+
+        /* A set without a closing bracket is just a literal "[". */
+        if (setCursor < patternLength) {
+            *pCursor = setCursor + 1;
+            return isMatch != isNegated;
+        }
+    }
+
+    if (pPattern[cursor] == '\\' && cursor+1 < patternLength) {
+        cursor += 1;
+    }
+
+    *pCursor = cursor + 1;
+    return mfs_glob_fold(pPattern[cursor], isCaseInsensitive) == mfs_glob_fold(c, isCaseInsensitive);
+}
+
+static mfs_bool32 mfs_glob_match_segment(const mfs_glob_internal* pGlob, const mfs_glob_segment* pSegment, const char* pName, size_t nameLength)
+{
+    const char* pPattern = pGlob->pText + pSegment->offset;
+    size_t patternLength = pSegment->length;
+    size_t iPattern = 0;
+    size_t iName = 0;
+    size_t starPattern = 0;
+    size_t starName = 0;
+    mfs_bool32 hasStar = MFS_FALSE;
+
+    if (pSegment->isLiteral) {
+        return patternLength == nameLength && mfs_glob_text_equal(pPattern, pName, nameLength, pGlob->isCaseInsensitive);
+    }
+
+    /* The usual backtracking algorithm, where only the most recent "*" ever needs to be revisited. */
+    while (iName < nameLength) {
+        if (iPattern < patternLength) {
+            if (pPattern[iPattern] == '*') {
+                iPattern += 1;
+                starPattern = iPattern;
+                starName    = iName;
+                hasStar     = MFS_TRUE;
+                continue;
+            } else {
+                size_t nextPattern = iPattern;
+                if (mfs_glob_match_char(pPattern, patternLength, &nextPattern, pName[iName], pGlob->isCaseInsensitive)) {
+                    iPattern = nextPattern;
+                    iName   += 1;
+                    continue;
+                }
+            }
+        }
+
+        if (hasStar == MFS_FALSE) {
+            return MFS_FALSE;
+        }
+
+        starName += 1;
+        iPattern  = starPattern;
+        iName     = starName;
+    }
+
+    while (iPattern < patternLength && pPattern[iPattern] == '*') {
+        iPattern += 1;
+    }
+
+    return iPattern == patternLength;
+}
+
+static mfs_uint64 mfs_glob_advance_globstars(const mfs_glob_internal* pGlob, const mfs_glob_rule* pRule, mfs_uint64 states)
+{
+    /* A "**" can match nothing, so being before one means also being after it. */
+    size_t iSegment;
+
+    for (iSegment = 0; iSegment < pRule->segmentCount; iSegment += 1) {
+        if ((states & ((mfs_uint64)1 << iSegment)) != 0 && pGlob->pSegments[pRule->firstSegment + iSegment].isGlobstar) {
+            states |= (mfs_uint64)1 << (iSegment + 1);
+        }
+    }
+
+    return states;
+}
+
+static mfs_uint64 mfs_glob_rule_states(const mfs_glob_internal* pGlob, const mfs_glob_rule* pRule, const char* pPath, size_t pathLength)
+{
+    /*
+    Returns the set of positions in the rule that can be reached after consuming every segment of the path. Bit N means the first N
+    segments of the rule have been matched. Tracking every position at once avoids the exponential backtracking that "**" would
+    otherwise need.
+    */
+    mfs_uint64 states;
+    size_t cursor = 0;
+    size_t offset;
+    size_t length;
+
+    states = mfs_glob_advance_globstars(pGlob, pRule, 1);
+
+    while (mfs_glob_next_segment(pPath, pathLength, &cursor, &offset, &length)) {
+        mfs_uint64 nextStates = 0;
+        size_t iSegment;
+
+        for (iSegment = 0; iSegment < pRule->segmentCount; iSegment += 1) {
+            const mfs_glob_segment* pSegment;
+
+            if ((states & ((mfs_uint64)1 << iSegment)) == 0) {
+                continue;
+            }
+
+            pSegment = &pGlob->pSegments[pRule->firstSegment + iSegment];
+            if (pSegment->isGlobstar) {
+                nextStates |= (mfs_uint64)1 << iSegment;
+            } else if (mfs_glob_match_segment(pGlob, pSegment, pPath + offset, length)) {
+                nextStates |= (mfs_uint64)1 << (iSegment + 1);
+            }
+        }
+
+        states = mfs_glob_advance_globstars(pGlob, pRule, nextStates);
+        if (states == 0) {
+            break;
+        }
+    }
+
+    return states;
+}
+
+static mfs_bool32 mfs_glob_match_entry(const mfs_glob_internal* pGlob, const char* pPath, size_t pathLength, mfs_bool32 isDirectory)
+{
+    /* Matches a single path without looking at its ancestors. */
+    size_t best = 0;
+    size_t cursor = 0;
+    size_t offset;
+    size_t length;
+    size_t nameOffset = 0;
+    size_t nameLength = 0;
+    size_t iGeneral;
+
+    while (mfs_glob_next_segment(pPath, pathLength, &cursor, &offset, &length)) {
+        nameOffset = offset;
+        nameLength = length;
+    }
+
+    if (nameLength == 0) {
+        return MFS_FALSE;
+    }
+
+    best = mfs_glob_table_find(pGlob, MFS_GLOB_RULE_PATH, pPath, pathLength, isDirectory, best);
+    best = mfs_glob_table_find(pGlob, MFS_GLOB_RULE_NAME, pPath + nameOffset, nameLength, isDirectory, best);
+
+    if (pGlob->tables[MFS_GLOB_RULE_EXTENSION - 1].cap > 0) {
+        size_t extensionOffset = nameOffset + nameLength;
+        while (extensionOffset > nameOffset && pPath[extensionOffset-1] != '.') {
+            extensionOffset -= 1;
+        }
+
+        if (extensionOffset > nameOffset) {
+            best = mfs_glob_table_find(pGlob, MFS_GLOB_RULE_EXTENSION, pPath + extensionOffset, nameOffset + nameLength - extensionOffset, isDirectory, best);
+        }
+    }
+
+    if (best == 0 || pGlob->hasNegation) {
+        /* Only rules after the best one so far can change the outcome. */
+        for (iGeneral = pGlob->generalRuleCount; iGeneral > 0; iGeneral -= 1) {
+            size_t iRule = pGlob->pGeneralRules[iGeneral - 1];
+            const mfs_glob_rule* pRule = &pGlob->pRules[iRule];
+
+            if (iRule < best) {
+                break;
+            }
+
+            if (pRule->isDirectoryOnly && isDirectory == MFS_FALSE) {
+                continue;
+            }
+
+            if ((mfs_glob_rule_states(pGlob, pRule, pPath, pathLength) & ((mfs_uint64)1 << pRule->segmentCount)) != 0) {
+                best = iRule + 1;
+                break;
+            }
+        }
+    }
+
+    if (best == 0) {
+        return MFS_FALSE;
+    }
+
+    return !pGlob->pRules[best - 1].isNegated;
+}
+
+static mfs_bool32 mfs_glob_may_match_under_internal(const mfs_glob_internal* pGlob, const char* pPath, size_t pathLength)
+{
+    size_t iRule;
+
+    if (pGlob->hasLeadingGlobstar) {
+        return MFS_TRUE;
+    }
+
+    for (iRule = 0; iRule < pGlob->ruleCount; iRule += 1) {
+        const mfs_glob_rule* pRule = &pGlob->pRules[iRule];
+
+        if (pRule->isNegated) {
+            continue;
+        }
+
+        /* Anything short of the end of the rule means there are segments left to match something deeper. */
+        if ((mfs_glob_rule_states(pGlob, pRule, pPath, pathLength) & (((mfs_uint64)1 << pRule->segmentCount) - 1)) != 0) {
+            return MFS_TRUE;
+        }
+    }
+
+    return MFS_FALSE;
+}
+
+static mfs_bool32 mfs_glob_has_wildcard(const char* pSegment, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; i += 1) {
+        if (pSegment[i] == '\\') {
+            i += 1;
+        } else if (pSegment[i] == '*' || pSegment[i] == '?' || pSegment[i] == '[') {
+            return MFS_TRUE;
+        }
+    }
+
+    return MFS_FALSE;
+}
+
+static mfs_result mfs_glob_add_rule(mfs_glob_internal* pGlob, const char* pPattern, mfs_uint32 flags)
+{
+    mfs_glob_rule rule;
+    size_t length = strlen(pPattern);
+    size_t cursor;
+    size_t offset;
+    size_t segmentLength;
+    mfs_bool32 isAnchored = MFS_TRUE;
+    mfs_bool32 isAllLiteral = MFS_TRUE;
+    mfs_bool32 hasSegments = MFS_FALSE;
+
+    MFS_ZERO_OBJECT(&rule);
+
+    if ((flags & MFS_GLOB_FLAG_GITIGNORE) != 0) {
+        if (length == 0 || pPattern[0] == '#') {
+            return MFS_SUCCESS;
+        }
+
+        /* Trailing spaces are ignored unless they're escaped. */
+        while (length > 0 && (pPattern[length-1] == ' ' || pPattern[length-1] == '\r') && (length == 1 || pPattern[length-2] != '\\')) {
+            length -= 1;
+        }
+    }
+
+    if (length > 0 && pPattern[0] == '!') {
+        rule.isNegated = MFS_TRUE;
+        pPattern += 1;
+        length   -= 1;
+    }
+
+    while (length > 0 && pPattern[length-1] == '/') {
+        rule.isDirectoryOnly = MFS_TRUE;
+        length -= 1;
+    }
+
+    if ((flags & MFS_GLOB_FLAG_GITIGNORE) != 0) {
+        isAnchored = MFS_FALSE;
+        for (cursor = 0; cursor < length; cursor += 1) {
+            if (pPattern[cursor] == '/') {
+                isAnchored = MFS_TRUE;
+                break;
+            }
+        }
+    }
+
+    rule.textOffset   = pGlob->textLength;
+    rule.firstSegment = pGlob->segmentCount;
+
+    if (isAnchored == MFS_FALSE) {
+        mfs_glob_segment* pSegment = &pGlob->pSegments[pGlob->segmentCount];
+        pSegment->offset     = pGlob->textLength;
+        pSegment->length     = 2;
+        pSegment->isGlobstar = MFS_TRUE;
+        pSegment->isLiteral  = MFS_FALSE;
+
+        MFS_COPY_MEMORY(pGlob->pText + pGlob->textLength, "**", 2);
+        pGlob->textLength   += 2;
+        pGlob->segmentCount += 1;
+        rule.segmentCount   += 1;
+    }
+
+    /* Only forward slashes are separators in patterns. Backslashes are escapes. */
+    cursor = 0;
+    for (;;) {
+        mfs_glob_segment* pSegment;
+        char* pText;
+
+        while (cursor < length && pPattern[cursor] == '/') {
+            cursor += 1;
+        }
+
+        if (cursor == length) {
+            break;
+        }
+
+        offset = cursor;
+        while (cursor < length && pPattern[cursor] != '/') {
+            cursor += 1;
+        }
+        segmentLength = cursor - offset;
+
+        hasSegments = MFS_TRUE;
+
+        if (segmentLength == 2 && pPattern[offset] == '*' && pPattern[offset+1] == '*') {
+            if (rule.segmentCount > 0 && pGlob->pSegments[pGlob->segmentCount-1].isGlobstar) {
+                continue;   /* "**" followed by "**" is the same as just one. */
+            }
+        }
+
+        if (rule.segmentCount == MFS_GLOB_MAX_SEGMENTS) {
+            return MFS_INVALID_ARGS;
+        }
+
+        if (rule.segmentCount > 0) {
+            pGlob->pText[pGlob->textLength] = '/';
+            pGlob->textLength += 1;
+        }
+
+        pSegment = &pGlob->pSegments[pGlob->segmentCount];
+        pSegment->offset     = pGlob->textLength;
+        pSegment->isGlobstar = (segmentLength == 2 && pPattern[offset] == '*' && pPattern[offset+1] == '*');
+        pSegment->isLiteral  = !mfs_glob_has_wildcard(pPattern + offset, segmentLength);
+
+        pText = pGlob->pText + pGlob->textLength;
+        if (pSegment->isLiteral) {
+            size_t i;
+            size_t textLength = 0;
+
+            for (i = 0; i < segmentLength; i += 1) {
+                if (pPattern[offset + i] == '\\' && i+1 < segmentLength) {
+                    i += 1;
+                }
+
+                pText[textLength] = pPattern[offset + i];
+                textLength += 1;
+            }
+
+            pSegment->length = textLength;
+        } else {
+            MFS_COPY_MEMORY(pText, pPattern + offset, segmentLength);
+            pSegment->length = segmentLength;
+            isAllLiteral = MFS_FALSE;
+        }
+
+        pGlob->textLength   += pSegment->length;
+        pGlob->segmentCount += 1;
+        rule.segmentCount   += 1;
+    }
+
+    rule.textLength = pGlob->textLength - rule.textOffset;
+
+    if (hasSegments == MFS_FALSE) {
+        /* Nothing but slashes. Doesn't match anything. */
+        pGlob->segmentCount = rule.firstSegment;
+        pGlob->textLength   = rule.textOffset;
+        return MFS_SUCCESS;
+    }
+
+    /* Work out whether or not the rule can be matched with a hash lookup. */
+    if (isAllLiteral && isAnchored) {
+        rule.kind = MFS_GLOB_RULE_PATH;
+    } else if (rule.segmentCount == 2 && pGlob->pSegments[rule.firstSegment].isGlobstar) {
+        const mfs_glob_segment* pLast = &pGlob->pSegments[rule.firstSegment + 1];
+        const char* pLastText = pGlob->pText + pLast->offset;
+
+        if (pLast->isLiteral) {
+            rule.kind = MFS_GLOB_RULE_NAME;
+        } else if (pLast->length > 2 && pLastText[0] == '*' && pLastText[1] == '.') {
+            size_t i;
+
+            rule.kind = MFS_GLOB_RULE_EXTENSION;
+            for (i = 2; i < pLast->length; i += 1) {
+                if (pLastText[i] == '.' || pLastText[i] == '*' || pLastText[i] == '?' || pLastText[i] == '[' || pLastText[i] == '\\') {
+                    rule.kind = MFS_GLOB_RULE_GENERAL;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (rule.isNegated) {
+        pGlob->hasNegation = MFS_TRUE;
+    } else if (pGlob->pSegments[rule.firstSegment].isGlobstar) {
+        pGlob->hasLeadingGlobstar = MFS_TRUE;
+    }
+
+    pGlob->pRules[pGlob->ruleCount] = rule;
+    pGlob->ruleCount += 1;
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_glob_compile(const char** ppPatterns, size_t patternCount, mfs_uint32 flags, mfs_glob_matcher* pGlob)
+{
+    mfs_result result;
+    mfs_glob_internal* pInternal;
+    size_t textCap = 0;
+    size_t segmentCap = 0;
+    size_t tableCounts[3] = {0, 0, 0};
+    size_t iPattern;
+    size_t iRule;
+    size_t iTable;
+
+    if (pGlob == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(pGlob);
+
+    if (ppPatterns == NULL && patternCount > 0) {
+        return MFS_INVALID_ARGS;
+    }
+
+    /* The text of a rule is never longer than the pattern plus the leading "**" of an unanchored rule. */
+    for (iPattern = 0; iPattern < patternCount; iPattern += 1) {
+        size_t length;
+        size_t i;
+
+        if (ppPatterns[iPattern] == NULL) {
+            return MFS_INVALID_ARGS;
+        }
+
+        length = strlen(ppPatterns[iPattern]);
+        textCap    += length + 3;
+        segmentCap += 2;
+        for (i = 0; i < length; i += 1) {
+            if (ppPatterns[iPattern][i] == '/') {
+                segmentCap += 1;
+            }
+        }
+    }
+
+    pInternal = (mfs_glob_internal*)MFS_MALLOC(sizeof(*pInternal));
+    if (pInternal == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    MFS_ZERO_OBJECT(pInternal);
+    pInternal->isCaseInsensitive = (flags & MFS_GLOB_FLAG_CASE_INSENSITIVE) != 0;
+    pGlob->flags     = flags;
+    pGlob->pInternal = pInternal;
+
+    pInternal->pText         = (char*)MFS_MALLOC(textCap + 1);
+    pInternal->pSegments     = (mfs_glob_segment*)MFS_MALLOC(sizeof(*pInternal->pSegments) * (segmentCap + 1));
+    pInternal->pRules        = (mfs_glob_rule*)MFS_MALLOC(sizeof(*pInternal->pRules) * (patternCount + 1));
+    pInternal->pGeneralRules = (size_t*)MFS_MALLOC(sizeof(*pInternal->pGeneralRules) * (patternCount + 1));
+    if (pInternal->pText == NULL || pInternal->pSegments == NULL || pInternal->pRules == NULL || pInternal->pGeneralRules == NULL) {
+        mfs_glob_uninit(pGlob);
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    for (iPattern = 0; iPattern < patternCount; iPattern += 1) {
+        result = mfs_glob_add_rule(pInternal, ppPatterns[iPattern], flags);
+        if (result != MFS_SUCCESS) {
+            mfs_glob_uninit(pGlob);
+            return result;
+        }
+    }
+
+    for (iRule = 0; iRule < pInternal->ruleCount; iRule += 1) {
+        if (pInternal->pRules[iRule].kind == MFS_GLOB_RULE_GENERAL) {
+            pInternal->pGeneralRules[pInternal->generalRuleCount] = iRule;
+            pInternal->generalRuleCount += 1;
+        } else {
+            tableCounts[pInternal->pRules[iRule].kind - 1] += 1;
+        }
+    }
+
+    /* The tables are kept at most half full. */
+    for (iTable = 0; iTable < 3; iTable += 1) {
+        mfs_glob_table* pTable = &pInternal->tables[iTable];
+
+        if (tableCounts[iTable] == 0) {
+            continue;
+        }
+
+        pTable->cap = 8;
+        while (pTable->cap < tableCounts[iTable] * 2) {
+            pTable->cap *= 2;
+        }
+
+        pTable->pSlots = (size_t*)MFS_MALLOC(sizeof(*pTable->pSlots) * pTable->cap);
+        if (pTable->pSlots == NULL) {
+            mfs_glob_uninit(pGlob);
+            return MFS_OUT_OF_MEMORY;
+        }
+
+        MFS_ZERO_MEMORY(pTable->pSlots, sizeof(*pTable->pSlots) * pTable->cap);
+    }
+
+    for (iRule = 0; iRule < pInternal->ruleCount; iRule += 1) {
+        const mfs_glob_rule* pRule = &pInternal->pRules[iRule];
+        mfs_glob_table* pTable;
+        size_t iSlot;
+
+        if (pRule->kind == MFS_GLOB_RULE_GENERAL) {
+            continue;
+        }
+
+        pTable = &pInternal->tables[pRule->kind - 1];
+        iSlot  = (size_t)mfs_glob_rule_hash(pInternal, pRule) & (pTable->cap - 1);
+        while (pTable->pSlots[iSlot] != 0) {
+            iSlot = (iSlot + 1) & (pTable->cap - 1);
+        }
+
+        pTable->pSlots[iSlot] = iRule + 1;
+    }
+
+    return MFS_SUCCESS;
+}
+
+void mfs_glob_uninit(mfs_glob_matcher* pGlob)
+{
+    mfs_glob_internal* pInternal;
+    size_t iTable;
+
+    if (pGlob == NULL || pGlob->pInternal == NULL) {
+        return;
+    }
+
+    pInternal = (mfs_glob_internal*)pGlob->pInternal;
+
+    for (iTable = 0; iTable < 3; iTable += 1) {
+        MFS_FREE(pInternal->tables[iTable].pSlots);
+    }
+
+    MFS_FREE(pInternal->pGeneralRules);
+    MFS_FREE(pInternal->pRules);
+    MFS_FREE(pInternal->pSegments);
+    MFS_FREE(pInternal->pText);
+    MFS_FREE(pInternal);
+
+    pGlob->pInternal = NULL;
+}
+
+mfs_bool32 mfs_glob_match(const mfs_glob_matcher* pGlob, const char* pPath, mfs_bool32 isDirectory)
+{
+    const mfs_glob_internal* pInternal;
+    size_t pathLength;
+
+    if (pGlob == NULL || pGlob->pInternal == NULL || pPath == NULL) {
+        return MFS_FALSE;
+    }
+
+    pInternal  = (const mfs_glob_internal*)pGlob->pInternal;
+    pathLength = strlen(pPath);
+
+    /* With .gitignore rules, everything under a directory that matches also matches. */
+    if ((pGlob->flags & MFS_GLOB_FLAG_GITIGNORE) != 0) {
+        size_t cursor = 0;
+        size_t offset;
+        size_t length;
+
+        while (mfs_glob_next_segment(pPath, pathLength, &cursor, &offset, &length)) {
+            size_t next = cursor;
+            size_t nextOffset;
+            size_t nextLength;
+
+            if (mfs_glob_next_segment(pPath, pathLength, &next, &nextOffset, &nextLength) == MFS_FALSE) {
+                break;  /* The last segment is the path itself. */
+            }
+
+            if (mfs_glob_match_entry(pInternal, pPath, cursor, MFS_TRUE)) {
+                return MFS_TRUE;
+            }
+        }
+    }
+
+    return mfs_glob_match_entry(pInternal, pPath, pathLength, isDirectory);
+}
+
+mfs_bool32 mfs_glob_may_match_under(const mfs_glob_matcher* pGlob, const char* pDirectoryPath)
+{
+    if (pGlob == NULL || pGlob->pInternal == NULL || pDirectoryPath == NULL) {
+        return MFS_FALSE;
+    }
+
+    return mfs_glob_may_match_under_internal((const mfs_glob_internal*)pGlob->pInternal, pDirectoryPath, strlen(pDirectoryPath));
+}
+
+
+
+/* Walking */
+#define MFS_WALK_DEFAULT_MAX_OPEN_DIRECTORIES   32
+
+#if defined(MFS_POSIX) && defined(AT_FDCWD) && defined(O_DIRECTORY) && defined(O_NOFOLLOW) && defined(O_CLOEXEC)
+    #define MFS_WALK_AT
+#endif
+
+typedef struct
+{
+    size_t pathLength;          /* The length of this directory's path in the path buffer. */
+    size_t nameOffset;          /* The offset of this directory's name in the path buffer. */
+    mfs_uint64 inode;
+    mfs_uint64 device;          /* Only set when following links. Used for detecting loops. */
+    mfs_uint64 position;        /* Where to continue from if the directory needs to be reopened. */
+    mfs_bool32 isSymlink;       /* Whether or not this directory was reached through a link. */
+    mfs_bool32 isHidden;        /* Set when the directory is only being read because something under it could match pInclude. */
+    mfs_bool32 isOpen;
+#if defined(MFS_WIN32)
+    HANDLE hFind;
+    WIN32_FIND_DATAA findData;
+    mfs_bool32 hasFindData;     /* Whether or not findData holds an entry that hasn't been returned yet. */
+#elif defined(MFS_ITERATOR_GETDENTS64)
+    int fd;
+    char* pBuffer;              /* Only assigned while the directory is open. */
+    size_t bufferCursor;
+    size_t bufferEnd;
+#elif defined(MFS_POSIX)
+    DIR* pDir;
+#endif
+} mfs_walk_level;
+
+typedef struct
+{
+    mfs_walk_config config;
+    mfs_walk_proc onEntry;
+    void* pUserData;
+    mfs_result result;          /* The first error that was reported through onError. */
+    char* pPath;                /* The path buffer shared by every level. */
+    size_t pathCap;
+    mfs_walk_level* pLevels;
+    size_t levelCap;
+    mfs_uint32 openCount;
+    mfs_uint32 threadIndex;
+    size_t rootLength;          /* For working out paths relative to the root for pInclude and pExclude. */
+#if defined(MFS_ITERATOR_GETDENTS64)
+    char** ppFreeBuffers;       /* Buffers of closed directories, ready to be reused. There's at most one per open directory. */
+    mfs_uint32 freeBufferCount;
+#endif
+} mfs_walk_state;
+
+mfs_walk_config mfs_walk_config_init(void)
+{
+    mfs_walk_config config;
+
+    MFS_ZERO_OBJECT(&config);
+    config.flags              = MFS_WALK_FLAG_PRE_ORDER;
+    config.symlinks           = MFS_WALK_SYMLINKS_NONE;
+    config.maxOpenDirectories = MFS_WALK_DEFAULT_MAX_OPEN_DIRECTORIES;
+
+    return config;
+}
+
+static void mfs_walk_report_error(mfs_walk_state* pState, const char* pPath, mfs_result result)
+{
+    if (pState->result == MFS_SUCCESS) {
+        pState->result = result;
+    }
+
+    if (pState->config.onError != NULL) {
+        pState->config.onError(pState->pUserData, pPath, result);
+    }
+}
+
+static mfs_result mfs_walk_reserve_path(mfs_walk_state* pState, size_t length)
+{
+    /* length does not include the null terminator. A few extra bytes are always available for the Win32 wildcard. */
+    char* pNewPath;
+    size_t newCap;
+
+    if (length + 4 <= pState->pathCap) {
+        return MFS_SUCCESS;
+    }
+
+    newCap = (pState->pathCap > 0) ? pState->pathCap : 256;
+    while (newCap < length + 4) {
+        newCap *= 2;
+    }
+
+    pNewPath = (char*)MFS_REALLOC(pState->pPath, newCap);
+    if (pNewPath == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    pState->pPath   = pNewPath;
+    pState->pathCap = newCap;
+
+    return MFS_SUCCESS;
+}
+
+static mfs_result mfs_walk_reserve_levels(mfs_walk_state* pState, size_t count)
+{
+    mfs_walk_level* pNewLevels;
+    size_t newCap;
+
+    if (count <= pState->levelCap) {
+        return MFS_SUCCESS;
+    }
+
+    newCap = (pState->levelCap > 0) ? pState->levelCap * 2 : 16;
+    while (newCap < count) {
+        newCap *= 2;
+    }
+
+    pNewLevels = (mfs_walk_level*)MFS_REALLOC(pState->pLevels, sizeof(*pNewLevels) * newCap);
+    if (pNewLevels == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    pState->pLevels  = pNewLevels;
+    pState->levelCap = newCap;
+
+    return MFS_SUCCESS;
+}
+
+static void mfs_walk_close_level(mfs_walk_state* pState, mfs_walk_level* pLevel)
+{
+    if (pLevel->isOpen == MFS_FALSE) {
+        return;
+    }
+
+#if defined(MFS_WIN32)
+    FindClose(pLevel->hFind);
+#elif defined(MFS_ITERATOR_GETDENTS64)
+    close(pLevel->fd);
+    pState->ppFreeBuffers[pState->freeBufferCount] = pLevel->pBuffer;
+    pState->freeBufferCount += 1;
+    pLevel->pBuffer = NULL;
+#elif defined(MFS_POSIX)
+    closedir(pLevel->pDir);
+#endif
+
+    pLevel->isOpen = MFS_FALSE;
+    pState->openCount -= 1;
+}
+
+#if defined(MFS_WALK_AT)
+static int mfs_walk_level_fd(const mfs_walk_level* pLevel)
+{
+#if defined(MFS_ITERATOR_GETDENTS64)
+    return pLevel->fd;
+#else
+    return dirfd(pLevel->pDir);
+#endif
+}
+#endif
+
+/*
+Reads the next entry. pType is set to one of MFS_FILE_TYPE_*, where MFS_FILE_TYPE_UNKNOWN means the file system doesn't report it.
+The name is null terminated.
+*/
+static mfs_result mfs_walk_read_level(mfs_walk_level* pLevel, const char** ppName, mfs_uint32* pType, mfs_uint64* pInode)
+{
+#if defined(MFS_WIN32)
+    if (pLevel->hasFindData == MFS_FALSE) {
+        if (!FindNextFileA(pLevel->hFind, &pLevel->findData)) {
+            DWORD error = GetLastError();
+            if (error == ERROR_NO_MORE_FILES) {
+                return MFS_AT_END;
+            }
+
+            return mfs_result_from_GetLastError(error);
+        }
+    }
+
+    pLevel->hasFindData = MFS_FALSE;
+    pLevel->position   += 1;
+
+    *ppName = pLevel->findData.cFileName;
+    *pInode = 0;
+
+    if ((pLevel->findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0 && pLevel->findData.dwReserved0 == IO_REPARSE_TAG_SYMLINK) {
+        *pType = MFS_FILE_TYPE_SYMLINK;
+    } else if ((pLevel->findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+        *pType = MFS_FILE_TYPE_DIRECTORY;
+    } else {
+        *pType = MFS_FILE_TYPE_FILE;
+    }
+
+    return MFS_SUCCESS;
+#elif defined(MFS_POSIX)
+    int type = -1;
+
+    #if defined(MFS_ITERATOR_GETDENTS64)
+    {
+        mfs_linux_dirent64* pEntry;
+
+        if (pLevel->bufferCursor >= pLevel->bufferEnd) {
+            long bytesRead;
+
+            do {
+                bytesRead = syscall(SYS_getdents64, pLevel->fd, pLevel->pBuffer, MFS_ITERATOR_DEFAULT_BUFFER_SIZE);
+            } while (bytesRead < 0 && errno == EINTR);
+
+            if (bytesRead < 0) {
+                return mfs_result_from_errno(errno);
+            }
+
+            if (bytesRead == 0) {
+                return MFS_AT_END;
+            }
+
+            pLevel->bufferCursor = 0;
+            pLevel->bufferEnd    = (size_t)bytesRead;
+        }
+
+        pEntry = (mfs_linux_dirent64*)(pLevel->pBuffer + pLevel->bufferCursor);
+        pLevel->bufferCursor += pEntry->d_reclen;
+        pLevel->position      = (mfs_uint64)pEntry->d_off;  /* The offset of the next entry. */
+
+        *ppName = pEntry->d_name;
+        *pInode = pEntry->d_ino;
+        type    = pEntry->d_type;
+    }
+    #else
+    {
+        struct dirent* pEntry;
+
+        errno = 0;
+        pEntry = readdir(pLevel->pDir);
+        if (pEntry == NULL) {
+            if (errno != 0) {
+                return mfs_result_from_errno(errno);
+            }
+
+            return MFS_AT_END;
+        }
+
+        pLevel->position += 1;
+
+        *ppName = pEntry->d_name;
+        *pInode = (mfs_uint64)pEntry->d_ino;
+        #if defined(DT_UNKNOWN)
+        type    = pEntry->d_type;
+        #endif
+    }
     #endif
-    #ifdef EKEYEXPIRED
-        case EKEYEXPIRED: return MFS_ERROR;
+
+    switch (type)
+    {
+    #if defined(DT_UNKNOWN)
+        case DT_REG:     *pType = MFS_FILE_TYPE_FILE;      break;
+        case DT_DIR:     *pType = MFS_FILE_TYPE_DIRECTORY; break;
+        case DT_LNK:     *pType = MFS_FILE_TYPE_SYMLINK;   break;
+        case DT_UNKNOWN: *pType = MFS_FILE_TYPE_UNKNOWN;   break;
     #endif
-    #ifdef EKEYREVOKED
-        case EKEYREVOKED: return MFS_ERROR;
+        case -1:         *pType = MFS_FILE_TYPE_UNKNOWN;   break;
+        default:         *pType = MFS_FILE_TYPE_OTHER;     break;
+    }
+
+    return MFS_SUCCESS;
+#else
+    (void)pLevel;
+    (void)ppName;
+    (void)pType;
+    (void)pInode;
+    return MFS_NOT_IMPLEMENTED;
+#endif
+}
+
+/*
+Opens the directory at the given level, continuing from its previous position if it's being reopened. The path buffer must hold the
+directory's path. If the limit on open directories has been reached, the shallowest one is closed to make room.
+*/
+static mfs_result mfs_walk_open_level(mfs_walk_state* pState, size_t iLevel)
+{
+    mfs_walk_level* pLevel = &pState->pLevels[iLevel];
+    mfs_result result = MFS_SUCCESS;
+
+    MFS_ASSERT(pLevel->isOpen == MFS_FALSE);
+
+    if (pState->openCount >= pState->config.maxOpenDirectories) {
+        size_t iOpenLevel;
+        for (iOpenLevel = 0; iOpenLevel < iLevel; iOpenLevel += 1) {
+            if (pState->pLevels[iOpenLevel].isOpen) {
+                mfs_walk_close_level(pState, &pState->pLevels[iOpenLevel]);
+                break;
+            }
+        }
+    }
+
+    pState->pPath[pLevel->pathLength] = '\0';
+
+#if defined(MFS_WIN32)
+    {
+        mfs_uint64 iSkip;
+        size_t queryLength = pLevel->pathLength;
+
+        /* We need to add a wildcard to the path. There's always room for it. */
+        if (queryLength == 0) {
+            pState->pPath[queryLength++] = '.';
+        }
+        if (pState->pPath[queryLength-1] != '\\' && pState->pPath[queryLength-1] != '/') {
+            pState->pPath[queryLength++] = '\\';
+        }
+        pState->pPath[queryLength++] = '*';
+        pState->pPath[queryLength]   = '\0';
+
+        pLevel->hFind = FindFirstFileA(pState->pPath, &pLevel->findData);
+        pState->pPath[pLevel->pathLength] = '\0';
+
+        if (pLevel->hFind == INVALID_HANDLE_VALUE) {
+            return mfs_result_from_GetLastError(GetLastError());
+        }
+
+        pLevel->hasFindData = MFS_TRUE;
+        pLevel->isOpen = MFS_TRUE;
+        pState->openCount += 1;
+
+        /* Win32 has no way to seek so we just skip over what we've already seen. */
+        for (iSkip = 0; iSkip < pLevel->position; iSkip += 1) {
+            pLevel->hasFindData = MFS_FALSE;
+            if (!FindNextFileA(pLevel->hFind, &pLevel->findData)) {
+                break;
+            }
+            pLevel->hasFindData = MFS_TRUE;
+        }
+    }
+#elif defined(MFS_WALK_AT)
+    {
+        int fd;
+        int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+
+        /* Guards against a directory being swapped for a link after we decided not to follow it. */
+        if (pLevel->isSymlink == MFS_FALSE) {
+            flags |= O_NOFOLLOW;
+        }
+
+        if (iLevel > 0 && pState->pLevels[iLevel-1].isOpen) {
+            fd = openat(mfs_walk_level_fd(&pState->pLevels[iLevel-1]), pState->pPath + pLevel->nameOffset, flags);
+        } else {
+            fd = open((pLevel->pathLength > 0) ? pState->pPath : ".", flags);
+        }
+
+        if (fd < 0) {
+            return mfs_result_from_errno(errno);
+        }
+
+        if (pState->config.symlinks == MFS_WALK_SYMLINKS_ALL) {
+            struct stat info;
+            if (fstat(fd, &info) == 0) {
+                pLevel->device = (mfs_uint64)info.st_dev;
+                pLevel->inode  = (mfs_uint64)info.st_ino;
+            }
+        }
+
+    #if defined(MFS_ITERATOR_GETDENTS64)
+        if (pLevel->position > 0) {
+            if (lseek(fd, (off_t)pLevel->position, SEEK_SET) == (off_t)-1) {
+                result = mfs_result_from_errno(errno);
+                close(fd);
+                return result;
+            }
+        }
+
+        if (pState->freeBufferCount > 0) {
+            pState->freeBufferCount -= 1;
+            pLevel->pBuffer = pState->ppFreeBuffers[pState->freeBufferCount];
+        } else {
+            pLevel->pBuffer = (char*)MFS_MALLOC(MFS_ITERATOR_DEFAULT_BUFFER_SIZE);
+            if (pLevel->pBuffer == NULL) {
+                close(fd);
+                return MFS_OUT_OF_MEMORY;
+            }
+        }
+
+        pLevel->fd           = fd;
+        pLevel->bufferCursor = 0;
+        pLevel->bufferEnd    = 0;
+    #else
+        pLevel->pDir = fdopendir(fd);
+        if (pLevel->pDir == NULL) {
+            result = mfs_result_from_errno(errno);
+            close(fd);
+            return result;
+        }
     #endif
-    #ifdef EKEYREJECTED
-        case EKEYREJECTED: return MFS_ERROR;
+
+        pLevel->isOpen = MFS_TRUE;
+        pState->openCount += 1;
+    }
+#elif defined(MFS_POSIX)
+    {
+        pLevel->pDir = opendir((pLevel->pathLength > 0) ? pState->pPath : ".");
+        if (pLevel->pDir == NULL) {
+            return mfs_result_from_errno(errno);
+        }
+
+        if (pState->config.symlinks == MFS_WALK_SYMLINKS_ALL) {
+            struct stat info;
+            if (stat((pLevel->pathLength > 0) ? pState->pPath : ".", &info) == 0) {
+                pLevel->device = (mfs_uint64)info.st_dev;
+                pLevel->inode  = (mfs_uint64)info.st_ino;
+            }
+        }
+
+        pLevel->isOpen = MFS_TRUE;
+        pState->openCount += 1;
+    }
+#endif
+
+#if defined(MFS_POSIX) && !defined(MFS_ITERATOR_GETDENTS64)
+    {
+        /* Positions from telldir() are not guaranteed to survive a closedir() so we just skip over what we've already seen. */
+        mfs_uint64 iSkip;
+        for (iSkip = 0; iSkip < pLevel->position; iSkip += 1) {
+            if (readdir(pLevel->pDir) == NULL) {
+                break;
+            }
+        }
+    }
+#endif
+
+#if !defined(MFS_WIN32) && !defined(MFS_POSIX)
+    (void)pLevel;
+    result = MFS_NOT_IMPLEMENTED;
+#endif
+
+    return result;
+}
+static mfs_uint32 mfs_walk_report(mfs_walk_state* pState, mfs_walk_level* pParentLevel, size_t depth, size_t nameOffset, size_t pathLength, mfs_uint32 type, mfs_uint64 inode, mfs_bool32 isSymlink, mfs_bool32 isPostOrder)
+{
+    /* pParentLevel is the directory containing the entry, if it's available, so mfs_walk_get_file_info() can use its handle. */
+    mfs_walk_entry entry;
+
+    pState->pPath[pathLength] = '\0';
+
+    entry.pPath       = pState->pPath;
+    entry.pathLength  = pathLength;
+    entry.pName       = pState->pPath + nameOffset;
+    entry.nameLength  = pathLength - nameOffset;
+    entry.depth       = (mfs_uint32)depth;
+    entry.type        = type;
+    entry.inode       = inode;
+    entry.isSymlink   = isSymlink;
+    entry.isPostOrder = isPostOrder;
+    entry.threadIndex = pState->threadIndex;
+    entry.pInternal   = pParentLevel;
+
+    return pState->onEntry(pState->pUserData, &entry);
+}
+
+#define MFS_WALK_FILTER_REPORT      0x01
+#define MFS_WALK_FILTER_DESCEND     0x02
+
+static mfs_uint32 mfs_walk_filter(const mfs_walk_state* pState, size_t pathLength, mfs_uint32 type)
+{
+    /* Returns a combination of MFS_WALK_FILTER_* flags for the entry at the end of the path buffer. */
+    const char* pRelativePath;
+    size_t relativeOffset;
+    mfs_bool32 isDirectory = (type == MFS_FILE_TYPE_DIRECTORY);
+    mfs_uint32 filter = MFS_WALK_FILTER_REPORT | MFS_WALK_FILTER_DESCEND;
+
+    if (pState->config.pInclude == NULL && pState->config.pExclude == NULL) {
+        return filter;
+    }
+
+    relativeOffset = pState->rootLength;
+    if (relativeOffset < pathLength && (pState->pPath[relativeOffset] == '/' || pState->pPath[relativeOffset] == '\\')) {
+        relativeOffset += 1;
+    }
+
+    pRelativePath = pState->pPath + relativeOffset;
+
+    /* Anything under an excluded directory is also excluded, so there's no need to read it. */
+    if (pState->config.pExclude != NULL && pState->config.pExclude->pInternal != NULL) {
+        if (mfs_glob_match_entry((const mfs_glob_internal*)pState->config.pExclude->pInternal, pRelativePath, pathLength - relativeOffset, isDirectory)) {
+            return 0;
+        }
+    }
+
+    if (pState->config.pInclude != NULL && pState->config.pInclude->pInternal != NULL) {
+        const mfs_glob_internal* pInclude = (const mfs_glob_internal*)pState->config.pInclude->pInternal;
+
+        if (mfs_glob_match_entry(pInclude, pRelativePath, pathLength - relativeOffset, isDirectory) == MFS_FALSE) {
+            filter &= ~MFS_WALK_FILTER_REPORT;
+        }
+
+        if (isDirectory && mfs_glob_may_match_under_internal(pInclude, pRelativePath, pathLength - relativeOffset) == MFS_FALSE) {
+            filter &= ~MFS_WALK_FILTER_DESCEND;
+        }
+    }
+
+    return filter;
+}
+
+#if defined(MFS_POSIX)
+static mfs_bool32 mfs_walk_is_loop(mfs_walk_state* pState, size_t iLevel, mfs_uint64 device, mfs_uint64 inode)
+{
+    size_t iAncestor;
+
+    for (iAncestor = 0; iAncestor < iLevel; iAncestor += 1) {
+        if (pState->pLevels[iAncestor].device == device && pState->pLevels[iAncestor].inode == inode) {
+            return MFS_TRUE;
+        }
+    }
+
+    return MFS_FALSE;
+}
+#endif
+
+/*
+Resolves the type of an entry where the file system didn't report it, or where it's a link that needs to be followed. The entry's
+path must be in the path buffer. If a link is followed, pInode is set to the target's.
+*/
+static void mfs_walk_resolve_type(mfs_walk_state* pState, size_t iLevel, const char* pName, mfs_uint32* pType, mfs_bool32* pIsSymlink, mfs_uint64* pInode)
+{
+    mfs_file_info_ex info;
+    mfs_result result;
+
+    if (*pType == MFS_FILE_TYPE_UNKNOWN) {
+    #if defined(MFS_WALK_AT)
+        if (pState->pLevels[iLevel].isOpen) {
+            result = mfs_get_file_info_at__posix(mfs_walk_level_fd(&pState->pLevels[iLevel]), pName, MFS_FILE_INFO_FIELD_TYPE | MFS_FILE_INFO_FLAG_NO_FOLLOW, &info);
+        } else
     #endif
-    #ifdef EOWNERDEAD
-        case EOWNERDEAD: return MFS_ERROR;
+        {
+            result = mfs_get_file_info_ex(pState->pPath, MFS_FILE_INFO_FIELD_TYPE | MFS_FILE_INFO_FLAG_NO_FOLLOW, &info);
+        }
+
+        if (result == MFS_SUCCESS) {
+            *pType = info.type;
+        }
+    }
+
+    if (*pType == MFS_FILE_TYPE_SYMLINK && pState->config.symlinks == MFS_WALK_SYMLINKS_ALL) {
+    #if defined(MFS_WALK_AT)
+        if (pState->pLevels[iLevel].isOpen) {
+            result = mfs_get_file_info_at__posix(mfs_walk_level_fd(&pState->pLevels[iLevel]), pName, MFS_FILE_INFO_FIELD_TYPE | MFS_FILE_INFO_FIELD_INODE, &info);
+        } else
     #endif
-    #ifdef ENOTRECOVERABLE
-        case ENOTRECOVERABLE: return MFS_ERROR;
+        {
+            result = mfs_get_file_info_ex(pState->pPath, MFS_FILE_INFO_FIELD_TYPE | MFS_FILE_INFO_FIELD_INODE, &info);
+        }
+
+        /* Dangling links are reported as links. */
+        if (result == MFS_SUCCESS) {
+            *pType      = info.type;
+            *pIsSymlink = MFS_TRUE;
+            *pInode     = info.inode;
+        }
+    }
+
+    (void)pName;
+}
+
+static void mfs_walk_cleanup(mfs_walk_state* pState, size_t levelCount)
+{
+    size_t iLevel;
+
+    for (iLevel = 0; iLevel < levelCount; iLevel += 1) {
+        mfs_walk_close_level(pState, &pState->pLevels[iLevel]);
+    }
+
+#if defined(MFS_ITERATOR_GETDENTS64)
+    while (pState->freeBufferCount > 0) {
+        pState->freeBufferCount -= 1;
+        MFS_FREE(pState->ppFreeBuffers[pState->freeBufferCount]);
+    }
+    MFS_FREE(pState->ppFreeBuffers);
+#endif
+
+    MFS_FREE(pState->pLevels);
+    MFS_FREE(pState->pPath);
+}
+
+mfs_result mfs_walk(const char* pRootPath, const mfs_walk_config* pConfig, mfs_walk_proc onEntry, void* pUserData)
+{
+    mfs_result result;
+    mfs_walk_state state;
+    mfs_walk_level* pLevel;
+    mfs_file_info_ex rootInfo;
+    size_t rootLength;
+    size_t depth;
+    mfs_bool32 preOrder;
+    mfs_bool32 postOrder;
+
+    if (pRootPath == NULL || onEntry == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(&state);
+    if (pConfig != NULL) {
+        state.config = *pConfig;
+    } else {
+        state.config = mfs_walk_config_init();
+    }
+
+    if (state.config.maxOpenDirectories == 0) {
+        state.config.maxOpenDirectories = MFS_WALK_DEFAULT_MAX_OPEN_DIRECTORIES;
+    }
+
+    if ((state.config.flags & (MFS_WALK_FLAG_PRE_ORDER | MFS_WALK_FLAG_POST_ORDER)) == 0) {
+        state.config.flags |= MFS_WALK_FLAG_PRE_ORDER;
+    }
+
+    preOrder  = (state.config.flags & MFS_WALK_FLAG_PRE_ORDER)  != 0;
+    postOrder = (state.config.flags & MFS_WALK_FLAG_POST_ORDER) != 0;
+
+    state.onEntry   = onEntry;
+    state.pUserData = pUserData;
+
+    result = mfs_get_file_info_ex((pRootPath[0] != '\0') ? pRootPath : ".", MFS_FILE_INFO_FIELD_TYPE | MFS_FILE_INFO_FIELD_INODE | ((state.config.symlinks == MFS_WALK_SYMLINKS_NONE) ? MFS_FILE_INFO_FLAG_NO_FOLLOW : 0), &rootInfo);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+#if defined(MFS_ITERATOR_GETDENTS64)
+    state.ppFreeBuffers = (char**)MFS_MALLOC(sizeof(*state.ppFreeBuffers) * state.config.maxOpenDirectories);
+    if (state.ppFreeBuffers == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+#endif
+
+    rootLength = strlen(pRootPath);
+    state.rootLength = rootLength;
+    if (mfs_walk_reserve_path(&state, rootLength) != MFS_SUCCESS || mfs_walk_reserve_levels(&state, 1) != MFS_SUCCESS) {
+        mfs_walk_cleanup(&state, 0);
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    MFS_COPY_MEMORY(state.pPath, pRootPath, rootLength+1);
+
+    pLevel = &state.pLevels[0];
+    MFS_ZERO_OBJECT(pLevel);
+    pLevel->pathLength = rootLength;
+    pLevel->nameOffset = (size_t)(mfs_path_file_name(pRootPath) - pRootPath);
+    pLevel->inode      = rootInfo.inode;
+    pLevel->isSymlink  = state.config.symlinks != MFS_WALK_SYMLINKS_NONE;   /* Allows the root to be opened through a link. It's never reported as one. */
+
+    /* The root is reported like any other entry. If it's not a directory there's nothing more to do. */
+    if (preOrder || rootInfo.type != MFS_FILE_TYPE_DIRECTORY) {
+        mfs_uint32 action = mfs_walk_report(&state, NULL, 0, pLevel->nameOffset, pLevel->pathLength, rootInfo.type, rootInfo.inode, MFS_FALSE, MFS_FALSE);
+        if (action == MFS_WALK_STOP) {
+            mfs_walk_cleanup(&state, 1);
+            return MFS_CANCELLED;
+        }
+
+        if (action == MFS_WALK_SKIP || rootInfo.type != MFS_FILE_TYPE_DIRECTORY) {
+            mfs_walk_cleanup(&state, 1);
+            return MFS_SUCCESS;
+        }
+    }
+
+    result = mfs_walk_open_level(&state, 0);
+    if (result != MFS_SUCCESS) {
+        mfs_walk_cleanup(&state, 1);
+        return result;
+    }
+
+    depth = 0;
+    for (;;) {
+        const char* pName;
+        mfs_uint32 type;
+        mfs_uint64 inode;
+        mfs_bool32 isSymlink = MFS_FALSE;
+        mfs_bool32 descend;
+        size_t nameLength;
+        size_t nameOffset;
+        size_t pathLength;
+        mfs_uint32 action;
+        mfs_uint32 filter;
+
+        pLevel = &state.pLevels[depth];
+
+        /* The directory might have been closed to stay under the limit while we were in one of its subdirectories. */
+        if (pLevel->isOpen == MFS_FALSE) {
+            result = mfs_walk_open_level(&state, depth);
+            if (result != MFS_SUCCESS) {
+                state.pPath[pLevel->pathLength] = '\0';
+                mfs_walk_report_error(&state, state.pPath, result);
+                result = MFS_AT_END;
+            } else {
+                result = mfs_walk_read_level(pLevel, &pName, &type, &inode);
+            }
+        } else {
+            result = mfs_walk_read_level(pLevel, &pName, &type, &inode);
+        }
+
+        if (result != MFS_SUCCESS) {
+            if (result != MFS_AT_END) {
+                state.pPath[pLevel->pathLength] = '\0';
+                mfs_walk_report_error(&state, state.pPath, result);
+            }
+
+            /* Done with this directory. */
+            mfs_walk_close_level(&state, pLevel);
+
+            if (postOrder && pLevel->isHidden == MFS_FALSE) {
+                if (mfs_walk_report(&state, (depth > 0) ? &state.pLevels[depth-1] : NULL, depth, pLevel->nameOffset, pLevel->pathLength, MFS_FILE_TYPE_DIRECTORY, pLevel->inode, pLevel->isSymlink && depth > 0, MFS_TRUE) == MFS_WALK_STOP) {
+                    mfs_walk_cleanup(&state, depth + 1);
+                    return MFS_CANCELLED;
+                }
+            }
+
+            if (depth == 0) {
+                break;
+            }
+
+            depth -= 1;
+            continue;
+        }
+
+        if (pName[0] == '.' && (pName[1] == '\0' || (pName[1] == '.' && pName[2] == '\0'))) {
+            continue;   /* "." or "..". */
+        }
+
+        /* Append the name to the path. */
+        nameLength = strlen(pName);
+        nameOffset = pLevel->pathLength;
+        if (nameOffset > 0 && state.pPath[nameOffset-1] != '/' && state.pPath[nameOffset-1] != '\\') {
+            nameOffset += 1;
+        }
+        pathLength = nameOffset + nameLength;
+
+        if (mfs_walk_reserve_path(&state, pathLength) != MFS_SUCCESS) {
+            mfs_walk_cleanup(&state, depth + 1);
+            return MFS_OUT_OF_MEMORY;
+        }
+
+        if (nameOffset > pLevel->pathLength) {
+            state.pPath[pLevel->pathLength] = '/';
+        }
+        MFS_COPY_MEMORY(state.pPath + nameOffset, pName, nameLength+1);   /* <-- pName can't be used after this point on Win32 where it can point into the level. */
+
+        if (type == MFS_FILE_TYPE_UNKNOWN || (type == MFS_FILE_TYPE_SYMLINK && state.config.symlinks == MFS_WALK_SYMLINKS_ALL)) {
+            mfs_walk_resolve_type(&state, depth, state.pPath + nameOffset, &type, &isSymlink, &inode);
+        }
+
+        filter  = mfs_walk_filter(&state, pathLength, type);
+        descend = (type == MFS_FILE_TYPE_DIRECTORY) && (state.config.maxDepth == 0 || depth+1 < state.config.maxDepth) && (filter & MFS_WALK_FILTER_DESCEND) != 0;
+
+        if ((preOrder || type != MFS_FILE_TYPE_DIRECTORY) && (filter & MFS_WALK_FILTER_REPORT) != 0) {
+            action = mfs_walk_report(&state, pLevel, depth+1, nameOffset, pathLength, type, inode, isSymlink, MFS_FALSE);
+            if (action == MFS_WALK_STOP) {
+                mfs_walk_cleanup(&state, depth + 1);
+                return MFS_CANCELLED;
+            }
+
+            if (action == MFS_WALK_SKIP) {
+                continue;
+            }
+        }
+
+        if (descend) {
+            mfs_walk_level* pChild;
+
+            if (mfs_walk_reserve_levels(&state, depth + 2) != MFS_SUCCESS) {
+                mfs_walk_cleanup(&state, depth + 1);
+                return MFS_OUT_OF_MEMORY;
+            }
+
+            pChild = &state.pLevels[depth+1];
+            MFS_ZERO_OBJECT(pChild);
+            pChild->pathLength = pathLength;
+            pChild->nameOffset = nameOffset;
+            pChild->inode      = inode;
+            pChild->isSymlink  = isSymlink;
+            pChild->isHidden   = (filter & MFS_WALK_FILTER_REPORT) == 0;
+
+            result = mfs_walk_open_level(&state, depth+1);
+        #if defined(MFS_POSIX)
+            if (result == MFS_SUCCESS && state.config.symlinks == MFS_WALK_SYMLINKS_ALL) {
+                /* Anything under a followed link can lead back to an ancestor, not just the link itself. */
+                if (mfs_walk_is_loop(&state, depth+1, pChild->device, pChild->inode)) {
+                    mfs_walk_close_level(&state, pChild);
+                    result = MFS_TOO_MANY_LINKS;
+                }
+            }
+        #endif
+
+            if (result != MFS_SUCCESS) {
+                state.pPath[pathLength] = '\0';
+                mfs_walk_report_error(&state, state.pPath, result);
+                continue;
+            }
+
+            depth += 1;
+        } else if (type == MFS_FILE_TYPE_DIRECTORY && postOrder && (filter & MFS_WALK_FILTER_REPORT) != 0) {
+            if (mfs_walk_report(&state, pLevel, depth+1, nameOffset, pathLength, type, inode, isSymlink, MFS_TRUE) == MFS_WALK_STOP) {
+                mfs_walk_cleanup(&state, depth + 1);
+                return MFS_CANCELLED;
+            }
+        }
+    }
+
+    mfs_walk_cleanup(&state, 1);
+
+    return state.result;
+}
+
+mfs_result mfs_walk_get_file_info(const mfs_walk_entry* pEntry, mfs_uint32 fields, mfs_file_info_ex* pFileInfo)
+{
+    if (pFileInfo != NULL) {
+        MFS_ZERO_OBJECT(pFileInfo);
+    }
+
+    if (pEntry == NULL || pFileInfo == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (pEntry->isSymlink == MFS_FALSE) {
+        fields |= MFS_FILE_INFO_FLAG_NO_FOLLOW;
+    }
+
+#if defined(MFS_WALK_AT)
+    {
+        mfs_walk_level* pParentLevel = (mfs_walk_level*)pEntry->pInternal;
+
+        /* The parent directory will normally be open, except for the root and when it's been closed to stay under the limit. */
+        if (pParentLevel != NULL && pParentLevel->isOpen) {
+            return mfs_get_file_info_at__posix(mfs_walk_level_fd(pParentLevel), pEntry->pName, fields, pFileInfo);
+        }
+    }
+#endif
+
+    return mfs_get_file_info_ex((pEntry->pathLength > 0) ? pEntry->pPath : ".", fields, pFileInfo);
+}
+
+
+/*
+Parallel walking. Each directory is a node which is queued on a worker's deque. Nodes are reference counted in unordered mode so
+that a directory can be reported in post-order once the last of its subdirectories has been released. In ordered mode a node holds
+the directory's listing, and the calling thread reports listings in order as they become ready, reading directories itself while
+it waits.
+*/
+typedef struct mfs_walk_node mfs_walk_node;
+
+typedef struct
+{
+    size_t nameOffset;              /* Into the node's pNames buffer. */
+    size_t nameLength;
+    mfs_uint32 type;
+    mfs_uint64 inode;
+    mfs_bool32 isSymlink;
+    mfs_bool32 isHidden;            /* Set when the entry is only listed because something under it could match pInclude. */
+    mfs_walk_node* pChild;          /* Set for directories that are being descended into. */
+} mfs_walk_node_entry;
+
+struct mfs_walk_node
+{
+    mfs_walk_node* pParent;
+    char* pPath;                    /* Points to the memory immediately after this structure. */
+    size_t pathLength;
+    size_t nameOffset;
+    mfs_uint32 depth;
+    mfs_uint64 device;              /* Only set when following links. Used for detecting loops. */
+    mfs_uint64 inode;
+    mfs_bool32 isSymlink;
+    mfs_bool32 isHidden;            /* Set when the directory is only being read because something under it could match pInclude. */
+    mfs_uint32 refCount;            /* Unordered only. One for the node itself, plus one for each subdirectory that hasn't been released. */
+    mfs_bool32 isReady;             /* Ordered only. Set once the directory has been read. */
+    mfs_bool32 isSkipped;           /* Ordered only. Set when the directory no longer needs to be read. */
+    mfs_bool32 isUnopenable;        /* Set when the directory could not be opened, in which case it isn't reported in post-order, the same as mfs_walk(). */
+    mfs_walk_node_entry* pEntries;  /* Ordered only. */
+    size_t entryCount;
+    size_t entryCap;
+    char* pNames;
+    size_t namesLength;
+    size_t namesCap;
+};
+
+typedef struct
+{
+    mfs_mutex lock;
+    mfs_walk_node** ppNodes;        /* A ring buffer. The owner pushes and pops at the back. Other threads steal from the front. */
+    size_t cap;
+    size_t head;
+    size_t count;
+} mfs_walk_deque;
+
+typedef struct mfs_walk_parallel_state mfs_walk_parallel_state;
+
+typedef struct
+{
+    mfs_walk_parallel_state* pShared;
+    mfs_walk_state walk;            /* For reading directories. Only ever uses one level. */
+    mfs_walk_deque deque;
+    mfs_uint32 index;
+} mfs_walk_worker;
+
+struct mfs_walk_parallel_state
+{
+    mfs_walk_config config;
+    mfs_bool32 preOrder;
+    mfs_bool32 postOrder;
+    mfs_bool32 ordered;
+    mfs_mutex lock;                 /* For everything below, as well as node reference counts and readiness. */
+    mfs_cond cond;                  /* Signaled when a node is queued, when a node becomes ready and when there's nothing left to read. */
+    size_t pendingCount;            /* The number of nodes that are either queued or being read. */
+    size_t queuedCount;
+    mfs_uint32 idleCount;
+    mfs_bool32 isStopped;
+    mfs_result result;              /* The first error that was reported through onError. */
+    mfs_mutex errorLock;            /* For onError(). */
+    void* pUserData;
+    mfs_walk_worker* pWorkers;
+    mfs_uint32 workerCount;
+};
+
+static mfs_bool32 mfs_walk_deque_push(mfs_walk_deque* pDeque, mfs_walk_node* pNode)
+{
+    mfs_bool32 result = MFS_TRUE;
+
+    mfs_mutex_lock(&pDeque->lock);
+    {
+        if (pDeque->count == pDeque->cap) {
+            size_t newCap = (pDeque->cap > 0) ? pDeque->cap * 2 : 64;
+            mfs_walk_node** ppNewNodes = (mfs_walk_node**)MFS_MALLOC(sizeof(*ppNewNodes) * newCap);
+
+            if (ppNewNodes == NULL) {
+                result = MFS_FALSE;
+            } else {
+                size_t iNode;
+                for (iNode = 0; iNode < pDeque->count; iNode += 1) {
+                    ppNewNodes[iNode] = pDeque->ppNodes[(pDeque->head + iNode) % pDeque->cap];
+                }
+
+                MFS_FREE(pDeque->ppNodes);
+                pDeque->ppNodes = ppNewNodes;
+                pDeque->cap     = newCap;
+                pDeque->head    = 0;
+            }
+        }
+
+        if (result) {
+            pDeque->ppNodes[(pDeque->head + pDeque->count) % pDeque->cap] = pNode;
+            pDeque->count += 1;
+        }
+    }
+    mfs_mutex_unlock(&pDeque->lock);
+
+    return result;
+}
+
+static mfs_walk_node* mfs_walk_deque_pop(mfs_walk_deque* pDeque)
+{
+    mfs_walk_node* pNode = NULL;
+
+    mfs_mutex_lock(&pDeque->lock);
+    {
+        if (pDeque->count > 0) {
+            pDeque->count -= 1;
+            pNode = pDeque->ppNodes[(pDeque->head + pDeque->count) % pDeque->cap];
+        }
+    }
+    mfs_mutex_unlock(&pDeque->lock);
+
+    return pNode;
+}
+
+static mfs_walk_node* mfs_walk_deque_steal(mfs_walk_deque* pDeque)
+{
+    mfs_walk_node* pNode = NULL;
+
+    mfs_mutex_lock(&pDeque->lock);
+    {
+        if (pDeque->count > 0) {
+            pNode = pDeque->ppNodes[pDeque->head];
+            pDeque->head   = (pDeque->head + 1) % pDeque->cap;
+            pDeque->count -= 1;
+        }
+    }
+    mfs_mutex_unlock(&pDeque->lock);
+
+    return pNode;
+}
+
+static mfs_walk_node* mfs_walk_node_alloc(const char* pPath, size_t pathLength, size_t nameOffset, mfs_walk_node* pParent, mfs_uint64 inode, mfs_bool32 isSymlink)
+{
+    mfs_walk_node* pNode;
+
+    pNode = (mfs_walk_node*)MFS_MALLOC(sizeof(*pNode) + pathLength+1);
+    if (pNode == NULL) {
+        return NULL;
+    }
+
+    MFS_ZERO_OBJECT(pNode);
+    pNode->pParent    = pParent;
+    pNode->pPath      = (char*)(pNode + 1);
+    pNode->pathLength = pathLength;
+    pNode->nameOffset = nameOffset;
+    pNode->depth      = (pParent != NULL) ? pParent->depth + 1 : 0;
+    pNode->inode      = inode;
+    pNode->isSymlink  = isSymlink;
+    pNode->refCount   = 1;
+    MFS_COPY_MEMORY(pNode->pPath, pPath, pathLength);
+    pNode->pPath[pathLength] = '\0';
+
+    return pNode;
+}
+
+static void mfs_walk_node_free(mfs_walk_node* pNode)
+{
+    MFS_FREE(pNode->pEntries);
+    MFS_FREE(pNode->pNames);
+    MFS_FREE(pNode);
+}
+
+static mfs_result mfs_walk_node_add_entry(mfs_walk_node* pNode, const char* pName, size_t nameLength, mfs_uint32 type, mfs_uint64 inode, mfs_bool32 isSymlink, mfs_bool32 isHidden)
+{
+    mfs_walk_node_entry* pEntry;
+
+    if (pNode->entryCount == pNode->entryCap) {
+        size_t newCap = (pNode->entryCap > 0) ? pNode->entryCap * 2 : 16;
+        mfs_walk_node_entry* pNewEntries = (mfs_walk_node_entry*)MFS_REALLOC(pNode->pEntries, sizeof(*pNewEntries) * newCap);
+        if (pNewEntries == NULL) {
+            return MFS_OUT_OF_MEMORY;
+        }
+
+        pNode->pEntries = pNewEntries;
+        pNode->entryCap = newCap;
+    }
+
+    if (pNode->namesLength + nameLength+1 > pNode->namesCap) {
+        size_t newCap = (pNode->namesCap > 0) ? pNode->namesCap * 2 : 256;
+        char* pNewNames;
+
+        while (newCap < pNode->namesLength + nameLength+1) {
+            newCap *= 2;
+        }
+
+        pNewNames = (char*)MFS_REALLOC(pNode->pNames, newCap);
+        if (pNewNames == NULL) {
+            return MFS_OUT_OF_MEMORY;
+        }
+
+        pNode->pNames   = pNewNames;
+        pNode->namesCap = newCap;
+    }
+
+    pEntry = &pNode->pEntries[pNode->entryCount];
+    pEntry->nameOffset = pNode->namesLength;
+    pEntry->nameLength = nameLength;
+    pEntry->type       = type;
+    pEntry->inode      = inode;
+    pEntry->isSymlink  = isSymlink;
+    pEntry->isHidden   = isHidden;
+    pEntry->pChild     = NULL;
+
+    MFS_COPY_MEMORY(pNode->pNames + pNode->namesLength, pName, nameLength+1);
+    pNode->namesLength += nameLength+1;
+    pNode->entryCount  += 1;
+
+    return MFS_SUCCESS;
+}
+
+static void mfs_walk_parallel_report_error(mfs_walk_parallel_state* pShared, const char* pPath, mfs_result result)
+{
+    mfs_mutex_lock(&pShared->errorLock);
+    {
+        if (pShared->result == MFS_SUCCESS) {
+            pShared->result = result;
+        }
+
+        if (pShared->config.onError != NULL) {
+            pShared->config.onError(pShared->pUserData, pPath, result);
+        }
+    }
+    mfs_mutex_unlock(&pShared->errorLock);
+}
+
+static void mfs_walk_parallel_stop(mfs_walk_parallel_state* pShared)
+{
+    mfs_mutex_lock(&pShared->lock);
+    {
+        pShared->isStopped = MFS_TRUE;
+    }
+    mfs_mutex_unlock(&pShared->lock);
+}
+
+static mfs_result mfs_walk_parallel_push(mfs_walk_worker* pWorker, mfs_walk_node* pNode)
+{
+    mfs_walk_parallel_state* pShared = pWorker->pShared;
+
+    /* The counts need to be updated before the node becomes visible, otherwise it could be finished before it's been counted. */
+    mfs_mutex_lock(&pShared->lock);
+    {
+        pShared->pendingCount += 1;
+        pShared->queuedCount  += 1;
+        if (pNode->pParent != NULL && pShared->ordered == MFS_FALSE) {
+            pNode->pParent->refCount += 1;
+        }
+    }
+    mfs_mutex_unlock(&pShared->lock);
+
+    if (mfs_walk_deque_push(&pWorker->deque, pNode) == MFS_FALSE) {
+        mfs_mutex_lock(&pShared->lock);
+        {
+            pShared->pendingCount -= 1;
+            pShared->queuedCount  -= 1;
+            if (pNode->pParent != NULL && pShared->ordered == MFS_FALSE) {
+                pNode->pParent->refCount -= 1;
+            }
+        }
+        mfs_mutex_unlock(&pShared->lock);
+
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    mfs_mutex_lock(&pShared->lock);
+    {
+        if (pShared->idleCount > 0) {
+            mfs_cond_signal(&pShared->cond);
+        }
+    }
+    mfs_mutex_unlock(&pShared->lock);
+
+    return MFS_SUCCESS;
+}
+
+static mfs_walk_node* mfs_walk_parallel_take(mfs_walk_worker* pWorker)
+{
+    mfs_walk_parallel_state* pShared = pWorker->pShared;
+    mfs_walk_node* pNode;
+    mfs_uint32 iVictim;
+
+    pNode = mfs_walk_deque_pop(&pWorker->deque);
+    for (iVictim = 1; pNode == NULL && iVictim < pShared->workerCount; iVictim += 1) {
+        pNode = mfs_walk_deque_steal(&pShared->pWorkers[(pWorker->index + iVictim) % pShared->workerCount].deque);
+    }
+
+    if (pNode != NULL) {
+        mfs_mutex_lock(&pShared->lock);
+        {
+            pShared->queuedCount -= 1;
+        }
+        mfs_mutex_unlock(&pShared->lock);
+    }
+
+    return pNode;
+}
+
+static void mfs_walk_parallel_release(mfs_walk_worker* pWorker, mfs_walk_node* pNode)
+{
+    mfs_walk_parallel_state* pShared = pWorker->pShared;
+    mfs_walk_state* pState = &pWorker->walk;
+
+    while (pNode != NULL) {
+        mfs_walk_node* pParent = pNode->pParent;
+        mfs_bool32 isLast;
+        mfs_bool32 isStopped;
+
+        mfs_mutex_lock(&pShared->lock);
+        {
+            pNode->refCount -= 1;
+            isLast    = (pNode->refCount == 0);
+            isStopped = pShared->isStopped;
+        }
+        mfs_mutex_unlock(&pShared->lock);
+
+        if (isLast == MFS_FALSE) {
+            break;
+        }
+
+        /* The root is reported by mfs_walk_parallel() once everything is done. */
+        if (pShared->postOrder && isStopped == MFS_FALSE && pNode->depth > 0 && pNode->isUnopenable == MFS_FALSE && pNode->isHidden == MFS_FALSE) {
+            if (mfs_walk_reserve_path(pState, pNode->pathLength) == MFS_SUCCESS) {
+                MFS_COPY_MEMORY(pState->pPath, pNode->pPath, pNode->pathLength+1);
+                if (mfs_walk_report(pState, NULL, pNode->depth, pNode->nameOffset, pNode->pathLength, MFS_FILE_TYPE_DIRECTORY, pNode->inode, pNode->isSymlink, MFS_TRUE) == MFS_WALK_STOP) {
+                    mfs_walk_parallel_stop(pShared);
+                }
+            }
+        }
+
+        mfs_walk_node_free(pNode);
+        pNode = pParent;
+    }
+}
+
+static void mfs_walk_parallel_read(mfs_walk_worker* pWorker, mfs_walk_node* pNode)
+{
+    mfs_walk_parallel_state* pShared = pWorker->pShared;
+    mfs_walk_state* pState = &pWorker->walk;
+    mfs_walk_level* pLevel = &pState->pLevels[0];
+    mfs_result result;
+
+    if (mfs_walk_reserve_path(pState, pNode->pathLength) != MFS_SUCCESS) {
+        mfs_walk_parallel_report_error(pShared, pNode->pPath, MFS_OUT_OF_MEMORY);
+        return;
+    }
+
+    MFS_COPY_MEMORY(pState->pPath, pNode->pPath, pNode->pathLength+1);
+
+    MFS_ZERO_OBJECT(pLevel);
+    pLevel->pathLength = pNode->pathLength;
+    pLevel->nameOffset = pNode->nameOffset;
+    pLevel->inode      = pNode->inode;
+    pLevel->isSymlink  = pNode->isSymlink;
+
+    result = mfs_walk_open_level(pState, 0);
+#if defined(MFS_POSIX)
+    if (result == MFS_SUCCESS && pShared->config.symlinks == MFS_WALK_SYMLINKS_ALL) {
+        mfs_walk_node* pAncestor;
+
+        pNode->device = pLevel->device;
+        pNode->inode  = pLevel->inode;
+
+        for (pAncestor = pNode->pParent; pAncestor != NULL; pAncestor = pAncestor->pParent) {
+            if (pAncestor->device == pNode->device && pAncestor->inode == pNode->inode) {
+                mfs_walk_close_level(pState, pLevel);
+                result = MFS_TOO_MANY_LINKS;
+                break;
+            }
+        }
+    }
+#endif
+
+    if (result != MFS_SUCCESS) {
+        pNode->isUnopenable = MFS_TRUE;
+        mfs_walk_parallel_report_error(pShared, pNode->pPath, result);
+        return;
+    }
+
+    for (;;) {
+        const char* pName;
+        mfs_uint32 type;
+        mfs_uint64 inode;
+        mfs_bool32 isSymlink = MFS_FALSE;
+        mfs_bool32 descend;
+        size_t nameLength;
+        size_t nameOffset;
+        size_t pathLength;
+        mfs_uint32 action = MFS_WALK_CONTINUE;
+        mfs_uint32 filter;
+        mfs_walk_node* pChild = NULL;
+
+        result = mfs_walk_read_level(pLevel, &pName, &type, &inode);
+        if (result != MFS_SUCCESS) {
+            if (result != MFS_AT_END) {
+                mfs_walk_parallel_report_error(pShared, pNode->pPath, result);
+            }
+
+            break;
+        }
+
+        if (pName[0] == '.' && (pName[1] == '\0' || (pName[1] == '.' && pName[2] == '\0'))) {
+            continue;   /* "." or "..". */
+        }
+
+        nameLength = strlen(pName);
+        nameOffset = pNode->pathLength;
+        if (nameOffset > 0 && pState->pPath[nameOffset-1] != '/' && pState->pPath[nameOffset-1] != '\\') {
+            nameOffset += 1;
+        }
+        pathLength = nameOffset + nameLength;
+
+        if (mfs_walk_reserve_path(pState, pathLength) != MFS_SUCCESS) {
+            mfs_walk_parallel_report_error(pShared, pNode->pPath, MFS_OUT_OF_MEMORY);
+            break;
+        }
+
+        if (nameOffset > pNode->pathLength) {
+            pState->pPath[pNode->pathLength] = '/';
+        }
+        MFS_COPY_MEMORY(pState->pPath + nameOffset, pName, nameLength+1);
+
+        if (type == MFS_FILE_TYPE_UNKNOWN || (type == MFS_FILE_TYPE_SYMLINK && pShared->config.symlinks == MFS_WALK_SYMLINKS_ALL)) {
+            mfs_walk_resolve_type(pState, 0, pState->pPath + nameOffset, &type, &isSymlink, &inode);
+        }
+
+        filter  = mfs_walk_filter(pState, pathLength, type);
+        descend = (type == MFS_FILE_TYPE_DIRECTORY) && (pShared->config.maxDepth == 0 || pNode->depth+1 < pShared->config.maxDepth) && (filter & MFS_WALK_FILTER_DESCEND) != 0;
+
+        if ((filter & MFS_WALK_FILTER_REPORT) == 0 && descend == MFS_FALSE) {
+            continue;
+        }
+
+        if (pShared->ordered) {
+            result = mfs_walk_node_add_entry(pNode, pState->pPath + nameOffset, nameLength, type, inode, isSymlink, (filter & MFS_WALK_FILTER_REPORT) == 0);
+            if (result != MFS_SUCCESS) {
+                mfs_walk_parallel_report_error(pShared, pNode->pPath, result);
+                break;
+            }
+        } else {
+            if ((pShared->preOrder || type != MFS_FILE_TYPE_DIRECTORY) && (filter & MFS_WALK_FILTER_REPORT) != 0) {
+                action = mfs_walk_report(pState, pLevel, pNode->depth+1, nameOffset, pathLength, type, inode, isSymlink, MFS_FALSE);
+                if (action == MFS_WALK_STOP) {
+                    mfs_walk_parallel_stop(pShared);
+                    break;
+                }
+            }
+        }
+
+        if (action == MFS_WALK_SKIP) {
+            continue;
+        }
+
+        if (descend) {
+            pChild = mfs_walk_node_alloc(pState->pPath, pathLength, nameOffset, pNode, inode, isSymlink);
+            if (pChild == NULL) {
+                result = MFS_OUT_OF_MEMORY;
+            } else {
+                pChild->isHidden = (filter & MFS_WALK_FILTER_REPORT) == 0;
+                result = mfs_walk_parallel_push(pWorker, pChild);
+                if (result != MFS_SUCCESS) {
+                    mfs_walk_node_free(pChild);
+                    pChild = NULL;
+                }
+            }
+
+            if (result != MFS_SUCCESS) {
+                pState->pPath[pathLength] = '\0';
+                mfs_walk_parallel_report_error(pShared, pState->pPath, result);
+            }
+
+            if (pShared->ordered) {
+                pNode->pEntries[pNode->entryCount-1].pChild = pChild;
+            }
+        } else if (type == MFS_FILE_TYPE_DIRECTORY && pShared->postOrder && pShared->ordered == MFS_FALSE && (filter & MFS_WALK_FILTER_REPORT) != 0) {
+            if (mfs_walk_report(pState, pLevel, pNode->depth+1, nameOffset, pathLength, type, inode, isSymlink, MFS_TRUE) == MFS_WALK_STOP) {
+                mfs_walk_parallel_stop(pShared);
+                break;
+            }
+        }
+    }
+
+    mfs_walk_close_level(pState, pLevel);
+}
+
+static void mfs_walk_parallel_process(mfs_walk_worker* pWorker, mfs_walk_node* pNode)
+{
+    mfs_walk_parallel_state* pShared = pWorker->pShared;
+    mfs_bool32 isSkipped;
+
+    mfs_mutex_lock(&pShared->lock);
+    {
+        isSkipped = pShared->isStopped || pNode->isSkipped;
+    }
+    mfs_mutex_unlock(&pShared->lock);
+
+    if (isSkipped == MFS_FALSE) {
+        mfs_walk_parallel_read(pWorker, pNode);
+    }
+
+    if (pShared->ordered) {
+        mfs_mutex_lock(&pShared->lock);
+        {
+            pNode->isReady = MFS_TRUE;
+            mfs_cond_broadcast(&pShared->cond);
+        }
+        mfs_mutex_unlock(&pShared->lock);
+    } else {
+        mfs_walk_parallel_release(pWorker, pNode);
+    }
+
+    mfs_mutex_lock(&pShared->lock);
+    {
+        pShared->pendingCount -= 1;
+        if (pShared->pendingCount == 0) {
+            mfs_cond_broadcast(&pShared->cond);
+        }
+    }
+    mfs_mutex_unlock(&pShared->lock);
+}
+
+static void mfs_walk_parallel_run(mfs_walk_worker* pWorker, mfs_walk_node* pWaitFor)
+{
+    /* Reads directories until there's nothing left to read or, if pWaitFor is set, until that node is ready. */
+    mfs_walk_parallel_state* pShared = pWorker->pShared;
+    mfs_walk_node* pNode;
+
+    for (;;) {
+        mfs_bool32 isDone = MFS_FALSE;
+
+        mfs_mutex_lock(&pShared->lock);
+        for (;;) {
+            if ((pWaitFor != NULL) ? pWaitFor->isReady : (pShared->pendingCount == 0)) {
+                isDone = MFS_TRUE;
+                break;
+            }
+
+            /* Nodes can be counted slightly before they become visible in a deque, in which case we just try again. */
+            if (pShared->queuedCount > 0) {
+                break;
+            }
+
+            pShared->idleCount += 1;
+            mfs_cond_wait(&pShared->cond, &pShared->lock);
+            pShared->idleCount -= 1;
+        }
+        mfs_mutex_unlock(&pShared->lock);
+
+        if (isDone) {
+            break;
+        }
+
+        pNode = mfs_walk_parallel_take(pWorker);
+        if (pNode != NULL) {
+            mfs_walk_parallel_process(pWorker, pNode);
+        }
+    }
+}
+
+static mfs_thread_result MFS_THREADCALL mfs_walk_parallel_thread(void* pData)
+{
+    mfs_walk_parallel_run((mfs_walk_worker*)pData, NULL);
+    return (mfs_thread_result)0;
+}
+
+static void mfs_walk_parallel_discard(mfs_walk_worker* pWorker, mfs_walk_node* pNode)
+{
+    /* Ordered only. The node might still be queued, or being read by another thread, so we need to wait for it before freeing it. */
+    mfs_walk_parallel_state* pShared = pWorker->pShared;
+    size_t iEntry;
+
+    mfs_mutex_lock(&pShared->lock);
+    {
+        pNode->isSkipped = MFS_TRUE;
+    }
+    mfs_mutex_unlock(&pShared->lock);
+
+    mfs_walk_parallel_run(pWorker, pNode);
+
+    for (iEntry = 0; iEntry < pNode->entryCount; iEntry += 1) {
+        if (pNode->pEntries[iEntry].pChild != NULL) {
+            mfs_walk_parallel_discard(pWorker, pNode->pEntries[iEntry].pChild);
+        }
+    }
+
+    mfs_walk_node_free(pNode);
+}
+
+typedef struct
+{
+    mfs_walk_node* pNode;
+    size_t iEntry;
+} mfs_walk_emit_frame;
+
+static mfs_bool32 mfs_walk_parallel_emit(mfs_walk_worker* pWorker, mfs_walk_node* pRoot)
+{
+    /* Ordered only. Returns false if the walk was stopped. Everything is freed either way. */
+    mfs_walk_parallel_state* pShared = pWorker->pShared;
+    mfs_walk_state* pState = &pWorker->walk;
+    mfs_walk_emit_frame* pFrames;
+    size_t frameCount = 0;
+    size_t frameCap = 16;
+    mfs_bool32 isStopped = MFS_FALSE;
+
+    pFrames = (mfs_walk_emit_frame*)MFS_MALLOC(sizeof(*pFrames) * frameCap);
+    if (pFrames == NULL) {
+        mfs_walk_parallel_report_error(pShared, pRoot->pPath, MFS_OUT_OF_MEMORY);
+        mfs_walk_parallel_stop(pShared);
+        mfs_walk_parallel_discard(pWorker, pRoot);
+        return MFS_FALSE;
+    }
+
+    mfs_walk_parallel_run(pWorker, pRoot);
+    pFrames[0].pNode  = pRoot;
+    pFrames[0].iEntry = 0;
+    frameCount = 1;
+
+    while (frameCount > 0 && isStopped == MFS_FALSE) {
+        mfs_walk_node* pNode = pFrames[frameCount-1].pNode;
+        mfs_walk_node_entry* pEntry;
+        size_t nameOffset;
+        size_t pathLength;
+        mfs_uint32 action = MFS_WALK_CONTINUE;
+
+        if (pFrames[frameCount-1].iEntry == pNode->entryCount) {
+            frameCount -= 1;
+
+            if (pShared->postOrder && pNode->depth > 0 && pNode->isUnopenable == MFS_FALSE && pNode->isHidden == MFS_FALSE) {
+                if (mfs_walk_reserve_path(pState, pNode->pathLength) == MFS_SUCCESS) {
+                    MFS_COPY_MEMORY(pState->pPath, pNode->pPath, pNode->pathLength+1);
+                    if (mfs_walk_report(pState, NULL, pNode->depth, pNode->nameOffset, pNode->pathLength, MFS_FILE_TYPE_DIRECTORY, pNode->inode, pNode->isSymlink, MFS_TRUE) == MFS_WALK_STOP) {
+                        isStopped = MFS_TRUE;
+                    }
+                }
+            }
+
+            mfs_walk_node_free(pNode);
+            continue;
+        }
+
+        pEntry = &pNode->pEntries[pFrames[frameCount-1].iEntry];
+        pFrames[frameCount-1].iEntry += 1;
+
+        nameOffset = pNode->pathLength;
+        if (nameOffset > 0 && pNode->pPath[nameOffset-1] != '/' && pNode->pPath[nameOffset-1] != '\\') {
+            nameOffset += 1;
+        }
+        pathLength = nameOffset + pEntry->nameLength;
+
+        if (mfs_walk_reserve_path(pState, pathLength) != MFS_SUCCESS) {
+            mfs_walk_parallel_report_error(pShared, pNode->pPath, MFS_OUT_OF_MEMORY);
+            isStopped = MFS_TRUE;
+            break;
+        }
+
+        MFS_COPY_MEMORY(pState->pPath, pNode->pPath, pNode->pathLength);
+        pState->pPath[pNode->pathLength] = '/';
+        MFS_COPY_MEMORY(pState->pPath + nameOffset, pNode->pNames + pEntry->nameOffset, pEntry->nameLength+1);
+
+        if ((pShared->preOrder || pEntry->type != MFS_FILE_TYPE_DIRECTORY) && pEntry->isHidden == MFS_FALSE) {
+            action = mfs_walk_report(pState, NULL, pNode->depth+1, nameOffset, pathLength, pEntry->type, pEntry->inode, pEntry->isSymlink, MFS_FALSE);
+            if (action == MFS_WALK_STOP) {
+                isStopped = MFS_TRUE;
+                break;
+            }
+        }
+
+        if (pEntry->pChild != NULL) {
+            mfs_walk_node* pChild = pEntry->pChild;
+            pEntry->pChild = NULL;  /* Owned by the frame from now on. */
+
+            if (action == MFS_WALK_SKIP) {
+                mfs_walk_parallel_discard(pWorker, pChild);
+                continue;
+            }
+
+            if (frameCount == frameCap) {
+                mfs_walk_emit_frame* pNewFrames = (mfs_walk_emit_frame*)MFS_REALLOC(pFrames, sizeof(*pNewFrames) * frameCap * 2);
+                if (pNewFrames == NULL) {
+                    mfs_walk_parallel_report_error(pShared, pChild->pPath, MFS_OUT_OF_MEMORY);
+                    mfs_walk_parallel_discard(pWorker, pChild);
+                    isStopped = MFS_TRUE;
+                    break;
+                }
+
+                pFrames   = pNewFrames;
+                frameCap *= 2;
+            }
+
+            mfs_walk_parallel_run(pWorker, pChild);
+            pFrames[frameCount].pNode  = pChild;
+            pFrames[frameCount].iEntry = 0;
+            frameCount += 1;
+        } else if (pEntry->type == MFS_FILE_TYPE_DIRECTORY && pShared->postOrder && action != MFS_WALK_SKIP && pEntry->isHidden == MFS_FALSE) {
+            if (mfs_walk_report(pState, NULL, pNode->depth+1, nameOffset, pathLength, pEntry->type, pEntry->inode, pEntry->isSymlink, MFS_TRUE) == MFS_WALK_STOP) {
+                isStopped = MFS_TRUE;
+                break;
+            }
+        }
+    }
+
+    if (isStopped) {
+        /* Everything still on the stack needs to be cleaned up, along with any subdirectories that haven't been reported yet. */
+        mfs_walk_parallel_stop(pShared);
+
+        while (frameCount > 0) {
+            mfs_walk_node* pNode = pFrames[frameCount-1].pNode;
+            size_t iEntry;
+
+            /* Children that have already been taken by a frame or discarded will have been cleared. */
+            for (iEntry = 0; iEntry < pNode->entryCount; iEntry += 1) {
+                if (pNode->pEntries[iEntry].pChild != NULL) {
+                    mfs_walk_parallel_discard(pWorker, pNode->pEntries[iEntry].pChild);
+                }
+            }
+
+            mfs_walk_node_free(pNode);
+            frameCount -= 1;
+        }
+    }
+
+    MFS_FREE(pFrames);
+
+    return !isStopped;
+}
+
+mfs_result mfs_walk_parallel(const char* pRootPath, const mfs_walk_config* pConfig, mfs_walk_proc onEntry, void* pUserData)
+{
+    mfs_result result;
+    mfs_walk_parallel_state shared;
+    mfs_walk_state* pRootState;
+    mfs_walk_node* pRoot;
+    mfs_file_info_ex rootInfo;
+    mfs_thread* pThreads = NULL;
+    mfs_uint32 threadCount = 0;
+    mfs_uint32 iWorker;
+    size_t rootLength;
+    size_t rootNameOffset;
+    mfs_bool32 isStopped = MFS_FALSE;
+
+    if (pRootPath == NULL || onEntry == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(&shared);
+    if (pConfig != NULL) {
+        shared.config = *pConfig;
+    } else {
+        shared.config = mfs_walk_config_init();
+    }
+
+    if ((shared.config.flags & (MFS_WALK_FLAG_PRE_ORDER | MFS_WALK_FLAG_POST_ORDER)) == 0) {
+        shared.config.flags |= MFS_WALK_FLAG_PRE_ORDER;
+    }
+
+    if (shared.config.threadCount == 0) {
+        shared.config.threadCount = mfs_get_cpu_count();
+    }
+
+    shared.preOrder    = (shared.config.flags & MFS_WALK_FLAG_PRE_ORDER)  != 0;
+    shared.postOrder   = (shared.config.flags & MFS_WALK_FLAG_POST_ORDER) != 0;
+    shared.ordered     = (shared.config.flags & MFS_WALK_FLAG_ORDERED)    != 0;
+    shared.pUserData   = pUserData;
+    shared.workerCount = shared.config.threadCount;
+
+    result = mfs_get_file_info_ex((pRootPath[0] != '\0') ? pRootPath : ".", MFS_FILE_INFO_FIELD_TYPE | MFS_FILE_INFO_FIELD_INODE | ((shared.config.symlinks == MFS_WALK_SYMLINKS_NONE) ? MFS_FILE_INFO_FLAG_NO_FOLLOW : 0), &rootInfo);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    shared.pWorkers = (mfs_walk_worker*)MFS_MALLOC(sizeof(*shared.pWorkers) * shared.workerCount);
+    if (shared.pWorkers == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    MFS_ZERO_MEMORY(shared.pWorkers, sizeof(*shared.pWorkers) * shared.workerCount);
+
+    for (iWorker = 0; iWorker < shared.workerCount; iWorker += 1) {
+        mfs_walk_worker* pWorker = &shared.pWorkers[iWorker];
+
+        pWorker->pShared = &shared;
+        pWorker->index   = iWorker;
+        mfs_mutex_init(&pWorker->deque.lock);
+
+        pWorker->walk.config = shared.config;
+        pWorker->walk.config.maxOpenDirectories = 1;
+        pWorker->walk.config.onError = NULL;   /* Errors are reported through mfs_walk_parallel_report_error(). */
+        pWorker->walk.onEntry     = onEntry;
+        pWorker->walk.pUserData   = pUserData;
+        pWorker->walk.threadIndex = shared.ordered ? 0 : iWorker;
+
+        if (mfs_walk_reserve_levels(&pWorker->walk, 1) != MFS_SUCCESS) {
+            result = MFS_OUT_OF_MEMORY;
+        } else {
+            MFS_ZERO_OBJECT(&pWorker->walk.pLevels[0]);
+        }
+
+    #if defined(MFS_ITERATOR_GETDENTS64)
+        pWorker->walk.ppFreeBuffers = (char**)MFS_MALLOC(sizeof(*pWorker->walk.ppFreeBuffers));
+        if (pWorker->walk.ppFreeBuffers == NULL) {
+            result = MFS_OUT_OF_MEMORY;
+        }
     #endif
-    #ifdef ERFKILL
-        case ERFKILL: return MFS_ERROR;
+    }
+
+    mfs_mutex_init(&shared.lock);
+    mfs_mutex_init(&shared.errorLock);
+    mfs_cond_init(&shared.cond);
+
+    /* The root is reported on the calling thread, the same as mfs_walk(). */
+    pRootState = &shared.pWorkers[0].walk;
+    rootLength = strlen(pRootPath);
+    for (iWorker = 0; iWorker < shared.workerCount; iWorker += 1) {
+        shared.pWorkers[iWorker].walk.rootLength = rootLength;
+    }
+
+    rootNameOffset = (size_t)(mfs_path_file_name(pRootPath) - pRootPath);
+
+    if (result == MFS_SUCCESS) {
+        result = mfs_walk_reserve_path(pRootState, rootLength);
+    }
+
+    if (result == MFS_SUCCESS) {
+        MFS_COPY_MEMORY(pRootState->pPath, pRootPath, rootLength+1);
+
+        if (shared.preOrder || rootInfo.type != MFS_FILE_TYPE_DIRECTORY) {
+            mfs_uint32 action = mfs_walk_report(pRootState, NULL, 0, rootNameOffset, rootLength, rootInfo.type, rootInfo.inode, MFS_FALSE, MFS_FALSE);
+            if (action == MFS_WALK_STOP) {
+                isStopped = MFS_TRUE;
+            }
+
+            if (action != MFS_WALK_CONTINUE || rootInfo.type != MFS_FILE_TYPE_DIRECTORY) {
+                result = MFS_AT_END;    /* Nothing more to do. */
+            }
+        }
+    }
+
+    if (result == MFS_SUCCESS) {
+        /* The root is allowed to be opened through a link unless we're not following any. */
+        pRoot = mfs_walk_node_alloc(pRootPath, rootLength, rootNameOffset, NULL, rootInfo.inode, shared.config.symlinks != MFS_WALK_SYMLINKS_NONE);
+        if (pRoot == NULL) {
+            result = MFS_OUT_OF_MEMORY;
+        } else {
+            result = mfs_walk_parallel_push(&shared.pWorkers[0], pRoot);
+            if (result != MFS_SUCCESS) {
+                mfs_walk_node_free(pRoot);
+            }
+        }
+    }
+
+    if (result == MFS_SUCCESS) {
+        /* The calling thread counts as one of the threads. */
+        if (shared.workerCount > 1) {
+            pThreads = (mfs_thread*)MFS_MALLOC(sizeof(*pThreads) * (shared.workerCount - 1));
+            if (pThreads != NULL) {
+                for (iWorker = 1; iWorker < shared.workerCount; iWorker += 1) {
+                    if (mfs_thread_create(&pThreads[threadCount], mfs_walk_parallel_thread, &shared.pWorkers[iWorker]) != MFS_SUCCESS) {
+                        break;  /* Not a critical error. Nodes queued for missing threads will be stolen by the others. */
+                    }
+
+                    threadCount += 1;
+                }
+            }
+        }
+
+        if (shared.ordered) {
+            if (mfs_walk_parallel_emit(&shared.pWorkers[0], pRoot) == MFS_FALSE) {
+                isStopped = MFS_TRUE;
+            }
+        }
+
+        mfs_walk_parallel_run(&shared.pWorkers[0], NULL);
+
+        for (iWorker = 0; iWorker < threadCount; iWorker += 1) {
+            mfs_thread_join(pThreads[iWorker]);
+        }
+
+        if (shared.isStopped) {
+            isStopped = MFS_TRUE;
+        }
+
+        if (isStopped == MFS_FALSE && shared.postOrder) {
+            MFS_COPY_MEMORY(pRootState->pPath, pRootPath, rootLength+1);
+            if (mfs_walk_report(pRootState, NULL, 0, rootNameOffset, rootLength, MFS_FILE_TYPE_DIRECTORY, rootInfo.inode, MFS_FALSE, MFS_TRUE) == MFS_WALK_STOP) {
+                isStopped = MFS_TRUE;
+            }
+        }
+
+        result = shared.result;
+    } else if (result == MFS_AT_END) {
+        result = MFS_SUCCESS;
+    }
+
+    for (iWorker = 0; iWorker < shared.workerCount; iWorker += 1) {
+        mfs_walk_cleanup(&shared.pWorkers[iWorker].walk, (shared.pWorkers[iWorker].walk.pLevels != NULL) ? 1 : 0);
+        MFS_FREE(shared.pWorkers[iWorker].deque.ppNodes);
+        mfs_mutex_uninit(&shared.pWorkers[iWorker].deque.lock);
+    }
+
+    MFS_FREE(pThreads);
+    MFS_FREE(shared.pWorkers);
+    mfs_cond_uninit(&shared.cond);
+    mfs_mutex_uninit(&shared.errorLock);
+    mfs_mutex_uninit(&shared.lock);
+
+    if (isStopped) {
+        return MFS_CANCELLED;
+    }
+
+    return result;
+}
+
+typedef struct
+{
+    mfs_walk_proc onMatch;
+    void* pUserData;
+} mfs_glob_walk_data;
+
+static mfs_uint32 mfs_glob_walk_callback(void* pUserData, const mfs_walk_entry* pEntry)
+{
+    mfs_glob_walk_data* pData = (mfs_glob_walk_data*)pUserData;
+
+    if (pEntry->depth == 0) {
+        return MFS_WALK_CONTINUE;   /* The root is never a match. */
+    }
+
+    return pData->onMatch(pData->pUserData, pEntry);
+}
+
+mfs_result mfs_glob(const char* pRootPath, const char* pPattern, mfs_uint32 flags, mfs_walk_proc onMatch, void* pUserData)
+{
+    mfs_result result;
+    mfs_glob_matcher glob;
+    mfs_walk_config config;
+    mfs_glob_walk_data data;
+
+    if (pRootPath == NULL || pPattern == NULL || onMatch == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    result = mfs_glob_compile(&pPattern, 1, flags, &glob);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    data.onMatch   = onMatch;
+    data.pUserData = pUserData;
+
+    config = mfs_walk_config_init();
+    config.pInclude = &glob;
+
+    result = mfs_walk(pRootPath, &config, mfs_glob_walk_callback, &data);
+
+    mfs_glob_uninit(&glob);
+
+    return result;
+}
+
+
+/* Listing */
+typedef struct
+{
+    mfs_directory_listing_entry* pEntries;  /* pName is not set until the listing is finalized. */
+    size_t count;
+    size_t cap;
+    char* pNames;
+    size_t namesLength;
+    size_t namesCap;
+} mfs_list_directory_builder;
+
+static mfs_result mfs_list_directory_append(mfs_list_directory_builder* pBuilder, const char* pName, size_t nameLength, mfs_uint32 type, mfs_uint64 inode, mfs_uint64 sizeInBytes, mfs_int64 lastModifiedTime)
+{
+    mfs_directory_listing_entry* pEntry;
+
+    if (pBuilder->count == pBuilder->cap) {
+        size_t newCap = (pBuilder->cap > 0) ? pBuilder->cap * 2 : 64;
+        mfs_directory_listing_entry* pNewEntries = (mfs_directory_listing_entry*)MFS_REALLOC(pBuilder->pEntries, sizeof(*pNewEntries) * newCap);
+        if (pNewEntries == NULL) {
+            return MFS_OUT_OF_MEMORY;
+        }
+
+        pBuilder->pEntries = pNewEntries;
+        pBuilder->cap      = newCap;
+    }
+
+    if (pBuilder->namesLength + nameLength+1 > pBuilder->namesCap) {
+        size_t newCap = (pBuilder->namesCap > 0) ? pBuilder->namesCap * 2 : 1024;
+        char* pNewNames;
+
+        while (newCap < pBuilder->namesLength + nameLength+1) {
+            newCap *= 2;
+        }
+
+        pNewNames = (char*)MFS_REALLOC(pBuilder->pNames, newCap);
+        if (pNewNames == NULL) {
+            return MFS_OUT_OF_MEMORY;
+        }
+
+        pBuilder->pNames   = pNewNames;
+        pBuilder->namesCap = newCap;
+    }
+
+    MFS_COPY_MEMORY(pBuilder->pNames + pBuilder->namesLength, pName, nameLength);
+    pBuilder->pNames[pBuilder->namesLength + nameLength] = '\0';
+    pBuilder->namesLength += nameLength+1;
+
+    pEntry = &pBuilder->pEntries[pBuilder->count];
+    pEntry->pName            = NULL;
+    pEntry->nameLength       = nameLength;
+    pEntry->inode            = inode;
+    pEntry->sizeInBytes      = sizeInBytes;
+    pEntry->lastModifiedTime = lastModifiedTime;
+    pEntry->type             = type;
+    pBuilder->count += 1;
+
+    return MFS_SUCCESS;
+}
+
+static int mfs_list_directory_compare_natural(const char* pA, size_t lengthA, const char* pB, size_t lengthB)
+{
+    size_t iA = 0;
+    size_t iB = 0;
+
+    while (iA < lengthA && iB < lengthB) {
+        char a = pA[iA];
+        char b = pB[iB];
+
+        if (a >= '0' && a <= '9' && b >= '0' && b <= '9') {
+            size_t runA;
+            size_t runB;
+            size_t i;
+
+            /* Leading zeros don't change the value. A longer run of significant digits is a bigger number. */
+            while (iA < lengthA && pA[iA] == '0') {
+                iA += 1;
+            }
+            while (iB < lengthB && pB[iB] == '0') {
+                iB += 1;
+            }
+
+            for (runA = 0; iA + runA < lengthA && pA[iA + runA] >= '0' && pA[iA + runA] <= '9'; runA += 1) {
+            }
+            for (runB = 0; iB + runB < lengthB && pB[iB + runB] >= '0' && pB[iB + runB] <= '9'; runB += 1) {
+            }
+
+            if (runA != runB) {
+                return (runA < runB) ? -1 : 1;
+            }
+
+            for (i = 0; i < runA; i += 1) {
+                if (pA[iA + i] != pB[iB + i]) {
+                    return (pA[iA + i] < pB[iB + i]) ? -1 : 1;
+                }
+            }
+
+            iA += runA;
+            iB += runB;
+        } else {
+            if (a >= 'A' && a <= 'Z') {
+                a = (char)(a - 'A' + 'a');
+            }
+            if (b >= 'A' && b <= 'Z') {
+                b = (char)(b - 'A' + 'a');
+            }
+
+            if (a != b) {
+                return ((mfs_uint8)a < (mfs_uint8)b) ? -1 : 1;
+            }
+
+            iA += 1;
+            iB += 1;
+        }
+    }
+
+    if (lengthA - iA != lengthB - iB) {
+        return (lengthA - iA < lengthB - iB) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static int mfs_list_directory_compare(const mfs_directory_listing_entry* pA, const mfs_directory_listing_entry* pB, mfs_uint32 flags)
+{
+    int order = 0;
+
+    if ((flags & MFS_LIST_FLAG_DIRECTORIES_FIRST) != 0) {
+        mfs_bool32 isDirectoryA = (pA->type == MFS_FILE_TYPE_DIRECTORY);
+        mfs_bool32 isDirectoryB = (pB->type == MFS_FILE_TYPE_DIRECTORY);
+
+        if (isDirectoryA != isDirectoryB) {
+            return isDirectoryA ? -1 : 1;
+        }
+    }
+
+    switch (flags & MFS_LIST_SORT_MASK)
+    {
+        case MFS_LIST_SORT_NONE:
+        {
+            return 0;
+        }
+
+        case MFS_LIST_SORT_NATURAL:
+        {
+            order = mfs_list_directory_compare_natural(pA->pName, pA->nameLength, pB->pName, pB->nameLength);
+        } break;
+
+        case MFS_LIST_SORT_SIZE:
+        {
+            if (pA->sizeInBytes != pB->sizeInBytes) {
+                order = (pA->sizeInBytes < pB->sizeInBytes) ? -1 : 1;
+            }
+        } break;
+
+        case MFS_LIST_SORT_MODIFIED_TIME:
+        {
+            if (pA->lastModifiedTime != pB->lastModifiedTime) {
+                order = (pA->lastModifiedTime < pB->lastModifiedTime) ? -1 : 1;
+            }
+        } break;
+
+        case MFS_LIST_SORT_INODE:
+        {
+            if (pA->inode != pB->inode) {
+                order = (pA->inode < pB->inode) ? -1 : 1;
+            }
+        } break;
+
+        default: break;
+    }
+
+    if (order == 0) {
+        size_t length = (pA->nameLength < pB->nameLength) ? pA->nameLength : pB->nameLength;
+
+        order = memcmp(pA->pName, pB->pName, length);
+        if (order == 0 && pA->nameLength != pB->nameLength) {
+            order = (pA->nameLength < pB->nameLength) ? -1 : 1;
+        }
+    }
+
+    if ((flags & MFS_LIST_FLAG_DESCENDING) != 0) {
+        order = -order;
+    }
+
+    return order;
+}
+
+static mfs_result mfs_list_directory_sort(mfs_directory_listing_entry* pEntries, size_t count, mfs_uint32 flags)
+{
+    /* A bottom-up merge sort. It's stable, which matters for MFS_LIST_FLAG_DIRECTORIES_FIRST with MFS_LIST_SORT_NONE. */
+    mfs_directory_listing_entry* pTemp;
+    mfs_directory_listing_entry* pSrc;
+    mfs_directory_listing_entry* pDst;
+    size_t width;
+
+    if (count < 2) {
+        return MFS_SUCCESS;
+    }
+
+    pTemp = (mfs_directory_listing_entry*)MFS_MALLOC(sizeof(*pTemp) * count);
+    if (pTemp == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    pSrc = pEntries;
+    pDst = pTemp;
+
+    for (width = 1; width < count; width *= 2) {
+        size_t iRun;
+
+        for (iRun = 0; iRun < count; iRun += width * 2) {
+            size_t iLeft   = iRun;
+            size_t leftEnd = (iRun + width < count) ? iRun + width : count;
+            size_t iRight  = leftEnd;
+            size_t rightEnd = (iRun + width*2 < count) ? iRun + width*2 : count;
+            size_t iOut    = iRun;
+
+            while (iLeft < leftEnd && iRight < rightEnd) {
+                if (mfs_list_directory_compare(&pSrc[iRight], &pSrc[iLeft], flags) < 0) {
+                    pDst[iOut++] = pSrc[iRight++];
+                } else {
+                    pDst[iOut++] = pSrc[iLeft++];
+                }
+            }
+
+            while (iLeft < leftEnd) {
+                pDst[iOut++] = pSrc[iLeft++];
+            }
+
+            while (iRight < rightEnd) {
+                pDst[iOut++] = pSrc[iRight++];
+            }
+        }
+
+        pDst = pSrc;
+        pSrc = (pSrc == pEntries) ? pTemp : pEntries;
+    }
+
+    if (pSrc != pEntries) {
+        MFS_COPY_MEMORY(pEntries, pSrc, sizeof(*pEntries) * count);
+    }
+
+    MFS_FREE(pTemp);
+
+    return MFS_SUCCESS;
+}
+
+static mfs_result mfs_list_directory_read(const char* pDirectoryPath, mfs_bool32 needsFileInfo, mfs_list_directory_builder* pBuilder)
+{
+    mfs_result result;
+    mfs_iterator iterator;
+
+    result = mfs_iterator_init_ex(pDirectoryPath, MFS_FILE_INFO_FIELD_TYPE, &iterator);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+#if defined(MFS_WIN32)
+    {
+        /* Everything comes for free with FindNextFile(). */
+        mfs_file_info fi;
+
+        (void)needsFileInfo;
+
+        while ((result = mfs_iterator_next(&iterator, &fi)) == MFS_SUCCESS) {
+            FILETIME ft;
+
+            if (fi.pFileName[0] == '.' && (fi.pFileName[1] == '\0' || (fi.pFileName[1] == '.' && fi.pFileName[2] == '\0'))) {
+                continue;   /* "." or "..". */
+            }
+
+            ft.dwLowDateTime  = (DWORD)(fi.lastModifiedTime & 0xFFFFFFFF);
+            ft.dwHighDateTime = (DWORD)(fi.lastModifiedTime >> 32);
+
+            result = mfs_list_directory_append(pBuilder, fi.pFileName, strlen(fi.pFileName), fi.isDirectory ? MFS_FILE_TYPE_DIRECTORY : MFS_FILE_TYPE_FILE, 0, fi.sizeInBytes, mfs_FILETIME_to_unix_time_ns(ft));
+            if (result != MFS_SUCCESS) {
+                break;
+            }
+        }
+    }
+#else
+    for (;;) {
+        mfs_directory_entry entries[64];
+        size_t entryCount;
+        size_t iEntry;
+
+        result = mfs_iterator_next_batch(&iterator, entries, sizeof(entries) / sizeof(entries[0]), &entryCount);
+        if (result != MFS_SUCCESS) {
+            break;
+        }
+
+        for (iEntry = 0; iEntry < entryCount; iEntry += 1) {
+            const mfs_directory_entry* pEntry = &entries[iEntry];
+            mfs_uint64 sizeInBytes = 0;
+            mfs_int64 lastModifiedTime = 0;
+
+            if (pEntry->pName[0] == '.' && (pEntry->pName[1] == '\0' || (pEntry->pName[1] == '.' && pEntry->pName[2] == '\0'))) {
+                continue;   /* "." or "..". */
+            }
+
+            if (needsFileInfo) {
+                struct stat info;
+
+                /* The entry could have been deleted since it was read, in which case it's just left at zero. */
+                if (mfs_iterator_stat__posix(&iterator, pEntry->pName, &info, NULL) == 0) {
+                    sizeInBytes = (mfs_uint64)info.st_size;
+                #if defined(MFS_STAT_TIME_NS)
+                    lastModifiedTime = MFS_STAT_TIME_NS(info, m);
+                #else
+                    lastModifiedTime = (mfs_int64)info.st_mtime * 1000000000;
+                #endif
+                }
+            }
+
+            result = mfs_list_directory_append(pBuilder, pEntry->pName, pEntry->nameLength, pEntry->type, pEntry->inode, sizeInBytes, lastModifiedTime);
+            if (result != MFS_SUCCESS) {
+                break;
+            }
+        }
+
+        if (result != MFS_SUCCESS) {
+            break;
+        }
+    }
+#endif
+
+    mfs_iterator_uninit(&iterator);
+
+    if (result == MFS_AT_END) {
+        result = MFS_SUCCESS;
+    }
+
+    return result;
+}
+
+mfs_result mfs_list_directory(const char* pDirectoryPath, mfs_uint32 flags, mfs_directory_listing* pListing)
+{
+    mfs_result result;
+    mfs_list_directory_builder builder;
+    mfs_uint32 sort;
+    mfs_bool32 needsFileInfo;
+    char* pNames;
+    size_t iEntry;
+
+    if (pListing == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(pListing);
+
+    sort = flags & MFS_LIST_SORT_MASK;
+    if (pDirectoryPath == NULL || sort > MFS_LIST_SORT_INODE) {
+        return MFS_INVALID_ARGS;
+    }
+
+    needsFileInfo = (flags & MFS_LIST_FLAG_FILE_INFO) != 0 || sort == MFS_LIST_SORT_SIZE || sort == MFS_LIST_SORT_MODIFIED_TIME;
+
+    MFS_ZERO_OBJECT(&builder);
+    result = mfs_list_directory_read(pDirectoryPath, needsFileInfo, &builder);
+    if (result != MFS_SUCCESS) {
+        MFS_FREE(builder.pEntries);
+        MFS_FREE(builder.pNames);
+        return result;
+    }
+
+    /* Everything is moved into a single allocation so it can be freed in one go. */
+    pListing->pEntries = (mfs_directory_listing_entry*)MFS_MALLOC(sizeof(*pListing->pEntries) * builder.count + builder.namesLength + 1);
+    if (pListing->pEntries == NULL) {
+        MFS_FREE(builder.pEntries);
+        MFS_FREE(builder.pNames);
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    pNames = (char*)(pListing->pEntries + builder.count);
+    if (builder.count > 0) {
+        MFS_COPY_MEMORY(pListing->pEntries, builder.pEntries, sizeof(*pListing->pEntries) * builder.count);
+        MFS_COPY_MEMORY(pNames, builder.pNames, builder.namesLength);
+    }
+    pListing->count = builder.count;
+
+    MFS_FREE(builder.pEntries);
+    MFS_FREE(builder.pNames);
+
+    /* Names were appended in the same order as the entries. */
+    for (iEntry = 0; iEntry < pListing->count; iEntry += 1) {
+        pListing->pEntries[iEntry].pName = pNames;
+        pNames += pListing->pEntries[iEntry].nameLength + 1;
+    }
+
+    if (sort != MFS_LIST_SORT_NONE || (flags & MFS_LIST_FLAG_DIRECTORIES_FIRST) != 0) {
+        result = mfs_list_directory_sort(pListing->pEntries, pListing->count, flags);
+        if (result != MFS_SUCCESS) {
+            mfs_directory_listing_uninit(pListing);
+            return result;
+        }
+    }
+
+    return MFS_SUCCESS;
+}
+
+void mfs_directory_listing_uninit(mfs_directory_listing* pListing)
+{
+    if (pListing == NULL) {
+        return;
+    }
+
+    MFS_FREE(pListing->pEntries);
+    MFS_ZERO_OBJECT(pListing);
+}
+
+
+
+/* Tree Snapshots */
+#define MFS_TREE_SNAPSHOT_RACY_WINDOW   ((mfs_int64)2 * 1000000000)    /* Covers the 2 second timestamps of FAT. */
+#define MFS_TREE_SNAPSHOT_FIELDS        (MFS_FILE_INFO_FIELD_TYPE | MFS_FILE_INFO_FIELD_SIZE | MFS_FILE_INFO_FIELD_TIMES | MFS_FILE_INFO_FIELD_INODE)
+
+typedef struct
+{
+    mfs_uint32 flags;
+    const mfs_tree_snapshot* pPrevious;
+    const mfs_glob_matcher* pExclude;
+    void (* onError)(void* pUserData, const char* pPath, mfs_result result);
+    void* pUserData;
+    mfs_tree_snapshot_entry* pEntries;  /* pPath is not set until the snapshot is finalized. */
+    size_t count;
+    size_t cap;
+    char* pPaths;
+    size_t pathsLength;
+    size_t pathsCap;
+    const char* pRootPath;
+    char* pPath;                        /* The full path of the entry being processed. The relative part starts at rootLength. */
+    size_t pathCap;
+    size_t rootLength;
+    size_t reusedDirectoryCount;
+} mfs_tree_snapshot_builder;
+
+static mfs_int64 mfs_get_wall_time_ns(void)
+{
+#if defined(MFS_WIN32)
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    return mfs_FILETIME_to_unix_time_ns(ft);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ((mfs_int64)ts.tv_sec * 1000000000) + (mfs_int64)ts.tv_nsec;
+#endif
+}
+
+static int mfs_tree_snapshot_compare_paths(const char* pA, size_t lengthA, const char* pB, size_t lengthB)
+{
+    size_t length = (lengthA < lengthB) ? lengthA : lengthB;
+    size_t i;
+
+    /* Separators sort before everything else so that a directory's contents come before any sibling that shares its prefix. */
+    for (i = 0; i < length; i += 1) {
+        unsigned char a = (unsigned char)pA[i];
+        unsigned char b = (unsigned char)pB[i];
+
+        if (a != b) {
+            if (a == '/') {
+                return -1;
+            }
+            if (b == '/') {
+                return 1;
+            }
+
+            return (a < b) ? -1 : 1;
+        }
+    }
+
+    if (lengthA != lengthB) {
+        return (lengthA < lengthB) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static const char* mfs_tree_snapshot_entry_name(const mfs_tree_snapshot_entry* pEntry, size_t* pNameLength)
+{
+    size_t nameOffset = pEntry->pathLength;
+
+    while (nameOffset > 0 && pEntry->pPath[nameOffset - 1] != '/') {
+        nameOffset -= 1;
+    }
+
+    *pNameLength = pEntry->pathLength - nameOffset;
+    return pEntry->pPath + nameOffset;
+}
+
+static mfs_result mfs_tree_snapshot_set_path(mfs_tree_snapshot_builder* pBuilder, size_t parentLength, const char* pName, size_t nameLength, size_t* pPathLength)
+{
+    size_t pathLength = (parentLength > 0) ? parentLength + 1 + nameLength : nameLength;
+    char* pPath;
+
+    if (pBuilder->rootLength + pathLength+1 > pBuilder->pathCap) {
+        size_t newCap = pBuilder->pathCap * 2;
+        char* pNewPath;
+
+        while (newCap < pBuilder->rootLength + pathLength+1) {
+            newCap *= 2;
+        }
+
+        pNewPath = (char*)MFS_REALLOC(pBuilder->pPath, newCap);
+        if (pNewPath == NULL) {
+            return MFS_OUT_OF_MEMORY;
+        }
+
+        pBuilder->pPath   = pNewPath;
+        pBuilder->pathCap = newCap;
+    }
+
+    pPath = pBuilder->pPath + pBuilder->rootLength;
+    if (parentLength > 0) {
+        pPath[parentLength] = '/';
+    }
+    MFS_COPY_MEMORY(pPath + pathLength - nameLength, pName, nameLength);
+    pPath[pathLength] = '\0';
+
+    *pPathLength = pathLength;
+    return MFS_SUCCESS;
+}
+
+static mfs_result mfs_tree_snapshot_append(mfs_tree_snapshot_builder* pBuilder, size_t pathLength, mfs_uint32 type, mfs_uint64 inode, mfs_uint64 sizeInBytes, mfs_int64 lastModifiedTime)
+{
+    mfs_tree_snapshot_entry* pEntry;
+
+    if (pBuilder->count == pBuilder->cap) {
+        size_t newCap = (pBuilder->cap > 0) ? pBuilder->cap * 2 : 256;
+        mfs_tree_snapshot_entry* pNewEntries = (mfs_tree_snapshot_entry*)MFS_REALLOC(pBuilder->pEntries, sizeof(*pNewEntries) * newCap);
+        if (pNewEntries == NULL) {
+            return MFS_OUT_OF_MEMORY;
+        }
+
+        pBuilder->pEntries = pNewEntries;
+        pBuilder->cap      = newCap;
+    }
+
+    if (pBuilder->pathsLength + pathLength+1 > pBuilder->pathsCap) {
+        size_t newCap = (pBuilder->pathsCap > 0) ? pBuilder->pathsCap * 2 : 4096;
+        char* pNewPaths;
+
+        while (newCap < pBuilder->pathsLength + pathLength+1) {
+            newCap *= 2;
+        }
+
+        pNewPaths = (char*)MFS_REALLOC(pBuilder->pPaths, newCap);
+        if (pNewPaths == NULL) {
+            return MFS_OUT_OF_MEMORY;
+        }
+
+        pBuilder->pPaths   = pNewPaths;
+        pBuilder->pathsCap = newCap;
+    }
+
+    MFS_COPY_MEMORY(pBuilder->pPaths + pBuilder->pathsLength, pBuilder->pPath + pBuilder->rootLength, pathLength+1);
+    pBuilder->pathsLength += pathLength+1;
+
+    pEntry = &pBuilder->pEntries[pBuilder->count];
+    pEntry->pPath            = NULL;
+    pEntry->pathLength       = pathLength;
+    pEntry->inode            = inode;
+    pEntry->sizeInBytes      = (type == MFS_FILE_TYPE_DIRECTORY) ? 0 : sizeInBytes;
+    pEntry->lastModifiedTime = lastModifiedTime;
+    pEntry->descendantCount  = 0;
+    pEntry->type             = type;
+    pBuilder->count += 1;
+
+    return MFS_SUCCESS;
+}
+
+static mfs_bool32 mfs_tree_snapshot_can_reuse(const mfs_tree_snapshot_builder* pBuilder, mfs_int64 previousModifiedTime, mfs_int64 lastModifiedTime)
+{
+    /*
+    A directory modified shortly before the previous scan started could have been modified again while it was being scanned without
+    its time changing, if the file system's timestamps are coarse enough.
+    */
+    if (pBuilder->pPrevious == NULL || previousModifiedTime != lastModifiedTime) {
+        return MFS_FALSE;
+    }
+
+    return previousModifiedTime < pBuilder->pPrevious->scanTime - MFS_TREE_SNAPSHOT_RACY_WINDOW;
+}
+
+static mfs_result mfs_tree_snapshot_scan(mfs_tree_snapshot_builder* pBuilder, size_t pathLength, size_t previousBegin, size_t previousEnd, mfs_bool32 reuse);
+
+static mfs_result mfs_tree_snapshot_add(mfs_tree_snapshot_builder* pBuilder, size_t pathLength, mfs_uint32 type, mfs_uint64 inode, mfs_uint64 sizeInBytes, mfs_int64 lastModifiedTime, const mfs_tree_snapshot_entry* pPrevious)
+{
+    mfs_result result;
+    size_t index;
+
+    /* The full path of the entry must already be set. */
+    if (pBuilder->pExclude != NULL && mfs_glob_match(pBuilder->pExclude, pBuilder->pPath + pBuilder->rootLength, type == MFS_FILE_TYPE_DIRECTORY)) {
+        return MFS_SUCCESS;
+    }
+
+    index = pBuilder->count;
+
+    result = mfs_tree_snapshot_append(pBuilder, pathLength, type, inode, sizeInBytes, lastModifiedTime);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    if (type == MFS_FILE_TYPE_DIRECTORY) {
+        if (pPrevious != NULL && pPrevious->type == MFS_FILE_TYPE_DIRECTORY) {
+            size_t previousBegin = (size_t)(pPrevious - pBuilder->pPrevious->pEntries) + 1;
+
+            result = mfs_tree_snapshot_scan(pBuilder, pathLength, previousBegin, previousBegin + pPrevious->descendantCount, mfs_tree_snapshot_can_reuse(pBuilder, pPrevious->lastModifiedTime, lastModifiedTime));
+        } else {
+            result = mfs_tree_snapshot_scan(pBuilder, pathLength, 0, 0, MFS_FALSE);
+        }
+
+        if (result != MFS_SUCCESS) {
+            return result;
+        }
+
+        pBuilder->pEntries[index].descendantCount = pBuilder->count - index - 1;
+    }
+
+    return MFS_SUCCESS;
+}
+
+static mfs_result mfs_tree_snapshot_scan(mfs_tree_snapshot_builder* pBuilder, size_t pathLength, size_t previousBegin, size_t previousEnd, mfs_bool32 reuse)
+{
+    mfs_result result = MFS_SUCCESS;
+    const mfs_tree_snapshot_entry* pPreviousEntries = (pBuilder->pPrevious != NULL) ? pBuilder->pPrevious->pEntries : NULL;
+    size_t iPrevious = previousBegin;
+    const char* pName;
+    size_t nameLength;
+    size_t childLength;
+
+    if (reuse) {
+    #if defined(MFS_POSIX) && defined(AT_FDCWD) && defined(O_DIRECTORY) && defined(O_CLOEXEC)
+        int dirFD = -1;
+        mfs_bool32 isDirectoryOpen = MFS_FALSE;
     #endif
-    #ifdef EHWPOISON
-        case EHWPOISON: return MFS_ERROR;
+
+        /* Nothing was added, removed or renamed, so the names are taken from the previous snapshot. Only their metadata is refreshed. */
+        pBuilder->reusedDirectoryCount += 1;
+
+        while (iPrevious < previousEnd) {
+            const mfs_tree_snapshot_entry* pPrevious = &pPreviousEntries[iPrevious];
+            mfs_file_info_ex info;
+
+            iPrevious += 1 + pPrevious->descendantCount;
+
+            pName = mfs_tree_snapshot_entry_name(pPrevious, &nameLength);
+            result = mfs_tree_snapshot_set_path(pBuilder, pathLength, pName, nameLength, &childLength);
+            if (result != MFS_SUCCESS) {
+                break;
+            }
+
+            if ((pBuilder->flags & MFS_TREE_SNAPSHOT_FLAG_REUSE_FILE_INFO) != 0 && pPrevious->type != MFS_FILE_TYPE_DIRECTORY) {
+                result = mfs_tree_snapshot_add(pBuilder, childLength, pPrevious->type, pPrevious->inode, pPrevious->sizeInBytes, pPrevious->lastModifiedTime, pPrevious);
+                if (result != MFS_SUCCESS) {
+                    break;
+                }
+
+                continue;
+            }
+
+        #if defined(MFS_POSIX) && defined(AT_FDCWD) && defined(O_DIRECTORY) && defined(O_CLOEXEC)
+            /* Stat'ing relative to the directory saves resolving the whole path for every entry. It's only opened when needed. */
+            if (isDirectoryOpen == MFS_FALSE) {
+                if (pathLength > 0) {
+                    pBuilder->pPath[pBuilder->rootLength + pathLength] = '\0';
+                    dirFD = open(pBuilder->pPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                    pBuilder->pPath[pBuilder->rootLength + pathLength] = '/';
+                } else {
+                    dirFD = open(pBuilder->pRootPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                }
+
+                isDirectoryOpen = MFS_TRUE;
+            }
+
+            if (dirFD >= 0) {
+                result = mfs_get_file_info_at__posix(dirFD, pName, MFS_TREE_SNAPSHOT_FIELDS | MFS_FILE_INFO_FLAG_NO_FOLLOW, &info);
+            } else
+        #endif
+            {
+                result = mfs_get_file_info_ex(pBuilder->pPath, MFS_TREE_SNAPSHOT_FIELDS | MFS_FILE_INFO_FLAG_NO_FOLLOW, &info);
+            }
+
+            if (result != MFS_SUCCESS) {
+                result = MFS_SUCCESS;
+                continue;   /* Removed since the directory's time was checked. The next snapshot will pick up the change. */
+            }
+
+            result = mfs_tree_snapshot_add(pBuilder, childLength, info.type, info.inode, info.sizeInBytes, info.lastModifiedTime, pPrevious);
+            if (result != MFS_SUCCESS) {
+                break;
+            }
+        }
+
+    #if defined(MFS_POSIX) && defined(AT_FDCWD) && defined(O_DIRECTORY) && defined(O_CLOEXEC)
+        if (dirFD >= 0) {
+            close(dirFD);
+        }
     #endif
-        default: return MFS_ERROR;
+
+        if (result != MFS_SUCCESS) {
+            return result;
+        }
+    } else {
+        mfs_directory_listing listing;
+        size_t iEntry;
+
+        if (pathLength > 0) {
+            pBuilder->pPath[pBuilder->rootLength + pathLength] = '\0';
+            result = mfs_list_directory(pBuilder->pPath, MFS_LIST_SORT_NAME | MFS_LIST_FLAG_FILE_INFO, &listing);
+        } else {
+            result = mfs_list_directory(pBuilder->pRootPath, MFS_LIST_SORT_NAME | MFS_LIST_FLAG_FILE_INFO, &listing);
+        }
+
+        if (result != MFS_SUCCESS) {
+            if (result == MFS_OUT_OF_MEMORY) {
+                return result;
+            }
+
+            /* The directory is recorded without any contents. */
+            if (pBuilder->onError != NULL) {
+                pBuilder->onError(pBuilder->pUserData, (pathLength > 0) ? pBuilder->pPath : pBuilder->pRootPath, result);
+            }
+
+            return MFS_SUCCESS;
+        }
+
+        for (iEntry = 0; iEntry < listing.count; iEntry += 1) {
+            const mfs_directory_listing_entry* pEntry = &listing.pEntries[iEntry];
+            const mfs_tree_snapshot_entry* pPrevious = NULL;
+            mfs_uint64 inode = pEntry->inode;
+            mfs_uint64 sizeInBytes = pEntry->sizeInBytes;
+            mfs_int64 lastModifiedTime = pEntry->lastModifiedTime;
+
+            result = mfs_tree_snapshot_set_path(pBuilder, pathLength, pEntry->pName, pEntry->nameLength, &childLength);
+            if (result != MFS_SUCCESS) {
+                break;
+            }
+
+            /* The listing reports what links point to, but snapshots record the links themselves. */
+            if (pEntry->type == MFS_FILE_TYPE_SYMLINK) {
+                mfs_file_info_ex info;
+
+                if (mfs_get_file_info_ex(pBuilder->pPath, MFS_TREE_SNAPSHOT_FIELDS | MFS_FILE_INFO_FLAG_NO_FOLLOW, &info) == MFS_SUCCESS) {
+                    inode            = info.inode;
+                    sizeInBytes      = info.sizeInBytes;
+                    lastModifiedTime = info.lastModifiedTime;
+                }
+            }
+
+            /* Both are sorted by name, so the previous entries are merged in as we go. */
+            while (iPrevious < previousEnd) {
+                const mfs_tree_snapshot_entry* pCandidate = &pPreviousEntries[iPrevious];
+                int cmp;
+
+                pName = mfs_tree_snapshot_entry_name(pCandidate, &nameLength);
+                cmp = mfs_tree_snapshot_compare_paths(pName, nameLength, pEntry->pName, pEntry->nameLength);
+                if (cmp > 0) {
+                    break;
+                }
+
+                iPrevious += 1 + pCandidate->descendantCount;
+                if (cmp == 0) {
+                    pPrevious = pCandidate;
+                    break;
+                }
+            }
+
+            result = mfs_tree_snapshot_add(pBuilder, childLength, pEntry->type, inode, sizeInBytes, lastModifiedTime, pPrevious);
+            if (result != MFS_SUCCESS) {
+                break;
+            }
+        }
+
+        mfs_directory_listing_uninit(&listing);
+
+        if (result != MFS_SUCCESS) {
+            return result;
+        }
+    }
+
+    return MFS_SUCCESS;
+}
+
+mfs_tree_snapshot_config mfs_tree_snapshot_config_init(void)
+{
+    mfs_tree_snapshot_config config;
+
+    MFS_ZERO_OBJECT(&config);
+
+    return config;
+}
+
+mfs_result mfs_tree_snapshot_init(const char* pRootPath, const mfs_tree_snapshot_config* pConfig, mfs_tree_snapshot* pSnapshot)
+{
+    mfs_result result;
+    mfs_tree_snapshot_builder builder;
+    mfs_file_info_ex rootInfo;
+    mfs_int64 scanTime;
+    size_t rootPathLength;
+    char* pPaths;
+    size_t iEntry;
+
+    if (pSnapshot == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(pSnapshot);
+
+    if (pRootPath == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (pRootPath[0] == '\0') {
+        pRootPath = ".";
+    }
+
+    /* This needs to come before anything is read so that changes made during the scan are treated as racy by the next one. */
+    scanTime = mfs_get_wall_time_ns();
+
+    result = mfs_get_file_info_ex(pRootPath, MFS_FILE_INFO_FIELD_TYPE | MFS_FILE_INFO_FIELD_TIMES, &rootInfo);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    if (rootInfo.type != MFS_FILE_TYPE_DIRECTORY) {
+        return MFS_NOT_DIRECTORY;
+    }
+
+    MFS_ZERO_OBJECT(&builder);
+    if (pConfig != NULL) {
+        builder.flags     = pConfig->flags;
+        builder.pPrevious = pConfig->pPrevious;
+        builder.pExclude  = pConfig->pExclude;
+        builder.onError   = pConfig->onError;
+        builder.pUserData = pConfig->pUserData;
+    }
+
+    rootPathLength = strlen(pRootPath);
+
+    builder.pRootPath  = pRootPath;
+    builder.rootLength = rootPathLength;
+    if (pRootPath[rootPathLength - 1] != '/' && pRootPath[rootPathLength - 1] != '\\') {
+        builder.rootLength += 1;
+    }
+
+    builder.pathCap = builder.rootLength + 256;
+    builder.pPath   = (char*)MFS_MALLOC(builder.pathCap);
+    if (builder.pPath == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    MFS_COPY_MEMORY(builder.pPath, pRootPath, rootPathLength);
+    if (builder.rootLength > rootPathLength) {
+        builder.pPath[rootPathLength] = '/';
+    }
+
+    if (builder.pPrevious != NULL) {
+        result = mfs_tree_snapshot_scan(&builder, 0, 0, builder.pPrevious->count, mfs_tree_snapshot_can_reuse(&builder, builder.pPrevious->rootModifiedTime, rootInfo.lastModifiedTime));
+    } else {
+        result = mfs_tree_snapshot_scan(&builder, 0, 0, 0, MFS_FALSE);
+    }
+
+    MFS_FREE(builder.pPath);
+
+    if (result != MFS_SUCCESS) {
+        MFS_FREE(builder.pEntries);
+        MFS_FREE(builder.pPaths);
+        return result;
+    }
+
+    /* Everything is moved into a single allocation, the same as a directory listing. */
+    pSnapshot->pEntries = (mfs_tree_snapshot_entry*)MFS_MALLOC(sizeof(*pSnapshot->pEntries) * builder.count + builder.pathsLength + 1);
+    if (pSnapshot->pEntries == NULL) {
+        MFS_FREE(builder.pEntries);
+        MFS_FREE(builder.pPaths);
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    pPaths = (char*)(pSnapshot->pEntries + builder.count);
+    if (builder.count > 0) {
+        MFS_COPY_MEMORY(pSnapshot->pEntries, builder.pEntries, sizeof(*pSnapshot->pEntries) * builder.count);
+        MFS_COPY_MEMORY(pPaths, builder.pPaths, builder.pathsLength);
+    }
+
+    MFS_FREE(builder.pEntries);
+    MFS_FREE(builder.pPaths);
+
+    for (iEntry = 0; iEntry < builder.count; iEntry += 1) {
+        pSnapshot->pEntries[iEntry].pPath = pPaths;
+        pPaths += pSnapshot->pEntries[iEntry].pathLength + 1;
+    }
+
+    pSnapshot->count                = builder.count;
+    pSnapshot->rootModifiedTime     = rootInfo.lastModifiedTime;
+    pSnapshot->scanTime             = scanTime;
+    pSnapshot->reusedDirectoryCount = builder.reusedDirectoryCount;
+
+    return MFS_SUCCESS;
+}
+
+void mfs_tree_snapshot_uninit(mfs_tree_snapshot* pSnapshot)
+{
+    if (pSnapshot == NULL) {
+        return;
+    }
+
+    MFS_FREE(pSnapshot->pEntries);
+    MFS_ZERO_OBJECT(pSnapshot);
+}
+
+const mfs_tree_snapshot_entry* mfs_tree_snapshot_find(const mfs_tree_snapshot* pSnapshot, const char* pPath)
+{
+    size_t pathLength;
+    size_t lo;
+    size_t hi;
+
+    if (pSnapshot == NULL || pPath == NULL) {
+        return NULL;
+    }
+
+    /* Entries are in depth first order with sorted siblings, which is the same order as comparing their full paths. */
+    pathLength = strlen(pPath);
+    lo = 0;
+    hi = pSnapshot->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = mfs_tree_snapshot_compare_paths(pSnapshot->pEntries[mid].pPath, pSnapshot->pEntries[mid].pathLength, pPath, pathLength);
+
+        if (cmp == 0) {
+            return &pSnapshot->pEntries[mid];
+        }
+
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+const mfs_tree_snapshot_entry* mfs_tree_snapshot_first_child(const mfs_tree_snapshot* pSnapshot, const mfs_tree_snapshot_entry* pDirectory)
+{
+    if (pSnapshot == NULL) {
+        return NULL;
+    }
+
+    if (pDirectory == NULL) {
+        return (pSnapshot->count > 0) ? &pSnapshot->pEntries[0] : NULL;
+    }
+
+    return (pDirectory->descendantCount > 0) ? pDirectory + 1 : NULL;
+}
+
+const mfs_tree_snapshot_entry* mfs_tree_snapshot_next_sibling(const mfs_tree_snapshot* pSnapshot, const mfs_tree_snapshot_entry* pEntry)
+{
+    const mfs_tree_snapshot_entry* pNext;
+    size_t nameLength;
+    size_t parentLength;
+
+    if (pSnapshot == NULL || pEntry == NULL) {
+        return NULL;
+    }
+
+    pNext = pEntry + 1 + pEntry->descendantCount;
+    if (pNext >= pSnapshot->pEntries + pSnapshot->count) {
+        return NULL;
+    }
+
+    /* Whatever comes after the subtree is either a sibling, or belongs to a parent further up, in which case the prefix won't match. */
+    mfs_tree_snapshot_entry_name(pEntry, &nameLength);
+    parentLength = pEntry->pathLength - nameLength;
+    if (pNext->pathLength <= parentLength || memcmp(pNext->pPath, pEntry->pPath, parentLength) != 0) {
+        return NULL;
+    }
+
+    return pNext;
+}
+
+static mfs_result mfs_tree_diff_push(mfs_tree_changes* pChanges, size_t* pCap, mfs_uint32 type, const mfs_tree_snapshot_entry* pOld, const mfs_tree_snapshot_entry* pNew)
+{
+    mfs_tree_change* pChange;
+
+    if (pChanges->count == *pCap) {
+        size_t newCap = (*pCap > 0) ? *pCap * 2 : 64;
+        mfs_tree_change* pNewChanges = (mfs_tree_change*)MFS_REALLOC(pChanges->pChanges, sizeof(*pNewChanges) * newCap);
+        if (pNewChanges == NULL) {
+            return MFS_OUT_OF_MEMORY;
+        }
+
+        pChanges->pChanges = pNewChanges;
+        *pCap = newCap;
+    }
+
+    pChange = &pChanges->pChanges[pChanges->count];
+    pChange->type = type;
+    pChange->pOld = pOld;
+    pChange->pNew = pNew;
+    pChanges->count += 1;
+
+    return MFS_SUCCESS;
+}
+
+static size_t mfs_tree_diff_hash_inode(mfs_uint64 inode, size_t mask)
+{
+    return (size_t)((inode * MFS_UINT64_CONST(0x9E3779B9, 0x7F4A7C15)) >> 32) & mask;
+}
+
+static mfs_result mfs_tree_diff_find_renames(mfs_tree_changes* pChanges)
+{
+    size_t* pSlots;
+    size_t slotCount;
+    size_t removedCount = 0;
+    size_t iChange;
+    size_t iOutput;
+
+    for (iChange = 0; iChange < pChanges->count; iChange += 1) {
+        if (pChanges->pChanges[iChange].type == MFS_TREE_CHANGE_REMOVED && pChanges->pChanges[iChange].pOld->inode != 0) {
+            removedCount += 1;
+        }
+    }
+
+    if (removedCount == 0) {
+        return MFS_SUCCESS;
+    }
+
+    /* Removals are hashed by inode. Slots hold the index of the change plus one so that 0 can mean empty. */
+    slotCount = 16;
+    while (slotCount < removedCount * 2) {
+        slotCount *= 2;
+    }
+
+    pSlots = (size_t*)MFS_MALLOC(sizeof(*pSlots) * slotCount);
+    if (pSlots == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+    MFS_ZERO_MEMORY(pSlots, sizeof(*pSlots) * slotCount);
+
+    for (iChange = 0; iChange < pChanges->count; iChange += 1) {
+        const mfs_tree_change* pChange = &pChanges->pChanges[iChange];
+        size_t iSlot;
+
+        if (pChange->type != MFS_TREE_CHANGE_REMOVED || pChange->pOld->inode == 0) {
+            continue;
+        }
+
+        iSlot = mfs_tree_diff_hash_inode(pChange->pOld->inode, slotCount - 1);
+        while (pSlots[iSlot] != 0) {
+            iSlot = (iSlot + 1) & (slotCount - 1);
+        }
+        pSlots[iSlot] = iChange + 1;
+    }
+
+    /* Each removal can be paired with one addition. Paired removals are marked by clearing pOld, and dropped afterwards. */
+    for (iChange = 0; iChange < pChanges->count; iChange += 1) {
+        mfs_tree_change* pChange = &pChanges->pChanges[iChange];
+        size_t iSlot;
+
+        if (pChange->type != MFS_TREE_CHANGE_ADDED || pChange->pNew->inode == 0) {
+            continue;
+        }
+
+        iSlot = mfs_tree_diff_hash_inode(pChange->pNew->inode, slotCount - 1);
+        while (pSlots[iSlot] != 0) {
+            mfs_tree_change* pRemoved = &pChanges->pChanges[pSlots[iSlot] - 1];
+
+            if (pRemoved->pOld != NULL && pRemoved->pOld->inode == pChange->pNew->inode && pRemoved->pOld->type == pChange->pNew->type) {
+                pChange->type  = MFS_TREE_CHANGE_RENAMED;
+                pChange->pOld  = pRemoved->pOld;
+                pRemoved->pOld = NULL;
+                break;
+            }
+
+            iSlot = (iSlot + 1) & (slotCount - 1);
+        }
+    }
+
+    MFS_FREE(pSlots);
+
+    iOutput = 0;
+    for (iChange = 0; iChange < pChanges->count; iChange += 1) {
+        if (pChanges->pChanges[iChange].type == MFS_TREE_CHANGE_REMOVED && pChanges->pChanges[iChange].pOld == NULL) {
+            continue;
+        }
+
+        pChanges->pChanges[iOutput] = pChanges->pChanges[iChange];
+        iOutput += 1;
+    }
+    pChanges->count = iOutput;
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_tree_diff(const mfs_tree_snapshot* pOld, const mfs_tree_snapshot* pNew, mfs_tree_changes* pChanges)
+{
+    mfs_result result = MFS_SUCCESS;
+    size_t cap = 0;
+    size_t iOld = 0;
+    size_t iNew = 0;
+
+    if (pChanges == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(pChanges);
+
+    if (pOld == NULL || pNew == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    /* Both snapshots are in the same order, so they can be merged in a single pass. */
+    while (result == MFS_SUCCESS && (iOld < pOld->count || iNew < pNew->count)) {
+        const mfs_tree_snapshot_entry* pOldEntry = (iOld < pOld->count) ? &pOld->pEntries[iOld] : NULL;
+        const mfs_tree_snapshot_entry* pNewEntry = (iNew < pNew->count) ? &pNew->pEntries[iNew] : NULL;
+        int cmp;
+
+        if (pOldEntry == NULL) {
+            cmp = 1;
+        } else if (pNewEntry == NULL) {
+            cmp = -1;
+        } else {
+            cmp = mfs_tree_snapshot_compare_paths(pOldEntry->pPath, pOldEntry->pathLength, pNewEntry->pPath, pNewEntry->pathLength);
+        }
+
+        if (cmp < 0) {
+            result = mfs_tree_diff_push(pChanges, &cap, MFS_TREE_CHANGE_REMOVED, pOldEntry, NULL);
+            iOld += 1;
+        } else if (cmp > 0) {
+            result = mfs_tree_diff_push(pChanges, &cap, MFS_TREE_CHANGE_ADDED, NULL, pNewEntry);
+            iNew += 1;
+        } else {
+            if (pOldEntry->type != pNewEntry->type) {
+                result = mfs_tree_diff_push(pChanges, &cap, MFS_TREE_CHANGE_REMOVED, pOldEntry, NULL);
+                if (result == MFS_SUCCESS) {
+                    result = mfs_tree_diff_push(pChanges, &cap, MFS_TREE_CHANGE_ADDED, NULL, pNewEntry);
+                }
+            } else if (pOldEntry->type != MFS_FILE_TYPE_DIRECTORY && (pOldEntry->sizeInBytes != pNewEntry->sizeInBytes || pOldEntry->lastModifiedTime != pNewEntry->lastModifiedTime || pOldEntry->inode != pNewEntry->inode)) {
+                result = mfs_tree_diff_push(pChanges, &cap, MFS_TREE_CHANGE_MODIFIED, pOldEntry, pNewEntry);
+            }
+
+            iOld += 1;
+            iNew += 1;
+        }
+    }
+
+    if (result == MFS_SUCCESS) {
+        result = mfs_tree_diff_find_renames(pChanges);
+    }
+
+    if (result != MFS_SUCCESS) {
+        mfs_tree_changes_uninit(pChanges);
+        return result;
+    }
+
+    return MFS_SUCCESS;
+}
+
+void mfs_tree_changes_uninit(mfs_tree_changes* pChanges)
+{
+    if (pChanges == NULL) {
+        return;
+    }
+
+    MFS_FREE(pChanges->pChanges);
+    MFS_ZERO_OBJECT(pChanges);
+}
+
+
+
+/* Tree Indexes */
+#define MFS_TREE_INDEX_VERSION          1
+#define MFS_TREE_INDEX_BYTE_ORDER_MARK  0x01020304
+
+typedef struct
+{
+    char magic[8];                      /* "mfstree" with a null terminator. */
+    mfs_uint32 version;
+    mfs_uint32 byteOrderMark;           /* Reads back differently on a machine of the other endianness. */
+    mfs_uint64 rootPathLength;          /* The root path comes straight after the header, without a null terminator. */
+    mfs_uint64 entryCount;              /* The records come after the root path, followed by the compressed paths. */
+    mfs_uint64 pathsLength;             /* The length of every path once decompressed, including null terminators. */
+    mfs_uint64 compressedPathsLength;
+    mfs_int64 rootModifiedTime;
+    mfs_int64 scanTime;
+    mfs_uint32 checksum;                /* CRC32C of everything after the header. */
+    mfs_uint32 reserved;
+} mfs_tree_index_header;
+
+typedef struct
+{
+    mfs_uint64 inode;
+    mfs_uint64 sizeInBytes;
+    mfs_int64 lastModifiedTime;
+    mfs_uint64 descendantCount;
+    mfs_uint32 type;
+    mfs_uint32 reserved;
+} mfs_tree_index_record;
+
+typedef struct
+{
+    size_t* pSlots;     /* The index of the entry plus one, so 0 can mean empty. */
+    size_t slotCount;   /* Always a power of two. */
+} mfs_tree_index_internal;
+
+static size_t mfs_tree_index_write_varint(mfs_uint8* pOutput, mfs_uint64 value)
+{
+    size_t length = 0;
+
+    while (value >= 0x80) {
+        pOutput[length] = (mfs_uint8)(value | 0x80);
+        value >>= 7;
+        length += 1;
+    }
+
+    pOutput[length] = (mfs_uint8)value;
+    return length + 1;
+}
+
+static mfs_bool32 mfs_tree_index_read_varint(const mfs_uint8* pData, size_t dataSize, size_t* pCursor, mfs_uint64* pValue)
+{
+    mfs_uint64 value = 0;
+    unsigned int shift = 0;
+
+    while (*pCursor < dataSize && shift < 64) {
+        mfs_uint8 byte = pData[*pCursor];
+        *pCursor += 1;
+
+        value |= (mfs_uint64)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *pValue = value;
+            return MFS_TRUE;
+        }
+
+        shift += 7;
+    }
+
+    return MFS_FALSE;
+}
+
+static mfs_result mfs_tree_snapshot_encode(const mfs_tree_snapshot* pSnapshot, const char* pRootPath, mfs_uint8** ppData, size_t* pDataSize)
+{
+    mfs_tree_index_header header;
+    mfs_uint8* pData;
+    mfs_uint8* pPaths;
+    size_t dataSize;
+    size_t rootPathLength;
+    size_t pathsLength = 0;
+    size_t maxCompressedPathsLength = 0;
+    size_t compressedPathsLength = 0;
+    size_t iEntry;
+
+    rootPathLength = strlen(pRootPath);
+
+    for (iEntry = 0; iEntry < pSnapshot->count; iEntry += 1) {
+        pathsLength              += pSnapshot->pEntries[iEntry].pathLength + 1;
+        maxCompressedPathsLength += pSnapshot->pEntries[iEntry].pathLength + 20;   /* Two varints can't be more than 10 bytes each. */
+    }
+
+    dataSize = sizeof(header) + rootPathLength + sizeof(mfs_tree_index_record) * pSnapshot->count + maxCompressedPathsLength;
+    pData = (mfs_uint8*)MFS_MALLOC(dataSize);
+    if (pData == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    MFS_COPY_MEMORY(pData + sizeof(header), pRootPath, rootPathLength);
+
+    /* Each path is stored as the number of bytes it shares with the previous one, followed by whatever is left. */
+    pPaths = pData + sizeof(header) + rootPathLength + sizeof(mfs_tree_index_record) * pSnapshot->count;
+    for (iEntry = 0; iEntry < pSnapshot->count; iEntry += 1) {
+        const mfs_tree_snapshot_entry* pEntry = &pSnapshot->pEntries[iEntry];
+        mfs_tree_index_record record;
+        size_t prefixLength = 0;
+
+        record.inode            = pEntry->inode;
+        record.sizeInBytes      = pEntry->sizeInBytes;
+        record.lastModifiedTime = pEntry->lastModifiedTime;
+        record.descendantCount  = pEntry->descendantCount;
+        record.type             = pEntry->type;
+        record.reserved         = 0;
+        MFS_COPY_MEMORY(pData + sizeof(header) + rootPathLength + sizeof(record) * iEntry, &record, sizeof(record));
+
+        if (iEntry > 0) {
+            const mfs_tree_snapshot_entry* pPrevious = pEntry - 1;
+
+            while (prefixLength < pEntry->pathLength && prefixLength < pPrevious->pathLength && pEntry->pPath[prefixLength] == pPrevious->pPath[prefixLength]) {
+                prefixLength += 1;
+            }
+        }
+
+        compressedPathsLength += mfs_tree_index_write_varint(pPaths + compressedPathsLength, prefixLength);
+        compressedPathsLength += mfs_tree_index_write_varint(pPaths + compressedPathsLength, pEntry->pathLength - prefixLength);
+        MFS_COPY_MEMORY(pPaths + compressedPathsLength, pEntry->pPath + prefixLength, pEntry->pathLength - prefixLength);
+        compressedPathsLength += pEntry->pathLength - prefixLength;
+    }
+
+    dataSize = dataSize - maxCompressedPathsLength + compressedPathsLength;
+
+    MFS_ZERO_OBJECT(&header);
+    MFS_COPY_MEMORY(header.magic, "mfstree", 8);
+    header.version               = MFS_TREE_INDEX_VERSION;
+    header.byteOrderMark         = MFS_TREE_INDEX_BYTE_ORDER_MARK;
+    header.rootPathLength        = rootPathLength;
+    header.entryCount            = pSnapshot->count;
+    header.pathsLength           = pathsLength;
+    header.compressedPathsLength = compressedPathsLength;
+    header.rootModifiedTime      = pSnapshot->rootModifiedTime;
+    header.scanTime              = pSnapshot->scanTime;
+    header.checksum              = mfs_crc32c_update(0xFFFFFFFF, pData + sizeof(header), dataSize - sizeof(header)) ^ 0xFFFFFFFF;
+    MFS_COPY_MEMORY(pData, &header, sizeof(header));
+
+    *ppData    = pData;
+    *pDataSize = dataSize;
+
+    return MFS_SUCCESS;
+}
+
+static mfs_result mfs_tree_index_write_file(const char* pFilePath, const void* pData, size_t dataSize)
+{
+    mfs_result result;
+    char* pTempPath;
+    size_t filePathLength;
+
+    /* The file is written next to the destination and then moved into place so readers never see a partial index. */
+    filePathLength = strlen(pFilePath);
+    pTempPath = (char*)MFS_MALLOC(filePathLength + 5);
+    if (pTempPath == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    MFS_COPY_MEMORY(pTempPath, pFilePath, filePathLength);
+    MFS_COPY_MEMORY(pTempPath + filePathLength, ".tmp", 5);
+
+    result = mfs_open_and_write_file(pTempPath, dataSize, pData);
+    if (result == MFS_SUCCESS) {
+        result = mfs_move_file(pTempPath, pFilePath, MFS_FALSE);
+        if (result != MFS_SUCCESS) {
+            mfs_delete_file(pTempPath);
+        }
+    }
+
+    MFS_FREE(pTempPath);
+
+    return result;
+}
+
+mfs_result mfs_tree_snapshot_save(const mfs_tree_snapshot* pSnapshot, const char* pRootPath, const char* pFilePath)
+{
+    mfs_result result;
+    mfs_uint8* pData;
+    size_t dataSize;
+
+    if (pSnapshot == NULL || pRootPath == NULL || pFilePath == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (pRootPath[0] == '\0') {
+        pRootPath = ".";
+    }
+
+    result = mfs_tree_snapshot_encode(pSnapshot, pRootPath, &pData, &dataSize);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    result = mfs_tree_index_write_file(pFilePath, pData, dataSize);
+    MFS_FREE(pData);
+
+    return result;
+}
+
+static mfs_result mfs_tree_index_map(const char* pFilePath, const mfs_uint8** ppData, size_t* pDataSize, mfs_bool32* pIsMapped)
+{
+    void* pData;
+
+    *pIsMapped = MFS_FALSE;
+
+#if defined(MFS_POSIX)
+    {
+        int fd;
+        struct stat info;
+
+        fd = open(pFilePath, O_RDONLY);
+        if (fd < 0) {
+            return mfs_result_from_errno(errno);
+        }
+
+        if (fstat(fd, &info) != 0) {
+            int e = errno;
+            close(fd);
+            return mfs_result_from_errno(e);
+        }
+
+        if (info.st_size > 0 && (mfs_uint64)info.st_size <= (mfs_uint64)((size_t)-1)) {
+            pData = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (pData != MAP_FAILED) {
+                close(fd);
+
+                *ppData    = (const mfs_uint8*)pData;
+                *pDataSize = (size_t)info.st_size;
+                *pIsMapped = MFS_TRUE;
+                return MFS_SUCCESS;
+            }
+        }
+
+        close(fd);  /* Fall back to reading the file. */
+    }
+#endif
+
+    {
+        mfs_result result = mfs_open_and_read_file(pFilePath, pDataSize, &pData);
+        if (result != MFS_SUCCESS) {
+            return result;
+        }
+
+        *ppData = (const mfs_uint8*)pData;
+        return MFS_SUCCESS;
+    }
+}
+
+static void mfs_tree_index_unmap(const mfs_uint8* pData, size_t dataSize, mfs_bool32 isMapped)
+{
+#if defined(MFS_POSIX)
+    if (isMapped) {
+        munmap((void*)pData, dataSize);
+        return;
+    }
+#endif
+
+    (void)dataSize;
+    (void)isMapped;
+    MFS_FREE((void*)pData);
+}
+
+static mfs_result mfs_tree_snapshot_decode(const mfs_uint8* pData, size_t dataSize, const char* pRootPath, mfs_tree_snapshot* pSnapshot)
+{
+    mfs_tree_index_header header;
+    const mfs_uint8* pPaths;
+    char* pOutput;
+    size_t outputLength = 0;
+    size_t cursor = 0;
+    size_t iEntry;
+
+    if (dataSize < sizeof(header)) {
+        return MFS_INVALID_FILE;
+    }
+
+    MFS_COPY_MEMORY(&header, pData, sizeof(header));
+    if (memcmp(header.magic, "mfstree", 8) != 0 || header.version != MFS_TREE_INDEX_VERSION || header.byteOrderMark != MFS_TREE_INDEX_BYTE_ORDER_MARK) {
+        return MFS_INVALID_FILE;
+    }
+
+    /* The sizes are checked one at a time so that none of the additions can overflow. */
+    dataSize -= sizeof(header);
+    if (header.rootPathLength != strlen(pRootPath) || header.rootPathLength > dataSize || memcmp(pData + sizeof(header), pRootPath, (size_t)header.rootPathLength) != 0) {
+        return MFS_INVALID_FILE;
+    }
+
+    if (header.entryCount > (dataSize - header.rootPathLength) / sizeof(mfs_tree_index_record) || header.compressedPathsLength != dataSize - header.rootPathLength - header.entryCount * sizeof(mfs_tree_index_record)) {
+        return MFS_INVALID_FILE;
+    }
+
+    if (header.pathsLength > (mfs_uint64)((size_t)-1) - sizeof(mfs_tree_snapshot_entry) * header.entryCount - 1) {
+        return MFS_TOO_BIG;
+    }
+
+    if ((mfs_crc32c_update(0xFFFFFFFF, pData + sizeof(header), dataSize) ^ 0xFFFFFFFF) != header.checksum) {
+        return MFS_CHECKSUM_MISMATCH;
+    }
+
+    pSnapshot->pEntries = (mfs_tree_snapshot_entry*)MFS_MALLOC(sizeof(*pSnapshot->pEntries) * (size_t)header.entryCount + (size_t)header.pathsLength + 1);
+    if (pSnapshot->pEntries == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    pOutput = (char*)(pSnapshot->pEntries + header.entryCount);
+    pPaths  = pData + sizeof(header) + header.rootPathLength + header.entryCount * sizeof(mfs_tree_index_record);
+
+    for (iEntry = 0; iEntry < header.entryCount; iEntry += 1) {
+        mfs_tree_snapshot_entry* pEntry = &pSnapshot->pEntries[iEntry];
+        mfs_tree_index_record record;
+        mfs_uint64 prefixLength;
+        mfs_uint64 suffixLength;
+
+        MFS_COPY_MEMORY(&record, pData + sizeof(header) + header.rootPathLength + sizeof(record) * iEntry, sizeof(record));
+
+        if (mfs_tree_index_read_varint(pPaths, (size_t)header.compressedPathsLength, &cursor, &prefixLength) == MFS_FALSE ||
+            mfs_tree_index_read_varint(pPaths, (size_t)header.compressedPathsLength, &cursor, &suffixLength) == MFS_FALSE ||
+            suffixLength > header.compressedPathsLength - cursor ||
+            prefixLength > ((iEntry > 0) ? pEntry[-1].pathLength : 0) ||
+            prefixLength + suffixLength + 1 > header.pathsLength - outputLength ||
+            record.descendantCount > header.entryCount - iEntry - 1) {
+            mfs_tree_snapshot_uninit(pSnapshot);
+            return MFS_INVALID_FILE;
+        }
+
+        if (prefixLength > 0) {
+            MFS_COPY_MEMORY(pOutput + outputLength, pEntry[-1].pPath, (size_t)prefixLength);
+        }
+        MFS_COPY_MEMORY(pOutput + outputLength + prefixLength, pPaths + cursor, (size_t)suffixLength);
+        cursor += (size_t)suffixLength;
+
+        pEntry->pPath            = pOutput + outputLength;
+        pEntry->pathLength       = (size_t)(prefixLength + suffixLength);
+        pEntry->inode            = record.inode;
+        pEntry->sizeInBytes      = record.sizeInBytes;
+        pEntry->lastModifiedTime = record.lastModifiedTime;
+        pEntry->descendantCount  = (size_t)record.descendantCount;
+        pEntry->type             = record.type;
+
+        pOutput[outputLength + pEntry->pathLength] = '\0';
+        outputLength += pEntry->pathLength + 1;
+    }
+
+    pSnapshot->count            = (size_t)header.entryCount;
+    pSnapshot->rootModifiedTime = header.rootModifiedTime;
+    pSnapshot->scanTime         = header.scanTime;
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_tree_snapshot_load(const char* pFilePath, const char* pRootPath, mfs_tree_snapshot* pSnapshot)
+{
+    mfs_result result;
+    const mfs_uint8* pData;
+    size_t dataSize;
+    mfs_bool32 isMapped;
+
+    if (pSnapshot == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(pSnapshot);
+
+    if (pFilePath == NULL || pRootPath == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (pRootPath[0] == '\0') {
+        pRootPath = ".";
+    }
+
+    result = mfs_tree_index_map(pFilePath, &pData, &dataSize, &isMapped);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    result = mfs_tree_snapshot_decode(pData, dataSize, pRootPath, pSnapshot);
+    mfs_tree_index_unmap(pData, dataSize, isMapped);
+
+    return result;
+}
+
+static mfs_bool32 mfs_tree_snapshot_equal(const mfs_tree_snapshot* pA, const mfs_tree_snapshot* pB)
+{
+    size_t iEntry;
+
+    if (pA->count != pB->count || pA->rootModifiedTime != pB->rootModifiedTime) {
+        return MFS_FALSE;
+    }
+
+    for (iEntry = 0; iEntry < pA->count; iEntry += 1) {
+        const mfs_tree_snapshot_entry* pEntryA = &pA->pEntries[iEntry];
+        const mfs_tree_snapshot_entry* pEntryB = &pB->pEntries[iEntry];
+
+        if (pEntryA->pathLength != pEntryB->pathLength || pEntryA->inode != pEntryB->inode || pEntryA->sizeInBytes != pEntryB->sizeInBytes ||
+            pEntryA->lastModifiedTime != pEntryB->lastModifiedTime || pEntryA->type != pEntryB->type || memcmp(pEntryA->pPath, pEntryB->pPath, pEntryA->pathLength) != 0) {
+            return MFS_FALSE;
+        }
+    }
+
+    return MFS_TRUE;
+}
+
+mfs_result mfs_tree_index_open(const char* pIndexFilePath, const char* pRootPath, const mfs_tree_snapshot_config* pConfig, mfs_tree_index* pIndex)
+{
+    mfs_result result;
+    mfs_tree_snapshot_config config;
+    mfs_tree_snapshot previous;
+    mfs_bool32 isLoaded;
+    mfs_tree_index_internal* pInternal;
+    size_t iEntry;
+
+    if (pIndex == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(pIndex);
+
+    if (pIndexFilePath == NULL || pRootPath == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (pConfig != NULL) {
+        config = *pConfig;
+    } else {
+        config = mfs_tree_snapshot_config_init();
+    }
+
+    /* A file that can't be loaded for whatever reason is just replaced. */
+    isLoaded = mfs_tree_snapshot_load(pIndexFilePath, pRootPath, &previous) == MFS_SUCCESS;
+    config.pPrevious = (isLoaded) ? &previous : NULL;
+
+    result = mfs_tree_snapshot_init(pRootPath, &config, &pIndex->snapshot);
+    if (result != MFS_SUCCESS) {
+        if (isLoaded) {
+            mfs_tree_snapshot_uninit(&previous);
+        }
+
+        return result;
+    }
+
+    /* The file is left alone when nothing changed, which also keeps its older scan time for the next racy check. */
+    if (isLoaded == MFS_FALSE || mfs_tree_snapshot_equal(&previous, &pIndex->snapshot) == MFS_FALSE) {
+        result = mfs_tree_snapshot_save(&pIndex->snapshot, pRootPath, pIndexFilePath);
+        if (result != MFS_SUCCESS && config.onError != NULL) {
+            config.onError(config.pUserData, pIndexFilePath, result);
+        }
+    }
+
+    if (isLoaded) {
+        mfs_tree_snapshot_uninit(&previous);
+    }
+
+    pInternal = (mfs_tree_index_internal*)MFS_MALLOC(sizeof(*pInternal));
+    if (pInternal == NULL) {
+        mfs_tree_snapshot_uninit(&pIndex->snapshot);
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    pInternal->slotCount = 16;
+    while (pInternal->slotCount < pIndex->snapshot.count * 2) {
+        pInternal->slotCount *= 2;
+    }
+
+    pInternal->pSlots = (size_t*)MFS_MALLOC(sizeof(*pInternal->pSlots) * pInternal->slotCount);
+    if (pInternal->pSlots == NULL) {
+        MFS_FREE(pInternal);
+        mfs_tree_snapshot_uninit(&pIndex->snapshot);
+        return MFS_OUT_OF_MEMORY;
+    }
+    MFS_ZERO_MEMORY(pInternal->pSlots, sizeof(*pInternal->pSlots) * pInternal->slotCount);
+
+    for (iEntry = 0; iEntry < pIndex->snapshot.count; iEntry += 1) {
+        const mfs_tree_snapshot_entry* pEntry = &pIndex->snapshot.pEntries[iEntry];
+        size_t iSlot = (size_t)mfs_glob_hash(MFS_UINT64_CONST(0xCBF29CE4, 0x84222325), pEntry->pPath, pEntry->pathLength, MFS_FALSE) & (pInternal->slotCount - 1);
+
+        while (pInternal->pSlots[iSlot] != 0) {
+            iSlot = (iSlot + 1) & (pInternal->slotCount - 1);
+        }
+        pInternal->pSlots[iSlot] = iEntry + 1;
+    }
+
+    pIndex->pInternal = pInternal;
+
+    return MFS_SUCCESS;
+}
+
+void mfs_tree_index_close(mfs_tree_index* pIndex)
+{
+    mfs_tree_index_internal* pInternal;
+
+    if (pIndex == NULL) {
+        return;
+    }
+
+    pInternal = (mfs_tree_index_internal*)pIndex->pInternal;
+    if (pInternal != NULL) {
+        MFS_FREE(pInternal->pSlots);
+        MFS_FREE(pInternal);
+    }
+
+    mfs_tree_snapshot_uninit(&pIndex->snapshot);
+    MFS_ZERO_OBJECT(pIndex);
+}
+
+const mfs_tree_snapshot_entry* mfs_tree_index_find(const mfs_tree_index* pIndex, const char* pPath)
+{
+    const mfs_tree_index_internal* pInternal;
+    size_t pathLength;
+    size_t iSlot;
+
+    if (pIndex == NULL || pIndex->pInternal == NULL || pPath == NULL) {
+        return NULL;
+    }
+
+    pInternal  = (const mfs_tree_index_internal*)pIndex->pInternal;
+    pathLength = strlen(pPath);
+
+    iSlot = (size_t)mfs_glob_hash(MFS_UINT64_CONST(0xCBF29CE4, 0x84222325), pPath, pathLength, MFS_FALSE) & (pInternal->slotCount - 1);
+    while (pInternal->pSlots[iSlot] != 0) {
+        const mfs_tree_snapshot_entry* pEntry = &pIndex->snapshot.pEntries[pInternal->pSlots[iSlot] - 1];
+
+        if (pEntry->pathLength == pathLength && memcmp(pEntry->pPath, pPath, pathLength) == 0) {
+            return pEntry;
+        }
+
+        iSlot = (iSlot + 1) & (pInternal->slotCount - 1);
+    }
+
+    return NULL;
+}
+
+
+
+/* Disk Usage */
+typedef struct
+{
+    mfs_uint64 device;
+    mfs_uint64 inode;
+    mfs_bool32 isUsed;
+} mfs_disk_usage_file_id;
+
+typedef struct
+{
+    mfs_disk_usage_totals totals;
+    mfs_uint8 padding[64];          /* Keeps each thread's totals on their own cache line. */
+} mfs_disk_usage_thread;
+
+typedef struct
+{
+    mfs_disk_usage_config config;
+    mfs_uint64 rootDevice;
+    mfs_disk_usage_thread* pThreads;
+    mfs_disk_usage_totals* pThreadDepths;   /* depthCount elements for each thread. */
+    size_t depthCount;
+    mfs_mutex lock;                         /* For the set of files with more than one link. */
+    mfs_disk_usage_file_id* pFileIDs;
+    size_t fileIDCount;
+    size_t fileIDCap;                       /* Always a power of two. */
+    mfs_result result;                      /* Only set when the set of files can't be grown. */
+} mfs_disk_usage_state;
+
+static size_t mfs_disk_usage_hash(mfs_uint64 device, mfs_uint64 inode, size_t mask)
+{
+    mfs_uint64 hash = (inode ^ (device * MFS_UINT64_CONST(0xC2B2AE3D, 0x27D4EB4F))) * MFS_UINT64_CONST(0x9E3779B9, 0x7F4A7C15);
+    return (size_t)(hash >> 32) & mask;
+}
+
+static mfs_result mfs_disk_usage_insert(mfs_disk_usage_state* pState, mfs_uint64 device, mfs_uint64 inode, mfs_bool32* pIsNew)
+{
+    size_t iSlot;
+
+    /* Must be called while the lock is held. The table is kept at most half full. */
+    if ((pState->fileIDCount + 1) * 2 > pState->fileIDCap) {
+        size_t newCap = (pState->fileIDCap > 0) ? pState->fileIDCap * 2 : 1024;
+        mfs_disk_usage_file_id* pNewFileIDs;
+        size_t iOld;
+
+        pNewFileIDs = (mfs_disk_usage_file_id*)MFS_MALLOC(sizeof(*pNewFileIDs) * newCap);
+        if (pNewFileIDs == NULL) {
+            return MFS_OUT_OF_MEMORY;
+        }
+        MFS_ZERO_MEMORY(pNewFileIDs, sizeof(*pNewFileIDs) * newCap);
+
+        for (iOld = 0; iOld < pState->fileIDCap; iOld += 1) {
+            if (pState->pFileIDs[iOld].isUsed) {
+                iSlot = mfs_disk_usage_hash(pState->pFileIDs[iOld].device, pState->pFileIDs[iOld].inode, newCap - 1);
+                while (pNewFileIDs[iSlot].isUsed) {
+                    iSlot = (iSlot + 1) & (newCap - 1);
+                }
+                pNewFileIDs[iSlot] = pState->pFileIDs[iOld];
+            }
+        }
+
+        MFS_FREE(pState->pFileIDs);
+        pState->pFileIDs  = pNewFileIDs;
+        pState->fileIDCap = newCap;
+    }
+
+    iSlot = mfs_disk_usage_hash(device, inode, pState->fileIDCap - 1);
+    while (pState->pFileIDs[iSlot].isUsed) {
+        if (pState->pFileIDs[iSlot].device == device && pState->pFileIDs[iSlot].inode == inode) {
+            *pIsNew = MFS_FALSE;
+            return MFS_SUCCESS;
+        }
+
+        iSlot = (iSlot + 1) & (pState->fileIDCap - 1);
+    }
+
+    pState->pFileIDs[iSlot].device = device;
+    pState->pFileIDs[iSlot].inode  = inode;
+    pState->pFileIDs[iSlot].isUsed = MFS_TRUE;
+    pState->fileIDCount += 1;
+
+    *pIsNew = MFS_TRUE;
+    return MFS_SUCCESS;
+}
+
+static mfs_uint32 mfs_disk_usage_on_entry(void* pUserData, const mfs_walk_entry* pEntry)
+{
+    mfs_disk_usage_state* pState = (mfs_disk_usage_state*)pUserData;
+    mfs_disk_usage_totals* pTotals;
+    mfs_file_info_ex info;
+    mfs_uint64 allocatedBytes;
+
+    if (mfs_walk_get_file_info(pEntry, MFS_FILE_INFO_FIELD_SIZE | MFS_FILE_INFO_FIELD_INODE | MFS_FILE_INFO_FIELD_LINK_COUNT | MFS_FILE_INFO_FIELD_BLOCKS, &info) != MFS_SUCCESS) {
+        return MFS_WALK_CONTINUE;   /* Removed since the directory was read. */
+    }
+
+    if (pEntry->type == MFS_FILE_TYPE_DIRECTORY && pEntry->depth > 0 && (pState->config.flags & MFS_DISK_USAGE_FLAG_ONE_FILE_SYSTEM) != 0 && info.device != pState->rootDevice) {
+        return MFS_WALK_SKIP;
+    }
+
+    /* Directories can't be hard linked, so only files with more than one link need to go through the shared set. */
+    if (pEntry->type != MFS_FILE_TYPE_DIRECTORY && (info.fields & MFS_FILE_INFO_FIELD_LINK_COUNT) != 0 && info.linkCount > 1) {
+        mfs_result result;
+        mfs_bool32 isNew = MFS_TRUE;
+
+        mfs_mutex_lock(&pState->lock);
+        {
+            result = mfs_disk_usage_insert(pState, info.device, info.inode, &isNew);
+            if (result != MFS_SUCCESS) {
+                pState->result = result;
+            }
+        }
+        mfs_mutex_unlock(&pState->lock);
+
+        if (result != MFS_SUCCESS) {
+            return MFS_WALK_STOP;
+        }
+
+        if (isNew == MFS_FALSE) {
+            return MFS_WALK_CONTINUE;
+        }
+    }
+
+    if ((info.fields & MFS_FILE_INFO_FIELD_BLOCKS) != 0) {
+        allocatedBytes = info.blockCount * 512;
+    } else {
+        allocatedBytes = info.sizeInBytes;
+    }
+
+    pTotals = &pState->pThreads[pEntry->threadIndex].totals;
+    if (pEntry->type == MFS_FILE_TYPE_DIRECTORY) {
+        pTotals->directoryCount += 1;
+    } else {
+        pTotals->fileCount     += 1;
+        pTotals->apparentBytes += info.sizeInBytes;
+    }
+    pTotals->allocatedBytes += allocatedBytes;
+
+    if (pState->depthCount > 0) {
+        pTotals = &pState->pThreadDepths[(pEntry->threadIndex * pState->depthCount) + ((pEntry->depth < pState->depthCount) ? pEntry->depth : pState->depthCount - 1)];
+        if (pEntry->type == MFS_FILE_TYPE_DIRECTORY) {
+            pTotals->directoryCount += 1;
+        } else {
+            pTotals->fileCount     += 1;
+            pTotals->apparentBytes += info.sizeInBytes;
+        }
+        pTotals->allocatedBytes += allocatedBytes;
+    }
+
+    return MFS_WALK_CONTINUE;
+}
+
+static void mfs_disk_usage_on_error(void* pUserData, const char* pPath, mfs_result result)
+{
+    mfs_disk_usage_state* pState = (mfs_disk_usage_state*)pUserData;
+
+    if (pState->config.onError != NULL) {
+        pState->config.onError(pState->config.pUserData, pPath, result);
+    }
+}
+
+static void mfs_disk_usage_add(mfs_disk_usage_totals* pDst, const mfs_disk_usage_totals* pSrc)
+{
+    pDst->apparentBytes  += pSrc->apparentBytes;
+    pDst->allocatedBytes += pSrc->allocatedBytes;
+    pDst->fileCount      += pSrc->fileCount;
+    pDst->directoryCount += pSrc->directoryCount;
+}
+
+mfs_disk_usage_config mfs_disk_usage_config_init(void)
+{
+    mfs_disk_usage_config config;
+
+    MFS_ZERO_OBJECT(&config);
+
+    return config;
+}
+
+mfs_result mfs_disk_usage(const char* pRootPath, const mfs_disk_usage_config* pConfig, mfs_disk_usage_totals* pTotals, mfs_disk_usage_totals* pDepths, size_t depthCount)
+{
+    mfs_result result;
+    mfs_disk_usage_state state;
+    mfs_walk_config walkConfig;
+    mfs_file_info_ex rootInfo;
+    mfs_uint32 iThread;
+    size_t iDepth;
+
+    if (pTotals != NULL) {
+        MFS_ZERO_OBJECT(pTotals);
+    }
+
+    if (pDepths != NULL && depthCount > 0) {
+        MFS_ZERO_MEMORY(pDepths, sizeof(*pDepths) * depthCount);
+    }
+
+    if (pRootPath == NULL || pTotals == NULL || (pDepths == NULL && depthCount > 0)) {
+        return MFS_INVALID_ARGS;
+    }
+
+    MFS_ZERO_OBJECT(&state);
+    if (pConfig != NULL) {
+        state.config = *pConfig;
+    } else {
+        state.config = mfs_disk_usage_config_init();
+    }
+
+    if (state.config.threadCount == 0) {
+        state.config.threadCount = mfs_get_cpu_count();
+    }
+
+    if ((state.config.flags & MFS_DISK_USAGE_FLAG_ONE_FILE_SYSTEM) != 0) {
+        result = mfs_get_file_info_ex((pRootPath[0] != '\0') ? pRootPath : ".", MFS_FILE_INFO_FIELD_INODE, &rootInfo);
+        if (result != MFS_SUCCESS) {
+            return result;
+        }
+
+        state.rootDevice = rootInfo.device;
+    }
+
+    /* Thread indices are always less than the thread count passed to mfs_walk_parallel(). */
+    state.depthCount = depthCount;
+    state.pThreads   = (mfs_disk_usage_thread*)MFS_MALLOC(sizeof(*state.pThreads) * state.config.threadCount + sizeof(*state.pThreadDepths) * state.config.threadCount * depthCount);
+    if (state.pThreads == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+    MFS_ZERO_MEMORY(state.pThreads, sizeof(*state.pThreads) * state.config.threadCount + sizeof(*state.pThreadDepths) * state.config.threadCount * depthCount);
+
+    state.pThreadDepths = (mfs_disk_usage_totals*)(state.pThreads + state.config.threadCount);
+
+    mfs_mutex_init(&state.lock);
+
+    walkConfig = mfs_walk_config_init();
+    walkConfig.threadCount = state.config.threadCount;
+    walkConfig.pExclude    = state.config.pExclude;
+    walkConfig.onError     = mfs_disk_usage_on_error;
+
+    result = mfs_walk_parallel(pRootPath, &walkConfig, mfs_disk_usage_on_entry, &state);
+    if (result == MFS_CANCELLED) {
+        result = state.result;  /* The only reason for stopping early. */
+    }
+
+    for (iThread = 0; iThread < state.config.threadCount; iThread += 1) {
+        mfs_disk_usage_add(pTotals, &state.pThreads[iThread].totals);
+
+        for (iDepth = 0; iDepth < depthCount; iDepth += 1) {
+            mfs_disk_usage_add(&pDepths[iDepth], &state.pThreadDepths[(iThread * depthCount) + iDepth]);
+        }
+    }
+
+    mfs_mutex_uninit(&state.lock);
+    MFS_FREE(state.pFileIDs);
+    MFS_FREE(state.pThreads);
+
+    return result;
+}
+
+
+
+/* Searching */
+#define MFS_SEARCH_MAX_REPEAT           100
+#define MFS_SEARCH_MAX_NESTING          256
+#define MFS_SEARCH_MAX_PROGRAM_SIZE     65536
+#define MFS_SEARCH_BUFFER_SIZE          262144
+#define MFS_SEARCH_MAX_BUFFER_SIZE      67108864    /* Files with a line longer than this are skipped. */
+#define MFS_SEARCH_MMAP_THRESHOLD       4194304
+#define MFS_SEARCH_BINARY_CHECK_SIZE    8192
+
+/* Regular expressions are parsed into a tree, which is then compiled into a program for a Pike VM. */
+#define MFS_REGEX_NODE_EMPTY    0
+#define MFS_REGEX_NODE_CHAR     1   /* a is the character. */
+#define MFS_REGEX_NODE_ANY      2
+#define MFS_REGEX_NODE_CLASS    3   /* a is the index of the class. */
+#define MFS_REGEX_NODE_BOL      4
+#define MFS_REGEX_NODE_EOL      5
+#define MFS_REGEX_NODE_CAT      6   /* a and b are the children. */
+#define MFS_REGEX_NODE_ALT      7   /* a and b are the children. */
+#define MFS_REGEX_NODE_REPEAT   8   /* a is the child, repeated between min and max times. */
+
+#define MFS_REGEX_OP_CHAR       0   /* x is the character. */
+#define MFS_REGEX_OP_ANY        1
+#define MFS_REGEX_OP_CLASS      2   /* x is the index of the class. */
+#define MFS_REGEX_OP_SPLIT      3   /* Continue at both x and y. */
+#define MFS_REGEX_OP_JMP        4   /* Continue at x. */
+#define MFS_REGEX_OP_BOL        5
+#define MFS_REGEX_OP_EOL        6
+#define MFS_REGEX_OP_MATCH      7
+
+#define MFS_REGEX_UNBOUNDED     0xFFFFFFFF
+
+typedef struct
+{
+    mfs_uint32 type;
+    mfs_uint32 a;
+    mfs_uint32 b;
+    mfs_uint32 min;
+    mfs_uint32 max;
+} mfs_regex_node;
+
+typedef struct
+{
+    mfs_uint32 op;
+    mfs_uint32 x;
+    mfs_uint32 y;
+} mfs_regex_inst;
+
+typedef struct
+{
+    mfs_uint8 bits[32];
+} mfs_regex_class;
+
+typedef struct
+{
+    mfs_regex_inst* pProgram;
+    mfs_uint32 programSize;
+    mfs_uint32 programCap;
+    mfs_regex_class* pClasses;
+    mfs_uint32 classCount;
+    mfs_uint32 classCap;
+    mfs_bool32 isCaseInsensitive;
+} mfs_regex;
+
+typedef struct
+{
+    mfs_regex* pRegex;
+    const char* pPattern;
+    size_t cursor;
+    mfs_regex_node* pNodes;
+    mfs_uint32 nodeCount;
+    mfs_uint32 nodeCap;
+    mfs_uint32 depth;
+    mfs_result result;
+} mfs_regex_parser;
+
+static char mfs_regex_fold(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+static mfs_uint32 mfs_regex_add_node(mfs_regex_parser* pParser, mfs_uint32 type, mfs_uint32 a, mfs_uint32 b)
+{
+    mfs_regex_node* pNode;
+
+    if (pParser->nodeCount == pParser->nodeCap) {
+        mfs_uint32 newCap = (pParser->nodeCap > 0) ? pParser->nodeCap * 2 : 64;
+        mfs_regex_node* pNewNodes = (mfs_regex_node*)MFS_REALLOC(pParser->pNodes, sizeof(*pNewNodes) * newCap);
+        if (pNewNodes == NULL) {
+            pParser->result = MFS_OUT_OF_MEMORY;
+            return 0;
+        }
+
+        pParser->pNodes  = pNewNodes;
+        pParser->nodeCap = newCap;
+    }
+
+    pNode = &pParser->pNodes[pParser->nodeCount];
+    pNode->type = type;
+    pNode->a    = a;
+    pNode->b    = b;
+    pNode->min  = 0;
+    pNode->max  = 0;
+
+    pParser->nodeCount += 1;
+    return pParser->nodeCount - 1;
+}
+
+static mfs_uint32 mfs_regex_add_class(mfs_regex_parser* pParser, const mfs_regex_class* pClass)
+{
+    mfs_regex* pRegex = pParser->pRegex;
+
+    if (pRegex->classCount == pRegex->classCap) {
+        mfs_uint32 newCap = (pRegex->classCap > 0) ? pRegex->classCap * 2 : 8;
+        mfs_regex_class* pNewClasses = (mfs_regex_class*)MFS_REALLOC(pRegex->pClasses, sizeof(*pNewClasses) * newCap);
+        if (pNewClasses == NULL) {
+            pParser->result = MFS_OUT_OF_MEMORY;
+            return 0;
+        }
+
+        pRegex->pClasses = pNewClasses;
+        pRegex->classCap = newCap;
+    }
+
+    pRegex->pClasses[pRegex->classCount] = *pClass;
+    pRegex->classCount += 1;
+
+    return pRegex->classCount - 1;
+}
+
+static void mfs_regex_class_set(mfs_regex_class* pClass, mfs_uint8 c)
+{
+    pClass->bits[c >> 3] |= (mfs_uint8)(1 << (c & 7));
+}
+
+static mfs_bool32 mfs_regex_class_test(const mfs_regex_class* pClass, mfs_uint8 c)
+{
+    return (pClass->bits[c >> 3] & (1 << (c & 7))) != 0;
+}
+
+static mfs_bool32 mfs_regex_shorthand_class(char c, mfs_regex_class* pClass)
+{
+    /* Adds the characters of \d, \w or \s to the class. The upper case versions are the inverse. */
+    mfs_regex_class set;
+    int i;
+
+    MFS_ZERO_OBJECT(&set);
+
+    switch (c)
+    {
+        case 'd': case 'D':
+        {
+            for (i = '0'; i <= '9'; i += 1) {
+                mfs_regex_class_set(&set, (mfs_uint8)i);
+            }
+        } break;
+
+        case 'w': case 'W':
+        {
+            for (i = 0; i < 256; i += 1) {
+                if ((i >= 'a' && i <= 'z') || (i >= 'A' && i <= 'Z') || (i >= '0' && i <= '9') || i == '_') {
+                    mfs_regex_class_set(&set, (mfs_uint8)i);
+                }
+            }
+        } break;
+
+        case 's': case 'S':
+        {
+            mfs_regex_class_set(&set, ' ');
+            mfs_regex_class_set(&set, '\t');
+            mfs_regex_class_set(&set, '\n');
+            mfs_regex_class_set(&set, '\r');
+            mfs_regex_class_set(&set, '\v');
+            mfs_regex_class_set(&set, '\f');
+        } break;
+
+        default: return MFS_FALSE;
+    }
+
+    for (i = 0; i < 32; i += 1) {
+        pClass->bits[i] |= (c >= 'A' && c <= 'Z') ? (mfs_uint8)~set.bits[i] : set.bits[i];
+    }
+
+    return MFS_TRUE;
+}
+
+static char mfs_regex_escape(char c)
+{
+    switch (c)
+    {
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        default:  return c;
+    }
+}
+
+static mfs_uint32 mfs_regex_parse_class(mfs_regex_parser* pParser)
+{
+    /* The opening bracket has already been consumed. */
+    const char* pPattern = pParser->pPattern;
+    mfs_regex_class set;
+    mfs_bool32 isNegated = MFS_FALSE;
+    mfs_bool32 isFirst = MFS_TRUE;
+    int i;
+
+    MFS_ZERO_OBJECT(&set);
+
+    if (pPattern[pParser->cursor] == '^') {
+        isNegated = MFS_TRUE;
+        pParser->cursor += 1;
+    }
+
+    /* A closing bracket straight after the opening one is a literal. */
+    while (pPattern[pParser->cursor] != ']' || isFirst) {
+        char lo = pPattern[pParser->cursor];
+        char hi;
+
+        isFirst = MFS_FALSE;
+
+        if (lo == '\0') {
+            pParser->result = MFS_INVALID_ARGS;
+            return 0;
+        }
+
+        pParser->cursor += 1;
+
+        if (lo == '\\') {
+            lo = pPattern[pParser->cursor];
+            if (lo == '\0') {
+                pParser->result = MFS_INVALID_ARGS;
+                return 0;
+            }
+
+            pParser->cursor += 1;
+            if (mfs_regex_shorthand_class(lo, &set)) {
+                continue;
+            }
+
+            lo = mfs_regex_escape(lo);
+        }
+
+        hi = lo;
+        if (pPattern[pParser->cursor] == '-' && pPattern[pParser->cursor + 1] != ']' && pPattern[pParser->cursor + 1] != '\0') {
+            hi = pPattern[pParser->cursor + 1];
+            pParser->cursor += 2;
+
+            if (hi == '\\') {
+                hi = mfs_regex_escape(pPattern[pParser->cursor]);
+                if (hi == '\0') {
+                    pParser->result = MFS_INVALID_ARGS;
+                    return 0;
+                }
+                pParser->cursor += 1;
+            }
+
+            if ((mfs_uint8)hi < (mfs_uint8)lo) {
+                pParser->result = MFS_INVALID_ARGS;
+                return 0;
+            }
+        }
+
+        for (i = (mfs_uint8)lo; i <= (mfs_uint8)hi; i += 1) {
+            mfs_regex_class_set(&set, (mfs_uint8)i);
+        }
+    }
+
+    pParser->cursor += 1;   /* The closing bracket. */
+
+    if (pParser->pRegex->isCaseInsensitive) {
+        for (i = 'a'; i <= 'z'; i += 1) {
+            if (mfs_regex_class_test(&set, (mfs_uint8)i) || mfs_regex_class_test(&set, (mfs_uint8)(i - 'a' + 'A'))) {
+                mfs_regex_class_set(&set, (mfs_uint8)i);
+                mfs_regex_class_set(&set, (mfs_uint8)(i - 'a' + 'A'));
+            }
+        }
+    }
+
+    if (isNegated) {
+        for (i = 0; i < 32; i += 1) {
+            set.bits[i] = (mfs_uint8)~set.bits[i];
+        }
     }
+
+    return mfs_regex_add_node(pParser, MFS_REGEX_NODE_CLASS, mfs_regex_add_class(pParser, &set), 0);
 }
 
+static mfs_uint32 mfs_regex_parse_alt(mfs_regex_parser* pParser);
 
-/*
-Return Values:
-  0:  Success
-  22: EINVAL
-  34: ERANGE
+static mfs_uint32 mfs_regex_parse_atom(mfs_regex_parser* pParser)
+{
+    char c = pParser->pPattern[pParser->cursor];
+    mfs_uint32 node;
 
-Not using symbolic constants for errors because I want to avoid #including errno.h
-*/
-int mfs_strcpy_s(char* dst, size_t dstSizeInBytes, const char* src)
+    pParser->cursor += 1;
+
+    switch (c)
+    {
+        case '(':
+        {
+            if (pParser->depth == MFS_SEARCH_MAX_NESTING) {
+                pParser->result = MFS_INVALID_ARGS;
+                return 0;
+            }
+
+            pParser->depth += 1;
+            node = mfs_regex_parse_alt(pParser);
+            pParser->depth -= 1;
+
+            if (pParser->pPattern[pParser->cursor] != ')') {
+                pParser->result = MFS_INVALID_ARGS;
+                return 0;
+            }
+
+            pParser->cursor += 1;
+            return node;
+        }
+
+        case '[': return mfs_regex_parse_class(pParser);
+        case '.': return mfs_regex_add_node(pParser, MFS_REGEX_NODE_ANY, 0, 0);
+        case '^': return mfs_regex_add_node(pParser, MFS_REGEX_NODE_BOL, 0, 0);
+        case '$': return mfs_regex_add_node(pParser, MFS_REGEX_NODE_EOL, 0, 0);
+
+        case '*':
+        case '+':
+        case '?':
+        {
+            pParser->result = MFS_INVALID_ARGS;   /* Nothing to repeat. */
+            return 0;
+        }
+
+        case '\\':
+        {
+            mfs_regex_class set;
+
+            c = pParser->pPattern[pParser->cursor];
+            if (c == '\0') {
+                pParser->result = MFS_INVALID_ARGS;
+                return 0;
+            }
+
+            pParser->cursor += 1;
+
+            MFS_ZERO_OBJECT(&set);
+            if (mfs_regex_shorthand_class(c, &set)) {
+                return mfs_regex_add_node(pParser, MFS_REGEX_NODE_CLASS, mfs_regex_add_class(pParser, &set), 0);
+            }
+
+            return mfs_regex_add_node(pParser, MFS_REGEX_NODE_CHAR, (mfs_uint8)mfs_regex_escape(c), 0);
+        }
+
+        default: return mfs_regex_add_node(pParser, MFS_REGEX_NODE_CHAR, (mfs_uint8)c, 0);
+    }
+}
+
+static mfs_bool32 mfs_regex_parse_count(mfs_regex_parser* pParser, mfs_uint32* pMin, mfs_uint32* pMax)
 {
-    size_t i;
+    /* Returns false if what follows isn't a valid count, in which case the brace is treated as a literal. */
+    const char* pPattern = pParser->pPattern;
+    size_t cursor = pParser->cursor + 1;
+    mfs_uint32 min = 0;
+    mfs_uint32 max;
 
-    if (dst == 0) {
-        return 22;
+    if (pPattern[cursor] < '0' || pPattern[cursor] > '9') {
+        return MFS_FALSE;
     }
-    if (dstSizeInBytes == 0) {
-        return 34;
+
+    while (pPattern[cursor] >= '0' && pPattern[cursor] <= '9') {
+        min = min * 10 + (mfs_uint32)(pPattern[cursor] - '0');
+        if (min > MFS_SEARCH_MAX_REPEAT) {
+            return MFS_FALSE;
+        }
+        cursor += 1;
     }
-    if (src == 0) {
-        dst[0] = '\0';
-        return 22;
+
+    max = min;
+    if (pPattern[cursor] == ',') {
+        cursor += 1;
+
+        if (pPattern[cursor] == '}') {
+            max = MFS_REGEX_UNBOUNDED;
+        } else {
+            max = 0;
+            while (pPattern[cursor] >= '0' && pPattern[cursor] <= '9') {
+                max = max * 10 + (mfs_uint32)(pPattern[cursor] - '0');
+                if (max > MFS_SEARCH_MAX_REPEAT) {
+                    return MFS_FALSE;
+                }
+                cursor += 1;
+            }
+
+            if (max < min) {
+                return MFS_FALSE;
+            }
+        }
     }
 
-    for (i = 0; i < dstSizeInBytes && src[i] != '\0'; ++i) {
-        dst[i] = src[i];
+    if (pPattern[cursor] != '}') {
+        return MFS_FALSE;
     }
 
-    if (i < dstSizeInBytes) {
-        dst[i] = '\0';
+    pParser->cursor = cursor + 1;
+    *pMin = min;
+    *pMax = max;
+
+    return MFS_TRUE;
+}
+
+static mfs_uint32 mfs_regex_parse_repeat(mfs_regex_parser* pParser)
+{
+    mfs_uint32 node = mfs_regex_parse_atom(pParser);
+
+    while (pParser->result == MFS_SUCCESS) {
+        char c = pParser->pPattern[pParser->cursor];
+        mfs_uint32 min;
+        mfs_uint32 max;
+
+        if (c == '*') {
+            min = 0;
+            max = MFS_REGEX_UNBOUNDED;
+            pParser->cursor += 1;
+        } else if (c == '+') {
+            min = 1;
+            max = MFS_REGEX_UNBOUNDED;
+            pParser->cursor += 1;
+        } else if (c == '?') {
+            min = 0;
+            max = 1;
+            pParser->cursor += 1;
+        } else if (c == '{' && mfs_regex_parse_count(pParser, &min, &max)) {
+            /* The count has been consumed. */
+        } else {
+            break;
+        }
+
+        node = mfs_regex_add_node(pParser, MFS_REGEX_NODE_REPEAT, node, 0);
+        if (pParser->result == MFS_SUCCESS) {
+            pParser->pNodes[node].min = min;
+            pParser->pNodes[node].max = max;
+        }
+    }
+
+    return node;
+}
+
+static mfs_uint32 mfs_regex_parse_cat(mfs_regex_parser* pParser)
+{
+    mfs_uint32 node = 0;
+    mfs_bool32 isEmpty = MFS_TRUE;
+
+    while (pParser->result == MFS_SUCCESS) {
+        char c = pParser->pPattern[pParser->cursor];
+        mfs_uint32 item;
+
+        if (c == '\0' || c == '|' || c == ')') {
+            break;
+        }
+
+        item = mfs_regex_parse_repeat(pParser);
+        if (isEmpty) {
+            node = item;
+            isEmpty = MFS_FALSE;
+        } else {
+            node = mfs_regex_add_node(pParser, MFS_REGEX_NODE_CAT, node, item);
+        }
+    }
+
+    if (isEmpty) {
+        node = mfs_regex_add_node(pParser, MFS_REGEX_NODE_EMPTY, 0, 0);
+    }
+
+    return node;
+}
+
+static mfs_uint32 mfs_regex_parse_alt(mfs_regex_parser* pParser)
+{
+    mfs_uint32 node = mfs_regex_parse_cat(pParser);
+
+    while (pParser->result == MFS_SUCCESS && pParser->pPattern[pParser->cursor] == '|') {
+        mfs_uint32 right;
+
+        pParser->cursor += 1;
+        right = mfs_regex_parse_cat(pParser);
+        node  = mfs_regex_add_node(pParser, MFS_REGEX_NODE_ALT, node, right);
+    }
+
+    return node;
+}
+
+static mfs_uint32 mfs_regex_emit(mfs_regex* pRegex, mfs_uint32 op, mfs_uint32 x, mfs_uint32 y, mfs_result* pResult)
+{
+    mfs_regex_inst* pInst;
+
+    if (*pResult != MFS_SUCCESS) {
         return 0;
     }
 
-    dst[0] = '\0';
-    return 34;
+    if (pRegex->programSize == pRegex->programCap) {
+        mfs_uint32 newCap = (pRegex->programCap > 0) ? pRegex->programCap * 2 : 64;
+        mfs_regex_inst* pNewProgram;
+
+        if (pRegex->programSize >= MFS_SEARCH_MAX_PROGRAM_SIZE) {
+            *pResult = MFS_TOO_BIG;
+            return 0;
+        }
+
+        pNewProgram = (mfs_regex_inst*)MFS_REALLOC(pRegex->pProgram, sizeof(*pNewProgram) * newCap);
+        if (pNewProgram == NULL) {
+            *pResult = MFS_OUT_OF_MEMORY;
+            return 0;
+        }
+
+        pRegex->pProgram   = pNewProgram;
+        pRegex->programCap = newCap;
+    }
+
+    pInst = &pRegex->pProgram[pRegex->programSize];
+    pInst->op = op;
+    pInst->x  = x;
+    pInst->y  = y;
+
+    pRegex->programSize += 1;
+    return pRegex->programSize - 1;
 }
 
-int mfs_strncpy_s(char* dst, size_t dstSizeInBytes, const char* src, size_t count)
+static void mfs_regex_compile_node(mfs_regex* pRegex, const mfs_regex_node* pNodes, mfs_uint32 node, mfs_result* pResult)
 {
-    size_t maxcount;
-    size_t i;
+    const mfs_regex_node* pNode = &pNodes[node];
+    mfs_uint32 split;
+    mfs_uint32 jmp;
+    mfs_uint32 i;
 
-    if (dst == 0) {
-        return 22;
+    if (*pResult != MFS_SUCCESS) {
+        return;
     }
-    if (dstSizeInBytes == 0) {
-        return 34;
+
+    switch (pNode->type)
+    {
+        case MFS_REGEX_NODE_EMPTY: break;
+        case MFS_REGEX_NODE_CHAR:  mfs_regex_emit(pRegex, MFS_REGEX_OP_CHAR,  pNode->a, 0, pResult); break;
+        case MFS_REGEX_NODE_ANY:   mfs_regex_emit(pRegex, MFS_REGEX_OP_ANY,   0, 0, pResult); break;
+        case MFS_REGEX_NODE_CLASS: mfs_regex_emit(pRegex, MFS_REGEX_OP_CLASS, pNode->a, 0, pResult); break;
+        case MFS_REGEX_NODE_BOL:   mfs_regex_emit(pRegex, MFS_REGEX_OP_BOL,   0, 0, pResult); break;
+        case MFS_REGEX_NODE_EOL:   mfs_regex_emit(pRegex, MFS_REGEX_OP_EOL,   0, 0, pResult); break;
+
+        case MFS_REGEX_NODE_CAT:
+        {
+            mfs_regex_compile_node(pRegex, pNodes, pNode->a, pResult);
+            mfs_regex_compile_node(pRegex, pNodes, pNode->b, pResult);
+        } break;
+
+        case MFS_REGEX_NODE_ALT:
+        {
+            split = mfs_regex_emit(pRegex, MFS_REGEX_OP_SPLIT, 0, 0, pResult);
+            mfs_regex_compile_node(pRegex, pNodes, pNode->a, pResult);
+            jmp = mfs_regex_emit(pRegex, MFS_REGEX_OP_JMP, 0, 0, pResult);
+            mfs_regex_compile_node(pRegex, pNodes, pNode->b, pResult);
+
+            if (*pResult == MFS_SUCCESS) {
+                pRegex->pProgram[split].x = split + 1;
+                pRegex->pProgram[split].y = jmp + 1;
+                pRegex->pProgram[jmp].x   = pRegex->programSize;
+            }
+        } break;
+
+        case MFS_REGEX_NODE_REPEAT:
+        {
+            /* The required copies come first, followed by a loop for an unbounded repeat or optional copies for a bounded one. */
+            for (i = 0; i < pNode->min; i += 1) {
+                mfs_regex_compile_node(pRegex, pNodes, pNode->a, pResult);
+            }
+
+            if (pNode->max == MFS_REGEX_UNBOUNDED) {
+                split = mfs_regex_emit(pRegex, MFS_REGEX_OP_SPLIT, 0, 0, pResult);
+                mfs_regex_compile_node(pRegex, pNodes, pNode->a, pResult);
+                jmp = mfs_regex_emit(pRegex, MFS_REGEX_OP_JMP, split, 0, pResult);
+
+                if (*pResult == MFS_SUCCESS) {
+                    pRegex->pProgram[split].x = split + 1;
+                    pRegex->pProgram[split].y = jmp + 1;
+                }
+            } else {
+                for (i = pNode->min; i < pNode->max; i += 1) {
+                    split = mfs_regex_emit(pRegex, MFS_REGEX_OP_SPLIT, 0, 0, pResult);
+                    mfs_regex_compile_node(pRegex, pNodes, pNode->a, pResult);
+
+                    if (*pResult == MFS_SUCCESS) {
+                        pRegex->pProgram[split].x = split + 1;
+                        pRegex->pProgram[split].y = pRegex->programSize;
+                    }
+                }
+            }
+        } break;
+
+        default: break;
     }
-    if (src == 0) {
-        dst[0] = '\0';
-        return 22;
+}
+
+static void mfs_regex_flatten(const mfs_regex_node* pNodes, mfs_uint32 node, mfs_uint32* pItems, mfs_uint32* pItemCount)
+{
+    /* Flattens the top level concatenation into a list of items, in order. pItems has room for every node. */
+    if (pNodes[node].type == MFS_REGEX_NODE_CAT) {
+        mfs_regex_flatten(pNodes, pNodes[node].a, pItems, pItemCount);
+        mfs_regex_flatten(pNodes, pNodes[node].b, pItems, pItemCount);
+    } else {
+        pItems[*pItemCount] = node;
+        *pItemCount += 1;
     }
+}
 
-    maxcount = count;
-    if (count == ((size_t)-1) || count >= dstSizeInBytes) {        /* -1 = _TRUNCATE */
-        maxcount = dstSizeInBytes - 1;
+static mfs_result mfs_regex_compile(const char* pPattern, mfs_bool32 isCaseInsensitive, mfs_regex* pRegex, char** ppLiteral, size_t* pLiteralLength, mfs_bool32* pIsLiteralOnly)
+{
+    /*
+    Along with the program, this extracts the longest run of plain characters that must appear in every match so that lines can be
+    filtered with memchr() before running the program. If that run is the whole pattern, the program doesn't need to be run at all.
+    */
+    mfs_regex_parser parser;
+    mfs_uint32 root;
+    mfs_uint32* pItems;
+    mfs_uint32 itemCount = 0;
+    mfs_uint32 iItem;
+    mfs_uint32 bestStart = 0;
+    mfs_uint32 bestLength = 0;
+    mfs_uint32 runStart = 0;
+    mfs_uint32 runLength = 0;
+    mfs_result result = MFS_SUCCESS;
+
+    MFS_ZERO_OBJECT(pRegex);
+    pRegex->isCaseInsensitive = isCaseInsensitive;
+
+    *ppLiteral      = NULL;
+    *pLiteralLength = 0;
+    *pIsLiteralOnly = MFS_FALSE;
+
+    MFS_ZERO_OBJECT(&parser);
+    parser.pRegex   = pRegex;
+    parser.pPattern = pPattern;
+
+    root = mfs_regex_parse_alt(&parser);
+    if (parser.result == MFS_SUCCESS && pPattern[parser.cursor] != '\0') {
+        parser.result = MFS_INVALID_ARGS;    /* An unmatched closing parenthesis. */
+    }
+
+    if (parser.result != MFS_SUCCESS) {
+        MFS_FREE(parser.pNodes);
+        MFS_FREE(pRegex->pClasses);
+        MFS_ZERO_OBJECT(pRegex);
+        return parser.result;
+    }
+
+    mfs_regex_compile_node(pRegex, parser.pNodes, root, &result);
+    mfs_regex_emit(pRegex, MFS_REGEX_OP_MATCH, 0, 0, &result);
+
+    pItems = (mfs_uint32*)MFS_MALLOC(sizeof(*pItems) * parser.nodeCount);
+    if (pItems == NULL && result == MFS_SUCCESS) {
+        result = MFS_OUT_OF_MEMORY;
+    }
+
+    if (result != MFS_SUCCESS) {
+        MFS_FREE(pItems);
+        MFS_FREE(parser.pNodes);
+        MFS_FREE(pRegex->pProgram);
+        MFS_FREE(pRegex->pClasses);
+        MFS_ZERO_OBJECT(pRegex);
+        return result;
+    }
+
+    mfs_regex_flatten(parser.pNodes, root, pItems, &itemCount);
+
+    for (iItem = 0; iItem <= itemCount; iItem += 1) {
+        if (iItem < itemCount && parser.pNodes[pItems[iItem]].type == MFS_REGEX_NODE_CHAR && parser.pNodes[pItems[iItem]].a != '\n') {
+            if (runLength == 0) {
+                runStart = iItem;
+            }
+            runLength += 1;
+        } else {
+            if (runLength > bestLength) {
+                bestStart  = runStart;
+                bestLength = runLength;
+            }
+            runLength = 0;
+        }
+    }
+
+    if (bestLength > 0) {
+        *ppLiteral = (char*)MFS_MALLOC(bestLength);
+        if (*ppLiteral == NULL) {
+            MFS_FREE(pItems);
+            MFS_FREE(parser.pNodes);
+            MFS_FREE(pRegex->pProgram);
+            MFS_FREE(pRegex->pClasses);
+            MFS_ZERO_OBJECT(pRegex);
+            return MFS_OUT_OF_MEMORY;
+        }
+
+        for (iItem = 0; iItem < bestLength; iItem += 1) {
+            (*ppLiteral)[iItem] = (char)parser.pNodes[pItems[bestStart + iItem]].a;
+        }
+
+        *pLiteralLength = bestLength;
+        *pIsLiteralOnly = (bestLength == itemCount);
+    }
+
+    MFS_FREE(pItems);
+    MFS_FREE(parser.pNodes);
+
+    return MFS_SUCCESS;
+}
+
+static void mfs_regex_uninit(mfs_regex* pRegex)
+{
+    MFS_FREE(pRegex->pProgram);
+    MFS_FREE(pRegex->pClasses);
+    MFS_ZERO_OBJECT(pRegex);
+}
+
+typedef struct
+{
+    mfs_uint32* pPCs;
+    size_t* pStarts;
+    mfs_uint32 count;
+} mfs_regex_thread_list;
+
+typedef struct
+{
+    mfs_regex_thread_list lists[2];
+    mfs_uint32* pMarks;     /* The generation each instruction was last added to a list in. */
+    mfs_uint32 generation;
+    mfs_uint32* pStack;
+} mfs_regex_vm;
+
+static mfs_result mfs_regex_vm_init(const mfs_regex* pRegex, mfs_regex_vm* pVM)
+{
+    size_t size = pRegex->programSize;
+
+    MFS_ZERO_OBJECT(pVM);
+
+    /* Each instruction can be in a list once per step, and each can push at most two more onto the stack. */
+    pVM->lists[0].pPCs    = (mfs_uint32*)MFS_MALLOC(sizeof(mfs_uint32) * size * 6 + sizeof(size_t) * size * 2);
+    if (pVM->lists[0].pPCs == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    pVM->lists[1].pPCs    = pVM->lists[0].pPCs + size;
+    pVM->pMarks           = pVM->lists[1].pPCs + size;
+    pVM->pStack           = pVM->pMarks + size;
+    pVM->lists[0].pStarts = (size_t*)(pVM->pStack + size * 3);
+    pVM->lists[1].pStarts = pVM->lists[0].pStarts + size;
+
+    MFS_ZERO_MEMORY(pVM->pMarks, sizeof(*pVM->pMarks) * size);
+
+    return MFS_SUCCESS;
+}
+
+static void mfs_regex_vm_uninit(mfs_regex_vm* pVM)
+{
+    MFS_FREE(pVM->lists[0].pPCs);
+    MFS_ZERO_OBJECT(pVM);
+}
+
+static void mfs_regex_vm_add(const mfs_regex* pRegex, mfs_regex_vm* pVM, mfs_regex_thread_list* pList, mfs_uint32 pc, size_t start, size_t pos, size_t lineLength)
+{
+    mfs_uint32 stackSize = 0;
+
+    pVM->pStack[stackSize++] = pc;
+
+    while (stackSize > 0) {
+        const mfs_regex_inst* pInst;
+
+        pc = pVM->pStack[--stackSize];
+        if (pVM->pMarks[pc] == pVM->generation) {
+            continue;
+        }
+
+        pVM->pMarks[pc] = pVM->generation;
+        pInst = &pRegex->pProgram[pc];
+
+        switch (pInst->op)
+        {
+            case MFS_REGEX_OP_JMP:
+            {
+                pVM->pStack[stackSize++] = pInst->x;
+            } break;
+
+            case MFS_REGEX_OP_SPLIT:
+            {
+                pVM->pStack[stackSize++] = pInst->y;
+                pVM->pStack[stackSize++] = pInst->x;
+            } break;
+
+            case MFS_REGEX_OP_BOL:
+            {
+                if (pos == 0) {
+                    pVM->pStack[stackSize++] = pc + 1;
+                }
+            } break;
+
+            case MFS_REGEX_OP_EOL:
+            {
+                if (pos == lineLength) {
+                    pVM->pStack[stackSize++] = pc + 1;
+                }
+            } break;
+
+            default:
+            {
+                pList->pPCs[pList->count]    = pc;
+                pList->pStarts[pList->count] = start;
+                pList->count += 1;
+            } break;
+        }
+    }
+}
+
+static void mfs_regex_vm_next_generation(mfs_regex_vm* pVM, size_t programSize)
+{
+    pVM->generation += 1;
+    if (pVM->generation == 0) {
+        MFS_ZERO_MEMORY(pVM->pMarks, sizeof(*pVM->pMarks) * programSize);
+        pVM->generation = 1;
     }
+}
+
+static mfs_bool32 mfs_regex_match(const mfs_regex* pRegex, mfs_regex_vm* pVM, const char* pLine, size_t lineLength, size_t* pMatchOffset, size_t* pMatchLength)
+{
+    mfs_regex_thread_list* pCurrent = &pVM->lists[0];
+    mfs_regex_thread_list* pNext    = &pVM->lists[1];
+    mfs_bool32 hasMatch = MFS_FALSE;
+    size_t bestStart = 0;
+    size_t bestEnd = 0;
+    size_t pos;
+
+    /*
+    Threads are kept in order of where their match started, so the first thread to reach an instruction is the one that started
+    furthest left, and later ones can be dropped. Once something matches, no more threads are started, and threads that started
+    later than the match are ignored.
+    */
+    pCurrent->count = 0;
+    mfs_regex_vm_next_generation(pVM, pRegex->programSize);
+    mfs_regex_vm_add(pRegex, pVM, pCurrent, 0, 0, 0, lineLength);
+
+    for (pos = 0; pos <= lineLength; pos += 1) {
+        mfs_uint32 iThread;
+
+        pNext->count = 0;
+        mfs_regex_vm_next_generation(pVM, pRegex->programSize);
+
+        for (iThread = 0; iThread < pCurrent->count; iThread += 1) {
+            const mfs_regex_inst* pInst = &pRegex->pProgram[pCurrent->pPCs[iThread]];
+            size_t start = pCurrent->pStarts[iThread];
+            mfs_bool32 isMatch = MFS_FALSE;
+
+            if (hasMatch && start > bestStart) {
+                break;
+            }
+
+            if (pInst->op == MFS_REGEX_OP_MATCH) {
+                if (hasMatch == MFS_FALSE || start < bestStart || (start == bestStart && pos > bestEnd)) {
+                    hasMatch  = MFS_TRUE;
+                    bestStart = start;
+                    bestEnd   = pos;
+                }
+
+                continue;
+            }
+
+            if (pos == lineLength) {
+                continue;
+            }
+
+            switch (pInst->op)
+            {
+                case MFS_REGEX_OP_CHAR:
+                {
+                    if (pRegex->isCaseInsensitive) {
+                        isMatch = mfs_regex_fold(pLine[pos]) == mfs_regex_fold((char)pInst->x);
+                    } else {
+                        isMatch = (mfs_uint8)pLine[pos] == pInst->x;
+                    }
+                } break;
+
+                case MFS_REGEX_OP_ANY:   isMatch = MFS_TRUE; break;
+                case MFS_REGEX_OP_CLASS: isMatch = mfs_regex_class_test(&pRegex->pClasses[pInst->x], (mfs_uint8)pLine[pos]); break;
+                default: break;
+            }
+
+            if (isMatch) {
+                mfs_regex_vm_add(pRegex, pVM, pNext, pCurrent->pPCs[iThread] + 1, start, pos + 1, lineLength);
+            }
+        }
+
+        if (hasMatch == MFS_FALSE && pos < lineLength) {
+            mfs_regex_vm_add(pRegex, pVM, pNext, 0, pos + 1, pos + 1, lineLength);
+        }
+
+        if (pNext->count == 0 && (hasMatch || pos == lineLength)) {
+            break;
+        }
 
-    for (i = 0; i < maxcount && src[i] != '\0'; ++i) {
-        dst[i] = src[i];
+        {
+            mfs_regex_thread_list* pTemp = pCurrent;
+            pCurrent = pNext;
+            pNext    = pTemp;
+        }
     }
 
-    if (src[i] == '\0' || i == count || count == ((size_t)-1)) {
-        dst[i] = '\0';
-        return 0;
-    }
+    *pMatchOffset = bestStart;
+    *pMatchLength = bestEnd - bestStart;
 
-    dst[0] = '\0';
-    return 34;
+    return hasMatch;
 }
 
-int mfs_strcat_s(char* dst, size_t dstSizeInBytes, const char* src)
+typedef struct mfs_search_state mfs_search_state;
+
+typedef struct
 {
-    char* dstorig;
+    mfs_search_state* pState;
+    char* pBuffer;
+    size_t bufferCap;
+    mfs_regex_vm vm;
+} mfs_search_worker;
 
-    if (dst == 0) {
-        return 22;
-    }
-    if (dstSizeInBytes == 0) {
-        return 34;
-    }
-    if (src == 0) {
-        dst[0] = '\0';
-        return 22;
-    }
+struct mfs_search_state
+{
+    mfs_search_config config;
+    mfs_search_proc onMatch;
+    void* pUserData;
+    mfs_regex regex;
+    char* pLiteral;                 /* Can be NULL, in which case every line is run through the regex. */
+    size_t literalLength;
+    mfs_bool32 isLiteralOnly;       /* When set, finding the literal is a match, and the regex is never run. */
+    mfs_search_worker* pWorkers;
+    mfs_mutex lock;                 /* For everything below, and for onError(). */
+    size_t matchCount;
+    mfs_bool32 isStopped;
+    mfs_result result;
+};
 
-    dstorig = dst;
+typedef struct
+{
+    const char* pPath;
+    mfs_uint32 threadIndex;
+    mfs_uint64 lineNumber;          /* The number of the line at the start of the data being scanned. */
+    size_t matchCount;
+} mfs_search_file;
 
-    while (dstSizeInBytes > 0 && dst[0] != '\0') {
-        dst += 1;
-        dstSizeInBytes -= 1;
-    }
+static void mfs_search_report_error(mfs_search_state* pState, const char* pPath, mfs_result result)
+{
+    mfs_mutex_lock(&pState->lock);
+    {
+        if (pState->result == MFS_SUCCESS) {
+            pState->result = result;
+        }
 
-    if (dstSizeInBytes == 0) {
-        return 22;  /* Unterminated. */
+        if (pState->config.onError != NULL) {
+            pState->config.onError(pState->pUserData, pPath, result);
+        }
     }
+    mfs_mutex_unlock(&pState->lock);
+}
 
+static void mfs_search_on_walk_error(void* pUserData, const char* pPath, mfs_result result)
+{
+    mfs_search_report_error((mfs_search_state*)pUserData, pPath, result);
+}
 
-    while (dstSizeInBytes > 0 && src[0] != '\0') {
-        *dst++ = *src++;
-        dstSizeInBytes -= 1;
-    }
+static mfs_bool32 mfs_search_is_stopped(mfs_search_state* pState)
+{
+    mfs_bool32 isStopped;
 
-    if (dstSizeInBytes > 0) {
-        dst[0] = '\0';
-    } else {
-        dstorig[0] = '\0';
-        return 34;
+    mfs_mutex_lock(&pState->lock);
+    {
+        isStopped = pState->isStopped;
     }
+    mfs_mutex_unlock(&pState->lock);
 
-    return 0;
+    return isStopped;
 }
 
-mfs_bool32 mfs_string_is_null_or_empty(const char* str)
+static size_t mfs_search_find_byte(const char* pData, size_t dataSize, char c, mfs_bool32 isCaseInsensitive)
 {
-    return str == NULL || str[0] == '\0';
-}
+    /* Returns dataSize if the byte isn't found. Letters are searched for in each case separately so memchr() can still be used. */
+    const char* pFound;
 
+    if (isCaseInsensitive && mfs_regex_fold(c) >= 'a' && mfs_regex_fold(c) <= 'z') {
+        const char* pUpper;
+
+        pFound = (const char*)memchr(pData, mfs_regex_fold(c), dataSize);
+        pUpper = (const char*)memchr(pData, mfs_regex_fold(c) - 'a' + 'A', (pFound != NULL) ? (size_t)(pFound - pData) : dataSize);
+        if (pUpper != NULL) {
+            pFound = pUpper;
+        }
+    } else {
+        pFound = (const char*)memchr(pData, c, dataSize);
+    }
 
+    return (pFound != NULL) ? (size_t)(pFound - pData) : dataSize;
+}
 
-mfs_result mfs_fopen(FILE** ppFile, const char* pFilePath, const char* pOpenMode)
+static mfs_bool32 mfs_search_find_literal(const char* pLiteral, size_t literalLength, mfs_bool32 isCaseInsensitive, const char* pData, size_t dataSize, size_t* pOffset)
 {
-#if defined(_MSC_VER) && _MSC_VER >= 1400
-    errno_t err;
-#endif
+    size_t offset = 0;
 
-    if (ppFile != NULL) {
-        *ppFile = NULL;  /* Safety. */
-    }
+    while (offset + literalLength <= dataSize) {
+        size_t i;
 
-    if (pFilePath == NULL || pOpenMode == NULL || ppFile == NULL) {
-        return MFS_INVALID_ARGS;
-    }
+        offset += mfs_search_find_byte(pData + offset, dataSize - literalLength + 1 - offset, pLiteral[0], isCaseInsensitive);
+        if (offset + literalLength > dataSize) {
+            break;
+        }
 
-#if defined(_MSC_VER) && _MSC_VER >= 1400
-    err = fopen_s(ppFile, pFilePath, pOpenMode);
-    if (err != 0) {
-        return mfs_result_from_errno(err);
-    }
-#else
-#if defined(_WIN32) || defined(__APPLE__)
-    *ppFile = fopen(pFilePath, pOpenMode);
-#else
-    #if defined(_FILE_OFFSET_BITS) && _FILE_OFFSET_BITS == 64 && defined(_LARGEFILE64_SOURCE)
-        *ppFile = fopen64(pFilePath, pOpenMode);
-    #else
-        *ppFile = fopen(pFilePath, pOpenMode);
-    #endif
-#endif
-    if (*ppFile == NULL) {
-        mfs_result result = mfs_result_from_errno(errno);
-        if (result == MFS_SUCCESS) {
-            result = MFS_ERROR; /* Just a safety check to make sure we never ever return success when pFile == NULL. */
+        if (isCaseInsensitive) {
+            for (i = 1; i < literalLength; i += 1) {
+                if (mfs_regex_fold(pData[offset + i]) != mfs_regex_fold(pLiteral[i])) {
+                    break;
+                }
+            }
+        } else {
+            i = (memcmp(pData + offset + 1, pLiteral + 1, literalLength - 1) == 0) ? literalLength : 0;
         }
 
-        return result;
+        if (i == literalLength) {
+            *pOffset = offset;
+            return MFS_TRUE;
+        }
+
+        offset += 1;
     }
-#endif
 
-    return MFS_SUCCESS;
+    return MFS_FALSE;
 }
 
-/*
-_wfopen() isn't always available in all compilation environments.
-
-    * Windows only.
-    * MSVC seems to support it universally as far back as VC6 from what I can tell (haven't checked further back).
-    * MinGW-64 (both 32- and 64-bit) seems to support it.
-    * MinGW wraps it in !defined(__STRICT_ANSI__).
-
-This can be reviewed as compatibility issues arise. The preference is to use _wfopen_s() and _wfopen() as opposed to the wcsrtombs()
-fallback, so if you notice your compiler not detecting this properly I'm happy to look at adding support.
-*/
-#if defined(_WIN32)
-    #if defined(_MSC_VER) || defined(__MINGW64__) || !defined(__STRICT_ANSI__)
-        #define MFS_HAS_WFOPEN
-    #endif
-#endif
-
-mfs_result mfs_wfopen(FILE** ppFile, const wchar_t* pFilePath, const wchar_t* pOpenMode)
+static mfs_uint64 mfs_search_count_lines(const char* pData, size_t dataSize)
 {
-#if defined(_MSC_VER) && _MSC_VER >= 1400
-    errno_t err;
-#endif
+    mfs_uint64 count = 0;
+    const char* pEnd = pData + dataSize;
 
-    if (ppFile != NULL) {
-        *ppFile = NULL;  /* Safety. */
-    }
+    for (;;) {
+        pData = (const char*)memchr(pData, '\n', (size_t)(pEnd - pData));
+        if (pData == NULL) {
+            break;
+        }
 
-    if (pFilePath == NULL || pOpenMode == NULL || ppFile == NULL) {
-        return MFS_INVALID_ARGS;
+        count += 1;
+        pData += 1;
     }
 
-#if defined(MFS_HAS_WFOPEN)
-    /* Use _wfopen() on Windows. */
-    #if defined(_MSC_VER) && _MSC_VER >= 1400
-        err = _wfopen_s(ppFile, pFilePath, pOpenMode);
-        if (err != 0) {
-            return mfs_result_from_errno(err);
-        }
-    #else
-        *ppFile = _wfopen(pFilePath, pOpenMode);
-        if (*ppFile == NULL) {
-            return mfs_result_from_errno(errno);
-        }
-    #endif
-#else
+    return count;
+}
+
+static mfs_uint32 mfs_search_scan(mfs_search_worker* pWorker, mfs_search_file* pFile, const char* pData, size_t dataSize, mfs_bool32 isLast, size_t* pConsumed)
+{
     /*
-    Use fopen() on anything other than Windows. Requires a conversion. This is annoying because fopen() is locale specific. The only real way I can
-    think of to do this is with wcsrtombs(). Note that wcstombs() is apparently not thread-safe because it uses a static global mbstate_t object for
-    maintaining state. I've checked this with -std=c89 and it works, but if somebody get's a compiler error I'll look into improving compatibility.
+    Searches every complete line in the data. When this isn't the end of the file, the trailing partial line is left alone, and
+    *pConsumed is set to where it starts so the caller can carry it over into the next chunk.
     */
-    {
-        mbstate_t mbs;
-        size_t lenMB;
-        const wchar_t* pFilePathTemp = pFilePath;
-        char* pFilePathMB = NULL;
-        char pOpenModeMB[32] = {0};
+    mfs_search_state* pState = pWorker->pState;
+    size_t end = dataSize;
+    size_t cursor = 0;      /* Always at the start of a line. */
+    size_t counted = 0;     /* Lines have been counted up to here. */
+
+    if (isLast == MFS_FALSE) {
+        while (end > 0 && pData[end - 1] != '\n') {
+            end -= 1;
+        }
+    }
 
-        /* Get the length first. */
-        MFS_ZERO_OBJECT(&mbs);
-        lenMB = wcsrtombs(NULL, &pFilePathTemp, 0, &mbs);
-        if (lenMB == (size_t)-1) {
-            return mfs_result_from_errno(errno);
+    while (cursor < end) {
+        const char* pLineEnd;
+        size_t lineStart;
+        size_t lineEnd;
+        size_t literalOffset = 0;
+        size_t matchOffset = 0;
+        size_t matchLength = 0;
+        mfs_search_match match;
+        mfs_bool32 isStopped;
+        mfs_bool32 isLimitReached = MFS_FALSE;
+        mfs_uint32 action;
+
+        if (pState->literalLength > 0) {
+            if (mfs_search_find_literal(pState->pLiteral, pState->literalLength, pState->regex.isCaseInsensitive, pData + cursor, end - cursor, &literalOffset) == MFS_FALSE) {
+                break;
+            }
+
+            literalOffset += cursor;
+            lineStart = literalOffset;
+            while (lineStart > cursor && pData[lineStart - 1] != '\n') {
+                lineStart -= 1;
+            }
+        } else {
+            lineStart = cursor;
         }
 
-        pFilePathMB = (char*)MFS_MALLOC(lenMB + 1);
-        if (pFilePathMB == NULL) {
-            return MFS_OUT_OF_MEMORY;
+        pLineEnd = (const char*)memchr(pData + lineStart, '\n', end - lineStart);
+        lineEnd  = (pLineEnd != NULL) ? (size_t)(pLineEnd - pData) : end;
+        cursor   = lineEnd + 1;
+
+        if (pState->isLiteralOnly) {
+            matchOffset = literalOffset - lineStart;
+            matchLength = pState->literalLength;
+        } else {
+            if (mfs_regex_match(&pState->regex, &pWorker->vm, pData + lineStart, lineEnd - lineStart, &matchOffset, &matchLength) == MFS_FALSE) {
+                continue;
+            }
         }
 
-        pFilePathTemp = pFilePath;
-        MFS_ZERO_OBJECT(&mbs);
-        wcsrtombs(pFilePathMB, &pFilePathTemp, lenMB + 1, &mbs);
+        pFile->lineNumber += mfs_search_count_lines(pData + counted, lineStart - counted);
+        counted = lineStart;
 
-        /* The open mode should always consist of ASCII characters so we should be able to do a trivial conversion. */
+        /* The limit on the total is checked before reporting so it's never exceeded, even with many threads. */
+        mfs_mutex_lock(&pState->lock);
         {
-            size_t i = 0;
-            for (;;) {
-                if (pOpenMode[i] == 0) {
-                    pOpenModeMB[i] = '\0';
-                    break;
+            isStopped = pState->isStopped;
+            if (isStopped == MFS_FALSE) {
+                pState->matchCount += 1;
+                if (pState->config.maxMatches > 0 && pState->matchCount >= pState->config.maxMatches) {
+                    pState->isStopped = MFS_TRUE;
+                    isLimitReached = MFS_TRUE;
                 }
+            }
+        }
+        mfs_mutex_unlock(&pState->lock);
 
-                pOpenModeMB[i] = (char)pOpenMode[i];
-                i += 1;
+        if (isStopped) {
+            return MFS_WALK_STOP;
+        }
+
+        match.pPath       = pFile->pPath;
+        match.pLine       = pData + lineStart;
+        match.lineLength  = lineEnd - lineStart;
+        match.lineNumber  = pFile->lineNumber + 1;
+        match.column      = matchOffset + 1;
+        match.matchLength = matchLength;
+        match.threadIndex = pFile->threadIndex;
+
+        if (pState->config.maxLineLength > 0 && match.lineLength > pState->config.maxLineLength) {
+            match.lineLength = pState->config.maxLineLength;
+        }
+
+        action = pState->onMatch(pState->pUserData, &match);
+        if (action == MFS_WALK_STOP) {
+            mfs_mutex_lock(&pState->lock);
+            {
+                pState->isStopped = MFS_TRUE;
             }
+            mfs_mutex_unlock(&pState->lock);
+
+            return MFS_WALK_STOP;
         }
 
-        *ppFile = fopen(pFilePathMB, pOpenModeMB);
+        if (isLimitReached) {
+            return MFS_WALK_STOP;
+        }
 
-        MFS_FREE(pFilePathMB);
-    }
+        if (action == MFS_WALK_SKIP) {
+            return MFS_WALK_SKIP;
+        }
 
-    if (*ppFile == NULL) {
-        return MFS_ERROR;
+        pFile->matchCount += 1;
+        if (pState->config.maxMatchesPerFile > 0 && pFile->matchCount >= pState->config.maxMatchesPerFile) {
+            return MFS_WALK_SKIP;
+        }
     }
-#endif
 
-    return MFS_SUCCESS;
+    pFile->lineNumber += mfs_search_count_lines(pData + counted, end - counted);
+    *pConsumed = end;
+
+    return MFS_WALK_CONTINUE;
 }
 
-mfs_result mfs_fclose(FILE* pFile)
+static mfs_bool32 mfs_search_is_binary(const mfs_search_state* pState, const char* pData, size_t dataSize)
 {
-    int result = fclose(pFile);
-    if (result != 0) {
-        return MFS_ERROR;
+    if ((pState->config.flags & MFS_SEARCH_FLAG_BINARY) != 0) {
+        return MFS_FALSE;
     }
 
-    return MFS_SUCCESS;
+    return memchr(pData, '\0', (dataSize < MFS_SEARCH_BINARY_CHECK_SIZE) ? dataSize : MFS_SEARCH_BINARY_CHECK_SIZE) != NULL;
 }
 
-mfs_result mfs_fread(FILE* pFile, void* pData, size_t sizeInBytes, size_t* pBytesRead)
+static mfs_uint32 mfs_search_file_contents(mfs_search_worker* pWorker, mfs_search_file* pFile)
 {
-    size_t result;
+    mfs_search_state* pState = pWorker->pState;
+    mfs_result result;
+    mfs_uint32 action = MFS_WALK_CONTINUE;
+    size_t carry = 0;
+    mfs_bool32 isFirst = MFS_TRUE;
+    FILE* pStream;
 
-    result = fread(pData, 1, sizeInBytes, pFile);
-    
-    if (pBytesRead != NULL) {
-        *pBytesRead = result;
+    result = mfs_fopen(&pStream, pFile->pPath, "rb");
+    if (result != MFS_SUCCESS) {
+        mfs_search_report_error(pState, pFile->pPath, result);
+        return MFS_WALK_CONTINUE;
     }
-    
-    if (result != sizeInBytes) {
-        if (feof(pFile)) {
-            return MFS_END_OF_FILE;
-        } else {
-            return mfs_result_from_errno(ferror(pFile));
+
+#if defined(MFS_POSIX)
+    {
+        mfs_stat_info info;
+
+        /* Big files are mapped so they don't need to be copied into the buffer. */
+        if (mfs_fstat(pStream, &info) == MFS_SUCCESS && info.st_size >= MFS_SEARCH_MMAP_THRESHOLD && (mfs_uint64)info.st_size <= (mfs_uint64)((size_t)-1)) {
+            void* pMappedData = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fileno(pStream), 0);
+            if (pMappedData != MAP_FAILED) {
+                size_t consumed;
+
+            #if defined(MADV_SEQUENTIAL)
+                madvise(pMappedData, (size_t)info.st_size, MADV_SEQUENTIAL);
+            #endif
+
+                if (mfs_search_is_binary(pState, (const char*)pMappedData, (size_t)info.st_size) == MFS_FALSE) {
+                    action = mfs_search_scan(pWorker, pFile, (const char*)pMappedData, (size_t)info.st_size, MFS_TRUE, &consumed);
+                }
+
+                munmap(pMappedData, (size_t)info.st_size);
+                mfs_fclose(pStream);
+
+                return (action == MFS_WALK_STOP) ? MFS_WALK_STOP : MFS_WALK_CONTINUE;
+            }
         }
     }
+#endif
 
-    return MFS_SUCCESS;
-}
+    for (;;) {
+        size_t bytesRead;
+        size_t consumed = 0;
+        mfs_bool32 isLast;
+
+        /* A line that doesn't fit in the buffer makes it grow. */
+        if (carry == pWorker->bufferCap) {
+            size_t newCap = (pWorker->bufferCap > 0) ? pWorker->bufferCap * 2 : MFS_SEARCH_BUFFER_SIZE;
+            char* pNewBuffer;
+
+            if (newCap > MFS_SEARCH_MAX_BUFFER_SIZE) {
+                break;
+            }
+
+            pNewBuffer = (char*)MFS_REALLOC(pWorker->pBuffer, newCap);
+            if (pNewBuffer == NULL) {
+                mfs_search_report_error(pState, pFile->pPath, MFS_OUT_OF_MEMORY);
+                break;
+            }
+
+            pWorker->pBuffer   = pNewBuffer;
+            pWorker->bufferCap = newCap;
+        }
+
+        result = mfs_fread(pStream, pWorker->pBuffer + carry, pWorker->bufferCap - carry, &bytesRead);
+        if (result != MFS_SUCCESS && result != MFS_END_OF_FILE) {
+            mfs_search_report_error(pState, pFile->pPath, result);
+            break;
+        }
+
+        isLast = (result == MFS_END_OF_FILE);
+
+        if (isFirst) {
+            if (mfs_search_is_binary(pState, pWorker->pBuffer, bytesRead)) {
+                break;
+            }
+
+            isFirst = MFS_FALSE;
+        }
 
-mfs_result mfs_fwrite(FILE* pFile, const void* pData, size_t sizeInBytes, size_t* pBytesWritten)
-{
-    size_t result;
+        action = mfs_search_scan(pWorker, pFile, pWorker->pBuffer, carry + bytesRead, isLast, &consumed);
+        if (action != MFS_WALK_CONTINUE || isLast) {
+            break;
+        }
 
-    result = fwrite(pData, 1, sizeInBytes, pFile);
+        if (mfs_search_is_stopped(pState)) {
+            action = MFS_WALK_STOP;
+            break;
+        }
 
-    if (pBytesWritten != NULL) {
-        *pBytesWritten = result;
+        carry = carry + bytesRead - consumed;
+        memmove(pWorker->pBuffer, pWorker->pBuffer + consumed, carry);
     }
 
-    if (result != sizeInBytes) {
-        return mfs_result_from_errno(ferror(pFile));
-    }
+    mfs_fclose(pStream);
 
-    return MFS_SUCCESS;
+    return (action == MFS_WALK_STOP) ? MFS_WALK_STOP : MFS_WALK_CONTINUE;
 }
 
-mfs_result mfs_fseek(FILE* pFile, mfs_int64 offset, int origin)
+static mfs_uint32 mfs_search_on_entry(void* pUserData, const mfs_walk_entry* pEntry)
 {
-    int result;
-#if defined(_WIN32)
-    result = _fseeki64(pFile, offset, origin);
-#else
-    result = fseek(pFile, (long int)offset, origin);
-#endif
-    if (result != 0) {
-        return MFS_ERROR;
+    mfs_search_state* pState = (mfs_search_state*)pUserData;
+    mfs_search_file file;
+
+    if (pEntry->type != MFS_FILE_TYPE_FILE) {
+        return MFS_WALK_CONTINUE;
     }
 
-    return MFS_SUCCESS;
-}
+    if (mfs_search_is_stopped(pState)) {
+        return MFS_WALK_STOP;
+    }
 
-mfs_int64 mfs_ftell(FILE* pFile)
-{
-    mfs_int64 result;
-#if defined(_WIN32)
-    result = _ftelli64(pFile);
-#else
-    result = ftell(pFile);
-#endif
+    file.pPath       = pEntry->pPath;
+    file.threadIndex = pEntry->threadIndex;
+    file.lineNumber  = 0;
+    file.matchCount  = 0;
 
-    return result;
+    return mfs_search_file_contents(&pState->pWorkers[pEntry->threadIndex], &file);
 }
 
-#if !defined(_MSC_VER) && !((defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 1) || defined(_XOPEN_SOURCE) || defined(_POSIX_SOURCE)) && !(defined(__DragonFly__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__))
-int fileno(FILE *stream);
-#endif
-
-mfs_result mfs_fstat(FILE* pFile, mfs_stat_info* info)
+mfs_search_config mfs_search_config_init(void)
 {
-    int fd;
-
-#if defined(_MSC_VER)
-    fd = _fileno(pFile);
-#else
-    fd =  fileno(pFile);
-#endif
+    mfs_search_config config;
 
-#if defined(_MSC_VER)
-    if (_fstat64(fd, info) != 0) {
-#elif defined(_FILE_OFFSET_BITS) && _FILE_OFFSET_BITS == 64 && defined(_LARGEFILE64_SOURCE)
-    if (fstat64(fd, info) != 0) {
-#else
-    if (fstat(fd, info) != 0) {
-#endif
-        return mfs_result_from_errno(errno);
-    }
+    MFS_ZERO_OBJECT(&config);
 
-    return MFS_SUCCESS;
+    return config;
 }
 
-
-static mfs_result mfs_open_and_read_file_with_extra_data(const char* pFilePath, size_t* pFileSizeOut, void** ppFileData, size_t extraBytes)
+mfs_result mfs_search(const char* pRootPath, const char* pPattern, const mfs_search_config* pConfig, mfs_search_proc onMatch, void* pUserData)
 {
     mfs_result result;
-    mfs_uint64 fileSize;
-    FILE* pFile;
-    void* pFileData;
-    size_t bytesRead;
+    mfs_search_state state;
+    mfs_walk_config walkConfig;
+    mfs_uint32 iWorker;
 
-    if (pFilePath == NULL) {
+    if (pRootPath == NULL || pPattern == NULL || onMatch == NULL) {
         return MFS_INVALID_ARGS;
     }
 
-    result = mfs_fopen(&pFile, pFilePath, "rb");
-    if (result != MFS_SUCCESS) {
-        return result;
+    MFS_ZERO_OBJECT(&state);
+    if (pConfig != NULL) {
+        state.config = *pConfig;
+    } else {
+        state.config = mfs_search_config_init();
     }
 
-    fseek(pFile, 0, SEEK_END);
-    fileSize = ftell(pFile);
-    fseek(pFile, 0, SEEK_SET);
+    if (state.config.threadCount == 0) {
+        state.config.threadCount = mfs_get_cpu_count();
+    }
 
-    if (fileSize+extraBytes > SIZE_MAX) {
-        mfs_fclose(pFile);
-        return MFS_TOO_BIG;
+    state.onMatch   = onMatch;
+    state.pUserData = pUserData;
+
+    if ((state.config.flags & MFS_SEARCH_FLAG_LITERAL) != 0) {
+        state.literalLength = strlen(pPattern);
+        if (state.literalLength == 0 || memchr(pPattern, '\n', state.literalLength) != NULL) {
+            return MFS_INVALID_ARGS;    /* Can't match within a line. */
+        }
+
+        state.pLiteral = (char*)MFS_MALLOC(state.literalLength);
+        if (state.pLiteral == NULL) {
+            return MFS_OUT_OF_MEMORY;
+        }
+
+        MFS_COPY_MEMORY(state.pLiteral, pPattern, state.literalLength);
+        state.isLiteralOnly = MFS_TRUE;
+        state.regex.isCaseInsensitive = (state.config.flags & MFS_SEARCH_FLAG_CASE_INSENSITIVE) != 0;
+    } else {
+        result = mfs_regex_compile(pPattern, (state.config.flags & MFS_SEARCH_FLAG_CASE_INSENSITIVE) != 0, &state.regex, &state.pLiteral, &state.literalLength, &state.isLiteralOnly);
+        if (result != MFS_SUCCESS) {
+            return result;
+        }
     }
 
-    pFileData = MFS_MALLOC((size_t)fileSize + extraBytes);    /* <-- Safe cast due to the check above. */
-    if (pFileData == NULL) {
-        mfs_fclose(pFile);
+    /* Thread indices are always less than the thread count passed to mfs_walk_parallel(). */
+    state.pWorkers = (mfs_search_worker*)MFS_MALLOC(sizeof(*state.pWorkers) * state.config.threadCount);
+    if (state.pWorkers == NULL) {
+        MFS_FREE(state.pLiteral);
+        mfs_regex_uninit(&state.regex);
         return MFS_OUT_OF_MEMORY;
     }
+    MFS_ZERO_MEMORY(state.pWorkers, sizeof(*state.pWorkers) * state.config.threadCount);
 
-    result = mfs_fread(pFile, pFileData, (size_t)fileSize, &bytesRead);
-    if (result != MFS_SUCCESS) {
-        MFS_FREE(pFileData);
-        fclose(pFile);
-        return result;
+    result = MFS_SUCCESS;
+    for (iWorker = 0; iWorker < state.config.threadCount; iWorker += 1) {
+        state.pWorkers[iWorker].pState = &state;
+
+        if (state.isLiteralOnly == MFS_FALSE) {
+            result = mfs_regex_vm_init(&state.regex, &state.pWorkers[iWorker].vm);
+            if (result != MFS_SUCCESS) {
+                break;
+            }
+        }
     }
 
-    fclose(pFile);
+    mfs_mutex_init(&state.lock);
 
-    if (pFileSizeOut) {
-        *pFileSizeOut = (size_t)fileSize;
+    if (result == MFS_SUCCESS) {
+        walkConfig = mfs_walk_config_init();
+        walkConfig.threadCount = state.config.threadCount;
+        walkConfig.pInclude    = state.config.pInclude;
+        walkConfig.pExclude    = state.config.pExclude;
+        walkConfig.onError     = mfs_search_on_walk_error;
+
+        result = mfs_walk_parallel(pRootPath, &walkConfig, mfs_search_on_entry, &state);
+
+        /* Reaching the limit isn't an error. Otherwise the walk is only stopped when onMatch asked for it. */
+        if (result == MFS_CANCELLED && state.config.maxMatches > 0 && state.matchCount >= state.config.maxMatches) {
+            result = MFS_SUCCESS;
+        }
+
+        if (result == MFS_SUCCESS) {
+            result = state.result;
+        }
     }
 
-    if (ppFileData) {
-        *ppFileData = pFileData;
-    } else {
-        MFS_FREE(pFileData);
+    for (iWorker = 0; iWorker < state.config.threadCount; iWorker += 1) {
+        MFS_FREE(state.pWorkers[iWorker].pBuffer);
+        mfs_regex_vm_uninit(&state.pWorkers[iWorker].vm);
     }
 
-    return MFS_SUCCESS;
-}
+    mfs_mutex_uninit(&state.lock);
+    MFS_FREE(state.pWorkers);
+    MFS_FREE(state.pLiteral);
+    mfs_regex_uninit(&state.regex);
 
-mfs_result mfs_open_and_read_file(const char* pFilePath, size_t* pFileSizeOut, void** ppFileData)
-{
-    return mfs_open_and_read_file_with_extra_data(pFilePath, pFileSizeOut, ppFileData, 0);
+    return result;
 }
 
-mfs_result mfs_open_and_read_text_file(const char* pFilePath, size_t* pFileSizeOut, char** ppFileData)
-{
-    size_t fileSize;
-    mfs_result result = mfs_open_and_read_file_with_extra_data(pFilePath, &fileSize, (void**)ppFileData, 1);    /* 1 extra byte for the null terminator. */
-    if (result != MFS_SUCCESS) {
-        return result;
-    }
 
-    /* Output data needs to be null terminated. */
-    (*ppFileData)[fileSize] = '\0';
 
-    if (pFileSizeOut != NULL) {
-        *pFileSizeOut = fileSize;
-    }
 
-    return result;
-}
+/* Trigram Indexes */
+#define MFS_TRIGRAM_INDEX_VERSION           1
+#define MFS_TRIGRAM_INDEX_FILES_PER_CHUNK   64
+#define MFS_TRIGRAM_INDEX_NONE              0xFFFFFFFF
+#define MFS_TRIGRAM_INDEX_SEEN_SIZE         (16777216 / 8)  /* A bit for every possible trigram. */
 
+/* Flags for each entry of the new snapshot while building. */
+#define MFS_TRIGRAM_INDEX_NEEDS_PATH        0x01
+#define MFS_TRIGRAM_INDEX_NEEDS_CONTENTS    0x02
+#define MFS_TRIGRAM_INDEX_KEEP_PATH         0x04    /* The trigrams of the path can be carried over from the old index. */
+#define MFS_TRIGRAM_INDEX_KEEP_CONTENTS     0x08
+#define MFS_TRIGRAM_INDEX_ADDED             0x10    /* Added or renamed, so it has no counterpart at the same position in the old snapshot. */
+#define MFS_TRIGRAM_INDEX_MODIFIED          0x20
 
-mfs_result mfs_open_and_write_file(const char* pFilePath, size_t fileSize, const void* pFileData)
+typedef struct
 {
-    mfs_result result;
-    FILE* pFile;
+    char magic[8];                      /* "mfstgrm" with a null terminator. */
+    mfs_uint32 version;
+    mfs_uint32 byteOrderMark;
+    mfs_uint32 flags;                   /* The MFS_TRIGRAM_INDEX_FLAG_* flags the index was built with. */
+    mfs_uint32 checksum;                /* CRC32C of the tables and posting lists. The snapshot has its own. */
+    mfs_uint64 maxFileSize;
+    mfs_uint64 snapshotLength;          /* The snapshot comes straight after the header, in the same format as mfs_tree_snapshot_save(). */
+    mfs_uint64 pathTrigramCount;        /* The tables come after the snapshot, padded to 8 bytes. Paths first, then contents. */
+    mfs_uint64 contentTrigramCount;
+    mfs_uint64 postingsLength;          /* The posting lists come after the tables. */
+} mfs_trigram_index_header;
 
-    if (pFilePath == NULL) {
-        return MFS_INVALID_ARGS;
-    }
+typedef struct
+{
+    mfs_uint32 trigram;
+    mfs_uint32 count;                   /* The number of entries in the list. */
+    mfs_uint64 offset;                  /* From the start of the posting lists. Each entry is a varint of the difference from the one before. */
+} mfs_trigram_index_record;
 
-    result = mfs_fopen(&pFile, pFilePath, "wb");
-    if (result != MFS_SUCCESS) {
-        return result;
+typedef struct
+{
+    const mfs_uint8* pData;
+    size_t dataSize;
+    mfs_bool32 isMapped;
+    const mfs_trigram_index_record* pPathTable;     /* Sorted by trigram. */
+    size_t pathTrigramCount;
+    const mfs_trigram_index_record* pContentTable;
+    size_t contentTrigramCount;
+    const mfs_uint8* pPostings;
+    size_t postingsLength;
+    mfs_uint32 flags;
+    mfs_uint64 maxFileSize;
+    char* pRootPath;                    /* Without any trailing separators, so a separator and a relative path can be appended to it. */
+    size_t rootPathLength;
+} mfs_trigram_index_internal;
+
+typedef struct
+{
+    mfs_uint64* pKeys;                  /* The trigram in the top 32 bits and the entry in the bottom 32 bits, so sorting groups them by trigram. */
+    size_t count;
+    size_t cap;
+} mfs_trigram_index_keys;
+
+static mfs_bool32 mfs_trigram_index_reserve(void** ppData, size_t* pCap, size_t count, size_t elementSize)
+{
+    size_t newCap;
+    void* pNewData;
+
+    if (count <= *pCap) {
+        return MFS_TRUE;
     }
 
-    result = mfs_fwrite(pFile, pFileData, fileSize, NULL);
-    mfs_fclose(pFile);
+    newCap = (*pCap > 0) ? *pCap * 2 : 256;
+    while (newCap < count) {
+        newCap *= 2;
+    }
 
-    return result;
-}
+    pNewData = MFS_REALLOC(*ppData, newCap * elementSize);
+    if (pNewData == NULL) {
+        return MFS_FALSE;
+    }
 
+    *ppData = pNewData;
+    *pCap   = newCap;
 
-/* Current Directory */
+    return MFS_TRUE;
+}
 
-#if defined(MFS_WIN32)
-mfs_result mfs_set_current_directory__win32(const char* pDirectoryPath)
+static mfs_result mfs_trigram_index_extract(const char* pData, size_t dataSize, mfs_uint32 entry, mfs_uint8* pSeen, mfs_trigram_index_keys* pKeys)
 {
-    if (SetCurrentDirectoryA(pDirectoryPath)) {
+    /* Adds a key for each distinct trigram. pSeen has a bit for every trigram, and is left cleared. */
+    mfs_result result = MFS_SUCCESS;
+    mfs_uint32 trigram;
+    size_t first = pKeys->count;
+    size_t i;
+
+    if (dataSize < 3) {
         return MFS_SUCCESS;
     }
 
-    return mfs_result_from_GetLastError(GetLastError());
-}
+    trigram = ((mfs_uint32)(mfs_uint8)mfs_regex_fold(pData[0]) << 8) | (mfs_uint8)mfs_regex_fold(pData[1]);
 
-mfs_result mfs_get_current_directory__win32(char* pDirectoryPath, size_t directoryPathSizeInBytes)
-{
-    DWORD result;
+    for (i = 2; i < dataSize; i += 1) {
+        trigram = ((trigram << 8) | (mfs_uint8)mfs_regex_fold(pData[i])) & 0xFFFFFF;
 
-    result = GetCurrentDirectoryA((DWORD)directoryPathSizeInBytes, pDirectoryPath);
-    if (result == 0) {
-        return mfs_result_from_GetLastError(GetLastError());
+        if ((pSeen[trigram >> 3] & (1 << (trigram & 7))) == 0) {
+            if (mfs_trigram_index_reserve((void**)&pKeys->pKeys, &pKeys->cap, pKeys->count + 1, sizeof(*pKeys->pKeys)) == MFS_FALSE) {
+                result = MFS_OUT_OF_MEMORY;
+                break;
+            }
+
+            pSeen[trigram >> 3] |= (mfs_uint8)(1 << (trigram & 7));
+            pKeys->pKeys[pKeys->count] = ((mfs_uint64)trigram << 32) | entry;
+            pKeys->count += 1;
+        }
     }
 
-    /*
-    It's not entirely clear by the documentation for GetCurrentDirectory() what the contents of the output buffer is set to in the scenario where
-    it's not large enough to hold the result. For consistency with the POSIX implementation I'm going to explicitly set this to a blank string and
-    return an error if the return value is larger than the size of the buffer.
-    */
-    if (result > (DWORD)directoryPathSizeInBytes) {
-        pDirectoryPath[0] = '\0';
-        return MFS_OUT_OF_RANGE;
+    for (i = first; i < pKeys->count; i += 1) {
+        trigram = (mfs_uint32)(pKeys->pKeys[i] >> 32);
+        pSeen[trigram >> 3] &= (mfs_uint8)~(1 << (trigram & 7));
     }
 
-    return MFS_SUCCESS;
+    return result;
 }
 
-mfs_result mfs_mkdir__win32(const char* pDirectoryPath)
+static mfs_result mfs_trigram_index_sort_keys(mfs_trigram_index_keys* pKeys)
 {
-    BOOL result = CreateDirectoryA(pDirectoryPath, NULL);
-    if (result) {
+    /* A least significant digit radix sort, a byte at a time. Bytes that are the same in every key are skipped. */
+    mfs_uint64* pSrc = pKeys->pKeys;
+    mfs_uint64* pDst;
+    mfs_uint64* pTemp;
+    size_t counts[256];
+    unsigned int shift;
+    size_t i;
+
+    if (pKeys->count < 2) {
         return MFS_SUCCESS;
     }
 
-    return mfs_result_from_GetLastError(GetLastError());
-}
-#endif
-
-#if defined(MFS_POSIX)
-mfs_result mfs_set_current_directory__posix(const char* pDirectoryPath)
-{
-    int result = chdir(pDirectoryPath);
-    if (result != 0) {
-        return mfs_result_from_errno(errno);
+    pTemp = (mfs_uint64*)MFS_MALLOC(sizeof(*pTemp) * pKeys->count);
+    if (pTemp == NULL) {
+        return MFS_OUT_OF_MEMORY;
     }
 
-    return MFS_SUCCESS;
-}
+    pDst = pTemp;
 
-mfs_result mfs_get_current_directory__posix(char* pDirectoryPath, size_t directoryPathSizeInBytes)
-{
-    int result;
-    char* cwd;
-    
-    cwd = getcwd(NULL, 0);
-    if (cwd == NULL) {
-        return mfs_result_from_errno(errno);
-    }
+    for (shift = 0; shift < 64; shift += 8) {
+        size_t offset = 0;
 
-    result = mfs_strcpy_s(pDirectoryPath, directoryPathSizeInBytes, cwd);
-    free(cwd);
+        MFS_ZERO_MEMORY(counts, sizeof(counts));
+        for (i = 0; i < pKeys->count; i += 1) {
+            counts[(pSrc[i] >> shift) & 0xFF] += 1;
+        }
 
-    if (result != 0) {
-        return mfs_result_from_errno(errno);
+        if (counts[(pSrc[0] >> shift) & 0xFF] == pKeys->count) {
+            continue;
+        }
+
+        for (i = 0; i < 256; i += 1) {
+            size_t count = counts[i];
+            counts[i] = offset;
+            offset += count;
+        }
+
+        for (i = 0; i < pKeys->count; i += 1) {
+            pDst[counts[(pSrc[i] >> shift) & 0xFF]++] = pSrc[i];
+        }
+
+        pDst = pSrc;
+        pSrc = (pSrc == pKeys->pKeys) ? pTemp : pKeys->pKeys;
     }
 
+    if (pSrc != pKeys->pKeys) {
+        MFS_COPY_MEMORY(pKeys->pKeys, pSrc, sizeof(*pSrc) * pKeys->count);
+    }
+
+    MFS_FREE(pTemp);
+
     return MFS_SUCCESS;
 }
 
-mfs_result mfs_mkdir__posix(const char* pDirectoryPath)
+static char* mfs_trigram_index_full_path(const char* pRootPath, size_t rootPathLength, const mfs_tree_snapshot_entry* pEntry, char** ppBuffer, size_t* pBufferCap)
 {
-    if (mkdir(pDirectoryPath, 0777) == 0) {
-        return MFS_SUCCESS;
+    if (mfs_trigram_index_reserve((void**)ppBuffer, pBufferCap, rootPathLength + 1 + pEntry->pathLength + 1, 1) == MFS_FALSE) {
+        return NULL;
     }
 
-    return mfs_result_from_errno(errno);
-}
-#endif
+    MFS_COPY_MEMORY(*ppBuffer, pRootPath, rootPathLength);
+    (*ppBuffer)[rootPathLength] = '/';
+    MFS_COPY_MEMORY(*ppBuffer + rootPathLength + 1, pEntry->pPath, pEntry->pathLength + 1);
 
-mfs_result mfs_set_current_directory(const char* pDirectoryPath)
-{
-#if defined(MFS_WIN32)
-    return mfs_set_current_directory__win32(pDirectoryPath);
-#elif defined(MFS_POSIX)
-    return mfs_set_current_directory__posix(pDirectoryPath);
-#else
-    return MFS_INVALID_OPERATION;   /* Unsupported platform. */
-#endif
+    return *ppBuffer;
 }
 
-mfs_result mfs_get_current_directory(char* pDirectoryPath, size_t directoryPathSizeInBytes)
+typedef struct
 {
-    if (pDirectoryPath == NULL) {
-        return MFS_INVALID_ARGS;
-    }
-    if (directoryPathSizeInBytes == 0) {
-        return MFS_OUT_OF_RANGE;
-    }
+    const mfs_trigram_index_config* pConfig;
+    const char* pRootPath;
+    size_t rootPathLength;
+    const mfs_tree_snapshot* pSnapshot;
+    const mfs_uint32* pFiles;           /* The entries whose contents need to be read. */
+    size_t fileCount;
+    mfs_mutex lock;                     /* For everything below, and for onError(). */
+    size_t nextFile;
+    mfs_result result;
+} mfs_trigram_index_builder;
 
-    pDirectoryPath[0] = '\0';
+typedef struct
+{
+    mfs_job job;
+    mfs_trigram_index_builder* pBuilder;
+    mfs_trigram_index_keys keys;
+} mfs_trigram_index_reader;
 
-#if defined(MFS_WIN32)
-    return mfs_get_current_directory__win32(pDirectoryPath, directoryPathSizeInBytes);
-#elif defined(MFS_POSIX)
-    return mfs_get_current_directory__posix(pDirectoryPath, directoryPathSizeInBytes);
-#else
-    return MFS_INVALID_OPERATION;   /* Unsupported platform. */
-#endif
+static void mfs_trigram_index_report_error(mfs_trigram_index_builder* pBuilder, const char* pPath, mfs_result result)
+{
+    mfs_mutex_lock(&pBuilder->lock);
+    {
+        if (pBuilder->result == MFS_SUCCESS && result == MFS_OUT_OF_MEMORY) {
+            pBuilder->result = result;  /* Anything else just leaves the file out. */
+        }
+
+        if (pBuilder->pConfig->onError != NULL) {
+            pBuilder->pConfig->onError(pBuilder->pConfig->pUserData, pPath, result);
+        }
+    }
+    mfs_mutex_unlock(&pBuilder->lock);
 }
 
-mfs_result mfs_mkdir(const char* pDirectory, mfs_bool32 recursive)
+static mfs_result mfs_trigram_index_read_file(const char* pPath, mfs_uint64 maxFileSize, char** ppBuffer, size_t* pBufferCap, size_t* pDataSize)
 {
-    if (pDirectory == NULL) {
-        return MFS_INVALID_ARGS;
-    }
+    /* Reads up to maxFileSize bytes. Anything beyond that is ignored. */
+    mfs_result result;
+    FILE* pFile;
+    size_t dataSize = 0;
 
-    if (pDirectory[0] == '\0') {
-        return MFS_SUCCESS; /* It's an empty directory which we'll treat as the current directory. The current directory must exist so we just pretend to be successful. */
+    result = mfs_fopen(&pFile, pPath, "rb");
+    if (result != MFS_SUCCESS) {
+        return result;
     }
 
-    if (recursive == MFS_FALSE) {
-    #if defined(MFS_WIN32)
-        return mfs_mkdir__win32(pDirectory);
-    #elif defined(MFS_POSIX)
-        return mfs_mkdir__posix(pDirectory);
-    #else
-        return MFS_INVALID_OPERATION;   /* Unsupported platform. */
-    #endif
-    } else {
-        /*
-        Getting here means we're creating the directory recursively. We keep iterating over each segment of the path until we find a directory that does
-        not exist, after which point we just keep creating directories until we reach the end.
-        */
-        mfs_result result;
-        mfs_path_iterator iterator;
-        char* pRunningPath = NULL;
-        size_t runningPathCap = 0;
-        size_t newRunningPathLen;
+    for (;;) {
+        size_t bytesRead;
+        size_t bytesToRead;
 
-        result = mfs_path_first_segment(pDirectory, &iterator);
-        if (result != MFS_SUCCESS) {
-            return result;
+        if (dataSize == *pBufferCap && mfs_trigram_index_reserve((void**)ppBuffer, pBufferCap, dataSize + 1, 1) == MFS_FALSE) {
+            result = MFS_OUT_OF_MEMORY;
+            break;
         }
 
-        runningPathCap = 256;
-        pRunningPath = (char*)MFS_MALLOC(runningPathCap);
-        if (pRunningPath == NULL) {
-            return MFS_OUT_OF_MEMORY;
+        bytesToRead = *pBufferCap - dataSize;
+        if (bytesToRead > maxFileSize - dataSize) {
+            bytesToRead = (size_t)(maxFileSize - dataSize);
         }
-        mfs_strncpy_s(pRunningPath, runningPathCap, iterator.path + iterator.segment.offset, iterator.segment.length);
 
+        if (bytesToRead == 0) {
+            break;
+        }
 
-        /* If it's an absolute path we want to skip the first segment as that will be the root directory . */
-        if (mfs_path_is_absolute(pDirectory)) {
-            result = mfs_path_next_segment(&iterator);
-            if (result != MFS_SUCCESS) {
-                if (result == MFS_AT_END) {
-                    return MFS_SUCCESS;
-                } else {
-                    return result;
-                }
-            }
+        result = mfs_fread(pFile, *ppBuffer + dataSize, bytesToRead, &bytesRead);
+        dataSize += bytesRead;
 
-            /* Get the size of the new running path. */
-            result = mfs_path_append_iterator(NULL, 0, pRunningPath, iterator, &newRunningPathLen);
-            if (result != MFS_SUCCESS) {
-                MFS_FREE(pRunningPath);
-                return result;
+        if (result != MFS_SUCCESS) {
+            if (result == MFS_END_OF_FILE) {
+                result = MFS_SUCCESS;
             }
 
-            /* Allocate memory for the running path if necessary. */
-            if (newRunningPathLen > runningPathCap+1) {
-                char* pNewRunningPath;
-                size_t newRunningPathCap = runningPathCap*2;
-                if (newRunningPathCap < newRunningPathLen+1) {
-                    newRunningPathCap = newRunningPathLen+1;
-                }
+            break;
+        }
+    }
 
-                pNewRunningPath = (char*)MFS_REALLOC(pRunningPath, newRunningPathCap);
-                if (pNewRunningPath == NULL) {
-                    MFS_FREE(pRunningPath);
-                    return MFS_OUT_OF_MEMORY;
-                }
+    mfs_fclose(pFile);
+
+    *pDataSize = dataSize;
+    return result;
+}
+
+static mfs_bool32 mfs_trigram_index_is_binary(const char* pData, size_t dataSize)
+{
+    return memchr(pData, '\0', (dataSize < MFS_SEARCH_BINARY_CHECK_SIZE) ? dataSize : MFS_SEARCH_BINARY_CHECK_SIZE) != NULL;
+}
+
+static void mfs_trigram_index_process_reader(mfs_job* pJob)
+{
+    mfs_trigram_index_reader* pReader = (mfs_trigram_index_reader*)pJob;
+    mfs_trigram_index_builder* pBuilder = pReader->pBuilder;
+    mfs_uint8* pSeen;
+    char* pPath = NULL;
+    size_t pathCap = 0;
+    char* pBuffer = NULL;
+    size_t bufferCap = 0;
+
+    pSeen = (mfs_uint8*)MFS_MALLOC(MFS_TRIGRAM_INDEX_SEEN_SIZE);
+    if (pSeen == NULL) {
+        mfs_trigram_index_report_error(pBuilder, pBuilder->pRootPath, MFS_OUT_OF_MEMORY);
+        return;
+    }
+    MFS_ZERO_MEMORY(pSeen, MFS_TRIGRAM_INDEX_SEEN_SIZE);
+
+    /* Files are taken a chunk at a time until there are none left. */
+    for (;;) {
+        size_t first;
+        size_t last;
+        size_t iFile;
 
-                pRunningPath   = pNewRunningPath;
-                runningPathCap = newRunningPathCap;
+        mfs_mutex_lock(&pBuilder->lock);
+        {
+            first = pBuilder->nextFile;
+            last  = first + MFS_TRIGRAM_INDEX_FILES_PER_CHUNK;
+            if (last > pBuilder->fileCount) {
+                last = pBuilder->fileCount;
             }
 
-            /* Append the segment to the running path. */
-            result = mfs_path_append_iterator(pRunningPath, runningPathCap, pRunningPath, iterator, NULL);
-            if (result != MFS_SUCCESS) {
-                MFS_FREE(pRunningPath);
-                return result;  /* Should never hit this as any error should have been returned by the first call that we used to measure the string. */
+            pBuilder->nextFile = last;
+
+            if (pBuilder->result != MFS_SUCCESS) {
+                last = first;
             }
         }
+        mfs_mutex_unlock(&pBuilder->lock);
 
-        /*
-        We need to loop over every segment until we find the first directory that does not exist. After that we then just create each sub-directory
-        until we reach the end of the path.
-        */
-        for (;;) {
-            /* Now that we have the running path we can check whether or not it exists. If it does not exists, it's created, so long as we're not looking at a file in which case we have an error. */
-            if (mfs_file_exists(pRunningPath)) {
-                MFS_FREE(pRunningPath);
-                return MFS_INVALID_OPERATION;   /* The path refers to a file. */
-            }
-
-            if (mfs_is_directory(pRunningPath) == MFS_FALSE) {
-            #if defined(MFS_WIN32)
-                result = mfs_mkdir__win32(pRunningPath);
-            #elif defined(MFS_POSIX)
-                result = mfs_mkdir__posix(pRunningPath);
-            #else
-                result = MFS_INVALID_OPERATION;   /* Unsupported platform. */
-            #endif
-                if (result != MFS_SUCCESS) {
-                    MFS_FREE(pRunningPath);
-                    return result;  /* An error occurred when creating the directory. */
-                }
-            }
+        if (first == last) {
+            break;
+        }
 
-            /* We're done with this segment so move on to the next. */
-            result = mfs_path_next_segment(&iterator);
-            if (result != MFS_SUCCESS) {
-                if (result == MFS_AT_END) {
-                    break;  /* We're done. */
-                } else {
-                    MFS_FREE(pRunningPath);
-                    return result;
-                }
+        for (iFile = first; iFile < last; iFile += 1) {
+            const mfs_tree_snapshot_entry* pEntry = &pBuilder->pSnapshot->pEntries[pBuilder->pFiles[iFile]];
+            mfs_result result;
+            size_t dataSize;
+
+            if (mfs_trigram_index_full_path(pBuilder->pRootPath, pBuilder->rootPathLength, pEntry, &pPath, &pathCap) == NULL) {
+                mfs_trigram_index_report_error(pBuilder, pBuilder->pRootPath, MFS_OUT_OF_MEMORY);
+                break;
             }
 
-            /* Get the size of the new running path. */
-            result = mfs_path_append_iterator(NULL, 0, pRunningPath, iterator, &newRunningPathLen);
+            result = mfs_trigram_index_read_file(pPath, pBuilder->pConfig->maxFileSize, &pBuffer, &bufferCap, &dataSize);
             if (result != MFS_SUCCESS) {
-                MFS_FREE(pRunningPath);
-                return result;
+                mfs_trigram_index_report_error(pBuilder, pPath, result);
+                continue;
             }
 
-            /* Allocate memory for the running path if necessary. */
-            if (newRunningPathLen > runningPathCap+1) {
-                char* pNewRunningPath;
-                size_t newRunningPathCap = runningPathCap*2;
-                if (newRunningPathCap < newRunningPathLen+1) {
-                    newRunningPathCap = newRunningPathLen+1;
-                }
-
-                pNewRunningPath = (char*)MFS_REALLOC(pRunningPath, newRunningPathCap);
-                if (pNewRunningPath == NULL) {
-                    MFS_FREE(pRunningPath);
-                    return MFS_OUT_OF_MEMORY;
-                }
-
-                pRunningPath   = pNewRunningPath;
-                runningPathCap = newRunningPathCap;
+            if (mfs_trigram_index_is_binary(pBuffer, dataSize)) {
+                continue;
             }
 
-            /* Append the segment to the running path. */
-            result = mfs_path_append_iterator(pRunningPath, runningPathCap, pRunningPath, iterator, NULL);
+            result = mfs_trigram_index_extract(pBuffer, dataSize, pBuilder->pFiles[iFile], pSeen, &pReader->keys);
             if (result != MFS_SUCCESS) {
-                MFS_FREE(pRunningPath);
-                return result;  /* Should never hit this as any error should have been returned by the first call that we used to measure the string. */
+                mfs_trigram_index_report_error(pBuilder, pPath, result);
+                break;
             }
         }
-
-        MFS_FREE(pRunningPath);
-        return MFS_SUCCESS;
     }
+
+    MFS_FREE(pBuffer);
+    MFS_FREE(pPath);
+    MFS_FREE(pSeen);
 }
 
-mfs_result mfs_rmdir(const char* pDirectory, mfs_bool32 recursive)
+static mfs_result mfs_trigram_index_read_contents(const mfs_trigram_index_config* pConfig, const char* pRootPath, size_t rootPathLength, const mfs_tree_snapshot* pSnapshot, const mfs_uint32* pFiles, size_t fileCount, mfs_trigram_index_keys* pKeys)
 {
-    if (pDirectory == NULL) {
-        return MFS_INVALID_ARGS;
+    mfs_result result;
+    mfs_trigram_index_builder builder;
+    mfs_trigram_index_reader* pReaders;
+    mfs_worker_pool pool;
+    mfs_uint32 readerCount;
+    mfs_uint32 iReader;
+    size_t keyCount = 0;
+
+    if (fileCount == 0) {
+        return MFS_SUCCESS;
     }
 
-    if (mfs_is_directory(pDirectory) == MFS_FALSE) {
-        return MFS_NOT_DIRECTORY;
+    readerCount = (pConfig->threadCount > 0) ? pConfig->threadCount : mfs_get_cpu_count();
+    if (readerCount > (fileCount + MFS_TRIGRAM_INDEX_FILES_PER_CHUNK - 1) / MFS_TRIGRAM_INDEX_FILES_PER_CHUNK) {
+        readerCount = (mfs_uint32)((fileCount + MFS_TRIGRAM_INDEX_FILES_PER_CHUNK - 1) / MFS_TRIGRAM_INDEX_FILES_PER_CHUNK);
     }
 
-    if (recursive) {
-        mfs_result result = mfs_rmdir_content(pDirectory);
-        if (result != MFS_SUCCESS) {
-            return result;  /* Failed to delete the content of the directory. */
-        }
+    pReaders = (mfs_trigram_index_reader*)MFS_MALLOC(sizeof(*pReaders) * readerCount);
+    if (pReaders == NULL) {
+        return MFS_OUT_OF_MEMORY;
     }
+    MFS_ZERO_MEMORY(pReaders, sizeof(*pReaders) * readerCount);
+
+    MFS_ZERO_OBJECT(&builder);
+    builder.pConfig        = pConfig;
+    builder.pRootPath      = pRootPath;
+    builder.rootPathLength = rootPathLength;
+    builder.pSnapshot      = pSnapshot;
+    builder.pFiles         = pFiles;
+    builder.fileCount      = fileCount;
+    mfs_mutex_init(&builder.lock);
+
+    result = mfs_worker_pool_init(readerCount, MFS_IO_PRIORITY_DEFAULT, &pool);
+    if (result == MFS_SUCCESS) {
+        /* Each reader keeps going until every file has been taken, so it doesn't matter how many threads the pool ended up with. */
+        for (iReader = 0; iReader < readerCount; iReader += 1) {
+            pReaders[iReader].job.onProcess = mfs_trigram_index_process_reader;
+            pReaders[iReader].pBuilder      = &builder;
+            mfs_worker_pool_post(&pool, &pReaders[iReader].job);
+        }
 
-    return mfs_delete_file(pDirectory);
-}
-
-mfs_result mfs_rmdir_content(const char* pDirectory)
-{
-    /* We'll use an iterator for this. */
-    mfs_result result;
-    mfs_iterator iterator;
-    mfs_file_info fi;
+        mfs_worker_pool_wait(&pool);
+        mfs_worker_pool_uninit(&pool);
 
-    if (pDirectory == NULL) {
-        return MFS_INVALID_ARGS;
+        result = builder.result;
     }
 
-    result = mfs_iterator_init(pDirectory, &iterator);
-    if (result != MFS_SUCCESS) {
-        return result;  /* Failed to initialize iterator. */
+    mfs_mutex_uninit(&builder.lock);
+
+    for (iReader = 0; iReader < readerCount; iReader += 1) {
+        keyCount += pReaders[iReader].keys.count;
     }
 
-    while (mfs_iterator_next(&iterator, &fi) == MFS_SUCCESS) {
-        char* pFilePath;
-        size_t filePathLen;
+    if (result == MFS_SUCCESS && mfs_trigram_index_reserve((void**)&pKeys->pKeys, &pKeys->cap, pKeys->count + keyCount, sizeof(*pKeys->pKeys)) == MFS_FALSE) {
+        result = MFS_OUT_OF_MEMORY;
+    }
 
-        /* Get the length first. */
-        result = mfs_path_append(NULL, 0, pDirectory, fi.pFileName, &filePathLen);
-        if (result == MFS_SUCCESS) {
-            pFilePath = (char*)MFS_MALLOC(filePathLen + 1);    /* +1 for null terminator. */
-            if (pFilePath != NULL) {
-                result = mfs_path_append(pFilePath, filePathLen + 1, pDirectory, fi.pFileName, NULL);
-                if (result == MFS_SUCCESS) {
-                    if (fi.isDirectory) {
-                        if (fi.pFileName[0] == '.' && fi.pFileName[1] == '\0') {
-                            /* "." - ignore. */
-                        } else if (fi.pFileName[0] == '.' && fi.pFileName[1] == '.' && fi.pFileName[2] == '\0') {
-                            /* ".." - ignore. */
-                        } else {
-                            mfs_rmdir(pFilePath, MFS_TRUE);
-                        }
-                    } else {
-                        mfs_delete_file(pFilePath);
-                    }
-                } else {
-                    /* Failed to create file path. */
-                }
-            } else {
-                return MFS_OUT_OF_MEMORY;
-            }
-        } else {
-            /* Failed to retrieve the file path length. */
+    for (iReader = 0; iReader < readerCount; iReader += 1) {
+        if (result == MFS_SUCCESS && pReaders[iReader].keys.count > 0) {
+            MFS_COPY_MEMORY(pKeys->pKeys + pKeys->count, pReaders[iReader].keys.pKeys, sizeof(*pKeys->pKeys) * pReaders[iReader].keys.count);
+            pKeys->count += pReaders[iReader].keys.count;
         }
+
+        MFS_FREE(pReaders[iReader].keys.pKeys);
     }
 
-    return MFS_SUCCESS;
-}
+    MFS_FREE(pReaders);
 
+    return result;
+}
 
-#if defined(MFS_WIN32)
-mfs_bool32 mfs_is_directory__win32(const char* pPath)
+typedef struct
 {
-    DWORD attributes;
-
-    MFS_ASSERT(pPath != NULL);
+    mfs_trigram_index_record* pRecords;
+    size_t recordCount;
+    size_t recordCap;
+    mfs_uint8* pPostings;
+    size_t postingsLength;
+    size_t postingsCap;
+    mfs_uint32* pList;                  /* The entries of the list being built. */
+    size_t listCap;
+    mfs_uint32* pMerged;
+    size_t mergedCap;
+} mfs_trigram_index_writer;
+
+static int mfs_trigram_index_compare_entries(const void* pA, const void* pB)
+{
+    mfs_uint32 a = *(const mfs_uint32*)pA;
+    mfs_uint32 b = *(const mfs_uint32*)pB;
 
-    attributes = GetFileAttributesA(pPath);
-    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    return (a < b) ? -1 : (a > b) ? 1 : 0;
 }
 
-mfs_bool32 mfs_file_exists__win32(const char* pFilePath)
+static mfs_result mfs_trigram_index_write_table(mfs_trigram_index_writer* pWriter, const mfs_trigram_index_internal* pOld, mfs_bool32 isContents, size_t oldEntryCount, const mfs_uint32* pOldToNew, const mfs_uint8* pFlags, mfs_bool32 isSortNeeded, const mfs_trigram_index_keys* pKeys)
 {
-    DWORD attributes;
+    /*
+    Merges the old lists, with their entries translated to the new snapshot, with the new keys. Entries that are not marked to be
+    kept are dropped. Returns MFS_INVALID_FILE if the old lists are corrupt.
+    */
+    const mfs_trigram_index_record* pOldTable = NULL;
+    size_t oldTrigramCount = 0;
+    mfs_uint8 keepFlag = (isContents) ? MFS_TRIGRAM_INDEX_KEEP_CONTENTS : MFS_TRIGRAM_INDEX_KEEP_PATH;
+    size_t iOld = 0;
+    size_t iKey = 0;
+
+    if (pOld != NULL) {
+        pOldTable       = (isContents) ? pOld->pContentTable : pOld->pPathTable;
+        oldTrigramCount = (isContents) ? pOld->contentTrigramCount : pOld->pathTrigramCount;
+    }
 
-    MFS_ASSERT(pFilePath != NULL);
+    while (iOld < oldTrigramCount || iKey < pKeys->count) {
+        mfs_uint32 trigram;
+        size_t oldCount = 0;
+        size_t newCount = 0;
+        size_t listCount;
+        mfs_uint32* pList;
+        mfs_uint32 previous = 0;
+        size_t i;
+
+        if (iOld < oldTrigramCount && (iKey == pKeys->count || pOldTable[iOld].trigram <= (mfs_uint32)(pKeys->pKeys[iKey] >> 32))) {
+            trigram = pOldTable[iOld].trigram;
+        } else {
+            trigram = (mfs_uint32)(pKeys->pKeys[iKey] >> 32);
+        }
 
-    attributes = GetFileAttributesA(pFilePath);
-    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0;
-}
+        if (iOld < oldTrigramCount && pOldTable[iOld].trigram == trigram) {
+            size_t cursor = (size_t)pOldTable[iOld].offset;
+            mfs_uint64 entry = 0;
 
-mfs_result mfs_copy_file__win32(const char* pSrcFilePath, const char* pDstFilePath, mfs_bool32 failIfExists)
-{
-    BOOL result = CopyFileA(pSrcFilePath, pDstFilePath, failIfExists);
-    if (result) {
-        return MFS_SUCCESS;
-    }
+            if (pOldTable[iOld].offset > pOld->postingsLength || mfs_trigram_index_reserve((void**)&pWriter->pList, &pWriter->listCap, pOldTable[iOld].count, sizeof(*pWriter->pList)) == MFS_FALSE) {
+                return (pOldTable[iOld].offset > pOld->postingsLength) ? MFS_INVALID_FILE : MFS_OUT_OF_MEMORY;
+            }
 
-    return mfs_result_from_GetLastError(GetLastError());
-}
+            for (i = 0; i < pOldTable[iOld].count; i += 1) {
+                mfs_uint64 delta;
+                mfs_uint32 newEntry;
 
-mfs_result mfs_move_file__win32(const char* pSrcFilePath, const char* pDstFilePath, mfs_bool32 failIfExists)
-{
-    DWORD dwFlags;
-    BOOL result;
+                if (mfs_tree_index_read_varint(pOld->pPostings, pOld->postingsLength, &cursor, &delta) == MFS_FALSE || delta >= oldEntryCount - entry) {
+                    return MFS_INVALID_FILE;
+                }
 
-    dwFlags = MOVEFILE_COPY_ALLOWED;
-    if (failIfExists == MFS_FALSE) {
-        dwFlags |= MOVEFILE_REPLACE_EXISTING;
-    }
+                entry += delta;
 
-    result = MoveFileExA(pSrcFilePath, pDstFilePath, dwFlags);
-    if (result) {
-        return MFS_SUCCESS;
-    }
+                newEntry = pOldToNew[entry];
+                if (newEntry != MFS_TRIGRAM_INDEX_NONE && (pFlags[newEntry] & keepFlag) != 0) {
+                    pWriter->pList[oldCount] = newEntry;
+                    oldCount += 1;
+                }
+            }
 
-    return mfs_result_from_GetLastError(GetLastError());
-}
+            /* Renamed entries can end up out of order. */
+            if (isSortNeeded) {
+                qsort(pWriter->pList, oldCount, sizeof(*pWriter->pList), mfs_trigram_index_compare_entries);
+            }
 
-mfs_result mfs_delete_file__win32(const char* pFilePath)
-{
-    BOOL wasSuccessful;
-    DWORD attributes;
+            iOld += 1;
+        }
 
-    attributes = GetFileAttributesA(pFilePath);
-    if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
-        wasSuccessful = DeleteFileA(pFilePath);
-    } else {
-        wasSuccessful = RemoveDirectoryA(pFilePath);
-    }
+        while (iKey + newCount < pKeys->count && (mfs_uint32)(pKeys->pKeys[iKey + newCount] >> 32) == trigram) {
+            newCount += 1;
+        }
 
-    if (wasSuccessful) {
-        return MFS_SUCCESS;
-    }
+        listCount = oldCount + newCount;
+        pList     = pWriter->pList;
 
-    return mfs_result_from_GetLastError(GetLastError());
-}
-#endif
+        if (newCount > 0) {
+            size_t iA = 0;
+            size_t iB = 0;
 
-#if defined(MFS_POSIX)
-mfs_bool32 mfs_is_directory__posix(const char* pPath)
-{
-    struct stat info;
+            if (mfs_trigram_index_reserve((void**)&pWriter->pMerged, &pWriter->mergedCap, listCount, sizeof(*pWriter->pMerged)) == MFS_FALSE) {
+                return MFS_OUT_OF_MEMORY;
+            }
 
-    MFS_ASSERT(pPath != NULL);
+            for (i = 0; i < listCount; i += 1) {
+                if (iB == newCount || (iA < oldCount && pWriter->pList[iA] < (mfs_uint32)pKeys->pKeys[iKey + iB])) {
+                    pWriter->pMerged[i] = pWriter->pList[iA];
+                    iA += 1;
+                } else {
+                    pWriter->pMerged[i] = (mfs_uint32)pKeys->pKeys[iKey + iB];
+                    iB += 1;
+                }
+            }
 
-    if (stat(pPath, &info) != 0) {
-        return MFS_FALSE;   /* Likely the folder doesn't exist. */
-    }
+            pList = pWriter->pMerged;
+            iKey += newCount;
+        }
 
-    return (info.st_mode & S_IFDIR) != 0;
-}
+        if (listCount == 0) {
+            continue;
+        }
 
-mfs_bool32 mfs_file_exists__posix(const char* pFilePath)
-{
-    struct stat info;
+        if (mfs_trigram_index_reserve((void**)&pWriter->pRecords, &pWriter->recordCap, pWriter->recordCount + 1, sizeof(*pWriter->pRecords)) == MFS_FALSE ||
+            mfs_trigram_index_reserve((void**)&pWriter->pPostings, &pWriter->postingsCap, pWriter->postingsLength + listCount * 5, 1) == MFS_FALSE) {
+            return MFS_OUT_OF_MEMORY;
+        }
 
-    MFS_ASSERT(pFilePath != NULL);
-    
-    if (stat(pFilePath, &info) != 0) {
-        return MFS_FALSE;   /* Likely the file doesn't exist. */
+        pWriter->pRecords[pWriter->recordCount].trigram = trigram;
+        pWriter->pRecords[pWriter->recordCount].count   = (mfs_uint32)listCount;
+        pWriter->pRecords[pWriter->recordCount].offset  = pWriter->postingsLength;
+        pWriter->recordCount += 1;
+
+        for (i = 0; i < listCount; i += 1) {
+            pWriter->postingsLength += mfs_tree_index_write_varint(pWriter->pPostings + pWriter->postingsLength, pList[i] - previous);
+            previous = pList[i];
+        }
     }
 
-    return (info.st_mode & S_IFDIR) == 0;
+    return MFS_SUCCESS;
 }
 
-mfs_result mfs_copy_file__posix(const char* pSrcFilePath, const char* pDstFilePath, mfs_bool32 failIfExists)
+static mfs_result mfs_trigram_index_map_entries(const mfs_tree_snapshot* pOldSnapshot, const mfs_tree_snapshot* pSnapshot, mfs_uint32* pOldToNew, mfs_uint8* pFlags, mfs_bool32* pIsSortNeeded)
 {
-    mfs_result res;
-    int inFd, outFd;
-    struct stat info;
-    ssize_t writeBytes, readBytes, writtenBytes;
-    char buff[4096];
-
-    /* Checks weather the destination file exists. */
-    if (failIfExists && stat(pDstFilePath, &info) == 0) {
-        return MFS_ALREADY_EXISTS;
-    }
-
-    /* Acquire a file descriptor for the input file. */
-    inFd = open(pSrcFilePath, O_RDONLY);
-    if (inFd < 0) {
-        res = mfs_result_from_errno(errno);
-        return res;
-    }
+    /*
+    Works out which entry of the new snapshot each entry of the old one became, and clears the flags of new entries whose trigrams
+    can be carried over, marking them to be kept instead. Once everything that was added, removed or renamed is set aside, the remaining entries of both snapshots have
+    the same paths in the same order, so they can be paired up one by one.
+    */
+    mfs_result result;
+    mfs_tree_changes changes;
+    mfs_uint8* pIsOldSkipped;
+    size_t iChange;
+    size_t iOld = 0;
+    size_t iNew = 0;
 
-    /* Retrieve mode information of the input file. */
-    if (fstat(inFd, &info) != 0) {
-        res = mfs_result_from_errno(errno);
-        close(inFd);
-        return res;
+    result = mfs_tree_diff(pOldSnapshot, pSnapshot, &changes);
+    if (result != MFS_SUCCESS) {
+        return result;
     }
 
-    /* Create an output file and acquire its FD. */
-    outFd = open(pDstFilePath, O_CREAT | O_WRONLY | O_TRUNC, info.st_mode);
-    if (outFd < 0) {
-        res = mfs_result_from_errno(errno);
-        close(inFd);
-        return res;
+    pIsOldSkipped = (mfs_uint8*)MFS_MALLOC(pOldSnapshot->count + 1);
+    if (pIsOldSkipped == NULL) {
+        mfs_tree_changes_uninit(&changes);
+        return MFS_OUT_OF_MEMORY;
     }
+    MFS_ZERO_MEMORY(pIsOldSkipped, pOldSnapshot->count + 1);
 
-    /* Perform file copy in chunks until end of file. */
-    do {
-        readBytes = read(inFd, buff, sizeof(buff));
+    for (iChange = 0; iChange < changes.count; iChange += 1) {
+        const mfs_tree_change* pChange = &changes.pChanges[iChange];
+        size_t oldEntry = (pChange->pOld != NULL) ? (size_t)(pChange->pOld - pOldSnapshot->pEntries) : 0;
+        size_t newEntry = (pChange->pNew != NULL) ? (size_t)(pChange->pNew - pSnapshot->pEntries) : 0;
 
-        if (readBytes < 0) { /* Read error. */
-            res = mfs_result_from_errno(errno);
-            close(inFd);
-            close(outFd);
-            return res;
-        } else if (readBytes > 0) { /* Read some bytes. */
-            writtenBytes = 0;
-            do { /* Keep writing until all read bytes are written. */
-                writeBytes = write(outFd, &buff[writtenBytes], readBytes - writtenBytes);
-                if (writeBytes < 0) { /* Write error. */
-                    res = mfs_result_from_errno(errno);
-                    close(inFd);
-                    close(outFd);
-                    return res;
+        switch (pChange->type)
+        {
+            case MFS_TREE_CHANGE_ADDED:    pFlags[newEntry] |= MFS_TRIGRAM_INDEX_ADDED; break;
+            case MFS_TREE_CHANGE_REMOVED:  pIsOldSkipped[oldEntry] = MFS_TRUE; break;
+            case MFS_TREE_CHANGE_MODIFIED: pFlags[newEntry] |= MFS_TRIGRAM_INDEX_MODIFIED; break;
+
+            case MFS_TREE_CHANGE_RENAMED:
+            {
+                pFlags[newEntry] |= MFS_TRIGRAM_INDEX_ADDED;
+                pIsOldSkipped[oldEntry] = MFS_TRUE;
+
+                /* The path is different, but the contents can be kept if the file wasn't also modified. */
+                pOldToNew[oldEntry] = (mfs_uint32)newEntry;
+                if (pChange->pOld->sizeInBytes == pChange->pNew->sizeInBytes && pChange->pOld->lastModifiedTime == pChange->pNew->lastModifiedTime) {
+                    pFlags[newEntry] &= (mfs_uint8)~MFS_TRIGRAM_INDEX_NEEDS_CONTENTS;
+                    pFlags[newEntry] |= MFS_TRIGRAM_INDEX_KEEP_CONTENTS;
+                    *pIsSortNeeded = MFS_TRUE;
                 }
-                /* The write may be incomplete, thus we should keep writing until finished or an error. */
-                writtenBytes += writeBytes;
-            } while (writtenBytes < readBytes);
+            } break;
+
+            default: break;
         }
-    } while (readBytes > 0);
+    }
 
-    /* Close both FDs. */
-    close(outFd);
-    close(inFd);
+    for (;;) {
+        while (iOld < pOldSnapshot->count && pIsOldSkipped[iOld]) {
+            iOld += 1;
+        }
 
-    return MFS_SUCCESS;
-}
+        while (iNew < pSnapshot->count && (pFlags[iNew] & MFS_TRIGRAM_INDEX_ADDED) != 0) {
+            iNew += 1;
+        }
 
-mfs_result mfs_move_file__posix(const char* pSrcFilePath, const char* pDstFilePath, mfs_bool32 failIfExists)
-{
-    if (rename(pSrcFilePath, pDstFilePath) == 0) {
-        return MFS_SUCCESS;
+        if (iOld == pOldSnapshot->count || iNew == pSnapshot->count) {
+            break;
+        }
+
+        MFS_ASSERT(pOldSnapshot->pEntries[iOld].pathLength == pSnapshot->pEntries[iNew].pathLength);
+
+        pOldToNew[iOld] = (mfs_uint32)iNew;
+        pFlags[iNew] &= (mfs_uint8)~MFS_TRIGRAM_INDEX_NEEDS_PATH;
+        pFlags[iNew] |= MFS_TRIGRAM_INDEX_KEEP_PATH;
+        if ((pFlags[iNew] & MFS_TRIGRAM_INDEX_MODIFIED) == 0) {
+            pFlags[iNew] &= (mfs_uint8)~MFS_TRIGRAM_INDEX_NEEDS_CONTENTS;
+            pFlags[iNew] |= MFS_TRIGRAM_INDEX_KEEP_CONTENTS;
+        }
+
+        iOld += 1;
+        iNew += 1;
     }
 
-    return mfs_result_from_errno(errno);
+    MFS_FREE(pIsOldSkipped);
+    mfs_tree_changes_uninit(&changes);
+
+    return MFS_SUCCESS;
 }
 
-mfs_result mfs_delete_file__posix(const char* pFilePath)
+static mfs_result mfs_trigram_index_build(const mfs_trigram_index_config* pConfig, const char* pRootPath, const mfs_trigram_index_internal* pInternal, const mfs_trigram_index_internal* pOld, const mfs_tree_snapshot* pOldSnapshot, const mfs_tree_snapshot* pSnapshot, mfs_uint8** ppData, size_t* pDataSize)
 {
-    if (remove(pFilePath) == 0) {
-        return MFS_SUCCESS;
+    mfs_result result;
+    mfs_uint8* pFlags;
+    mfs_uint32* pOldToNew = NULL;
+    mfs_uint32* pFiles = NULL;
+    size_t fileCount = 0;
+    mfs_uint8* pSeen = NULL;
+    mfs_trigram_index_keys pathKeys;
+    mfs_trigram_index_keys contentKeys;
+    mfs_trigram_index_writer pathWriter;
+    mfs_trigram_index_writer contentWriter;
+    mfs_bool32 isSortNeeded = MFS_FALSE;
+    mfs_trigram_index_header header;
+    mfs_uint8* pSnapshotData = NULL;
+    size_t snapshotLength;
+    size_t tablesOffset;
+    mfs_uint8* pData;
+    size_t dataSize;
+    size_t iEntry;
+
+    MFS_ZERO_OBJECT(&pathKeys);
+    MFS_ZERO_OBJECT(&contentKeys);
+    MFS_ZERO_OBJECT(&pathWriter);
+    MFS_ZERO_OBJECT(&contentWriter);
+
+    pFlags = (mfs_uint8*)MFS_MALLOC(pSnapshot->count + 1);
+    if (pFlags == NULL) {
+        return MFS_OUT_OF_MEMORY;
     }
 
-    return mfs_result_from_errno(errno);
-}
-#endif
+    /* Everything needs extracting until it's known that it can be carried over from the old index. */
+    for (iEntry = 0; iEntry < pSnapshot->count; iEntry += 1) {
+        const mfs_tree_snapshot_entry* pEntry = &pSnapshot->pEntries[iEntry];
 
-mfs_bool32 mfs_is_directory(const char* pPath)
-{
-    if (pPath == NULL) {
-        return MFS_FALSE;
+        pFlags[iEntry] = MFS_TRIGRAM_INDEX_NEEDS_PATH;
+        if ((pConfig->flags & MFS_TRIGRAM_INDEX_FLAG_CONTENTS) != 0 && pEntry->type == MFS_FILE_TYPE_FILE && pEntry->sizeInBytes <= pConfig->maxFileSize) {
+            pFlags[iEntry] |= MFS_TRIGRAM_INDEX_NEEDS_CONTENTS;
+        }
     }
 
-#if defined(MFS_WIN32)
-    return mfs_is_directory__win32(pPath);
-#elif defined(MFS_POSIX)
-    return mfs_is_directory__posix(pPath);
-#else
-    return MFS_FALSE;
-#endif
-}
+    if (pOld != NULL) {
+        pOldToNew = (mfs_uint32*)MFS_MALLOC(sizeof(*pOldToNew) * (pOldSnapshot->count + 1));
+        if (pOldToNew == NULL) {
+            result = MFS_OUT_OF_MEMORY;
+            goto done;
+        }
 
-mfs_bool32 mfs_file_exists(const char* pFilePath)
-{
-    if (pFilePath == NULL) {
-        return MFS_FALSE;
+        for (iEntry = 0; iEntry < pOldSnapshot->count; iEntry += 1) {
+            pOldToNew[iEntry] = MFS_TRIGRAM_INDEX_NONE;
+        }
+
+        result = mfs_trigram_index_map_entries(pOldSnapshot, pSnapshot, pOldToNew, pFlags, &isSortNeeded);
+        if (result != MFS_SUCCESS) {
+            goto done;
+        }
     }
-    
-#if defined(MFS_WIN32)
-    return mfs_file_exists__win32(pFilePath);
-#elif defined(MFS_POSIX)
-    return mfs_file_exists__posix(pFilePath);
-#else
-    return MFS_FALSE;
-#endif
-}
 
+    pSeen  = (mfs_uint8*)MFS_MALLOC(MFS_TRIGRAM_INDEX_SEEN_SIZE);
+    pFiles = (mfs_uint32*)MFS_MALLOC(sizeof(*pFiles) * (pSnapshot->count + 1));
+    if (pSeen == NULL || pFiles == NULL) {
+        result = MFS_OUT_OF_MEMORY;
+        goto done;
+    }
+    MFS_ZERO_MEMORY(pSeen, MFS_TRIGRAM_INDEX_SEEN_SIZE);
 
-mfs_result mfs_copy_file(const char* pSrcFilePath, const char* pDstFilePath, mfs_bool32 failIfExists)
-{
-    if (pSrcFilePath == NULL || pDstFilePath == NULL) {
-        return MFS_INVALID_ARGS;
+    result = MFS_SUCCESS;
+    for (iEntry = 0; iEntry < pSnapshot->count && result == MFS_SUCCESS; iEntry += 1) {
+        if ((pFlags[iEntry] & MFS_TRIGRAM_INDEX_NEEDS_PATH) != 0) {
+            result = mfs_trigram_index_extract(pSnapshot->pEntries[iEntry].pPath, pSnapshot->pEntries[iEntry].pathLength, (mfs_uint32)iEntry, pSeen, &pathKeys);
+        }
+
+        if ((pFlags[iEntry] & MFS_TRIGRAM_INDEX_NEEDS_CONTENTS) != 0) {
+            pFiles[fileCount] = (mfs_uint32)iEntry;
+            fileCount += 1;
+        }
     }
 
-#if defined(MFS_WIN32)
-    return mfs_copy_file__win32(pSrcFilePath, pDstFilePath, failIfExists);
-#elif defined(MFS_POSIX)
-    return mfs_copy_file__posix(pSrcFilePath, pDstFilePath, failIfExists);
-#else
-    return MFS_NOT_IMPLEMENTED;
-#endif
-}
+    if (result == MFS_SUCCESS) {
+        result = mfs_trigram_index_sort_keys(&pathKeys);
+    }
 
-mfs_result mfs_move_file(const char* pSrcFilePath, const char* pDstFilePath, mfs_bool32 failIfExists)
-{
-    if (pSrcFilePath == NULL || pDstFilePath == NULL) {
-        return MFS_INVALID_ARGS;
+    if (result == MFS_SUCCESS) {
+        result = mfs_trigram_index_read_contents(pConfig, pInternal->pRootPath, pInternal->rootPathLength, pSnapshot, pFiles, fileCount, &contentKeys);
     }
 
-#if defined(MFS_WIN32)
-    return mfs_move_file__win32(pSrcFilePath, pDstFilePath, failIfExists);
-#elif defined(MFS_POSIX)
-    return mfs_move_file__posix(pSrcFilePath, pDstFilePath, failIfExists);
-#else
-    return MFS_NOT_IMPLEMENTED;
-#endif
-}
+    if (result == MFS_SUCCESS) {
+        result = mfs_trigram_index_sort_keys(&contentKeys);
+    }
 
-mfs_result mfs_delete_file(const char* pFilePath)
-{
-    if (pFilePath == NULL) {
-        return MFS_INVALID_ARGS;
+    /* Both tables share the posting lists, so the content lists go after the path lists. */
+    if (result == MFS_SUCCESS) {
+        result = mfs_trigram_index_write_table(&pathWriter, pOld, MFS_FALSE, (pOldSnapshot != NULL) ? pOldSnapshot->count : 0, pOldToNew, pFlags, MFS_FALSE, &pathKeys);
     }
 
-#if defined(MFS_WIN32)
-    return mfs_delete_file__win32(pFilePath);
-#elif defined(MFS_POSIX)
-    return mfs_delete_file__posix(pFilePath);
-#else
-    return MFS_NOT_IMPLEMENTED;
-#endif
-}
+    if (result == MFS_SUCCESS) {
+        contentWriter.pPostings      = pathWriter.pPostings;
+        contentWriter.postingsLength = pathWriter.postingsLength;
+        contentWriter.postingsCap    = pathWriter.postingsCap;
+        pathWriter.pPostings = NULL;
 
+        result = mfs_trigram_index_write_table(&contentWriter, pOld, MFS_TRUE, (pOldSnapshot != NULL) ? pOldSnapshot->count : 0, pOldToNew, pFlags, isSortNeeded, &contentKeys);
+    }
 
-#if defined(MFS_WIN32)
-mfs_result mfs_get_file_info__win32(const char* pFilePath, mfs_file_info* pFileInfo)
-{
-    MFS_ASSERT(pFilePath != NULL);
+    if (result == MFS_SUCCESS) {
+        result = mfs_tree_snapshot_encode(pSnapshot, pRootPath, &pSnapshotData, &snapshotLength);
+    }
 
-    /* pFileInfo can be null, in which case it's equivalent to just checking if the file exist. */
-    if (pFileInfo == NULL) {
-        if (GetFileAttributesA(pFilePath) != INVALID_FILE_ATTRIBUTES) {
-            return MFS_SUCCESS;
-        }
+    if (result != MFS_SUCCESS) {
+        goto done;
+    }
 
-        return MFS_DOES_NOT_EXIST;
-    } else {
-        WIN32_FILE_ATTRIBUTE_DATA fad;
-        if (GetFileAttributesExA(pFilePath, GetFileExInfoStandard, &fad)) {
-            ULARGE_INTEGER li;
+    tablesOffset = (sizeof(header) + snapshotLength + 7) & ~(size_t)7;
+    dataSize     = tablesOffset + sizeof(mfs_trigram_index_record) * (pathWriter.recordCount + contentWriter.recordCount) + contentWriter.postingsLength;
 
-            li.LowPart  = fad.nFileSizeLow;
-            li.HighPart = fad.nFileSizeHigh;
-            pFileInfo->sizeInBytes = li.QuadPart;
+    pData = (mfs_uint8*)MFS_MALLOC(dataSize);
+    if (pData == NULL) {
+        result = MFS_OUT_OF_MEMORY;
+        goto done;
+    }
 
-            li.LowPart  = fad.ftLastWriteTime.dwLowDateTime;
-            li.HighPart = fad.ftLastWriteTime.dwHighDateTime;
-            pFileInfo->lastModifiedTime = li.QuadPart;
+    MFS_ZERO_MEMORY(pData, tablesOffset);
+    MFS_COPY_MEMORY(pData + sizeof(header), pSnapshotData, snapshotLength);
+    MFS_COPY_MEMORY(pData + tablesOffset, pathWriter.pRecords, sizeof(mfs_trigram_index_record) * pathWriter.recordCount);
+    MFS_COPY_MEMORY(pData + tablesOffset + sizeof(mfs_trigram_index_record) * pathWriter.recordCount, contentWriter.pRecords, sizeof(mfs_trigram_index_record) * contentWriter.recordCount);
+    MFS_COPY_MEMORY(pData + dataSize - contentWriter.postingsLength, contentWriter.pPostings, contentWriter.postingsLength);
+
+    MFS_ZERO_OBJECT(&header);
+    MFS_COPY_MEMORY(header.magic, "mfstgrm", 8);
+    header.version             = MFS_TRIGRAM_INDEX_VERSION;
+    header.byteOrderMark       = MFS_TREE_INDEX_BYTE_ORDER_MARK;
+    header.flags               = pConfig->flags;
+    header.maxFileSize         = pConfig->maxFileSize;
+    header.snapshotLength      = snapshotLength;
+    header.pathTrigramCount    = pathWriter.recordCount;
+    header.contentTrigramCount = contentWriter.recordCount;
+    header.postingsLength      = contentWriter.postingsLength;
+    header.checksum            = mfs_crc32c_update(0xFFFFFFFF, pData + tablesOffset, dataSize - tablesOffset) ^ 0xFFFFFFFF;
+    MFS_COPY_MEMORY(pData, &header, sizeof(header));
+
+    *ppData    = pData;
+    *pDataSize = dataSize;
+
+done:
+    MFS_FREE(pSnapshotData);
+    MFS_FREE(pathWriter.pRecords);
+    MFS_FREE(pathWriter.pPostings);
+    MFS_FREE(pathWriter.pList);
+    MFS_FREE(pathWriter.pMerged);
+    MFS_FREE(contentWriter.pRecords);
+    MFS_FREE(contentWriter.pPostings);
+    MFS_FREE(contentWriter.pList);
+    MFS_FREE(contentWriter.pMerged);
+    MFS_FREE(contentKeys.pKeys);
+    MFS_FREE(pathKeys.pKeys);
+    MFS_FREE(pFiles);
+    MFS_FREE(pSeen);
+    MFS_FREE(pOldToNew);
+    MFS_FREE(pFlags);
 
-            li.LowPart  = fad.ftLastAccessTime.dwLowDateTime;
-            li.HighPart = fad.ftLastAccessTime.dwHighDateTime;
-            pFileInfo->lastAccessTime = li.QuadPart;
+    return result;
+}
 
-            pFileInfo->isDirectory = (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
-            pFileInfo->isReadOnly  = (fad.dwFileAttributes & FILE_ATTRIBUTE_READONLY)  != 0;
+static mfs_result mfs_trigram_index_parse(const mfs_uint8* pData, size_t dataSize, mfs_bool32 isMapped, mfs_trigram_index_internal* pInternal)
+{
+    /* Points the tables at the data, which is owned by the index from here on, even on failure. Doesn't verify the checksum. */
+    mfs_trigram_index_header header;
+    size_t tablesOffset;
+    size_t tablesSize;
 
-            return MFS_SUCCESS;
-        }
+    pInternal->pData    = pData;
+    pInternal->dataSize = dataSize;
+    pInternal->isMapped = isMapped;
 
-        return MFS_DOES_NOT_EXIST;
+    if (dataSize < sizeof(header)) {
+        return MFS_INVALID_FILE;
     }
-}
-#elif defined(MFS_POSIX)
-mfs_result mfs_get_file_info__posix(const char* pFilePath, mfs_file_info* pFileInfo)
-{
-    struct stat info;
 
-    MFS_ASSERT(pFilePath != NULL);
+    MFS_COPY_MEMORY(&header, pData, sizeof(header));
+    if (memcmp(header.magic, "mfstgrm", 8) != 0 || header.version != MFS_TRIGRAM_INDEX_VERSION || header.byteOrderMark != MFS_TREE_INDEX_BYTE_ORDER_MARK) {
+        return MFS_INVALID_FILE;
+    }
 
-    if (stat(pFilePath, &info) != 0) {
-        return mfs_result_from_errno(errno);
+    if (header.snapshotLength > dataSize - sizeof(header)) {
+        return MFS_INVALID_FILE;
     }
 
-    if (pFileInfo != NULL) {
-        pFileInfo->sizeInBytes      = info.st_size;
-        pFileInfo->lastModifiedTime = info.st_mtime;
-        pFileInfo->lastAccessTime   = info.st_atime;
-        pFileInfo->isDirectory      = S_ISDIR(info.st_mode);
-        pFileInfo->isReadOnly       = (access(pFilePath, W_OK) != 0);
+    tablesOffset = (sizeof(header) + (size_t)header.snapshotLength + 7) & ~(size_t)7;
+    if (tablesOffset > dataSize) {
+        return MFS_INVALID_FILE;
+    }
+
+    tablesSize = dataSize - tablesOffset;
+    if (header.pathTrigramCount > tablesSize / sizeof(mfs_trigram_index_record) || header.contentTrigramCount > tablesSize / sizeof(mfs_trigram_index_record) - header.pathTrigramCount ||
+        header.postingsLength != tablesSize - (header.pathTrigramCount + header.contentTrigramCount) * sizeof(mfs_trigram_index_record)) {
+        return MFS_INVALID_FILE;
     }
 
+    pInternal->pPathTable          = (const mfs_trigram_index_record*)(pData + tablesOffset);
+    pInternal->pathTrigramCount    = (size_t)header.pathTrigramCount;
+    pInternal->pContentTable       = pInternal->pPathTable + header.pathTrigramCount;
+    pInternal->contentTrigramCount = (size_t)header.contentTrigramCount;
+    pInternal->pPostings           = (const mfs_uint8*)(pInternal->pContentTable + header.contentTrigramCount);
+    pInternal->postingsLength      = (size_t)header.postingsLength;
+    pInternal->flags               = header.flags;
+    pInternal->maxFileSize         = header.maxFileSize;
+
     return MFS_SUCCESS;
 }
-#endif
 
-mfs_result mfs_get_file_info(const char* pFilePath, mfs_file_info* pFileInfo)
+static mfs_result mfs_trigram_index_load(const char* pFilePath, const char* pRootPath, const mfs_trigram_index_config* pConfig, mfs_trigram_index_internal* pInternal, mfs_tree_snapshot* pSnapshot)
 {
-    if (mfs_string_is_null_or_empty(pFilePath)) {
-        return MFS_INVALID_ARGS;
-    }
+    mfs_result result;
+    const mfs_uint8* pData;
+    size_t dataSize;
+    mfs_bool32 isMapped;
+    mfs_trigram_index_header header;
 
-    /*
-    The caller will always have access to the original file path so I think it's OK to just copy as much of the name into the pre-allocated space
-    as possible and just truncate the rest. This will cover the majority of cases. Since the caller already has access to the original path, I
-    think this might be more useful to just store the file name portion rather than the whole path.
-    */
-    if (pFileInfo != NULL) {
-        mfs_strncpy_s(pFileInfo->pFileName, sizeof(pFileInfo->pFileName), mfs_path_file_name(pFilePath), (size_t)-1);
+    result = mfs_tree_index_map(pFilePath, &pData, &dataSize, &isMapped);
+    if (result != MFS_SUCCESS) {
+        return result;
     }
 
-#if defined(MFS_WIN32)
-    return mfs_get_file_info__win32(pFilePath, pFileInfo);
-#elif defined(MFS_POSIX)
-    return mfs_get_file_info__posix(pFilePath, pFileInfo);
-#else
-    return MFS_NOT_IMPLEMENTED; /* Unsupported platform. */
-#endif
-}
+    result = mfs_trigram_index_parse(pData, dataSize, isMapped, pInternal);
+    if (result == MFS_SUCCESS && (pInternal->flags != pConfig->flags || pInternal->maxFileSize != pConfig->maxFileSize)) {
+        result = MFS_INVALID_FILE;  /* Built with different settings. */
+    }
 
+    if (result == MFS_SUCCESS) {
+        MFS_COPY_MEMORY(&header, pData, sizeof(header));
+        if ((mfs_crc32c_update(0xFFFFFFFF, (const mfs_uint8*)pInternal->pPathTable, dataSize - (size_t)((const mfs_uint8*)pInternal->pPathTable - pData)) ^ 0xFFFFFFFF) != header.checksum) {
+            result = MFS_CHECKSUM_MISMATCH;
+        }
+    }
 
-#if defined(MFS_WIN32)
-mfs_result mfs_WIN32_FIND_DATAA_to_file_info(const WIN32_FIND_DATAA* pWin32FindData, mfs_file_info* pFileInfo)
-{
-    ULARGE_INTEGER li;
+    if (result == MFS_SUCCESS) {
+        result = mfs_tree_snapshot_decode(pData + sizeof(header), (size_t)header.snapshotLength, pRootPath, pSnapshot);
+    }
 
-    MFS_ASSERT(pWin32FindData != NULL);
-    MFS_ASSERT(pFileInfo != NULL);
+    if (result != MFS_SUCCESS) {
+        mfs_tree_index_unmap(pData, dataSize, isMapped);
+        return result;
+    }
 
-    /* Slashes need to be normalized to forward slashes. */
-    mfs_path_to_forward_slashes(pFileInfo->pFileName, sizeof(pFileInfo->pFileName), pWin32FindData->cFileName, NULL);
+    return MFS_SUCCESS;
+}
 
-    li.LowPart  = pWin32FindData->nFileSizeLow;
-    li.HighPart = pWin32FindData->nFileSizeHigh;
-    pFileInfo->sizeInBytes = li.QuadPart;
+static void mfs_trigram_index_free_data(mfs_trigram_index_internal* pInternal)
+{
+    if (pInternal->pData != NULL) {
+        mfs_tree_index_unmap(pInternal->pData, pInternal->dataSize, pInternal->isMapped);
+        pInternal->pData = NULL;
+    }
+}
 
-    li.LowPart  = pWin32FindData->ftLastWriteTime.dwLowDateTime;
-    li.HighPart = pWin32FindData->ftLastWriteTime.dwHighDateTime;
-    pFileInfo->lastModifiedTime = li.QuadPart;
+mfs_trigram_index_config mfs_trigram_index_config_init(void)
+{
+    mfs_trigram_index_config config;
 
-    li.LowPart  = pWin32FindData->ftLastAccessTime.dwLowDateTime;
-    li.HighPart = pWin32FindData->ftLastAccessTime.dwHighDateTime;
-    pFileInfo->lastAccessTime = li.QuadPart;
-    
-    pFileInfo->isDirectory = (pWin32FindData->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
-    pFileInfo->isReadOnly  = (pWin32FindData->dwFileAttributes & FILE_ATTRIBUTE_READONLY)  != 0;
+    MFS_ZERO_OBJECT(&config);
+    config.maxFileSize = 1048576;
 
-    return MFS_SUCCESS;
+    return config;
 }
 
-mfs_result mfs_iterator_init__win32(const char* pDirectoryPath, mfs_iterator* pIterator)
+mfs_result mfs_trigram_index_open(const char* pIndexFilePath, const char* pRootPath, const mfs_trigram_index_config* pConfig, mfs_trigram_index* pIndex)
 {
     mfs_result result;
-    char query[MAX_PATH];
-    size_t queryLen;
-    WIN32_FIND_DATAA fd;
+    mfs_trigram_index_config config;
+    mfs_tree_snapshot_config snapshotConfig;
+    mfs_trigram_index_internal* pInternal;
+    mfs_trigram_index_internal old;
+    mfs_tree_snapshot previous;
+    mfs_bool32 isLoaded;
+    mfs_uint8* pData = NULL;
+    size_t dataSize = 0;
+
+    if (pIndex == NULL) {
+        return MFS_INVALID_ARGS;
+    }
 
-    MFS_ASSERT(pDirectoryPath != NULL);
-    MFS_ASSERT(pIterator != NULL);
+    MFS_ZERO_OBJECT(pIndex);
 
-    /* We need to make sure slashes are normalized to back slashes for Win32. */
-    result = mfs_path_to_back_slashes(query, sizeof(query), pDirectoryPath, &queryLen);
-    if (result != MFS_SUCCESS) {
-        return result;
+    if (pIndexFilePath == NULL || pRootPath == NULL) {
+        return MFS_INVALID_ARGS;
     }
 
-    if (queryLen >= MAX_PATH-3) {
-        return MFS_PATH_TOO_LONG;
+    if (pConfig != NULL) {
+        config = *pConfig;
+    } else {
+        config = mfs_trigram_index_config_init();
     }
 
-    /* An empty path means the current directory. */
-    if (query[0] == '\0') {
-        query[0] = '.';
-        query[1] = '\0';
-        queryLen += 1;
+    if (pRootPath[0] == '\0') {
+        pRootPath = ".";
+    }
+
+    pInternal = (mfs_trigram_index_internal*)MFS_MALLOC(sizeof(*pInternal));
+    if (pInternal == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+    MFS_ZERO_OBJECT(pInternal);
+
+    pInternal->rootPathLength = strlen(pRootPath);
+    while (pInternal->rootPathLength > 0 && mfs_is_path_separator(pRootPath[pInternal->rootPathLength - 1])) {
+        pInternal->rootPathLength -= 1;
+    }
+
+    pInternal->pRootPath = (char*)MFS_MALLOC(pInternal->rootPathLength + 1);
+    if (pInternal->pRootPath == NULL) {
+        MFS_FREE(pInternal);
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    MFS_COPY_MEMORY(pInternal->pRootPath, pRootPath, pInternal->rootPathLength);
+    pInternal->pRootPath[pInternal->rootPathLength] = '\0';
+
+    /* A file that can't be loaded for whatever reason is just replaced. */
+    MFS_ZERO_OBJECT(&old);
+    isLoaded = mfs_trigram_index_load(pIndexFilePath, pRootPath, &config, &old, &previous) == MFS_SUCCESS;
+
+    snapshotConfig = mfs_tree_snapshot_config_init();
+    snapshotConfig.flags     = config.snapshotFlags;
+    snapshotConfig.pPrevious = (isLoaded) ? &previous : NULL;
+    snapshotConfig.pExclude  = config.pExclude;
+    snapshotConfig.onError   = config.onError;
+    snapshotConfig.pUserData = config.pUserData;
+
+    result = mfs_tree_snapshot_init(pRootPath, &snapshotConfig, &pIndex->snapshot);
+    if (result == MFS_SUCCESS && pIndex->snapshot.count >= MFS_TRIGRAM_INDEX_NONE) {
+        mfs_tree_snapshot_uninit(&pIndex->snapshot);
+        result = MFS_TOO_BIG;   /* Entries are stored as 32-bit indices. */
     }
 
-    /* We need to add a wildcard, making sure we don't duplicate any trailing slash. */
-    if (query[queryLen-1] == '\\' || query[queryLen-1] == '/') {
-        query[queryLen+0] = '*';
-        query[queryLen+1] = '\0';
-        queryLen += 1;
-    } else {
-        query[queryLen+0] = '\\';
-        query[queryLen+1] = '*';
-        query[queryLen+2] = '\0';
-        queryLen += 2;
+    if (result == MFS_SUCCESS) {
+        if (isLoaded && mfs_tree_snapshot_equal(&previous, &pIndex->snapshot)) {
+            /* Nothing changed, so the old file can be used as it is. This also keeps its older scan time for the next racy check. */
+            pInternal->pData               = old.pData;
+            pInternal->dataSize            = old.dataSize;
+            pInternal->isMapped            = old.isMapped;
+            pInternal->pPathTable          = old.pPathTable;
+            pInternal->pathTrigramCount    = old.pathTrigramCount;
+            pInternal->pContentTable       = old.pContentTable;
+            pInternal->contentTrigramCount = old.contentTrigramCount;
+            pInternal->pPostings           = old.pPostings;
+            pInternal->postingsLength      = old.postingsLength;
+            pInternal->flags               = old.flags;
+            pInternal->maxFileSize         = old.maxFileSize;
+            old.pData = NULL;
+        } else {
+            result = mfs_trigram_index_build(&config, pRootPath, pInternal, (isLoaded) ? &old : NULL, (isLoaded) ? &previous : NULL, &pIndex->snapshot, &pData, &dataSize);
+            if (result == MFS_INVALID_FILE) {
+                /* The old lists are corrupt in a way the checksum didn't catch. Start again from nothing. */
+                result = mfs_trigram_index_build(&config, pRootPath, pInternal, NULL, NULL, &pIndex->snapshot, &pData, &dataSize);
+            }
+
+            if (result == MFS_SUCCESS) {
+                mfs_result writeResult = mfs_tree_index_write_file(pIndexFilePath, pData, dataSize);
+                if (writeResult != MFS_SUCCESS && config.onError != NULL) {
+                    config.onError(config.pUserData, pIndexFilePath, writeResult);
+                }
+
+                result = mfs_trigram_index_parse(pData, dataSize, MFS_FALSE, pInternal);
+            }
+        }
     }
 
-    pIterator->win32.handle = (mfs_handle)FindFirstFileA(query, &fd);
-    if (pIterator->win32.handle == INVALID_HANDLE_VALUE) {
-        pIterator->win32.handle = NULL;
-        return mfs_result_from_GetLastError(GetLastError());
-    };
+    if (isLoaded) {
+        mfs_trigram_index_free_data(&old);
+        mfs_tree_snapshot_uninit(&previous);
+    }
 
-    result = mfs_WIN32_FIND_DATAA_to_file_info(&fd, &pIterator->win32.fi);
     if (result != MFS_SUCCESS) {
-        FindClose((HANDLE)pIterator->win32.handle);
-        pIterator->win32.handle = NULL;
+        mfs_trigram_index_free_data(pInternal);
+        MFS_FREE(pInternal->pRootPath);
+        MFS_FREE(pInternal);
+        mfs_tree_snapshot_uninit(&pIndex->snapshot);
+        MFS_ZERO_OBJECT(pIndex);
         return result;
     }
 
-    pIterator->win32.atEnd = MFS_FALSE;
+    pIndex->pInternal = pInternal;
 
     return MFS_SUCCESS;
 }
 
-void mfs_iterator_uninit__win32(mfs_iterator* pIterator)
+void mfs_trigram_index_close(mfs_trigram_index* pIndex)
 {
-    MFS_ASSERT(pIterator != NULL);
+    mfs_trigram_index_internal* pInternal;
 
-    FindClose((HANDLE)pIterator->win32.handle);
-    pIterator->win32.handle = NULL;
+    if (pIndex == NULL) {
+        return;
+    }
+
+    pInternal = (mfs_trigram_index_internal*)pIndex->pInternal;
+    if (pInternal != NULL) {
+        mfs_trigram_index_free_data(pInternal);
+        MFS_FREE(pInternal->pRootPath);
+        MFS_FREE(pInternal);
+    }
+
+    mfs_tree_snapshot_uninit(&pIndex->snapshot);
+    MFS_ZERO_OBJECT(pIndex);
 }
 
-mfs_result mfs_iterator_next__win32(mfs_iterator* pIterator, mfs_file_info* pFileInfo)
+static const mfs_trigram_index_record* mfs_trigram_index_lookup(const mfs_trigram_index_record* pTable, size_t count, mfs_uint32 trigram)
 {
-    WIN32_FIND_DATAA fd;
+    size_t lo = 0;
+    size_t hi = count;
 
-    MFS_ASSERT(pIterator != NULL);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
 
-    if (pIterator->win32.atEnd) {
-        return MFS_AT_END;
+        if (pTable[mid].trigram < trigram) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
 
-    MFS_ASSERT(pIterator->win32.atEnd == MFS_FALSE);
+    return (lo < count && pTable[lo].trigram == trigram) ? &pTable[lo] : NULL;
+}
 
-    /* The file info will have already been retrieved. The first file is retrieved in mfs_iterator_init__win32(). */
-    if (pFileInfo != NULL) {
-        MFS_COPY_MEMORY(pFileInfo, &pIterator->win32.fi, sizeof(*pFileInfo));
+static mfs_result mfs_trigram_index_find_candidates(const mfs_trigram_index* pIndex, const char* pText, size_t textLength, mfs_bool32 isContents, mfs_uint32** ppCandidates, size_t* pCandidateCount)
+{
+    /*
+    Intersects the lists of every trigram in the text, starting with the shortest so the candidates shrink as quickly as possible.
+    The lists are sorted, so each one is merged against the candidates in a single pass.
+    */
+    const mfs_trigram_index_internal* pInternal = (const mfs_trigram_index_internal*)pIndex->pInternal;
+    const mfs_trigram_index_record* pTable = (isContents) ? pInternal->pContentTable : pInternal->pPathTable;
+    size_t trigramCount = (isContents) ? pInternal->contentTrigramCount : pInternal->pathTrigramCount;
+    const mfs_trigram_index_record** ppLists;
+    size_t listCount = 0;
+    mfs_uint32* pCandidates = NULL;
+    size_t candidateCount = 0;
+    size_t iList;
+    size_t i;
+
+    *ppCandidates    = NULL;
+    *pCandidateCount = 0;
+
+    ppLists = (const mfs_trigram_index_record**)MFS_MALLOC(sizeof(*ppLists) * (textLength - 2));
+    if (ppLists == NULL) {
+        return MFS_OUT_OF_MEMORY;
     }
 
-    /* Now we need to get the next file and store the info. */
-    if (FindNextFileA((HANDLE)pIterator->win32.handle, &fd)) {
-        mfs_WIN32_FIND_DATAA_to_file_info(&fd, &pIterator->win32.fi);
-    } else {
-        pIterator->win32.atEnd = MFS_TRUE;  /* Reached the end. */
+    for (i = 0; i + 2 < textLength; i += 1) {
+        mfs_uint32 trigram = ((mfs_uint32)(mfs_uint8)mfs_regex_fold(pText[i]) << 16) | ((mfs_uint32)(mfs_uint8)mfs_regex_fold(pText[i + 1]) << 8) | (mfs_uint8)mfs_regex_fold(pText[i + 2]);
+        const mfs_trigram_index_record* pList = mfs_trigram_index_lookup(pTable, trigramCount, trigram);
+        size_t iInsert;
+
+        if (pList == NULL) {
+            MFS_FREE(ppLists);
+            return MFS_SUCCESS; /* Nothing contains this trigram, so nothing can match. */
+        }
+
+        for (iList = 0; iList < listCount; iList += 1) {
+            if (ppLists[iList] == pList) {
+                break;
+            }
+        }
+
+        if (iList < listCount) {
+            continue;
+        }
+
+        iInsert = listCount;
+        while (iInsert > 0 && ppLists[iInsert - 1]->count > pList->count) {
+            ppLists[iInsert] = ppLists[iInsert - 1];
+            iInsert -= 1;
+        }
+
+        ppLists[iInsert] = pList;
+        listCount += 1;
+    }
+
+    for (iList = 0; iList < listCount; iList += 1) {
+        const mfs_trigram_index_record* pList = ppLists[iList];
+        size_t cursor = (size_t)pList->offset;
+        mfs_uint64 entry = 0;
+        size_t iCandidate = 0;
+        size_t outputCount = 0;
+
+        if (iList == 0) {
+            pCandidates = (mfs_uint32*)MFS_MALLOC(sizeof(*pCandidates) * (pList->count + 1));
+            if (pCandidates == NULL) {
+                MFS_FREE(ppLists);
+                return MFS_OUT_OF_MEMORY;
+            }
+        }
+
+        for (i = 0; i < pList->count; i += 1) {
+            mfs_uint64 delta;
+
+            if (pList->offset > pInternal->postingsLength || mfs_tree_index_read_varint(pInternal->pPostings, pInternal->postingsLength, &cursor, &delta) == MFS_FALSE || delta >= pIndex->snapshot.count - entry) {
+                MFS_FREE(pCandidates);
+                MFS_FREE(ppLists);
+                return MFS_INVALID_FILE;
+            }
+
+            entry += delta;
+
+            if (iList == 0) {
+                pCandidates[outputCount] = (mfs_uint32)entry;
+                outputCount += 1;
+            } else {
+                while (iCandidate < candidateCount && pCandidates[iCandidate] < entry) {
+                    iCandidate += 1;
+                }
+
+                if (iCandidate == candidateCount) {
+                    break;
+                }
+
+                if (pCandidates[iCandidate] == entry) {
+                    pCandidates[outputCount] = (mfs_uint32)entry;
+                    outputCount += 1;
+                    iCandidate  += 1;
+                }
+            }
+        }
+
+        candidateCount = outputCount;
+        if (candidateCount == 0) {
+            break;
+        }
     }
 
+    MFS_FREE(ppLists);
+
+    *ppCandidates    = pCandidates;
+    *pCandidateCount = candidateCount;
+
     return MFS_SUCCESS;
 }
-#endif
 
-#if defined(MFS_POSIX)
-mfs_result mfs_iterator_init__posix(const char* pDirectoryPath, mfs_iterator* pIterator)
+static mfs_result mfs_trigram_index_find(const mfs_trigram_index* pIndex, const char* pText, mfs_uint32 flags, mfs_bool32 isContents, mfs_trigram_index_proc onMatch, void* pUserData)
 {
-    DIR* dir;
-    size_t directoryPathLen;
-
-    MFS_ASSERT(pDirectoryPath != NULL);
-    MFS_ASSERT(pIterator != NULL);
+    mfs_result result = MFS_SUCCESS;
+    const mfs_trigram_index_internal* pInternal;
+    mfs_bool32 isCaseInsensitive = (flags & MFS_SEARCH_FLAG_CASE_INSENSITIVE) != 0;
+    mfs_uint32* pCandidates = NULL;
+    size_t candidateCount;
+    size_t textLength;
+    char* pPath = NULL;
+    size_t pathCap = 0;
+    char* pBuffer = NULL;
+    size_t bufferCap = 0;
+    size_t iCandidate;
+
+    if (pIndex == NULL || pIndex->pInternal == NULL || pText == NULL || onMatch == NULL) {
+        return MFS_INVALID_ARGS;
+    }
 
-    /* In our implementation, an empty string is equivalent to ".". */
-    if (pDirectoryPath[0] == '\0') {
-        pDirectoryPath = ".";
+    pInternal = (const mfs_trigram_index_internal*)pIndex->pInternal;
+    if (isContents && (pInternal->flags & MFS_TRIGRAM_INDEX_FLAG_CONTENTS) == 0) {
+        return MFS_INVALID_OPERATION;
     }
 
-    dir = opendir(pDirectoryPath);
-    if (dir == NULL) {
-        return mfs_result_from_errno(errno);
+    textLength = strlen(pText);
+
+    /* Without a whole trigram to go on, everything is a candidate. */
+    if (textLength >= 3) {
+        result = mfs_trigram_index_find_candidates(pIndex, pText, textLength, isContents, &pCandidates, &candidateCount);
+        if (result != MFS_SUCCESS) {
+            return result;
+        }
+    } else {
+        candidateCount = pIndex->snapshot.count;
     }
 
-    /* We need to keep track of the path so we can avoid changing the working directory in mfs_iterator_next__posix() when stat-ing the file. */
-    directoryPathLen = strlen(pDirectoryPath);
-    pIterator->posix.pPath = (char*)MFS_MALLOC(directoryPathLen + 1);   /* +1 for null terminator. */
-    if (pIterator->posix.pPath == NULL) {
-        closedir(dir);
-        return MFS_OUT_OF_MEMORY;
+    for (iCandidate = 0; iCandidate < candidateCount; iCandidate += 1) {
+        const mfs_tree_snapshot_entry* pEntry = &pIndex->snapshot.pEntries[(pCandidates != NULL) ? pCandidates[iCandidate] : iCandidate];
+        size_t offset;
+
+        if (isContents) {
+            size_t dataSize;
+
+            if (pEntry->type != MFS_FILE_TYPE_FILE || pEntry->sizeInBytes > pInternal->maxFileSize) {
+                continue;
+            }
+
+            if (mfs_trigram_index_full_path(pInternal->pRootPath, pInternal->rootPathLength, pEntry, &pPath, &pathCap) == NULL) {
+                result = MFS_OUT_OF_MEMORY;
+                break;
+            }
+
+            if (mfs_trigram_index_read_file(pPath, pInternal->maxFileSize, &pBuffer, &bufferCap, &dataSize) != MFS_SUCCESS || mfs_trigram_index_is_binary(pBuffer, dataSize)) {
+                continue;
+            }
+
+            if (textLength > 0 && mfs_search_find_literal(pText, textLength, isCaseInsensitive, pBuffer, dataSize, &offset) == MFS_FALSE) {
+                continue;
+            }
+        } else {
+            if (textLength > 0 && mfs_search_find_literal(pText, textLength, isCaseInsensitive, pEntry->pPath, pEntry->pathLength, &offset) == MFS_FALSE) {
+                continue;
+            }
+        }
+
+        if (onMatch(pUserData, pEntry) == MFS_WALK_STOP) {
+            result = MFS_CANCELLED;
+            break;
+        }
     }
-    mfs_strcpy_s(pIterator->posix.pPath, directoryPathLen+1, pDirectoryPath);
 
-    pIterator->posix.dir = dir;
+    MFS_FREE(pBuffer);
+    MFS_FREE(pPath);
+    MFS_FREE(pCandidates);
 
-    return MFS_SUCCESS;
+    return result;
 }
 
-void mfs_iterator_uninit__posix(mfs_iterator* pIterator)
+mfs_result mfs_trigram_index_find_paths(const mfs_trigram_index* pIndex, const char* pText, mfs_uint32 flags, mfs_trigram_index_proc onMatch, void* pUserData)
 {
-    MFS_ASSERT(pIterator != NULL);
-
-    closedir((DIR*)pIterator->posix.dir);
-    pIterator->posix.dir = NULL;
-
-    MFS_FREE(pIterator->posix.pPath);
-    pIterator->posix.pPath = NULL;
+    return mfs_trigram_index_find(pIndex, pText, flags, MFS_FALSE, onMatch, pUserData);
 }
 
-mfs_result mfs_iterator_next__posix(mfs_iterator* pIterator, mfs_file_info* pFileInfo)
+mfs_result mfs_trigram_index_find_contents(const mfs_trigram_index* pIndex, const char* pText, mfs_uint32 flags, mfs_trigram_index_proc onMatch, void* pUserData)
 {
-    mfs_result result;
-    struct dirent* info;
-    struct stat statInfo;
-    int statResult;
-    mfs_bool32 hasWritePermissions;
-    size_t filePathLen;
-    char* pFilePath;
-    char* pFilePathHeap = NULL;
-    char  pFilePathStack[1024];
+    return mfs_trigram_index_find(pIndex, pText, flags, MFS_TRUE, onMatch, pUserData);
+}
 
-    MFS_ASSERT(pIterator != NULL);
-    MFS_ASSERT(pFileInfo != NULL);
 
-    info = readdir((DIR*)pIterator->posix.dir);
-    if (info == NULL) {
-        return MFS_AT_END;
-    }
+
+
+/* Paths */
+
+/*
+Scanning for separators, dots and null terminators is done 16 bytes at a time with SSE2 or NEON when available. SSE2 is always there
+on 64-bit x86 and paths are rarely long enough for anything wider to pay for the runtime dispatch it would need.
+*/
+#if !defined(MFS_NO_SIMD)
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define MFS_SUPPORT_SSE2
+        #include <emmintrin.h>
+    #elif defined(__ARM_NEON) && defined(__aarch64__)
+        #define MFS_SUPPORT_NEON
+        #include <arm_neon.h>
+    #endif
+#endif
+
+#if defined(MFS_SUPPORT_SSE2) || defined(MFS_SUPPORT_NEON)
+    #define MFS_PATH_SIMD
+
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
 
     /*
-    We don't want to change the working directory as this has thread-safety implications. We instead need to append the file name to the
-    directory path of the iterator.
+    The forward scans read whole aligned blocks, which can't cross into another page, so reading past the null terminator is safe so
+    long as the extra bytes are ignored. AddressSanitizer doesn't know that, so it's disabled for those functions.
     */
-    result = mfs_path_append(NULL, 0, pIterator->posix.pPath, info->d_name, &filePathLen);
-    if (result != MFS_SUCCESS) {
-        return result;
-    }
+    #if defined(__clang__)
+        #if defined(__has_feature)
+            #if __has_feature(address_sanitizer)
+                #define MFS_NO_SANITIZE_ADDRESS __attribute__((no_sanitize("address")))
+            #endif
+        #endif
+    #elif defined(__GNUC__) && defined(__SANITIZE_ADDRESS__)
+        #define MFS_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+    #endif
+#endif
 
-    if (filePathLen < sizeof(pFilePathStack)) {
-        pFilePath = pFilePathStack;
-    } else {
-        pFilePathHeap = MFS_MALLOC(filePathLen + 1);
-        if (pFilePathHeap == NULL) {
-            return MFS_OUT_OF_MEMORY;
-        }
+#if !defined(MFS_NO_SANITIZE_ADDRESS)
+    #define MFS_NO_SANITIZE_ADDRESS
+#endif
 
-        pFilePath = pFilePathHeap;
-    }
+#if defined(MFS_PATH_SIMD)
+static unsigned int mfs_bit_scan_forward(unsigned int mask)
+{
+    MFS_ASSERT(mask != 0);
 
-    result = mfs_path_append(pFilePath, filePathLen+1, pIterator->posix.pPath, info->d_name, NULL);
-    if (result != MFS_SUCCESS) {
-        MFS_FREE(pFilePathHeap);
-        return result;
+#if defined(_MSC_VER)
+    {
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (unsigned int)index;
     }
+#else
+    return (unsigned int)__builtin_ctz(mask);
+#endif
+}
 
-    statResult = stat(pFilePath, &statInfo);
-    hasWritePermissions = (access(pFilePath, W_OK) == 0);
-
-    MFS_FREE(pFilePathHeap);
-    pFilePathHeap = NULL;
-    pFilePath = NULL;
+static unsigned int mfs_bit_scan_reverse(unsigned int mask)
+{
+    MFS_ASSERT(mask != 0);
 
-    if (statResult != 0) {
-        return mfs_result_from_errno(errno);
+#if defined(_MSC_VER)
+    {
+        unsigned long index;
+        _BitScanReverse(&index, mask);
+        return (unsigned int)index;
     }
+#else
+    return 31 - (unsigned int)__builtin_clz(mask);
+#endif
+}
 
-    mfs_strcpy_s(pFileInfo->pFileName, sizeof(pFileInfo->pFileName), info->d_name);
-    pFileInfo->sizeInBytes      = statInfo.st_size;
-    pFileInfo->lastModifiedTime = statInfo.st_mtime;
-    pFileInfo->lastAccessTime   = statInfo.st_atime;
-    pFileInfo->isDirectory      = S_ISDIR(statInfo.st_mode);
-    pFileInfo->isReadOnly       = !hasWritePermissions;
+MFS_NO_SANITIZE_ADDRESS
+static unsigned int mfs_path_simd_match(const char* pBlock, char c0, char c1)
+{
+    /*
+    Returns a mask where bit i is set if pBlock[i] is either c0 or c1. 16 bytes must be readable from pBlock. This does the actual
+    loads, so it needs to opt out of AddressSanitizer too for when it's not inlined.
+    */
+#if defined(MFS_SUPPORT_SSE2)
+    __m128i block = _mm_loadu_si128((const __m128i*)pBlock);
+    __m128i match = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(c0)), _mm_cmpeq_epi8(block, _mm_set1_epi8(c1)));
 
-    return MFS_SUCCESS;
+    return (unsigned int)_mm_movemask_epi8(match);
+#else
+    static const mfs_uint8 bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t block = vld1q_u8((const mfs_uint8*)pBlock);
+    uint8x16_t match = vorrq_u8(vceqq_u8(block, vdupq_n_u8((mfs_uint8)c0)), vceqq_u8(block, vdupq_n_u8((mfs_uint8)c1)));
+
+    match = vandq_u8(match, vld1q_u8(bits));
+    return (unsigned int)vaddv_u8(vget_low_u8(match)) | ((unsigned int)vaddv_u8(vget_high_u8(match)) << 8);
+#endif
 }
 #endif
 
-mfs_result mfs_iterator_init(const char* pDirectoryPath, mfs_iterator* pIterator)
+MFS_NO_SANITIZE_ADDRESS
+static size_t mfs_path_find_separator_or_end(const char* pPath)
 {
-    if (pDirectoryPath == NULL || pIterator == NULL) {
-        return MFS_INVALID_ARGS;
+    /* Returns the offset of the first separator or the null terminator. */
+#if defined(MFS_PATH_SIMD)
+    size_t misalignment = (size_t)((mfs_uintptr)pPath & 15);
+    const char* pBlock = pPath - misalignment;
+    unsigned int mask;
+
+    mask = (mfs_path_simd_match(pBlock, '/', '\\') | mfs_path_simd_match(pBlock, '\0', '\0')) >> misalignment;
+    if (mask != 0) {
+        return mfs_bit_scan_forward(mask);
     }
 
-    MFS_ZERO_OBJECT(pIterator);
+    for (;;) {
+        pBlock += 16;
 
-#if defined(MFS_WIN32)
-    return mfs_iterator_init__win32(pDirectoryPath, pIterator);
-#elif defined(MFS_POSIX)
-    return mfs_iterator_init__posix(pDirectoryPath, pIterator);
+        mask = mfs_path_simd_match(pBlock, '/', '\\') | mfs_path_simd_match(pBlock, '\0', '\0');
+        if (mask != 0) {
+            return (size_t)(pBlock - pPath) + mfs_bit_scan_forward(mask);
+        }
+    }
 #else
-    return MFS_INVALID_OPERATION;   /* Unsupported platform. */
+    size_t length = 0;
+
+    while (pPath[length] != '\0' && pPath[length] != '/' && pPath[length] != '\\') {
+        length += 1;
+    }
+
+    return length;
 #endif
 }
 
-void mfs_iterator_uninit(mfs_iterator* pIterator)
+static size_t mfs_path_find_segment_start(const char* pPath, size_t end)
 {
-    if (pIterator == NULL) {
-        return;
-    }
+    /* Returns the offset just after the last separator before end, or 0 if there isn't one. */
+#if defined(MFS_PATH_SIMD)
+    while (end >= 16) {
+        unsigned int mask = mfs_path_simd_match(pPath + end - 16, '/', '\\');
+        if (mask != 0) {
+            return end - 16 + mfs_bit_scan_reverse(mask) + 1;
+        }
 
-#if defined(MFS_WIN32)
-    mfs_iterator_uninit__win32(pIterator);
-#elif defined(MFS_POSIX)
-    mfs_iterator_uninit__posix(pIterator);
-#else
-    /* Unsupported platform. */
+        end -= 16;
+    }
 #endif
 
-    MFS_ZERO_OBJECT(pIterator);
+    while (end > 0 && pPath[end - 1] != '/' && pPath[end - 1] != '\\') {
+        end -= 1;
+    }
+
+    return end;
 }
 
-mfs_result mfs_iterator_next(mfs_iterator* pIterator, mfs_file_info* pFileInfo)
-{
-    if (pIterator == NULL) {
-        return MFS_INVALID_ARGS;
-    }
+MFS_NO_SANITIZE_ADDRESS
+static const char* mfs_path_find_file_name(const char* pPath, const char** ppExtension)
+{
+    /*
+    Finds the file name and, optionally, its extension in one pass. The extension is just after the last dot in the file name, or the
+    null terminator if there isn't one.
+    */
+    const char* pFileName = pPath;
+    const char* pLastDot = NULL;
+    const char* pEnd;
+
+#if defined(MFS_PATH_SIMD)
+    size_t misalignment = (size_t)((mfs_uintptr)pPath & 15);
+    const char* pBlock = pPath - misalignment;
+    unsigned int ignoreMask = ~((1U << misalignment) - 1);   /* To ignore bytes before the start. */
+
+    for (;;) {
+        unsigned int separators = mfs_path_simd_match(pBlock, '/', '\\') & ignoreMask;
+        unsigned int dots       = mfs_path_simd_match(pBlock, '.',  '.' ) & ignoreMask;
+        unsigned int ends       = mfs_path_simd_match(pBlock, '\0', '\0') & ignoreMask;
+
+        if (ends != 0) {
+            unsigned int endMask = (1U << mfs_bit_scan_forward(ends)) - 1;
+            separators &= endMask;
+            dots       &= endMask;
+        }
+
+        if (separators != 0) {
+            pFileName = pBlock + mfs_bit_scan_reverse(separators) + 1;
+            pLastDot  = NULL;
+        }
+
+        if (dots != 0) {
+            const char* pDot = pBlock + mfs_bit_scan_reverse(dots);
+            if (pDot >= pFileName) {
+                pLastDot = pDot;
+            }
+        }
+
+        if (ends != 0) {
+            pEnd = pBlock + mfs_bit_scan_forward(ends);
+            break;
+        }
 
-    if (pFileInfo != NULL) {
-        MFS_ZERO_OBJECT(pFileInfo);
+        pBlock += 16;
+        ignoreMask = 0xFFFF;
     }
-
-#if defined(MFS_WIN32)
-    return mfs_iterator_next__win32(pIterator, pFileInfo);
-#elif defined(MFS_POSIX)
-    return mfs_iterator_next__posix(pIterator, pFileInfo);
 #else
-    return MFS_INVALID_OPERATION;
+    for (pEnd = pPath; pEnd[0] != '\0'; pEnd += 1) {
+        if (pEnd[0] == '/' || pEnd[0] == '\\') {
+            pFileName = pEnd + 1;
+            pLastDot  = NULL;
+        } else if (pEnd[0] == '.') {
+            pLastDot = pEnd;
+        }
+    }
 #endif
-}
-
 
+    if (ppExtension != NULL) {
+        *ppExtension = (pLastDot != NULL) ? pLastDot + 1 : pEnd;
+    }
 
-/* Paths */
+    return pFileName;
+}
 mfs_bool32 mfs_path_segments_equal(const char* s0Path, const mfs_path_segment s0, const char* s1Path, const mfs_path_segment s1)
 {
     if (s0Path == NULL || s1Path == NULL) {
@@ -2755,9 +16250,7 @@ mfs_result mfs_path_first_segment(const char* path, mfs_path_iterator* pIterator
         return MFS_INVALID_ARGS;
     }
 
-    while (pIterator->path[pIterator->segment.length] != '\0' && (pIterator->path[pIterator->segment.length] != '/' && pIterator->path[pIterator->segment.length] != '\\')) {
-        pIterator->segment.length += 1;
-    }
+    pIterator->segment.length = mfs_path_find_separator_or_end(path);
 
     return MFS_SUCCESS;
 }
@@ -2805,14 +16298,7 @@ mfs_result mfs_path_next_segment(mfs_path_iterator* pIterator)
         return MFS_AT_END;
     }
 
-    for (;;) {
-        char c = pIterator->path[pIterator->segment.offset + pIterator->segment.length];
-        if (c == '\0' || c == '/' || c == '\\') {
-            break;
-        }
-
-        pIterator->segment.length += 1;
-    }
+    pIterator->segment.length = mfs_path_find_separator_or_end(pIterator->path + pIterator->segment.offset);
 
     return MFS_SUCCESS;
 }
@@ -2842,14 +16328,7 @@ mfs_result mfs_path_prev_segment(mfs_path_iterator* pIterator)
     }
 
     offsetEnd = pIterator->segment.offset + 1;
-    while (pIterator->segment.offset > 0 && (pIterator->path[pIterator->segment.offset] != '/' && pIterator->path[pIterator->segment.offset] != '\\')) {
-        pIterator->segment.offset -= 1;
-    }
-
-    if (pIterator->path[pIterator->segment.offset] == '/' || pIterator->path[pIterator->segment.offset] == '\\') {
-        pIterator->segment.offset += 1;
-    }
-
+    pIterator->segment.offset = mfs_path_find_segment_start(pIterator->path, pIterator->segment.offset);
     pIterator->segment.length = offsetEnd - pIterator->segment.offset;
 
     return MFS_SUCCESS;
@@ -2987,6 +16466,7 @@ mfs_result mfs_path_copy(char* dst, size_t dstSizeInBytes, const char* src, size
 
 static mfs_result mfs_path_normalize_separator(char* dst, size_t dstSizeInBytes, const char* src, char oldSeparator, char newSeparator, size_t* pDstLenOut)
 {
+    size_t srcLen;
     size_t i;
 
     if (pDstLenOut != NULL) {
@@ -3016,7 +16496,40 @@ static mfs_result mfs_path_normalize_separator(char* dst, size_t dstSizeInBytes,
         return MFS_INVALID_ARGS;
     }
 
-    for (i = 0; i < dstSizeInBytes && src[i] != '\0'; ++i) {
+    srcLen = strlen(src);
+    if (srcLen >= dstSizeInBytes) {
+        dst[0] = '\0';
+        return MFS_OUT_OF_RANGE;
+    }
+
+    i = 0;
+
+#if defined(MFS_SUPPORT_SSE2)
+    {
+        /* Flipping the bits that differ between the two separators turns one into the other. */
+        __m128i oldSeparators = _mm_set1_epi8(oldSeparator);
+        __m128i difference    = _mm_set1_epi8((char)(oldSeparator ^ newSeparator));
+
+        for (; i + 16 <= srcLen; i += 16) {
+            __m128i block = _mm_loadu_si128((const __m128i*)(src + i));
+            block = _mm_xor_si128(block, _mm_and_si128(_mm_cmpeq_epi8(block, oldSeparators), difference));
+            _mm_storeu_si128((__m128i*)(dst + i), block);
+        }
+    }
+#elif defined(MFS_SUPPORT_NEON)
+    {
+        uint8x16_t oldSeparators = vdupq_n_u8((mfs_uint8)oldSeparator);
+        uint8x16_t difference    = vdupq_n_u8((mfs_uint8)(oldSeparator ^ newSeparator));
+
+        for (; i + 16 <= srcLen; i += 16) {
+            uint8x16_t block = vld1q_u8((const mfs_uint8*)(src + i));
+            block = veorq_u8(block, vandq_u8(vceqq_u8(block, oldSeparators), difference));
+            vst1q_u8((mfs_uint8*)(dst + i), block);
+        }
+    }
+#endif
+
+    for (; i < srcLen; i += 1) {
         if (src[i] == oldSeparator) {
             dst[i] =  newSeparator;
         } else {
@@ -3024,18 +16537,13 @@ static mfs_result mfs_path_normalize_separator(char* dst, size_t dstSizeInBytes,
         }
     }
 
-    if (i < dstSizeInBytes) {
-        dst[i] = '\0';
-
-        if (pDstLenOut != NULL) {
-            *pDstLenOut = i;
-        }
+    dst[srcLen] = '\0';
 
-        return MFS_SUCCESS;
+    if (pDstLenOut != NULL) {
+        *pDstLenOut = srcLen;
     }
 
-    dst[0] = '\0';
-    return MFS_OUT_OF_RANGE;
+    return MFS_SUCCESS;
 }
 
 mfs_result mfs_path_to_forward_slashes(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut)
@@ -3106,66 +16614,29 @@ mfs_bool32 mfs_path_is_child(const char* childAbsolutePath, const char* parentAb
 
 const char* mfs_path_file_name(const char* path)
 {
-    const char* pFileName;
-
     if (path == NULL) {
         return NULL;
     }
 
-    pFileName = path;
-
-    /* We just loop through the path until we find the last slash. */
-    while (path[0] != '\0') {
-        if (path[0] == '/' || path[0] == '\\') {
-            pFileName = path;
-        }
-
-        path += 1;
-    }
-
-    /* At this point the file name is sitting on a slash, so just move forward. */
-    while (pFileName[0] != '\0' && (pFileName[0] == '/' || pFileName[0] == '\\')) {
-        pFileName += 1;
-    }
-
-    return pFileName;
+    return mfs_path_find_file_name(path, NULL);
 }
 
 
 const char* mfs_path_extension(const char* path)
 {
-    const char* pFileName;
-    const char* pLastOccurance;
-    
-    pFileName = mfs_path_file_name(path);
-    if (pFileName == NULL) {
-        return NULL;
-    }
+    const char* pExtension;
 
-    pLastOccurance = NULL;
-
-    /* We just find the last occurance of a period. If no period is found we just return an empty string. */
-    while (*pFileName != '\0') {
-        if (*pFileName == '.') {
-            pFileName += 1;
-            pLastOccurance = pFileName;
-        } else {
-            pFileName += 1;
-        }
+    if (path == NULL) {
+        return NULL;
     }
 
     /*
-    If there's no extension we need to return an empty string, but we need the return value to be an offset of the input path
-    which means we actually want to return pFileName (which will be sitting on the null terminator at this point). The reason
-    we want to always want the return value to be an offset of path is to make it so the caller can always calculate the length
-    using a subtraction rather than an strlen().
+    If there's no extension the returned pointer sits on the null terminator rather than pointing to some static empty string. That
+    way the return value is always an offset of path and the caller can always calculate the length with a subtraction.
     */
-    if (pLastOccurance == NULL) {
-        MFS_ASSERT(pFileName[0] == '\0');
-        return pFileName;
-    } else {
-        return pLastOccurance;
-    }
+    mfs_path_find_file_name(path, &pExtension);
+
+    return pExtension;
 }
 
 mfs_bool32 mfs_path_has_extension(const char* path)
@@ -3181,36 +16652,7 @@ mfs_bool32 mfs_path_has_extension(const char* path)
 
 mfs_bool32 mfs_path_equal(const char* path1, const char* path2)
 {
-    mfs_path_iterator iPath1;
-    mfs_path_iterator iPath2;
-
-    if (path1 == NULL || path2 == NULL) {
-        return MFS_FALSE;
-    }
-
-    if (path1 == path2 || (path1[0] == '\0' && path2[0] == '\0')) {
-        return MFS_TRUE;    /* Two empty paths are treated as the same. */
-    }
-
-    
-    if (mfs_path_first_segment(path1, &iPath1) == MFS_SUCCESS && mfs_path_first_segment(path2, &iPath2) == MFS_SUCCESS) {
-        mfs_bool32 isPath1Valid;
-        mfs_bool32 isPath2Valid;
-
-        do {
-            if (!mfs_path_iterators_equal(iPath1, iPath2)) {
-                return MFS_FALSE;
-            }
-
-            isPath1Valid = mfs_path_next_segment(&iPath1) == MFS_SUCCESS;
-            isPath2Valid = mfs_path_next_segment(&iPath2) == MFS_SUCCESS;
-        } while (isPath1Valid && isPath2Valid);
-
-        /* At this point either iPath1 and/or iPath2 have finished iterating. If both of them are at the end, the two paths are equal. */
-        return isPath1Valid == isPath2Valid && iPath1.path[iPath1.segment.offset] == '\0' && iPath2.path[iPath2.segment.offset] == '\0';
-    }
-
-    return MFS_FALSE;
+    return mfs_path_equal_ex(path1, path2, 0);
 }
 
 mfs_bool32 mfs_path_extension_equal(const char* path, const char* extension)
@@ -3393,258 +16835,537 @@ mfs_result mfs_path_append(char* dst, size_t dstSizeInBytes, const char* base, c
         return MFS_INVALID_ARGS;
     }
 
-    return mfs_path_append__internal(dst, dstSizeInBytes, base, other, strlen(other), pDstLenOut);
+    return mfs_path_append__internal(dst, dstSizeInBytes, base, other, strlen(other), pDstLenOut);
+}
+
+mfs_result mfs_path_append_iterator(char* dst, size_t dstSizeInBytes, const char* base, mfs_path_iterator iterator, size_t* pDstLenOut)
+{
+    return mfs_path_append__internal(dst, dstSizeInBytes, base, iterator.path + iterator.segment.offset, iterator.segment.length, pDstLenOut);
+}
+
+mfs_result mfs_path_append_extension(char* dst, size_t dstSizeInBytes, const char* base, const char* extension, size_t* pDstLenOut)
+{
+    mfs_result result = MFS_SUCCESS;
+    size_t baseLength;
+    size_t extLength;
+    size_t dstLen;
+
+    if (pDstLenOut != NULL) {
+        *pDstLenOut = 0;
+    }
+
+    if (base == NULL) {
+        base = "";
+    }
+
+    if (extension == NULL) {
+        extension = "";
+    }
+
+    if (extension[0] == '\0') {
+        if (dst != NULL) {
+            if (dst != base) {
+                result = mfs_result_from_errno(mfs_strcpy_s(dst, dstSizeInBytes, base));
+            }
+        }
+
+        if (pDstLenOut != NULL) {
+            *pDstLenOut = strlen(base);
+        }
+        
+        return result;
+    }
+
+
+    baseLength = strlen(base);
+    extLength  = strlen(extension);
+    dstLen     = baseLength + 1 + extLength;
+
+    if (dst != NULL) {
+        if (dstLen+1 <= dstSizeInBytes) {
+            if (dst != base) {
+                mfs_strcpy_s(dst + 0, dstSizeInBytes - 0, base);
+            }
+            mfs_strcpy_s(dst + baseLength,     dstSizeInBytes - baseLength,     ".");
+            mfs_strcpy_s(dst + baseLength + 1, dstSizeInBytes - baseLength - 1, extension);
+        } else {
+            result = MFS_OUT_OF_RANGE;
+        }
+    }
+
+    if (pDstLenOut != NULL) {
+        *pDstLenOut = dstLen;
+    }
+
+    return result;
+}
+
+
+static mfs_bool32 mfs_path_clean__is_dot(const char* pSegment, size_t segmentLength)
+{
+    return segmentLength == 1 && pSegment[0] == '.';
+}
+
+static mfs_bool32 mfs_path_clean__is_dot_dot(const char* pSegment, size_t segmentLength)
+{
+    return segmentLength == 2 && pSegment[0] == '.' && pSegment[1] == '.';
+}
+
+static size_t mfs_path_clean__measure(const char** ppParts, size_t partCount, size_t rootLength)
+{
+    /*
+    Works out the length of the cleaned path without writing anything. Segments are visited from the end so that each ".." cancels the
+    next regular segment found before it, which means the only thing to keep track of is how many are still waiting to be cancelled.
+    */
+    size_t length = 0;
+    size_t segmentCount = 0;
+    size_t dotDotCount = 0;
+    size_t iPart;
+
+    for (iPart = partCount; iPart > 0; iPart -= 1) {
+        const char* pPart = ppParts[iPart - 1];
+        size_t end = strlen(pPart);
+
+        for (;;) {
+            size_t start;
+
+            while (end > 0 && mfs_is_path_separator(pPart[end - 1])) {
+                end -= 1;
+            }
+
+            if (end == 0) {
+                break;
+            }
+
+            start = end;
+            while (start > 0 && mfs_is_path_separator(pPart[start - 1]) == MFS_FALSE) {
+                start -= 1;
+            }
+
+            if (mfs_path_clean__is_dot_dot(pPart + start, end - start)) {
+                dotDotCount += 1;
+            } else if (mfs_path_clean__is_dot(pPart + start, end - start) == MFS_FALSE) {
+                if (dotDotCount > 0) {
+                    dotDotCount -= 1;
+                } else {
+                    length       += end - start;
+                    segmentCount += 1;
+                }
+            }
+
+            end = start;
+        }
+    }
+
+    return rootLength + length + ((segmentCount > 0) ? segmentCount - 1 : 0);
+}
+
+static mfs_bool32 mfs_path_clean__write(char* dst, size_t dstCap, const char** ppParts, size_t partCount, size_t rootLength, size_t* pLength)
+{
+    /*
+    Cleans the path in a single pass from the start, using the output itself as the stack of segments. A ".." just moves the end of the
+    output back to the last separator written. The output never gets ahead of the input, so dst can be the same as the only part.
+
+    Returns false if the output doesn't fit in dstCap bytes, not including the null terminator. dst will be partially written.
+    */
+    size_t length = rootLength;
+    size_t iPart;
+
+    if (rootLength > dstCap) {
+        return MFS_FALSE;
+    }
+
+    if (rootLength > 0) {
+        dst[0] = '/';
+    }
+
+    for (iPart = 0; iPart < partCount; iPart += 1) {
+        const char* pPart = ppParts[iPart];
+        size_t cursor = 0;
+
+        for (;;) {
+            size_t start;
+            size_t segmentLength;
+
+            while (mfs_is_path_separator(pPart[cursor])) {
+                cursor += 1;
+            }
+
+            if (pPart[cursor] == '\0') {
+                break;
+            }
+
+            start = cursor;
+            while (pPart[cursor] != '\0' && mfs_is_path_separator(pPart[cursor]) == MFS_FALSE) {
+                cursor += 1;
+            }
+
+            segmentLength = cursor - start;
+
+            if (mfs_path_clean__is_dot(pPart + start, segmentLength)) {
+                continue;
+            }
+
+            if (mfs_path_clean__is_dot_dot(pPart + start, segmentLength)) {
+                /* If there's nothing before it to remove the ".." is dropped. */
+                while (length > rootLength && dst[length - 1] != '/') {
+                    length -= 1;
+                }
+
+                if (length > rootLength) {
+                    length -= 1;    /* The separator before the removed segment. */
+                }
+
+                continue;
+            }
+
+            if (length > rootLength) {
+                if (length + 1 + segmentLength > dstCap) {
+                    return MFS_FALSE;
+                }
+
+                dst[length] = '/';
+                length += 1;
+            } else {
+                if (length + segmentLength > dstCap) {
+                    return MFS_FALSE;
+                }
+            }
+
+            /* When cleaning in place the segment may be moved over itself, hence memmove(). */
+            memmove(dst + length, pPart + start, segmentLength);
+            length += segmentLength;
+        }
+    }
+
+    *pLength = length;
+    return MFS_TRUE;
+}
+
+static mfs_result mfs_path_clean__internal(char* dst, size_t dstSizeInBytes, const char** ppParts, size_t partCount, size_t rootLength, mfs_bool32 isInPlace, size_t* pDstLenOut)
+{
+    mfs_result result = MFS_SUCCESS;
+    size_t length;
+
+    if (dst == NULL) {
+        length = mfs_path_clean__measure(ppParts, partCount, rootLength);
+    } else {
+        /*
+        When cleaning in place the output can never be longer than the input, so there's no need to check the size until the end. For
+        everything else a write that doesn't fit stops early and the length is measured instead, which is fine because the input will
+        not have been touched.
+        */
+        if (mfs_path_clean__write(dst, (isInPlace) ? (size_t)-1 : ((dstSizeInBytes > 0) ? dstSizeInBytes - 1 : 0), ppParts, partCount, rootLength, &length)) {
+            if (length < dstSizeInBytes) {
+                dst[length] = '\0';
+            } else {
+                result = MFS_OUT_OF_RANGE;
+            }
+        } else {
+            length = mfs_path_clean__measure(ppParts, partCount, rootLength);
+            result = MFS_OUT_OF_RANGE;
+
+            if (dstSizeInBytes > 0) {
+                dst[0] = '\0';
+            }
+        }
+    }
+
+    if (pDstLenOut != NULL) {
+        *pDstLenOut = length;
+    }
+
+    return result;
 }
 
-mfs_result mfs_path_append_iterator(char* dst, size_t dstSizeInBytes, const char* base, mfs_path_iterator iterator, size_t* pDstLenOut)
+mfs_result mfs_path_clean(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut)
 {
-    return mfs_path_append__internal(dst, dstSizeInBytes, base, iterator.path + iterator.segment.offset, iterator.segment.length, pDstLenOut);
+    if (pDstLenOut != NULL) {
+        *pDstLenOut = 0;
+    }
+
+    if (mfs_string_is_null_or_empty(src)) {
+        return MFS_INVALID_ARGS;
+    }
+
+    return mfs_path_clean__internal(dst, dstSizeInBytes, &src, 1, (src[0] == '/') ? 1 : 0, dst == src, pDstLenOut);
 }
 
-mfs_result mfs_path_append_extension(char* dst, size_t dstSizeInBytes, const char* base, const char* extension, size_t* pDstLenOut)
+mfs_result mfs_path_append_and_clean(char* dst, size_t dstSizeInBytes, const char* base, const char* other, size_t* pDstLenOut)
 {
-    mfs_result result = MFS_SUCCESS;
-    size_t baseLength;
-    size_t extLength;
-    size_t dstLen;
+    const char* pParts[2];
+    size_t rootLength;
 
     if (pDstLenOut != NULL) {
         *pDstLenOut = 0;
     }
 
-    if (base == NULL) {
-        base = "";
+    if (base == NULL || other == NULL) {
+        return MFS_INVALID_ARGS;
     }
 
-    if (extension == NULL) {
-        extension = "";
+    if (base[0] == '\0' && other[0] == '\0') {
+        return MFS_INVALID_ARGS;    /* Both input strings are empty. */
     }
 
-    if (extension[0] == '\0') {
-        if (dst != NULL) {
-            if (dst != base) {
-                result = mfs_result_from_errno(mfs_strcpy_s(dst, dstSizeInBytes, base));
-            }
-        }
-
-        if (pDstLenOut != NULL) {
-            *pDstLenOut = strlen(base);
-        }
-        
-        return result;
+    /* The root comes from whichever path is first, so an empty base takes it from other. */
+    if (base[0] != '\0') {
+        rootLength = (base[0]  == '/') ? 1 : 0;
+    } else {
+        rootLength = (other[0] == '/') ? 1 : 0;
     }
 
+    pParts[0] = base;
+    pParts[1] = other;
 
-    baseLength = strlen(base);
-    extLength  = strlen(extension);
-    dstLen     = baseLength + 1 + extLength;
+    return mfs_path_clean__internal(dst, dstSizeInBytes, pParts, 2, rootLength, MFS_FALSE, pDstLenOut);
+}
 
-    if (dst != NULL) {
-        if (dstLen+1 <= dstSizeInBytes) {
-            if (dst != base) {
-                mfs_strcpy_s(dst + 0, dstSizeInBytes - 0, base);
-            }
-            mfs_strcpy_s(dst + baseLength,     dstSizeInBytes - baseLength,     ".");
-            mfs_strcpy_s(dst + baseLength + 1, dstSizeInBytes - baseLength - 1, extension);
-        } else {
-            result = MFS_OUT_OF_RANGE;
+
+static mfs_uint64 mfs_path_fold_ascii64(mfs_uint64 x)
+{
+    /*
+    Lowercases every ASCII letter in the 8 bytes at once. The top bit of each byte in isAtLeastA and isAfterZ is set when the low 7
+    bits of the byte are >= 'A' and > 'Z' respectively. Bytes with their own top bit set are never letters.
+    */
+    mfs_uint64 ones = MFS_UINT64_CONST(0x01010101, 0x01010101);
+    mfs_uint64 low7 = x & (ones * 0x7F);
+    mfs_uint64 isAtLeastA = low7 + ones * (0x80 - 'A');
+    mfs_uint64 isAfterZ   = low7 + ones * (0x80 - 'Z' - 1);
+    mfs_uint64 isUpper    = isAtLeastA & ~isAfterZ & ~x & (ones * 0x80);
+
+    return x | (isUpper >> 2);  /* 0x80 >> 2 is 0x20, the bit that separates upper case from lower case. */
+}
+
+static mfs_uint64 mfs_path_hash_segment(const char* pSegment, size_t length, mfs_bool32 isCaseInsensitive)
+{
+    /* Consumes 8 bytes at a time with the XXH64 rounds. The length is part of the seed so the zero padding of the tail doesn't matter. */
+    mfs_uint64 hash = MFS_XXH64_PRIME5 + (mfs_uint64)length;
+    mfs_uint64 word;
+    mfs_uint8 tail[8];
+
+    while (length >= 8) {
+        word = mfs_read_le64((const mfs_uint8*)pSegment);
+        if (isCaseInsensitive) {
+            word = mfs_path_fold_ascii64(word);
         }
+
+        hash = mfs_xxh64_merge_round(hash, word);
+        pSegment += 8;
+        length   -= 8;
     }
 
-    if (pDstLenOut != NULL) {
-        *pDstLenOut = dstLen;
+    if (length > 0) {
+        MFS_ZERO_MEMORY(tail, sizeof(tail));
+        MFS_COPY_MEMORY(tail, pSegment, length);
+
+        word = mfs_read_le64(tail);
+        if (isCaseInsensitive) {
+            word = mfs_path_fold_ascii64(word);
+        }
+
+        hash = mfs_xxh64_merge_round(hash, word);
     }
 
-    return result;
+    return hash;
 }
 
-
-static size_t mfs_path_clean__try_write(mfs_path_iterator* iterators, unsigned int iteratorCount, char* pathOut, size_t pathOutSize, unsigned int ignoreCounter)
+mfs_uint64 mfs_path_hash_and_length(const char* path, mfs_uint32 flags, size_t* pLength)
 {
-    mfs_path_iterator iSegment;
-    mfs_path_iterator iPrev;
-    mfs_bool32 ignoreThisSegment;
-    size_t bytesWritten;
+    /*
+    The segment hashes are combined as a polynomial, hash = h[0]*P^(n-1) + h[1]*P^(n-2) + ... + h[n-1]. Going forward that's just a
+    multiply and add for each segment, but it can also be built from the end by keeping track of the power of P, which is what allows
+    a cleaned path to be hashed in a single pass from the end, where each ".." is simply a count of segments to skip.
+    */
+    mfs_bool32 isCaseInsensitive = (flags & MFS_PATH_FLAG_CASE_INSENSITIVE) != 0;
+    mfs_uint64 hash = 0;
+    mfs_uint64 segmentCount = 0;
+    mfs_bool32 isRooted;
+    size_t length;
+
+    if (pLength != NULL) {
+        *pLength = 0;
+    }
 
-    if (iteratorCount == 0) {
+    if (path == NULL) {
         return 0;
     }
 
-    iSegment = iterators[iteratorCount - 1];
+    if ((flags & MFS_PATH_FLAG_CLEAN) == 0) {
+        size_t cursor = 0;
 
+        isRooted = mfs_is_path_separator(path[0]);
 
-    /* If this segment is a ".", we ignore it. If it is a ".." we ignore it and increment "ignoreCount". */
-    ignoreThisSegment = ignoreCounter > 0 && iSegment.segment.length > 0;
+        for (;;) {
+            size_t segmentLength;
 
-    if (iSegment.segment.length == 1 && iSegment.path[iSegment.segment.offset] == '.') {
-        /* "." */
-        ignoreThisSegment = MFS_TRUE;
-    } else {
-        if (iSegment.segment.length == 2 && iSegment.path[iSegment.segment.offset] == '.' && iSegment.path[iSegment.segment.offset + 1] == '.') {
-            /* ".." */
-            ignoreThisSegment = MFS_TRUE;
-            ignoreCounter += 1;
-        } else {
-            /* It's a regular segment, so decrement the ignore counter. */
-            if (ignoreCounter > 0) {
-                ignoreCounter -= 1;
+            while (mfs_is_path_separator(path[cursor])) {
+                cursor += 1;
             }
-        }
-    }
 
+            if (path[cursor] == '\0') {
+                break;
+            }
 
-    /* The previous segment needs to be written before we can write this one. */
-    bytesWritten = 0;
+            segmentLength = mfs_path_find_separator_or_end(path + cursor);
 
-    iPrev = iSegment;
-    if (mfs_path_prev_segment(&iPrev) != MFS_SUCCESS) {
-        if (iteratorCount > 1) {
-            iteratorCount -= 1;
-            iPrev = iterators[iteratorCount - 1];
-        } else {
-            iPrev.path           = NULL;
-            iPrev.segment.offset = 0;
-            iPrev.segment.length = 0;
+            hash = hash * MFS_XXH64_PRIME1 + mfs_path_hash_segment(path + cursor, segmentLength, isCaseInsensitive);
+            segmentCount += 1;
+            cursor += segmentLength;
         }
-    }
 
-    if (iPrev.segment.length > 0) {
-        iterators[iteratorCount - 1] = iPrev;
-        bytesWritten = mfs_path_clean__try_write(iterators, iteratorCount, pathOut, pathOutSize, ignoreCounter);
-    }
+        length = cursor;
+    } else {
+        mfs_uint64 power = 1;
+        size_t dotDotCount = 0;
+        size_t end;
 
+        isRooted = (path[0] == '/');    /* Same as mfs_path_clean(). */
+        length   = strlen(path);
 
-    if (!ignoreThisSegment) {
-        if (pathOut != NULL) {
-            pathOut += bytesWritten;
-            if (pathOutSize >= bytesWritten) {
-                pathOutSize -= bytesWritten;
-            } else {
-                pathOutSize = 0;
+        end = length;
+        for (;;) {
+            size_t start;
+
+            while (end > 0 && mfs_is_path_separator(path[end - 1])) {
+                end -= 1;
             }
-        }
 
-        if (bytesWritten > 0) {
-            if (pathOut != NULL) {
-                pathOut[0] = '/';
-                pathOut += 1;
-                if (pathOutSize >= 1) {
-                    pathOutSize -= 1;
+            if (end == 0) {
+                break;
+            }
+
+            start = mfs_path_find_segment_start(path, end);
+
+            if (mfs_path_clean__is_dot_dot(path + start, end - start)) {
+                dotDotCount += 1;
+            } else if (mfs_path_clean__is_dot(path + start, end - start) == MFS_FALSE) {
+                if (dotDotCount > 0) {
+                    dotDotCount -= 1;
                 } else {
-                    pathOutSize = 0;
+                    hash  += mfs_path_hash_segment(path + start, end - start, isCaseInsensitive) * power;
+                    power *= MFS_XXH64_PRIME1;
+                    segmentCount += 1;
                 }
             }
-            bytesWritten += 1;
-        }
 
-        if (pathOut != NULL) {
-            MFS_COPY_MEMORY(pathOut, iSegment.path + iSegment.segment.offset, iSegment.segment.length); /* Don't use strncpy_s() here because we don't want to do anything with the null terminator at this point (that is set once at a higer level). */
+            end = start;
         }
+    }
 
-        bytesWritten += iSegment.segment.length;
+    if (pLength != NULL) {
+        *pLength = length;
     }
 
-    return bytesWritten;
+    /* The XXH64 avalanche, so that paths differing only in the last segment still differ in every bit. */
+    hash ^= (segmentCount << 1) | ((isRooted) ? 1 : 0);
+    hash ^= hash >> 33;
+    hash *= MFS_XXH64_PRIME2;
+    hash ^= hash >> 29;
+    hash *= MFS_XXH64_PRIME3;
+    hash ^= hash >> 32;
+
+    return hash;
 }
 
-mfs_result mfs_path_clean(char* dst, size_t dstSizeInBytes, const char* src, size_t* pDstLenOut)
+mfs_uint64 mfs_path_hash(const char* path, mfs_uint32 flags)
 {
-    mfs_result result = MFS_SUCCESS;
-    mfs_path_iterator iLast;
-    size_t bytesWritten = 0;
+    return mfs_path_hash_and_length(path, flags, NULL);
+}
 
-    if (pDstLenOut != NULL) {
-        *pDstLenOut = 0;
-    }
+static mfs_bool32 mfs_path_equal__internal(const char* path1, const char* path2, mfs_bool32 isCaseInsensitive)
+{
+    /* A path is a root, if it starts with a separator, followed by a list of segments. The number of separators between them doesn't matter. */
+    size_t cursor1 = 0;
+    size_t cursor2 = 0;
 
-    if (mfs_path_last_segment(src, &iLast) != MFS_SUCCESS) {
-        return MFS_INVALID_ARGS;
+    if (mfs_is_path_separator(path1[0]) != mfs_is_path_separator(path2[0])) {
+        return MFS_FALSE;
     }
 
-    
-    if (src[0] == '/') {
-        if (dst != NULL && dstSizeInBytes > 1) {
-            dst[0] = '/';
+    for (;;) {
+        size_t length;
+        size_t i;
+
+        while (mfs_is_path_separator(path1[cursor1])) {
+            cursor1 += 1;
+        }
+        while (mfs_is_path_separator(path2[cursor2])) {
+            cursor2 += 1;
         }
-        bytesWritten = 1;
-    }
 
-    if (dst == NULL || dstSizeInBytes <= bytesWritten) {
-        bytesWritten += mfs_path_clean__try_write(&iLast, 1, NULL, 0, 0);
-    } else {
-        bytesWritten += mfs_path_clean__try_write(&iLast, 1, dst + bytesWritten, dstSizeInBytes - bytesWritten - 1, 0);  /* -1 to ensure there is enough room for a null terminator later on. */
-    }
-        
-    if (dst != NULL) {
-        if (dstSizeInBytes > bytesWritten) {
-            dst[bytesWritten] = '\0';
+        if (path1[cursor1] == '\0' || path2[cursor2] == '\0') {
+            return path1[cursor1] == path2[cursor2];
+        }
+
+        length = mfs_path_find_separator_or_end(path1 + cursor1);
+        if (mfs_path_find_separator_or_end(path2 + cursor2) != length) {
+            return MFS_FALSE;
+        }
+
+        if (isCaseInsensitive == MFS_FALSE) {
+            if (memcmp(path1 + cursor1, path2 + cursor2, length) != 0) {
+                return MFS_FALSE;
+            }
         } else {
-            result = MFS_OUT_OF_RANGE;
+            for (i = 0; i < length; i += 1) {
+                if (mfs_regex_fold(path1[cursor1 + i]) != mfs_regex_fold(path2[cursor2 + i])) {
+                    return MFS_FALSE;
+                }
+            }
         }
-    }
 
-    if (pDstLenOut != NULL) {
-        *pDstLenOut = bytesWritten;
+        cursor1 += length;
+        cursor2 += length;
     }
-
-    return result;
 }
 
-mfs_result mfs_path_append_and_clean(char* dst, size_t dstSizeInBytes, const char* base, const char* other, size_t* pDstLenOut)
+mfs_bool32 mfs_path_equal_ex(const char* path1, const char* path2, mfs_uint32 flags)
 {
-    mfs_result result = MFS_SUCCESS;
-    size_t bytesWritten;
-    mfs_bool32 isPathEmpty0;
-    mfs_bool32 isPathEmpty1;
-    mfs_uint32 iteratorCount;
-    mfs_path_iterator last[2] = {
-        {NULL, {0, 0}},
-        {NULL, {0, 0}}
-    };
+    mfs_bool32 isEqual = MFS_FALSE;
+    mfs_path_buf clean1;
+    mfs_path_buf clean2;
+    mfs_result result1;
+    mfs_result result2;
+    size_t cleanLength;
 
-    if (pDstLenOut != NULL) {
-        *pDstLenOut = 0;
+    if (path1 == NULL || path2 == NULL) {
+        return MFS_FALSE;
     }
 
-    if (base == NULL || other == NULL) {
-        return MFS_INVALID_ARGS;
+    if (path1 == path2) {
+        return MFS_TRUE;
     }
 
-    isPathEmpty0 = mfs_path_last_segment(base,  last + 0) != MFS_SUCCESS;
-    isPathEmpty1 = mfs_path_last_segment(other, last + 1) != MFS_SUCCESS;
-
-    iteratorCount = !isPathEmpty0 + !isPathEmpty1;
-    if (iteratorCount == 0) {
-        return MFS_INVALID_ARGS;    /* Both input strings are empty. */
+    if ((flags & MFS_PATH_FLAG_CLEAN) == 0) {
+        return mfs_path_equal__internal(path1, path2, (flags & MFS_PATH_FLAG_CASE_INSENSITIVE) != 0);
     }
 
-    bytesWritten = 0;
-    if (base[0] == '/') {
-        if (dst != NULL && dstSizeInBytes > 1) {
-            dst[0] = '/';
-        }
-        bytesWritten = 1;
-    }
+    /*
+    The paths are cleaned in place in a copy, which only allocates if they're too long to fit inside a mfs_path_buf. There's no way to
+    report running out of memory, so that's treated as not equal.
+    */
+    result1 = mfs_path_buf_init(&clean1, path1);
+    result2 = mfs_path_buf_init(&clean2, path2);
 
-    if (dst == NULL || dstSizeInBytes <= bytesWritten) {
-        bytesWritten += mfs_path_clean__try_write(last, 2, NULL, 0, 0);
-    } else {
-        bytesWritten += mfs_path_clean__try_write(last, 2, dst + bytesWritten, dstSizeInBytes - bytesWritten - 1, 0);  /* -1 to ensure there is enough room for a null terminator later on. */
-    }
+    if (result1 == MFS_SUCCESS && result2 == MFS_SUCCESS) {
+        if (clean1.length > 0) {
+            mfs_path_clean(clean1.pPath, clean1.capacity, clean1.pPath, &cleanLength);
+            mfs_path_buf_truncate(&clean1, cleanLength);
+        }
 
-    if (dst != NULL && dstSizeInBytes > bytesWritten) {
-        if (dstSizeInBytes > bytesWritten) {
-            dst[bytesWritten] = '\0';
-        } else {
-            result = MFS_OUT_OF_RANGE;
+        if (clean2.length > 0) {
+            mfs_path_clean(clean2.pPath, clean2.capacity, clean2.pPath, &cleanLength);
+            mfs_path_buf_truncate(&clean2, cleanLength);
         }
-    }
 
-    if (pDstLenOut != NULL) {
-        *pDstLenOut = bytesWritten;
+        isEqual = mfs_path_equal__internal(clean1.pPath, clean2.pPath, (flags & MFS_PATH_FLAG_CASE_INSENSITIVE) != 0);
     }
 
-    return result;
+    mfs_path_buf_uninit(&clean1);
+    mfs_path_buf_uninit(&clean2);
+
+    return isEqual;
 }
 
 
@@ -3949,6 +17670,192 @@ mfs_result mfs_path_to_absolute(char* dst, size_t dstSizeInBytes, const char* re
 }
 
 
+mfs_result mfs_path_buf_init(mfs_path_buf* pBuf, const char* pPath)
+{
+    if (pBuf == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    pBuf->pPath          = pBuf->pInlineData;
+    pBuf->length         = 0;
+    pBuf->capacity       = sizeof(pBuf->pInlineData);
+    pBuf->pInlineData[0] = '\0';
+
+    if (pPath == NULL || pPath[0] == '\0') {
+        return MFS_SUCCESS;
+    }
+
+    return mfs_path_buf_push_segment(pBuf, pPath);  /* The buffer is empty so there's no separator and this is just a copy. */
+}
+
+void mfs_path_buf_uninit(mfs_path_buf* pBuf)
+{
+    if (pBuf == NULL) {
+        return;
+    }
+
+    if (pBuf->pPath != pBuf->pInlineData) {
+        MFS_FREE(pBuf->pPath);
+    }
+
+    pBuf->pPath          = pBuf->pInlineData;
+    pBuf->length         = 0;
+    pBuf->capacity       = sizeof(pBuf->pInlineData);
+    pBuf->pInlineData[0] = '\0';
+}
+
+static mfs_result mfs_path_buf_reserve(mfs_path_buf* pBuf, size_t length)
+{
+    /* Makes sure there's room for a path of the given length plus the null terminator. */
+    size_t newCapacity;
+    char* pNewPath;
+
+    if (length < pBuf->capacity) {
+        return MFS_SUCCESS;
+    }
+
+    newCapacity = pBuf->capacity * 2;
+    while (newCapacity <= length) {
+        newCapacity *= 2;
+    }
+
+    if (pBuf->pPath == pBuf->pInlineData) {
+        pNewPath = (char*)MFS_MALLOC(newCapacity);
+        if (pNewPath != NULL) {
+            MFS_COPY_MEMORY(pNewPath, pBuf->pInlineData, pBuf->length + 1);
+        }
+    } else {
+        pNewPath = (char*)MFS_REALLOC(pBuf->pPath, newCapacity);
+    }
+
+    if (pNewPath == NULL) {
+        return MFS_OUT_OF_MEMORY;
+    }
+
+    pBuf->pPath    = pNewPath;
+    pBuf->capacity = newCapacity;
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_path_buf_push_segment(mfs_path_buf* pBuf, const char* pSegment)
+{
+    mfs_result result;
+    size_t segmentLength;
+    size_t separatorLength;
+
+    if (pBuf == NULL || pSegment == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    if (pSegment[0] == '\0') {
+        return MFS_SUCCESS;
+    }
+
+    if (pBuf->length > 0 && mfs_path_is_absolute(pSegment)) {
+        return MFS_INVALID_ARGS;    /* Same as mfs_path_append(). */
+    }
+
+    segmentLength   = strlen(pSegment);
+    separatorLength = (pBuf->length > 0 && mfs_is_path_separator(pBuf->pPath[pBuf->length - 1]) == MFS_FALSE) ? 1 : 0;
+
+    result = mfs_path_buf_reserve(pBuf, pBuf->length + separatorLength + segmentLength);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    if (separatorLength > 0) {
+        pBuf->pPath[pBuf->length] = '/';
+        pBuf->length += 1;
+    }
+
+    MFS_COPY_MEMORY(pBuf->pPath + pBuf->length, pSegment, segmentLength + 1);
+    pBuf->length += segmentLength;
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_path_buf_pop_segment(mfs_path_buf* pBuf)
+{
+    size_t end;
+    size_t start;
+
+    if (pBuf == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    end = pBuf->length;
+    while (end > 0 && mfs_is_path_separator(pBuf->pPath[end - 1])) {
+        end -= 1;
+    }
+
+    if (end == 0) {
+        return MFS_AT_END;
+    }
+
+    start = mfs_path_find_segment_start(pBuf->pPath, end);
+    while (start > 0 && mfs_is_path_separator(pBuf->pPath[start - 1])) {
+        start -= 1;
+    }
+
+    if (start == 0 && mfs_is_path_separator(pBuf->pPath[0])) {
+        start = 1;  /* Keep the root. */
+    }
+
+    pBuf->length = start;
+    pBuf->pPath[start] = '\0';
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_path_buf_set_extension(mfs_path_buf* pBuf, const char* pExtension)
+{
+    mfs_result result;
+    const char* pOldExtension;
+    size_t extensionLength;
+
+    if (pBuf == NULL) {
+        return MFS_INVALID_ARGS;
+    }
+
+    /* Like mfs_path_remove_extension(), a trailing period with nothing after it is not counted as an extension. */
+    mfs_path_find_file_name(pBuf->pPath, &pOldExtension);
+    if (pOldExtension[0] != '\0') {
+        pBuf->length = (size_t)(pOldExtension - pBuf->pPath) - 1;   /* -1 for the period. */
+        pBuf->pPath[pBuf->length] = '\0';
+    }
+
+    if (pExtension == NULL || pExtension[0] == '\0') {
+        return MFS_SUCCESS;
+    }
+
+    extensionLength = strlen(pExtension);
+
+    result = mfs_path_buf_reserve(pBuf, pBuf->length + 1 + extensionLength);
+    if (result != MFS_SUCCESS) {
+        return result;
+    }
+
+    pBuf->pPath[pBuf->length] = '.';
+    MFS_COPY_MEMORY(pBuf->pPath + pBuf->length + 1, pExtension, extensionLength + 1);
+    pBuf->length += 1 + extensionLength;
+
+    return MFS_SUCCESS;
+}
+
+mfs_result mfs_path_buf_truncate(mfs_path_buf* pBuf, size_t length)
+{
+    if (pBuf == NULL || length > pBuf->length) {
+        return MFS_INVALID_ARGS;
+    }
+
+    pBuf->length = length;
+    pBuf->pPath[length] = '\0';
+
+    return MFS_SUCCESS;
+}
+
+
 void mfs_free(void* p)
 {
     MFS_FREE(p);
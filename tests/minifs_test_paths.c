@@ -0,0 +1,222 @@
+#define MINIFS_IMPLEMENTATION
+#include "../minifs.h"
+
+/*
+Checks the path scanning functions against straightforward byte-by-byte implementations. The paths are generated from a fixed seed
+and placed at every offset within a 16 byte block, with lengths on both sides of each block boundary, so the vectorised code paths
+get exercised with every alignment and tail length.
+*/
+static unsigned int g_seed = 1;
+
+static unsigned int test_random(void)
+{
+    g_seed = g_seed * 1103515245 + 12345;
+    return (g_seed >> 16) & 0x7FFF;
+}
+
+static void test_generate_path(char* pPath, size_t length)
+{
+    static const char chars[] = "//\\\\..abcdefgh";
+    size_t i;
+
+    for (i = 0; i < length; i += 1) {
+        pPath[i] = chars[test_random() % (sizeof(chars) - 1)];
+    }
+
+    pPath[length] = '\0';
+}
+
+static const char* reference_file_name(const char* path)
+{
+    const char* pFileName = path;
+
+    while (path[0] != '\0') {
+        if (path[0] == '/' || path[0] == '\\') {
+            pFileName = path + 1;
+        }
+
+        path += 1;
+    }
+
+    return pFileName;
+}
+
+static const char* reference_extension(const char* path)
+{
+    const char* pFileName = reference_file_name(path);
+    const char* pLastOccurance = NULL;
+
+    while (*pFileName != '\0') {
+        pFileName += 1;
+        if (pFileName[-1] == '.') {
+            pLastOccurance = pFileName;
+        }
+    }
+
+    return (pLastOccurance != NULL) ? pLastOccurance : pFileName;
+}
+
+static size_t reference_segments(const char* path, mfs_path_segment* pSegments)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+    for (;;) {
+        while (path[i] == '/' || path[i] == '\\') {
+            i += 1;
+        }
+
+        if (path[i] == '\0') {
+            break;
+        }
+
+        pSegments[count].offset = i;
+        while (path[i] != '\0' && path[i] != '/' && path[i] != '\\') {
+            i += 1;
+        }
+        pSegments[count].length = i - pSegments[count].offset;
+
+        count += 1;
+    }
+
+    return count;
+}
+
+static int test_path(const char* path)
+{
+    mfs_path_segment segments[128];
+    size_t segmentCount;
+    size_t iSegment;
+    size_t length;
+    mfs_path_iterator iterator;
+    char normalized[128];
+    size_t i;
+
+    length = strlen(path);
+
+    if (mfs_path_file_name(path) != reference_file_name(path)) {
+        printf("mfs_path_file_name(\"%s\") failed.\n", path);
+        return 1;
+    }
+
+    if (mfs_path_extension(path) != reference_extension(path)) {
+        printf("mfs_path_extension(\"%s\") failed.\n", path);
+        return 1;
+    }
+
+    /* Forward iteration. The first segment is allowed to be empty when the path starts with a separator. */
+    segmentCount = reference_segments(path, segments);
+    iSegment = 0;
+
+    if (length > 0 && mfs_path_first_segment(path, &iterator) == MFS_SUCCESS) {
+        if (iterator.segment.length > 0) {
+            if (segmentCount == 0 || iterator.segment.offset != segments[0].offset || iterator.segment.length != segments[0].length) {
+                printf("mfs_path_first_segment(\"%s\") failed.\n", path);
+                return 1;
+            }
+
+            iSegment = 1;
+        }
+
+        while (mfs_path_next_segment(&iterator) == MFS_SUCCESS) {
+            if (iSegment == segmentCount || iterator.segment.offset != segments[iSegment].offset || iterator.segment.length != segments[iSegment].length) {
+                printf("mfs_path_next_segment(\"%s\") failed.\n", path);
+                return 1;
+            }
+
+            iSegment += 1;
+        }
+
+        if (iSegment != segmentCount) {
+            printf("mfs_path_next_segment(\"%s\") stopped early.\n", path);
+            return 1;
+        }
+    }
+
+    /* Backward iteration. The first segment is left out because mfs_path_prev_segment() skips it when it's a single character. */
+    if (length > 0 && mfs_path_last_segment(path, &iterator) == MFS_SUCCESS && segmentCount > 0) {
+        iSegment = segmentCount;
+
+        do {
+            if (iterator.segment.length == 0 || iSegment == 0) {
+                break;
+            }
+
+            iSegment -= 1;
+            if (iterator.segment.offset != segments[iSegment].offset || iterator.segment.length != segments[iSegment].length) {
+                printf("mfs_path_prev_segment(\"%s\") failed.\n", path);
+                return 1;
+            }
+        } while (iSegment > 1 && mfs_path_prev_segment(&iterator) == MFS_SUCCESS);
+    }
+
+    if (mfs_path_to_forward_slashes(normalized, sizeof(normalized), path, &i) != MFS_SUCCESS || i != length) {
+        printf("mfs_path_to_forward_slashes(\"%s\") failed.\n", path);
+        return 1;
+    }
+
+    for (i = 0; i <= length; i += 1) {
+        if (normalized[i] != ((path[i] == '\\') ? '/' : path[i])) {
+            printf("mfs_path_to_forward_slashes(\"%s\") failed.\n", path);
+            return 1;
+        }
+    }
+
+    if (mfs_path_to_back_slashes(normalized, length, path, NULL) != MFS_OUT_OF_RANGE) {
+        printf("mfs_path_to_back_slashes(\"%s\") should not fit.\n", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int test_path_hash(const char* path1, const char* path2)
+{
+    mfs_uint32 flags;
+    size_t length;
+
+    for (flags = 0; flags < 4; flags += 1) {
+        if (mfs_path_equal_ex(path1, path2, flags) && mfs_path_hash(path1, flags) != mfs_path_hash(path2, flags)) {
+            printf("mfs_path_hash(\"%s\", %u) does not match \"%s\".\n", path1, (unsigned int)flags, path2);
+            return 1;
+        }
+
+        if (mfs_path_hash_and_length(path1, flags, &length) != mfs_path_hash(path1, flags) || length != strlen(path1)) {
+            printf("mfs_path_hash_and_length(\"%s\", %u) failed.\n", path1, (unsigned int)flags);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    char buffer[128];
+    char other[128];
+    size_t offset;
+    size_t length;
+    int iteration;
+    int errorCount = 0;
+
+    (void)argc;
+    (void)argv;
+
+    for (iteration = 0; iteration < 200; iteration += 1) {
+        for (offset = 0; offset < 16; offset += 1) {
+            for (length = 0; length < 64; length += 1) {
+                test_generate_path(buffer + offset, length);
+                errorCount += test_path(buffer + offset);
+
+                test_generate_path(other, test_random() % 16);
+                errorCount += test_path_hash(buffer + offset, other);
+            }
+        }
+    }
+
+    if (errorCount == 0) {
+        printf("All path tests passed.\n");
+    }
+
+    return (errorCount == 0) ? 0 : 1;
+}